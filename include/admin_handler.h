@@ -0,0 +1,35 @@
+#ifndef ADMIN_HANDLER_H
+#define ADMIN_HANDLER_H
+
+#include <microhttpd.h>
+
+#include "vector_database.h"
+#include "sharded_db.h"
+
+/**
+ * @struct AdminHandlerData
+ * @brief Structure to hold data for the admin handler.
+ */
+typedef struct AdminHandlerData {
+    ShardedDatabase* db; /**< Pointer to the vector database */
+} AdminHandlerData;
+
+/**
+ * @brief Handles administrative requests (e.g., training the PQ index).
+ * 
+ * @param cls User-defined data, in this case, the database.
+ * @param connection MHD_Connection object.
+ * @param url URL of the request.
+ * @param method HTTP method (should be "POST").
+ * @param version HTTP version.
+ * @param upload_data Data being uploaded in the request (ignored).
+ * @param upload_data_size Size of the upload data.
+ * @param con_cls Connection-specific data.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+enum MHD_Result admin_handler(void* cls, struct MHD_Connection* connection,
+                              const char* url, const char* method,
+                              const char* version, const char* upload_data,
+                              size_t* upload_data_size, void** con_cls);
+
+#endif // ADMIN_HANDLER_H
@@ -0,0 +1,40 @@
+#ifndef COMPACTOR_H
+#define COMPACTOR_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "vector_database.h"
+
+/**
+ * @struct Compactor
+ * @brief Background thread reclaiming tombstoned slots of a vector database in bounded steps.
+ */
+typedef struct Compactor {
+    VectorDatabase* db;       /**< Database to compact */
+    size_t batch_size;        /**< Maximum number of vectors moved per lock hold */
+    unsigned int interval_ms; /**< Sleep between passes when there is nothing to reclaim */
+    int running;              /**< Cleared to ask the thread to exit */
+    pthread_t thread;         /**< Compactor thread */
+    pthread_mutex_t lock;     /**< Protects running */
+    pthread_cond_t wakeup;    /**< Signalled on shutdown */
+} Compactor;
+
+/**
+ * @brief Start the background compactor.
+ * 
+ * @param db Database to compact.
+ * @param batch_size Maximum number of vectors moved each time the database lock is taken.
+ * @param interval_ms Idle sleep between passes, in milliseconds.
+ * @return Pointer to the running compactor, or NULL on failure.
+ */
+Compactor* compactor_start(VectorDatabase* db, size_t batch_size, unsigned int interval_ms);
+
+/**
+ * @brief Stop the compactor thread and free it.
+ * 
+ * @param compactor Compactor to stop.
+ */
+void compactor_stop(Compactor* compactor);
+
+#endif // COMPACTOR_H
@@ -4,6 +4,7 @@
 #include <microhttpd.h>
 
 #include "vector_database.h"
+#include "sharded_db.h"
 
 /**
  * @brief Handles comparison requests (e.g., cosine similarity, Euclidean distance, dot product).
@@ -24,7 +25,7 @@ enum MHD_Result compare_handler(void* cls, struct MHD_Connection* connection,
                                 size_t* upload_data_size, void** con_cls);
 
 /**
- * @brief Handles nearest neighbor search requests.
+ * @brief Handles nearest neighbor (/nearest) and radius (/range) search requests.
  * 
  * @param cls User-defined data, in this case, the database.
  * @param connection MHD_Connection object.
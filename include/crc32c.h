@@ -0,0 +1,19 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Extend a CRC32C (Castagnoli) checksum with more data.
+ * 
+ * Start with crc = 0; feeding a buffer in several pieces gives the same result as one call.
+ *
+ * @param crc Checksum of the data seen so far.
+ * @param data Data to add.
+ * @param length Number of bytes to add.
+ * @return Updated checksum.
+ */
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t length);
+
+#endif // CRC32C_H
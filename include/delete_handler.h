@@ -4,13 +4,14 @@
 #include <microhttpd.h>
 
 #include "vector_database.h"
+#include "sharded_db.h"
 
 /**
  * @struct DeleteHandlerData
  * @brief Structure to hold data for the DELETE handler.
  */
 typedef struct DeleteHandlerData {
-    VectorDatabase* db; /**< Pointer to the vector database */
+    ShardedDatabase* db; /**< Pointer to the vector database */
 } DeleteHandlerData;
 
 /**
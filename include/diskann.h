@@ -0,0 +1,203 @@
+#ifndef DISKANN_H
+#define DISKANN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pq_index.h"
+#include "vector_element.h"
+
+#define DISKANN_DEFAULT_DEGREE 64       // Neighbors per node when none are requested
+#define DISKANN_DEFAULT_BUILD_LIST 100  // Candidates kept while linking a node when none are requested
+#define DISKANN_DEFAULT_SEARCH_LIST 100 // Candidates kept by a search when none are requested
+#define DISKANN_DEFAULT_BEAM_WIDTH 4    // Nodes read from disk per search round when none are requested
+#define DISKANN_MAX_DEGREE 256          // Largest number of neighbors per node
+#define DISKANN_MAX_BEAM_WIDTH 64       // Largest number of nodes read per search round
+#define DISKANN_ALPHA 1.2               // A candidate is pruned if a kept neighbor is this much nearer to it
+#define DISKANN_SECTOR 4096             // Unit of the graph file layout and of every read
+#define DISKANN_PQ_COMPONENTS 4         // Components per byte of the in-memory routing codes
+#define DISKANN_NONE UINT32_MAX         // No node, no index
+#define DISKANN_FILE_MAGIC "SVDBVMNA"   // Magic of a graph file
+#define DISKANN_MAP_MAGIC "SVDBVMAP"    // Magic of a map file
+#define DISKANN_FILE_VERSION 1          // Layout version of graph and map files
+
+/**
+ * @brief Reads all components of a stored vector as doubles.
+ *
+ * @param context Context pointer given to diskann_build.
+ * @param index Index of the vector in the original dataset.
+ * @param buffer Scratch space of dimension doubles.
+ * @return The components, or NULL if the vector cannot be read.
+ */
+typedef const double* (*DiskANNPointFunc)(void* context, size_t index, double* buffer);
+
+/**
+ * @brief Squared Euclidean distance between a query and a stored vector.
+ *
+ * @param context Context pointer given to diskann_build or diskann_open.
+ * @param index Index of the vector in the original dataset.
+ * @param query Query of dimension components.
+ * @return The squared distance, or INFINITY if the vector cannot be read.
+ */
+typedef double (*DiskANNDistanceFunc)(void* context, size_t index, const double* query);
+
+/**
+ * @struct DiskANN
+ * @brief Vamana graph kept on disk, searched with a few sector reads per query.
+ *
+ * The graph file holds one record per node, the full vector followed by its neighbor list,
+ * packed into DISKANN_SECTOR-byte sectors so that a node costs one aligned read. Only the
+ * product quantization codes of the nodes stay in memory; a search routes on them and ranks
+ * what it reads by exact distance.
+ *
+ * The file is immutable once built. Nodes are numbered by the file, and maps from node to
+ * dataset index and back let compaction move a vector without touching it. A vector deleted or
+ * updated after the build leaves its node in place as a waypoint that is never returned; vectors
+ * inserted or updated since the build are kept in a delta list, searched exhaustively.
+ */
+typedef struct DiskANN {
+    size_t dimension;                /**< Number of components per vector */
+    VectorElementType element_type;  /**< Type of the vectors in the node records */
+    size_t degree;                   /**< Largest number of neighbors per node */
+    size_t build_list;               /**< Candidates kept while linking a node */
+    size_t node_count;               /**< Number of nodes in the file */
+    uint32_t entry;                  /**< Node nearest to the mean, where searches start */
+    uint64_t id;                     /**< Random identifier of the file, repeated in its map files */
+    int fd;                          /**< Graph file, read with pread */
+    size_t record_bytes;             /**< Bytes of one node record */
+    size_t block_nodes;              /**< Node records per block */
+    size_t block_bytes;              /**< Bytes per block: one sector, or the sectors of one record */
+    PQIndex* pq;                     /**< Codebooks of the routing codes */
+    uint8_t* codes;                  /**< pq->subspaces bytes per node */
+    uint32_t* index_of;              /**< Dataset index of every node, DISKANN_NONE once deleted or updated */
+    uint32_t* node_of;               /**< Node of every dataset index, DISKANN_NONE if absent */
+    uint32_t* delta_of;              /**< Position in delta of every dataset index, DISKANN_NONE if absent */
+    size_t index_capacity;           /**< Entries available in node_of and delta_of */
+    size_t* delta;                   /**< Dataset indices written since the build */
+    size_t delta_count;              /**< Number of entries in delta */
+    size_t delta_capacity;           /**< Entries available in delta */
+    size_t count;                    /**< Number of nodes with a dataset index */
+    DiskANNDistanceFunc distance_func; /**< Compares a query with a vector of the delta list */
+    void* context;                   /**< Context passed to the callbacks */
+} DiskANN;
+
+/**
+ * @brief Build a graph over a set of vectors, write it to a file and open it.
+ *
+ * The graph is linked in memory by a pool of threads, then written to "<filename>.tmp" and
+ * renamed over filename. The routing codes are trained on the samples.
+ *
+ * @param filename Graph file to write.
+ * @param dimension Number of components per vector.
+ * @param element_type Type the vectors are stored with in the node records.
+ * @param degree Largest number of neighbors per node, from 2 to DISKANN_MAX_DEGREE.
+ * @param build_list Candidates kept while linking a node, at least degree.
+ * @param indices Indices of the vectors in the original dataset, below DISKANN_NONE.
+ * @param count Number of vectors, at least 1.
+ * @param samples `sample_count` training vectors of `dimension` floats each.
+ * @param sample_count Number of training vectors, at least 1.
+ * @param thread_count Number of threads, at least 1.
+ * @param point_func Reads a vector.
+ * @param distance_func Compares a query with a vector.
+ * @param context Context passed to the callbacks.
+ * @return Pointer to the graph, or NULL on failure.
+ */
+DiskANN* diskann_build(const char* filename, size_t dimension, VectorElementType element_type, size_t degree,
+                       size_t build_list, const size_t* indices, size_t count, const float* samples,
+                       size_t sample_count, size_t thread_count, DiskANNPointFunc point_func,
+                       DiskANNDistanceFunc distance_func, void* context);
+
+/**
+ * @brief Open a graph file written by diskann_build.
+ *
+ * No node has a dataset index until a map is read with diskann_read_map.
+ *
+ * @param filename Graph file to open.
+ * @param dimension Number of components per vector.
+ * @param distance_func Compares a query with a vector.
+ * @param context Context passed to the callbacks.
+ * @return Pointer to the graph, or NULL if the file is missing, invalid or on failure.
+ */
+DiskANN* diskann_open(const char* filename, size_t dimension, DiskANNDistanceFunc distance_func, void* context);
+
+/**
+ * @brief Close the graph file and free a graph.
+ *
+ * @param ann Graph to free, may be NULL.
+ */
+void diskann_free(DiskANN* ann);
+
+/**
+ * @brief Add a vector to the delta list.
+ *
+ * @param ann Graph to update.
+ * @param index Index of the vector, not in the graph.
+ * @return 0 on success, -1 on failure.
+ */
+int diskann_insert(DiskANN* ann, size_t index);
+
+/**
+ * @brief Remove a vector, from its node or from the delta list.
+ *
+ * @param ann Graph to update.
+ * @param index Index of the vector.
+ */
+void diskann_remove(DiskANN* ann, size_t index);
+
+/**
+ * @brief Change the index stored for a vector after it was moved.
+ *
+ * @param ann Graph to update.
+ * @param old_index Index the vector was inserted with.
+ * @param new_index New index of the vector, below old_index.
+ */
+void diskann_remap(DiskANN* ann, size_t old_index, size_t new_index);
+
+/**
+ * @brief Find approximate nearest neighbors.
+ *
+ * A beam search routes on the routing codes from the entry node: every round reads the
+ * beam_width nearest unexpanded candidates from disk together, adds their neighbors to a list
+ * of search_list candidates and ranks the read vectors by exact distance. The delta list is
+ * then scanned and merged.
+ *
+ * @param ann Graph to search.
+ * @param query Query of dimension components.
+ * @param k Maximum number of neighbors.
+ * @param search_list Candidates kept by the beam search.
+ * @param beam_width Nodes read per round, from 1 to DISKANN_MAX_BEAM_WIDTH.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the squared distances of the neighbors (k entries).
+ * @return Number of neighbors found, or (size_t)-1 on failure.
+ */
+size_t diskann_search(const DiskANN* ann, const double* query, size_t k, size_t search_list, size_t beam_width,
+                      size_t* indices, double* distances);
+
+/**
+ * @brief Write the dataset index of every node to a map file.
+ *
+ * Indices are written through a map, so a graph over a dataset with holes can be saved next to
+ * the compacted dataset. Makes no allocation, so it can run in a forked snapshot child; writes
+ * through a static buffer, so calls must not run concurrently within a process.
+ *
+ * @param ann Graph to write the map of.
+ * @param fd File to write to, positioned at offset 0.
+ * @param index_map New index of every dataset index below index_bound, SIZE_MAX for vectors left out.
+ * @param index_bound Number of entries of index_map.
+ * @param tag Identifier of the dataset the map belongs to.
+ * @return 0 on success, -1 on failure.
+ */
+int diskann_write_map(const DiskANN* ann, int fd, const size_t* index_map, size_t index_bound, uint64_t tag);
+
+/**
+ * @brief Give the nodes of a freshly opened graph the dataset indices of a map file.
+ *
+ * @param ann Graph opened by diskann_open.
+ * @param file Map file written by diskann_write_map.
+ * @param tag Identifier the map must carry.
+ * @return 0 on success, -1 if the map is invalid, belongs to another file or dataset, or on failure.
+ */
+int diskann_read_map(DiskANN* ann, FILE* file, uint64_t tag);
+
+#endif // DISKANN_H
@@ -0,0 +1,95 @@
+#ifndef FLAT_SCAN_H
+#define FLAT_SCAN_H
+
+#include <stddef.h>
+
+#include "vector_element.h"
+
+#define FLAT_SCAN_BATCH 1024             // Slots taken at a time by a scan thread
+#define FLAT_SCAN_SLOTS_PER_THREAD 32768 // A scan takes one thread per this many slots, up to its thread count
+
+/**
+ * @enum FlatScanISA
+ * @brief Instruction set of the distance kernels, chosen once from the running CPU.
+ */
+typedef enum FlatScanISA {
+    FLAT_SCAN_ISA_SCALAR, /**< Portable C, vectorized by the compiler for the baseline target */
+    FLAT_SCAN_ISA_NEON,   /**< AArch64 Advanced SIMD, two doubles per lane */
+    FLAT_SCAN_ISA_AVX2,   /**< AVX2 with FMA and F16C, four doubles per lane */
+    FLAT_SCAN_ISA_AVX512  /**< AVX-512F with F16C, eight doubles per lane */
+} FlatScanISA;
+
+/**
+ * @brief Squared Euclidean distance between a query and stored components.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored components, of the element type the kernel was chosen for.
+ * @param n Number of components.
+ * @return The squared distance, accumulated in double precision.
+ */
+typedef double (*FlatScanKernel)(const double* query, const void* data, size_t n);
+
+/**
+ * @brief Reads the components of a stored vector.
+ *
+ * Called from several threads at once.
+ *
+ * @param context Context pointer given to flat_scan_search.
+ * @param index Index of the vector.
+ * @param buffer Scratch space of one vector (dimension components of the element type), owned
+ *               by the calling thread, for vectors that are not kept in memory.
+ * @return The components, or NULL to skip the index (deleted or unreadable).
+ */
+typedef const void* (*FlatScanDataFunc)(void* context, size_t index, void* buffer);
+
+/**
+ * @brief Instruction set the kernels use on this CPU.
+ *
+ * AVX-512 and AVX2 are detected at runtime, so one binary uses the widest lanes available;
+ * NEON is part of every AArch64 CPU.
+ *
+ * @return The instruction set.
+ */
+FlatScanISA flat_scan_isa(void);
+
+/**
+ * @brief Name of an instruction set as reported by the server.
+ *
+ * @param isa Instruction set.
+ * @return "scalar", "neon", "avx2" or "avx512".
+ */
+const char* flat_scan_isa_name(FlatScanISA isa);
+
+/**
+ * @brief Distance kernel for an element type on this CPU.
+ *
+ * @param type Element type of the stored components.
+ * @return The kernel.
+ */
+FlatScanKernel flat_scan_kernel(VectorElementType type);
+
+/**
+ * @brief Find the exact k nearest vectors by comparing the query with every index.
+ *
+ * Indices are split in batches of FLAT_SCAN_BATCH among the threads, each keeping its own
+ * top-k heap; the heaps are merged at the end. Ties are broken by index, so the results do not
+ * depend on the number of threads. The calling thread scans too, helped by the workers of a pool
+ * shared by every scan, which is started on first use rather than on every query.
+ *
+ * @param query Query of dimension components.
+ * @param dimension Number of components per vector.
+ * @param type Element type of the stored components.
+ * @param count Number of indices, from 0 to count - 1.
+ * @param k Maximum number of neighbors.
+ * @param thread_count Largest number of threads, the caller's included, at least 1; lowered for small counts.
+ * @param data_func Reads a vector.
+ * @param context Context passed to data_func.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the squared distances of the neighbors (k entries).
+ * @return Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t flat_scan_search(const double* query, size_t dimension, VectorElementType type, size_t count, size_t k,
+                        size_t thread_count, FlatScanDataFunc data_func, void* context,
+                        size_t* indices, double* distances);
+
+#endif // FLAT_SCAN_H
@@ -4,13 +4,14 @@
 #include <microhttpd.h>
 
 #include "vector_database.h"
+#include "sharded_db.h"
 
 /**
  * @struct GetHandlerData
  * @brief Structure to hold data for the GET handler.
  */
 typedef struct GetHandlerData {
-    VectorDatabase* db; /**< Pointer to the vector database */
+    ShardedDatabase* db; /**< Pointer to the vector database */
 } GetHandlerData;
 
 /**
@@ -0,0 +1,225 @@
+#ifndef HNSW_H
+#define HNSW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define HNSW_DEFAULT_M 16                 // Links per node and layer when none are requested
+#define HNSW_DEFAULT_EF_CONSTRUCTION 200  // Candidates kept while linking an insert when none are requested
+#define HNSW_DEFAULT_EF_SEARCH 64         // Candidates kept by a search when none are requested
+#define HNSW_MAX_M 128                    // Largest number of links per node and layer
+#define HNSW_MAX_LEVEL 31                 // Highest layer a node may be drawn on
+#define HNSW_LOCK_STRIPES 4096            // Mutexes guarding the link lists, shared by node number
+#define HNSW_NONE UINT32_MAX              // No node
+#define HNSW_FILE_MAGIC "SVDBHNSW"        // Magic of a graph file
+#define HNSW_FILE_VERSION 1               // Layout version of a graph file
+
+/**
+ * @enum HNSWMetric
+ * @brief How the distance function of a graph compares vectors. Smaller distances are nearer.
+ */
+typedef enum HNSWMetric {
+    HNSW_METRIC_L2 = 0,  /**< Squared Euclidean distance */
+    HNSW_METRIC_COSINE,  /**< 1 - cosine similarity */
+    HNSW_METRIC_IP       /**< Negated inner product */
+} HNSWMetric;
+
+/**
+ * @brief Reads all components of a stored point as doubles, in the form the distance function expects as query.
+ *
+ * @param context Context pointer given to hnsw_create.
+ * @param index Index of the point in the original dataset.
+ * @param buffer Scratch space of dimension doubles.
+ * @return The components, or NULL if the point cannot be read.
+ */
+typedef const double* (*HNSWPointFunc)(void* context, size_t index, double* buffer);
+
+/**
+ * @brief Distance between a query and a stored point under the metric of the graph.
+ *
+ * @param context Context pointer given to hnsw_create.
+ * @param index Index of the point in the original dataset.
+ * @param query Query of dimension components, as returned by the point function.
+ * @return The distance, or INFINITY if the point cannot be read.
+ */
+typedef double (*HNSWDistanceFunc)(void* context, size_t index, const double* query);
+
+/**
+ * @struct HNSWNode
+ * @brief One node of the graph.
+ *
+ * The links of all layers are one allocation: layer 0 holds a count and 2 * m node numbers,
+ * every higher layer a count and m node numbers.
+ */
+typedef struct HNSWNode {
+    size_t index;     /**< Index of the point in the original dataset */
+    uint32_t* links;  /**< Link lists of layers 0 to level, or NULL for a removed node */
+    uint8_t level;    /**< Highest layer of the node */
+    uint8_t removed;  /**< Set once the node is removed; its number waits on the free list */
+} HNSWNode;
+
+/**
+ * @struct HNSW
+ * @brief Hierarchical Navigable Small World graph for approximate nearest neighbor search.
+ *
+ * Like the KD-tree, the graph keeps no copy of the points and reads them back through its
+ * callbacks. Nodes are numbered by the graph; a map from dataset index to node number lets
+ * compaction move a point without touching the links that reach it. Inserts may run
+ * concurrently once room was reserved: every link list is read and written under its stripe
+ * lock, and the entry point under entry_lock.
+ */
+typedef struct HNSW {
+    size_t dimension;            /**< Number of components per point */
+    size_t m;                    /**< Links per node on layers above 0 (2 * m on layer 0) */
+    size_t ef_construction;      /**< Candidates kept while linking an insert */
+    HNSWMetric metric;           /**< Metric implemented by distance_func */
+    double level_factor;         /**< 1 / ln(m), scale of the random layer draw */
+    HNSWNode* nodes;             /**< Nodes by number */
+    size_t node_count;           /**< Node numbers handed out */
+    size_t node_capacity;        /**< Entries available in nodes */
+    uint32_t* free_nodes;        /**< Numbers of removed nodes, reused by inserts */
+    size_t free_count;           /**< Number of entries in free_nodes */
+    size_t free_capacity;        /**< Entries available in free_nodes */
+    uint32_t* node_of;           /**< Node number of every dataset index, HNSW_NONE if absent */
+    size_t index_capacity;       /**< Entries available in node_of */
+    size_t count;                /**< Number of points in the graph */
+    uint32_t entry;              /**< Node on the highest layer where searches start, or HNSW_NONE */
+    size_t max_level;            /**< Level of the entry node */
+    uint64_t seed;               /**< Seed of the layer draw */
+    HNSWPointFunc point_func;    /**< Reads a point */
+    HNSWDistanceFunc distance_func; /**< Compares a query with a point */
+    void* context;               /**< Context passed to the callbacks */
+    double* scratch;             /**< 3 * dimension doubles used by single-threaded inserts and removals */
+    pthread_mutex_t entry_lock;  /**< Guards node numbering, entry and max_level */
+    pthread_mutex_t* locks;      /**< HNSW_LOCK_STRIPES locks; node n's links are guarded by locks[n % HNSW_LOCK_STRIPES] */
+} HNSW;
+
+/**
+ * @brief Parses the name of a metric ("l2", "cosine" or "ip").
+ *
+ * @param name Name to parse.
+ * @param metric Set to the parsed metric on success.
+ * @return 0 on success, -1 if the name is unknown.
+ */
+int hnsw_metric_parse(const char* name, HNSWMetric* metric);
+
+/**
+ * @brief Returns the name of a metric.
+ *
+ * @param metric Metric.
+ * @return "l2", "cosine" or "ip".
+ */
+const char* hnsw_metric_name(HNSWMetric metric);
+
+/**
+ * @brief Create an empty graph.
+ *
+ * @param dimension Number of components per point.
+ * @param m Links per node and layer, from 2 to HNSW_MAX_M.
+ * @param ef_construction Candidates kept while linking an insert, at least m.
+ * @param metric Metric implemented by distance_func.
+ * @param point_func Reads a point.
+ * @param distance_func Compares a query with a point.
+ * @param context Context passed to the callbacks.
+ * @return Pointer to the graph, or NULL on failure.
+ */
+HNSW* hnsw_create(size_t dimension, size_t m, size_t ef_construction, HNSWMetric metric,
+                  HNSWPointFunc point_func, HNSWDistanceFunc distance_func, void* context);
+
+/**
+ * @brief Free a graph.
+ *
+ * @param graph Graph to free, may be NULL.
+ */
+void hnsw_free(HNSW* graph);
+
+/**
+ * @brief Insert a set of points with a pool of threads inserting concurrently.
+ *
+ * @param graph Graph to fill, not used by anyone else meanwhile.
+ * @param indices Indices of the points in the original dataset.
+ * @param count Number of points.
+ * @param thread_count Number of threads, at least 1.
+ * @return 0 on success, -1 on failure.
+ */
+int hnsw_build(HNSW* graph, const size_t* indices, size_t count, size_t thread_count);
+
+/**
+ * @brief Insert a point.
+ *
+ * @param graph Graph to update.
+ * @param index Index of the point, whose components must be readable.
+ * @return 0 on success, -1 on failure.
+ */
+int hnsw_insert(HNSW* graph, size_t index);
+
+/**
+ * @brief Remove a point, relinking its neighbors to each other.
+ *
+ * Links from other nodes to the removed node are dropped lazily: searches skip removed nodes
+ * and the next pruning of a list leaves them out.
+ *
+ * @param graph Graph to update.
+ * @param index Index of the point.
+ */
+void hnsw_remove(HNSW* graph, size_t index);
+
+/**
+ * @brief Change the index stored for a point after it was moved.
+ *
+ * @param graph Graph to update.
+ * @param old_index Index the point was inserted with.
+ * @param new_index New index of the point.
+ */
+void hnsw_remap(HNSW* graph, size_t old_index, size_t new_index);
+
+/**
+ * @brief Find approximate nearest neighbors.
+ *
+ * A greedy descent through the upper layers finds the start of a beam search of width
+ * max(ef_search, k) on layer 0.
+ *
+ * @param graph Graph to search.
+ * @param query Query of dimension components, in the form the distance function expects.
+ * @param k Maximum number of neighbors.
+ * @param ef_search Candidates kept by the beam search.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the metric distances of the neighbors (k entries).
+ * @return Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t hnsw_search(HNSW* graph, const double* query, size_t k, size_t ef_search, size_t* indices, double* distances);
+
+/**
+ * @brief Write a graph to a file.
+ *
+ * Indices are written through a map, so a graph over a dataset with holes can be saved next to
+ * the compacted dataset. The tag is stored in the header, to be checked by hnsw_read. Makes no
+ * allocation, so it can run in a forked snapshot child; writes through a static buffer, so calls
+ * must not run concurrently within a process.
+ *
+ * @param graph Graph to write.
+ * @param fd File to write to, positioned at offset 0.
+ * @param index_map New index of every dataset index below index_bound, SIZE_MAX for points left out.
+ * @param index_bound Number of entries of index_map.
+ * @param tag Identifier of the dataset the graph belongs to.
+ * @return 0 on success, -1 on failure.
+ */
+int hnsw_write(const HNSW* graph, int fd, const size_t* index_map, size_t index_bound, uint64_t tag);
+
+/**
+ * @brief Read a graph written by hnsw_write.
+ *
+ * @param file File to read from.
+ * @param dimension Number of components per point.
+ * @param tag Identifier the file must carry.
+ * @param point_func Reads a point.
+ * @param distance_func Compares a query with a point.
+ * @param context Context passed to the callbacks.
+ * @return Pointer to the graph, or NULL if the file is invalid, belongs to another dataset or on failure.
+ */
+HNSW* hnsw_read(FILE* file, size_t dimension, uint64_t tag, HNSWPointFunc point_func,
+                HNSWDistanceFunc distance_func, void* context);
+
+#endif // HNSW_H
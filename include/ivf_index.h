@@ -0,0 +1,175 @@
+#ifndef IVF_INDEX_H
+#define IVF_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IVF_DEFAULT_NPROBE 8  // Lists scanned by a search when none is requested
+#define IVF_MAX_LISTS 65536   // Largest number of lists, including those added by splits
+#define IVF_SPLIT_FACTOR 4    // A list longer than this many times the mean list length is split
+#define IVF_MIN_SPLIT 256     // Lists shorter than this are never split
+#define IVF_NONE UINT32_MAX   // No list
+
+/**
+ * @brief Reads all components of a stored vector as doubles.
+ *
+ * @param context Context pointer given to ivf_index_create.
+ * @param index Index of the vector in the original dataset.
+ * @param buffer Scratch space of dimension doubles.
+ * @return The components, or NULL if the vector cannot be read.
+ */
+typedef const double* (*IVFPointFunc)(void* context, size_t index, double* buffer);
+
+/**
+ * @brief Squared Euclidean distance between a query and a stored vector.
+ *
+ * @param context Context pointer given to ivf_index_create.
+ * @param index Index of the vector in the original dataset.
+ * @param query Query of dimension components.
+ * @return The squared distance, or INFINITY if the vector cannot be read.
+ */
+typedef double (*IVFDistanceFunc)(void* context, size_t index, const double* query);
+
+/**
+ * @brief Hints that a stored vector is about to be compared.
+ *
+ * @param context Context pointer given to ivf_index_create.
+ * @param index Index of the vector in the original dataset.
+ */
+typedef void (*IVFPrefetchFunc)(void* context, size_t index);
+
+/**
+ * @struct IVFList
+ * @brief Posting list of one centroid: the indices of the vectors nearest to it, in one array.
+ */
+typedef struct IVFList {
+    size_t* indices;  /**< Indices of the vectors of the list */
+    size_t count;     /**< Number of entries in indices */
+    size_t capacity;  /**< Entries available in indices */
+} IVFList;
+
+/**
+ * @struct IVFIndex
+ * @brief Inverted file index: vectors are grouped by their nearest k-means centroid.
+ *
+ * Like the KD-forest, the index keeps no copy of the vectors and reads them back through its
+ * callbacks. A search compares the query with every centroid and scans the lists of the nprobe
+ * nearest ones. Every vector remembers its list and position, so removing or moving one is
+ * constant time.
+ */
+typedef struct IVFIndex {
+    size_t dimension;               /**< Number of components per vector */
+    float* centroids;               /**< list_capacity * dimension floats, one centroid per list */
+    IVFList* lists;                 /**< Posting lists by number */
+    size_t list_count;              /**< Number of lists */
+    size_t list_capacity;           /**< Entries available in lists and centroids */
+    uint32_t* list_of;              /**< List of every dataset index, IVF_NONE if absent */
+    size_t* position_of;            /**< Position of every dataset index within its list */
+    size_t index_capacity;          /**< Entries available in list_of and position_of */
+    size_t count;                   /**< Number of vectors in the lists */
+    IVFPointFunc point_func;        /**< Reads a vector */
+    IVFDistanceFunc distance_func;  /**< Compares a query with a vector */
+    IVFPrefetchFunc prefetch_func;  /**< Prefetches a vector, or NULL */
+    void* context;                  /**< Context passed to the callbacks */
+    double* scratch;                /**< 3 * dimension doubles used by inserts and splits */
+} IVFIndex;
+
+/**
+ * @brief Create an index without lists.
+ *
+ * @param dimension Number of components per vector.
+ * @param point_func Reads a vector.
+ * @param distance_func Compares a query with a vector.
+ * @param prefetch_func Prefetches a vector, or NULL.
+ * @param context Context passed to the callbacks.
+ * @return Pointer to the index, or NULL on failure.
+ */
+IVFIndex* ivf_index_create(size_t dimension, IVFPointFunc point_func, IVFDistanceFunc distance_func,
+                           IVFPrefetchFunc prefetch_func, void* context);
+
+/**
+ * @brief Free an index and its lists.
+ *
+ * @param ivf Index to free, may be NULL.
+ */
+void ivf_index_free(IVFIndex* ivf);
+
+/**
+ * @brief Train the centroids with k-means, leaving every list empty.
+ *
+ * Each round assigns the samples to their nearest centroid with a pool of threads.
+ *
+ * @param ivf Index to train, without vectors.
+ * @param samples `count` training vectors of `dimension` floats each.
+ * @param count Number of training vectors.
+ * @param list_count Number of centroids, from 1 to IVF_MAX_LISTS; lowered to count if larger.
+ * @param thread_count Number of threads, at least 1.
+ * @return 0 on success, -1 on failure.
+ */
+int ivf_index_train(IVFIndex* ivf, const float* samples, size_t count, size_t list_count, size_t thread_count);
+
+/**
+ * @brief Assign a set of vectors to their lists with a pool of threads.
+ *
+ * @param ivf Trained index, not used by anyone else meanwhile.
+ * @param indices Indices of the vectors in the original dataset.
+ * @param count Number of vectors.
+ * @param thread_count Number of threads, at least 1.
+ * @return 0 on success, -1 on failure.
+ */
+int ivf_index_build(IVFIndex* ivf, const size_t* indices, size_t count, size_t thread_count);
+
+/**
+ * @brief Append a vector to the list of its nearest centroid.
+ *
+ * @param ivf Trained index.
+ * @param index Index of the vector, whose components must be readable.
+ * @return 0 on success, -1 on failure.
+ */
+int ivf_index_insert(IVFIndex* ivf, size_t index);
+
+/**
+ * @brief Remove a vector from its list.
+ *
+ * @param ivf Index to update.
+ * @param index Index of the vector.
+ */
+void ivf_index_remove(IVFIndex* ivf, size_t index);
+
+/**
+ * @brief Change the index stored for a vector after it was moved.
+ *
+ * @param ivf Index to update.
+ * @param old_index Index the vector was inserted with.
+ * @param new_index New index of the vector.
+ */
+void ivf_index_remap(IVFIndex* ivf, size_t old_index, size_t new_index);
+
+/**
+ * @brief Split the longest lists that outgrew the others.
+ *
+ * A list is split in two by 2-means over its vectors once it holds more than IVF_MIN_SPLIT
+ * vectors and IVF_SPLIT_FACTOR times the mean list length. One half keeps the list, the
+ * other gets a new list and centroid.
+ *
+ * @param ivf Index to update.
+ * @param max_splits Maximum number of lists split.
+ * @return Number of lists split, or (size_t)-1 on failure.
+ */
+size_t ivf_index_rebalance(IVFIndex* ivf, size_t max_splits);
+
+/**
+ * @brief Find approximate nearest neighbors by scanning the lists nearest to the query.
+ *
+ * @param ivf Index to search.
+ * @param query Query of dimension components.
+ * @param k Maximum number of neighbors.
+ * @param nprobe Number of lists scanned.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the squared distances of the neighbors (k entries).
+ * @return Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t ivf_index_search(const IVFIndex* ivf, const double* query, size_t k, size_t nprobe,
+                        size_t* indices, double* distances);
+
+#endif // IVF_INDEX_H
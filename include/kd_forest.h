@@ -0,0 +1,178 @@
+#ifndef KD_FOREST_H
+#define KD_FOREST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KD_FOREST_DEFAULT_TREES 4        // Trees built when none are requested
+#define KD_FOREST_DEFAULT_CHECKS 256     // Vectors compared by a search when no budget is given
+#define KD_FOREST_LEAF_SIZE 8            // Largest leaf left by a build; inserts split leaves past twice this
+#define KD_FOREST_TOP_AXES 5             // Highest-variance components a split picks from at random
+#define KD_FOREST_VARIANCE_SAMPLES 100   // Points sampled to estimate the variance of a range
+#define KD_FOREST_LEAF UINT32_MAX        // Axis of a leaf node
+
+/**
+ * @brief Reads one component of a stored point.
+ *
+ * @param context Context pointer given to kd_forest_create.
+ * @param index Index of the point in the original dataset.
+ * @param axis Component to read.
+ * @return The component, or 0.0 if the point cannot be read.
+ */
+typedef double (*KDForestComponentFunc)(void* context, size_t index, size_t axis);
+
+/**
+ * @brief Squared distance between a query and a stored point over all components.
+ *
+ * @param context Context pointer given to kd_forest_create.
+ * @param index Index of the point in the original dataset.
+ * @param query Query of dimension components.
+ * @return The squared distance, or INFINITY if the point cannot be read.
+ */
+typedef double (*KDForestDistanceFunc)(void* context, size_t index, const double* query);
+
+/**
+ * @brief Starts loading a stored point into the cache without waiting for it.
+ *
+ * @param context Context pointer given to kd_forest_create.
+ * @param index Index of the point in the original dataset.
+ */
+typedef void (*KDForestPrefetchFunc)(void* context, size_t index);
+
+/**
+ * @struct KDForestNode
+ * @brief Node of a randomized KD-tree.
+ *
+ * The two children of an inner node are stored next to each other, so one number locates both.
+ */
+typedef struct KDForestNode {
+    double split;    /**< Points below this value on axis go left, the others right */
+    uint32_t axis;   /**< Component compared, or KD_FOREST_LEAF */
+    uint32_t child;  /**< Left child (the right one follows it) of an inner node, leaf number of a leaf */
+} KDForestNode;
+
+/**
+ * @struct KDForestLeaf
+ * @brief Points held by a leaf.
+ */
+typedef struct KDForestLeaf {
+    size_t* indices;   /**< Indices of the points in the original dataset */
+    uint32_t count;    /**< Number of points */
+    uint32_t capacity; /**< Entries available in indices */
+} KDForestLeaf;
+
+/**
+ * @struct KDForestTree
+ * @brief One randomized KD-tree, node 0 being its root.
+ */
+typedef struct KDForestTree {
+    KDForestNode* nodes;    /**< Nodes, children after their parent */
+    size_t node_count;      /**< Number of nodes */
+    size_t node_capacity;   /**< Entries available in nodes */
+    KDForestLeaf* leaves;   /**< Leaves, referenced by number from the nodes */
+    size_t leaf_count;      /**< Number of leaves */
+    size_t leaf_capacity;   /**< Entries available in leaves */
+    unsigned int seed;      /**< State of the random choices of split axes */
+} KDForestTree;
+
+/**
+ * @struct KDForest
+ * @brief Randomized KD-forest for approximate nearest neighbor search over all components.
+ *
+ * Every tree splits on a component drawn at random among the KD_FOREST_TOP_AXES of highest
+ * variance, at the mean, so the trees partition the space differently and a query missed by one
+ * tree is likely caught by another. Like the KD-tree, the forest keeps no copy of the points and
+ * reads them back through its callbacks.
+ */
+typedef struct KDForest {
+    size_t dimension;                  /**< Number of components per point */
+    KDForestTree* trees;               /**< tree_count trees */
+    size_t tree_count;                 /**< Number of trees */
+    KDForestComponentFunc component_func; /**< Reads a component of a point */
+    KDForestDistanceFunc distance_func;   /**< Compares a query with a point */
+    KDForestPrefetchFunc prefetch_func;   /**< Prefetches a point, or NULL */
+    void* context;                     /**< Context passed to the callbacks */
+    double* scratch;                   /**< 2 * dimension doubles used by inserts to split leaves */
+} KDForest;
+
+/**
+ * @brief Create an empty forest.
+ *
+ * @param dimension Number of components per point.
+ * @param tree_count Number of trees, at least 1.
+ * @param component_func Reads a component of a point.
+ * @param distance_func Compares a query with a point.
+ * @param prefetch_func Prefetches a point, or NULL.
+ * @param context Context passed to the callbacks.
+ * @return Pointer to the forest, or NULL on failure.
+ */
+KDForest* kd_forest_create(size_t dimension, size_t tree_count, KDForestComponentFunc component_func,
+                           KDForestDistanceFunc distance_func, KDForestPrefetchFunc prefetch_func, void* context);
+
+/**
+ * @brief Free a forest.
+ *
+ * @param forest Forest to free, may be NULL.
+ */
+void kd_forest_free(KDForest* forest);
+
+/**
+ * @brief Replace the content of every tree with a tree built over a set of points.
+ *
+ * The trees are independent and are built by a pool of threads.
+ *
+ * @param forest Forest to build.
+ * @param indices Indices of the points in the original dataset.
+ * @param count Number of points.
+ * @return 0 on success, -1 on allocation failure, in which case the forest is empty.
+ */
+int kd_forest_build(KDForest* forest, const size_t* indices, size_t count);
+
+/**
+ * @brief Add a point to every tree.
+ *
+ * A leaf that fills up is split on one of its high-variance components.
+ *
+ * @param forest Forest to update.
+ * @param index Index of the point, whose components must be readable.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int kd_forest_insert(KDForest* forest, size_t index);
+
+/**
+ * @brief Remove a point from every tree.
+ *
+ * @param forest Forest to update.
+ * @param index Index of the point, whose components must still be readable.
+ */
+void kd_forest_remove(KDForest* forest, size_t index);
+
+/**
+ * @brief Change the index stored for a point after it was moved.
+ *
+ * @param forest Forest to update.
+ * @param old_index Index the point was inserted with.
+ * @param new_index New index of the point, whose components must be readable.
+ */
+void kd_forest_remap(KDForest* forest, size_t old_index, size_t new_index);
+
+/**
+ * @brief Find approximate nearest neighbors with a best-bin-first search over every tree.
+ *
+ * Every tree is descended to the leaf of the query, and the branches left on the way go into one
+ * priority queue shared by all trees, ordered by their distance to the query. Branches are then
+ * explored nearest first until max_checks points were compared or no branch can hold a nearer
+ * point. A point held by several trees is compared once.
+ *
+ * @param forest Forest to search.
+ * @param query Query of dimension components.
+ * @param k Maximum number of neighbors.
+ * @param max_checks Number of points compared before the search stops, at least 1.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the neighbors (k entries).
+ * @return Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t kd_forest_search(const KDForest* forest, const double* query, size_t k, size_t max_checks,
+                        size_t* indices, double* distances);
+
+#endif // KD_FOREST_H
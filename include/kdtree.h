@@ -3,13 +3,51 @@
 
 #include <stddef.h>
 
+#define KDTREE_ARENA_BLOCK_NODES 4096 // Nodes allocated at once by the arena
+#define KDTREE_BALANCE_ALPHA 0.7       // Largest share of a subtree's nodes one child may hold
+
+/**
+ * @brief Reads the coordinates of a stored point.
+ *
+ * @param context Context pointer given to kdtree_create.
+ * @param index Index of the point in the original dataset.
+ * @param buffer Scratch space of dimension doubles the coordinates may be decoded into.
+ * @return Pointer to the dimension coordinates of the point, valid until the dataset changes, or
+ *         NULL if the point cannot be read, in which case searches skip it.
+ */
+typedef const double* (*KDTreePointFunc)(void* context, size_t index, double* buffer);
+
+/**
+ * @brief Starts loading the coordinates of a stored point into the cache without waiting for them.
+ *
+ * @param context Context pointer given to kdtree_create.
+ * @param index Index of the point in the original dataset.
+ */
+typedef void (*KDTreePrefetchFunc)(void* context, size_t index);
+
+/**
+ * @brief Receives a point found by a range search.
+ *
+ * @param context Context pointer given to kdtree_range.
+ * @param index Index of the point in the original dataset.
+ * @param distance Euclidean distance to the query over the tree's dimension.
+ * @return 0 to continue the search, non-zero to stop it.
+ */
+typedef int (*KDTreeRangeFunc)(void* context, size_t index, double distance);
+
 /**
  * @struct KDTreeNode
  * @brief Structure representing a KD-tree node.
+ *
+ * Nodes do not copy their point: the coordinates are read back from the dataset through the
+ * tree's point function. Only the coordinate on the node's split axis is kept, so that searches
+ * are routed without reading points. Every node holds a live point; removed points take their
+ * node out of the tree.
  */
 typedef struct KDTreeNode {
-    double *point; /**< Point in the k-dimensional space */
+    double split; /**< Coordinate of the point on the axis split by this node */
     size_t index; /**< Index of the point in the original dataset */
+    size_t size; /**< Number of nodes in the subtree rooted here, used to keep it balanced */
     struct KDTreeNode *left; /**< Left child node */
     struct KDTreeNode *right; /**< Right child node */
 } KDTreeNode;
@@ -17,29 +55,100 @@ typedef struct KDTreeNode {
 /**
  * @struct KDTree
  * @brief Structure representing a KD-tree.
+ *
+ * Nodes are bump-allocated from blocks of KDTREE_ARENA_BLOCK_NODES that never move and are only
+ * released all at once. Removed nodes are chained on a free list and reused by later inserts.
  */
 typedef struct KDTree {
     KDTreeNode *root; /**< Root node of the KD-tree */
     size_t dimension; /**< Dimensionality of the points */
+    KDTreePointFunc point_func; /**< Reads the coordinates of a point */
+    KDTreePrefetchFunc prefetch_func; /**< Prefetches the coordinates of a point, or NULL */
+    void *point_context; /**< Context passed to point_func */
+    KDTreeNode **blocks; /**< Node blocks of the arena */
+    size_t block_count; /**< Number of allocated blocks */
+    size_t block_capacity; /**< Number of entries available in the block directory */
+    size_t block_used; /**< Nodes handed out from the last block */
+    KDTreeNode *free_nodes; /**< Removed nodes awaiting reuse, chained through their left child */
 } KDTree;
 
 /**
  * @brief Create a new KD-tree.
  * 
  * @param dimension Dimensionality of the points.
+ * @param point_func Reads the coordinates of a point from the dataset.
+ * @param prefetch_func Prefetches the coordinates of a point, or NULL.
+ * @param point_context Context passed to point_func and prefetch_func.
  * @return Pointer to the newly created KD-tree.
  */
-KDTree* kdtree_create(size_t dimension);
+KDTree* kdtree_create(size_t dimension, KDTreePointFunc point_func, KDTreePrefetchFunc prefetch_func,
+                      void* point_context);
 
 /**
  * @brief Insert a point into the KD-tree.
+ *
+ * The tree is kept alpha-weight-balanced: if a subtree on the insertion path ends up with one
+ * child holding more than KDTREE_BALANCE_ALPHA of its nodes, the highest such subtree is rebuilt
+ * around its medians, scapegoat style.
  * 
  * @param tree KD-tree into which the point is to be inserted.
- * @param point Point to be inserted.
+ * @param point Coordinates of the point, used to place it.
  * @param index Index of the point in the original dataset.
  */
 void kdtree_insert(KDTree* tree, const double* point, size_t index);
 
+/**
+ * @brief Replace the content of the KD-tree with a balanced tree over a set of points.
+ *
+ * The tree is complete and its nodes are stored breadth-first in one block, the children of the
+ * node at position p at 2p + 1 and 2p + 2, so the top levels share a few cache lines.
+ * 
+ * @param tree KD-tree to rebuild.
+ * @param indices Indices of the points in the original dataset.
+ * @param count Number of points.
+ * @param threads Maximum number of worker threads, 1 to build on the caller's thread.
+ * @return 0 on success, -1 on allocation failure, in which case the tree is unchanged.
+ */
+int kdtree_build(KDTree* tree, const size_t* indices, size_t count, size_t threads);
+
+/**
+ * @brief Remove a point from the KD-tree.
+ *
+ * A node with children takes over the point of its subtree that is nearest to its split on its
+ * axis, which is removed in turn, so the tree never keeps dead nodes. Subtrees left out of
+ * balance on the way are rebuilt as on insert. The points of the other nodes must still be
+ * readable through the point function.
+ * 
+ * @param tree KD-tree to remove the point from.
+ * @param point Coordinates the point was inserted with.
+ * @param index Index of the point in the original dataset.
+ */
+void kdtree_remove(KDTree* tree, const double* point, size_t index);
+
+/**
+ * @brief Move a point of the KD-tree to new coordinates.
+ *
+ * The node is updated in place when the new coordinates stay inside the region of space the node
+ * covers and the node still splits its children the same way; otherwise the point is removed and
+ * inserted again.
+ * 
+ * @param tree KD-tree holding the point.
+ * @param old_point Coordinates the point was inserted with.
+ * @param new_point New coordinates of the point.
+ * @param index Index of the point in the original dataset.
+ */
+void kdtree_update(KDTree* tree, const double* old_point, const double* new_point, size_t index);
+
+/**
+ * @brief Change the dataset index stored for a point after it was moved.
+ * 
+ * @param tree KD-tree holding the point.
+ * @param point Coordinates the point was inserted with.
+ * @param old_index Index the point was inserted with.
+ * @param new_index New index of the point in the original dataset.
+ */
+void kdtree_remap(KDTree* tree, const double* point, size_t old_index, size_t new_index);
+
 /**
  * @brief Free the memory allocated for the KD-tree.
  * 
@@ -47,6 +156,36 @@ void kdtree_insert(KDTree* tree, const double* point, size_t index);
  */
 void kdtree_free(KDTree* tree);
 
+/**
+ * @brief Find the k nearest neighbors in the KD-tree with a single walk.
+ *
+ * Candidates are kept in a bounded max-heap, and subtrees are pruned against the k-th best
+ * distance found so far.
+ * 
+ * @param tree KD-tree to search in.
+ * @param point Point to find the neighbors of.
+ * @param k Maximum number of neighbors.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the neighbors over the tree's dimension (k entries).
+ * @return Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t kdtree_knn(KDTree *tree, const double *point, size_t k, size_t *indices, double *distances);
+
+/**
+ * @brief Report every point within a radius of a query.
+ *
+ * Subtrees whose splitting plane is farther than the radius are skipped. Points are reported in
+ * tree order.
+ * 
+ * @param tree KD-tree to search in.
+ * @param point Query point.
+ * @param radius Largest Euclidean distance over the tree's dimension reported.
+ * @param func Called for every point found.
+ * @param context Context passed to func.
+ * @return Number of points reported, or (size_t)-1 on allocation failure.
+ */
+size_t kdtree_range(KDTree *tree, const double *point, double radius, KDTreeRangeFunc func, void *context);
+
 /**
  * @brief Find the nearest neighbor in the KD-tree.
  * 
@@ -4,13 +4,14 @@
 #define POST_HANDLER_H
 
 #include "vector_database.h"
+#include "sharded_db.h"
 
 /**
  * @struct PostHandlerData
  * @brief Structure to hold data for the POST handler
  */
 typedef struct {
-    VectorDatabase* db;
+    ShardedDatabase* db;
     size_t db_vector_size;
 } PostHandlerData;
 
@@ -0,0 +1,135 @@
+#ifndef PQ_INDEX_H
+#define PQ_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector_element.h"
+
+#define PQ_INDEX_CENTROIDS 256 // Centroids per subspace, so that a sub-code fits one byte
+
+/**
+ * @struct PQIndex
+ * @brief Product quantization index: one byte per subspace and per vector.
+ *
+ * The components are split into `subspaces` contiguous ranges; subspace j covers components
+ * [j * dimension / subspaces, (j + 1) * dimension / subspaces). Each range has its own codebook
+ * of PQ_INDEX_CENTROIDS centroids trained with k-means, and a vector is stored as the number of
+ * the nearest centroid in every subspace.
+ */
+typedef struct PQIndex {
+    size_t dimension;  /**< Number of components per vector */
+    size_t subspaces;  /**< Number of subspaces, also the code size in bytes */
+    float* centroids;  /**< PQ_INDEX_CENTROIDS * dimension floats; subspace j starts at PQ_INDEX_CENTROIDS * start(j) */
+    uint8_t* codes;    /**< `subspaces` bytes per slot */
+    size_t capacity;   /**< Number of slots allocated in codes */
+    size_t encoded;    /**< Every slot below this one holds a valid code */
+    int trained;       /**< Non-zero once the codebooks are trained */
+    double* scratch;   /**< dimension doubles used to decode stored components */
+} PQIndex;
+
+/**
+ * @brief Create an untrained index.
+ *
+ * @param dimension Number of components per vector.
+ * @param subspaces Number of subspaces, between 1 and dimension.
+ * @return Pointer to the index, or NULL on failure.
+ */
+PQIndex* pq_index_create(size_t dimension, size_t subspaces);
+
+/**
+ * @brief Free an index and its codes.
+ *
+ * @param pq Index to free.
+ */
+void pq_index_free(PQIndex* pq);
+
+/**
+ * @brief Train the codebook of every subspace with k-means.
+ *
+ * Subspaces are independent and are trained by a pool of threads.
+ *
+ * @param pq Index to train.
+ * @param samples `count` training vectors of `dimension` floats each.
+ * @param count Number of training vectors.
+ * @return 0 on success, -1 on failure.
+ */
+int pq_index_train(PQIndex* pq, const float* samples, size_t count);
+
+/**
+ * @brief Load trained codebooks and codes, e.g. from a database file.
+ *
+ * @param pq Index to fill.
+ * @param centroids PQ_INDEX_CENTROIDS * dimension floats.
+ * @param codes `subspaces` bytes per slot.
+ * @param count Number of slots.
+ * @return 0 on success, -1 on failure.
+ */
+int pq_index_restore(PQIndex* pq, const float* centroids, const uint8_t* codes, size_t count);
+
+/**
+ * @brief Encode a vector into a code owned by the caller.
+ *
+ * Only reads the codebooks, so threads may encode concurrently.
+ *
+ * @param pq Trained index.
+ * @param x `dimension` components.
+ * @param code `subspaces` bytes to fill.
+ */
+void pq_index_code(const PQIndex* pq, const double* x, uint8_t* code);
+
+/**
+ * @brief Encode the components of a slot. Does nothing while the index is untrained.
+ *
+ * Encoding the slot at pq->encoded advances it; a slot that cannot be encoded moves it back.
+ *
+ * @param pq Index to update.
+ * @param slot Storage slot of the vector.
+ * @param type Element type of data.
+ * @param data `dimension` components.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int pq_index_encode(PQIndex* pq, size_t slot, VectorElementType type, const void* data);
+
+/**
+ * @brief Copy the code of one slot to another, after the vector was moved.
+ *
+ * @param pq Index to update.
+ * @param dst Destination slot.
+ * @param src Source slot, below pq->encoded.
+ */
+void pq_index_move(PQIndex* pq, size_t dst, size_t src);
+
+/**
+ * @brief Build the asymmetric distance table of a query.
+ *
+ * Entry j * PQ_INDEX_CENTROIDS + c is the squared distance between the query components of
+ * subspace j and centroid c of that subspace.
+ *
+ * @param pq Trained index.
+ * @param query `dimension` components.
+ * @param table subspaces * PQ_INDEX_CENTROIDS floats to fill.
+ */
+void pq_index_table(const PQIndex* pq, const double* query, float* table);
+
+/**
+ * @brief Approximate squared Euclidean distance between a query and the code of a slot.
+ *
+ * @param pq Trained index.
+ * @param table Distance table built by pq_index_table for the query.
+ * @param slot Encoded slot.
+ * @return Approximate squared distance.
+ */
+float pq_index_distance(const PQIndex* pq, const float* table, size_t slot);
+
+/**
+ * @brief Approximate squared Euclidean distance between a query and a code owned by the caller.
+ *
+ * @param pq Trained index.
+ * @param table Distance table built by pq_index_table for the query.
+ * @param code `subspaces` bytes.
+ * @return Approximate squared distance.
+ */
+float pq_index_code_distance(const PQIndex* pq, const float* table, const uint8_t* code);
+
+#endif // PQ_INDEX_H
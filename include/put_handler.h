@@ -4,6 +4,7 @@
 #include <microhttpd.h>
 
 #include "vector_database.h"
+#include "sharded_db.h"
 
 /**
  * @brief Handles PUT requests.
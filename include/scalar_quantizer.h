@@ -0,0 +1,131 @@
+#ifndef SCALAR_QUANTIZER_H
+#define SCALAR_QUANTIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector_element.h"
+#include "vector_storage.h"
+
+#define SCALAR_QUANTIZER_CODE_ALIGNMENT 32 // Codes are zero-padded to a multiple of this many bytes
+
+/**
+ * @struct ScalarQuantizer
+ * @brief Int8 copy of every vector, trained from the per-dimension minimum and maximum.
+ *
+ * Component d of a vector is approximated by offset[d] + scale[d] * code[d] with code in
+ * [-127, 127]. Codes are stored per storage slot, code_stride bytes apart.
+ */
+typedef struct ScalarQuantizer {
+    size_t dimension;     /**< Number of components per vector */
+    size_t code_stride;   /**< Bytes per code, dimension rounded up to SCALAR_QUANTIZER_CODE_ALIGNMENT */
+    float* offset;        /**< Per-dimension midpoint of the trained range */
+    float* scale;         /**< Per-dimension step between two codes */
+    int8_t* codes;        /**< code_stride bytes per slot */
+    float* norms;         /**< Squared norm of the decoded code of every slot */
+    size_t capacity;      /**< Number of slots allocated in codes and norms */
+    size_t trained_count; /**< Number of vectors the ranges were trained on, 0 if untrained */
+    double* scratch;      /**< dimension doubles used to decode stored components */
+} ScalarQuantizer;
+
+/**
+ * @struct ScalarQuantizerQuery
+ * @brief Query prepared for scanning codes with integer dot products.
+ */
+typedef struct ScalarQuantizerQuery {
+    int8_t* weights;     /**< query[d] * scale[d], quantized to int8, code_stride bytes */
+    double weight_scale; /**< Value of one weight unit */
+    double bias;         /**< Sum of query[d] * offset[d] */
+    double norm;         /**< Squared norm of the query */
+} ScalarQuantizerQuery;
+
+/**
+ * @brief Create an untrained quantizer.
+ *
+ * @param dimension Number of components per vector.
+ * @return Pointer to the quantizer, or NULL on failure.
+ */
+ScalarQuantizer* scalar_quantizer_create(size_t dimension);
+
+/**
+ * @brief Free a quantizer and its codes.
+ *
+ * @param sq Quantizer to free.
+ */
+void scalar_quantizer_free(ScalarQuantizer* sq);
+
+/**
+ * @brief Train the per-dimension ranges on the live slots of a storage and encode all of them.
+ *
+ * @param sq Quantizer to train.
+ * @param storage Storage holding the vectors.
+ * @param size Number of slots in use, tombstones included.
+ * @return 0 on success, -1 on failure (the quantizer is left untrained).
+ */
+int scalar_quantizer_train(ScalarQuantizer* sq, const VectorStorage* storage, size_t size);
+
+/**
+ * @brief Load trained ranges and codes, e.g. from a database file.
+ *
+ * @param sq Quantizer to fill.
+ * @param offset Per-dimension midpoints.
+ * @param scale Per-dimension steps.
+ * @param codes code_stride bytes per slot.
+ * @param norms Squared norm of every code.
+ * @param count Number of slots.
+ * @return 0 on success, -1 on failure.
+ */
+int scalar_quantizer_restore(ScalarQuantizer* sq, const float* offset, const float* scale,
+                             const int8_t* codes, const float* norms, size_t count);
+
+/**
+ * @brief Encode the components of a slot. Does nothing while the quantizer is untrained.
+ *
+ * Components outside the trained range are clamped. If the code cannot be stored the quantizer
+ * becomes untrained.
+ *
+ * @param sq Quantizer to update.
+ * @param slot Storage slot of the vector.
+ * @param type Element type of data.
+ * @param data `dimension` components.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int scalar_quantizer_encode(ScalarQuantizer* sq, size_t slot, VectorElementType type, const void* data);
+
+/**
+ * @brief Copy the code of one slot to another, after the vector was moved.
+ *
+ * @param sq Quantizer to update.
+ * @param dst Destination slot.
+ * @param src Source slot.
+ */
+void scalar_quantizer_move(ScalarQuantizer* sq, size_t dst, size_t src);
+
+/**
+ * @brief Prepare a query for scalar_quantizer_distance.
+ *
+ * @param sq Trained quantizer.
+ * @param query `dimension` components.
+ * @param prepared Filled on success; release with scalar_quantizer_query_free.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int scalar_quantizer_query_init(const ScalarQuantizer* sq, const double* query, ScalarQuantizerQuery* prepared);
+
+/**
+ * @brief Release a prepared query.
+ *
+ * @param prepared Query to release.
+ */
+void scalar_quantizer_query_free(ScalarQuantizerQuery* prepared);
+
+/**
+ * @brief Approximate squared Euclidean distance between a query and the code of a slot.
+ *
+ * @param sq Trained quantizer.
+ * @param prepared Prepared query.
+ * @param slot Encoded slot.
+ * @return Approximate squared distance.
+ */
+double scalar_quantizer_distance(const ScalarQuantizer* sq, const ScalarQuantizerQuery* prepared, size_t slot);
+
+#endif // SCALAR_QUANTIZER_H
@@ -0,0 +1,347 @@
+#ifndef SHARDED_DB_H
+#define SHARDED_DB_H
+
+#include <stddef.h>
+
+#include "vector_database.h"
+#include "compactor.h"
+#include "snapshotter.h"
+#include "wal.h"
+
+/**
+ * @struct ShardedDatabase
+ * @brief A vector database split into independent shards routed by UUID hash.
+ *
+ * Every shard is a complete VectorDatabase with its own storage, indexes, lock, file, write-ahead
+ * log, compactor and snapshotter, so writes to different shards never contend. Global indices
+ * interleave the shards: index = local index * shard_count + shard. With one shard, global and
+ * local indices are the same and the files keep their unsharded names.
+ */
+typedef struct ShardedDatabase {
+    VectorDatabase** shards;    /**< shard_count databases */
+    size_t shard_count;         /**< Number of shards */
+    size_t vector_size;         /**< Number of components per vector */
+    char** filenames;           /**< Database file of every shard */
+    WAL** wals;                 /**< Write-ahead log of every shard, or NULL entries */
+    Compactor** compactors;     /**< Background compactor of every shard, or NULL entries */
+    Snapshotter** snapshotters; /**< Background snapshotter of every shard, or NULL entries */
+    VectorDBSearchMethod search_method; /**< Method used by sharded_db_nearest when none is requested */
+    VectorDBSearchParams search_params; /**< Knobs of sharded_db_nearest where a request leaves them at 0 */
+} ShardedDatabase;
+
+/**
+ * @brief Builds the file name of a shard.
+ *
+ * One shard uses the base name unchanged; otherwise shard i uses "<base>.shard<i>".
+ *
+ * @param base Base file name.
+ * @param shard_count Number of shards.
+ * @param shard Shard number.
+ * @return Newly allocated file name, or NULL on allocation failure.
+ */
+char* sharded_db_filename(const char* base, size_t shard_count, size_t shard);
+
+/**
+ * @brief Loads every shard from its file, or creates empty shards.
+ *
+ * If the files on disk were written with another shard count (including an unsharded database),
+ * their vectors are redistributed into the new shards. The new files are written under staged
+ * names and fsynced, then swapped in behind a marker file, and the previous files are renamed to
+ * "*.migrated"; a change interrupted after the marker is finished on the next open.
+ *
+ * @param filename Base file name of the database.
+ * @param shard_count Number of shards, at least 1.
+ * @param dimension Dimension of the KD-Tree.
+ * @param vector_size Number of components of every stored vector.
+ * @param element_type Storage type of every component.
+ * @param warmup How the mapped files are pre-faulted.
+ * @return Pointer to the database, or NULL on failure.
+ */
+ShardedDatabase* sharded_db_open(const char* filename, size_t shard_count, size_t dimension, size_t vector_size,
+                                 VectorElementType element_type, VectorDBWarmup warmup);
+
+/**
+ * @brief Replays the write-ahead logs and attaches one log per shard.
+ *
+ * Logs written under any shard count are replayed, each record into the shard its UUID routes to
+ * now. Shards that replayed records are then saved and the replayed logs removed, so a shard count
+ * change after a crash loses no logged write.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param filename Base file name of the logs.
+ * @param durability When appended records are fsynced.
+ * @param sync_interval_ms fsync period in asynchronous mode.
+ * @return 0 on success, -1 on failure.
+ */
+int sharded_db_open_wal(ShardedDatabase* db, const char* filename, WALDurability durability,
+                        unsigned int sync_interval_ms);
+
+/**
+ * @brief Moves the components of every shard to a cold file and keeps a bounded hot set in memory.
+ *
+ * Shard i keeps at most ceil(hot_set_size / shard_count) vectors resident; its cold vectors go to
+ * "<shard file>.cold", which is unlinked at once. The compactors demote the excess.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param hot_set_size Number of vectors kept in memory across all shards.
+ * @return 0 on success, -1 on failure.
+ */
+int sharded_db_enable_tiering(ShardedDatabase* db, size_t hot_set_size);
+
+/**
+ * @brief Starts the compactor and the snapshotter of every shard.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param compaction_batch_size Maximum number of vectors moved per compaction step.
+ * @param compaction_interval_ms Idle sleep of the compactors, in milliseconds.
+ * @param snapshot_interval_ms Time trigger of the snapshotters, in milliseconds (0 to disable).
+ * @param snapshot_dirty_writes Write-count trigger of the snapshotters (0 to disable).
+ * @return 0 on success, -1 on failure.
+ */
+int sharded_db_start(ShardedDatabase* db, size_t compaction_batch_size, unsigned int compaction_interval_ms,
+                     unsigned int snapshot_interval_ms, size_t snapshot_dirty_writes);
+
+/**
+ * @brief Stops the background threads, closes the logs and frees every shard.
+ *
+ * @param db Pointer to the ShardedDatabase structure to be freed.
+ */
+void sharded_db_free(ShardedDatabase* db);
+
+/**
+ * @brief Saves every shard to its file.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ */
+void sharded_db_save(ShardedDatabase* db);
+
+/**
+ * @brief Upper bound of the global indices in use.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @return Every stored vector has a global index below this value.
+ */
+size_t sharded_db_index_bound(ShardedDatabase* db);
+
+/**
+ * @brief Inserts a vector into the shard its UUID hashes to.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param vec Vector to be inserted.
+ * @return Global index of the inserted vector or -1 on failure.
+ */
+size_t sharded_db_insert(ShardedDatabase* db, Vector vec);
+
+/**
+ * @brief Checks whether a global index holds a live vector.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param index Global index.
+ * @return Non-zero if the vector exists.
+ */
+int sharded_db_contains(ShardedDatabase* db, size_t index);
+
+/**
+ * @brief Copies a vector out of the database.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param index Global index of the vector.
+ * @return Copy to release with vector_db_release, or NULL if not found.
+ */
+Vector* sharded_db_get(ShardedDatabase* db, size_t index);
+
+/**
+ * @brief Copies a vector out of the database, by uuid.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param uuid UUID of the vector.
+ * @return Copy to release with vector_db_release, or NULL if not found.
+ */
+Vector* sharded_db_get_by_uuid(ShardedDatabase* db, const char* uuid);
+
+/**
+ * @brief Finds the global index of a vector by uuid.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param uuid UUID of the vector.
+ * @return Global index of the vector or -1 if the UUID is unknown.
+ */
+size_t sharded_db_find_index(ShardedDatabase* db, const char* uuid);
+
+/**
+ * @brief Updates a vector.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param index Global index of the vector.
+ * @param vec New components.
+ */
+void sharded_db_update(ShardedDatabase* db, size_t index, Vector vec);
+
+/**
+ * @brief Deletes a vector.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param index Global index of the vector.
+ */
+void sharded_db_delete(ShardedDatabase* db, size_t index);
+
+/**
+ * @brief Enables or disables int8 quantization on every shard.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param enabled Non-zero to keep int8 codes.
+ * @param rescore_factor Number of quantized candidates rescored per result.
+ * @return 0 on success, -1 on failure.
+ */
+int sharded_db_set_quantization(ShardedDatabase* db, int enabled, size_t rescore_factor);
+
+/**
+ * @brief Sets the number of live vectors up to which a shard is scanned exactly by every search.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param threshold Largest number of live vectors of a shard scanned instead of searching an index, 0 to never scan.
+ */
+void sharded_db_set_flat_threshold(ShardedDatabase* db, size_t threshold);
+
+/**
+ * @brief Trains the product quantization index of every non-empty shard.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param subspaces Number of subspaces (bytes per code), or 0 for one per 8 components.
+ * @param code_bytes Set to the code size in bytes on success.
+ * @return Total number of vectors the codebooks were trained on, or -1 on failure.
+ */
+size_t sharded_db_train_pq(ShardedDatabase* db, size_t subspaces, size_t* code_bytes);
+
+/**
+ * @brief Rebuilds the balanced KD-Tree of every shard.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_rebuild_kdtree(ShardedDatabase* db);
+
+/**
+ * @brief Builds the randomized KD-forest of every shard.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param tree_count Number of trees per shard, or 0 for KD_FOREST_DEFAULT_TREES.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_build_forest(ShardedDatabase* db, size_t tree_count);
+
+/**
+ * @brief Builds the HNSW graph of every shard.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param m Links per node and layer, or 0 for HNSW_DEFAULT_M.
+ * @param ef_construction Candidates kept while linking a vector, or 0 for HNSW_DEFAULT_EF_CONSTRUCTION.
+ * @param metric Metric the graphs are built and searched with.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_build_hnsw(ShardedDatabase* db, size_t m, size_t ef_construction, HNSWMetric metric);
+
+/**
+ * @brief Keeps the HNSW graph loaded with every shard if it has the given shape, or builds it.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param m Links per node and layer, or 0 for HNSW_DEFAULT_M.
+ * @param ef_construction Candidates kept while linking a vector, or 0 for HNSW_DEFAULT_EF_CONSTRUCTION.
+ * @param metric Metric the graphs are built and searched with.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_enable_hnsw(ShardedDatabase* db, size_t m, size_t ef_construction, HNSWMetric metric);
+
+/**
+ * @brief Builds the inverted file index of every shard.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param list_count Number of lists per shard, or 0 for the square root of its live vectors.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_build_ivf(ShardedDatabase* db, size_t list_count);
+
+/**
+ * @brief Builds the on-disk Vamana graph of every shard, next to its database file.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param degree Largest number of neighbors per node, or 0 for DISKANN_DEFAULT_DEGREE.
+ * @param build_list Candidates kept while linking a vector, or 0 for DISKANN_DEFAULT_BUILD_LIST.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_build_diskann(ShardedDatabase* db, size_t degree, size_t build_list);
+
+/**
+ * @brief Keeps the Vamana graph loaded with every shard if it has the given degree, or builds it.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param degree Largest number of neighbors per node, or 0 for DISKANN_DEFAULT_DEGREE.
+ * @param build_list Candidates kept while linking a vector, or 0 for DISKANN_DEFAULT_BUILD_LIST.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_enable_diskann(ShardedDatabase* db, size_t degree, size_t build_list);
+
+/**
+ * @brief Finds the nearest vectors by searching every shard in parallel and merging the results.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param method Search method.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param params Per-query knobs of every shard, or NULL; fields left at 0 take search_params.
+ * @param indices Set to the global indices of the results, nearest first (k entries).
+ * @param distances Set to the exact Euclidean distances of the results over all components, or their
+ *                  distances under the graph metric for the HNSW method (k entries).
+ * @param uuids Set to the UUIDs of the results, copied under the lock of their shard (k entries of
+ *              UUID_SIZE bytes), or NULL.
+ * @return Number of results, or -1 if the method is unavailable or failed on a non-empty shard.
+ */
+size_t sharded_db_nearest(ShardedDatabase* db, VectorDBSearchMethod method, const double* query, size_t k,
+                          const VectorDBSearchParams* params, size_t* indices, double* distances, char* uuids);
+
+/**
+ * @brief Computes the distance between a query and a vector as sharded_db_nearest reports it.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param method Search method the distance is reported for.
+ * @param query Query vector of vector_size components.
+ * @param vec Copy of a stored vector, from sharded_db_get.
+ * @return Euclidean distance over all components, or the distance under the graph metric for the
+ *         HNSW method.
+ */
+double sharded_db_distance(ShardedDatabase* db, VectorDBSearchMethod method, const double* query, const Vector* vec);
+
+/**
+ * @brief Measures the recall of a search method against the exact flat scan.
+ *
+ * Evenly spaced stored vectors are used as queries. Recall is the share of the exact k nearest
+ * neighbors of every query that the method returns.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param method Search method to measure.
+ * @param k Number of neighbors per query.
+ * @param query_count Number of queries to run.
+ * @param params Per-query knobs of the method, or NULL; fields left at 0 take search_params.
+ * @param recall Set to the recall, from 0 to 1.
+ * @return Number of queries run, or -1 if the method is unavailable or failed.
+ */
+size_t sharded_db_measure_recall(ShardedDatabase* db, VectorDBSearchMethod method, size_t k, size_t query_count,
+                                 const VectorDBSearchParams* params, double* recall);
+
+/**
+ * @brief Finds every vector within a radius of a query in every shard.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param query Query vector of vector_size components.
+ * @param radius Largest Euclidean distance.
+ * @param max_results Keep only the nearest max_results vectors, or 0 to keep all of them.
+ * @param indices Set to a newly allocated array of the global indices of the results, nearest first, to free.
+ * @param distances Set to a newly allocated array of the distances of the results, to free.
+ * @param uuids Set to a newly allocated array of the UUIDs of the results, UUID_SIZE bytes each,
+ *              copied while each shard was locked, to free.
+ * @return Number of results, or -1 on failure.
+ */
+size_t sharded_db_range(ShardedDatabase* db, const double* query, double radius, size_t max_results,
+                        size_t** indices, double** distances, char** uuids);
+
+#endif // SHARDED_DB_H
@@ -0,0 +1,42 @@
+#ifndef SNAPSHOTTER_H
+#define SNAPSHOTTER_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "vector_database.h"
+
+/**
+ * @struct Snapshotter
+ * @brief Background thread saving a vector database after a time interval or a number of writes.
+ */
+typedef struct Snapshotter {
+    VectorDatabase* db;       /**< Database to save */
+    char* filename;           /**< File the database is saved to */
+    unsigned int interval_ms; /**< Save when dirty and this much time has passed, 0 to disable */
+    size_t dirty_writes;      /**< Save once this many mutations are pending, 0 to disable */
+    int running;              /**< Cleared to ask the thread to exit */
+    pthread_t thread;         /**< Snapshotter thread */
+    pthread_mutex_t lock;     /**< Protects running */
+    pthread_cond_t wakeup;    /**< Signalled on shutdown */
+} Snapshotter;
+
+/**
+ * @brief Start the background snapshotter.
+ * 
+ * @param db Database to save.
+ * @param filename File the database is saved to.
+ * @param interval_ms Save pending mutations at least this often, in milliseconds (0 to disable).
+ * @param dirty_writes Save as soon as this many mutations are pending (0 to disable).
+ * @return Pointer to the running snapshotter, or NULL on failure.
+ */
+Snapshotter* snapshotter_start(VectorDatabase* db, const char* filename, unsigned int interval_ms, size_t dirty_writes);
+
+/**
+ * @brief Stop the snapshotter thread and free it. A snapshot in progress is completed first.
+ * 
+ * @param snapshotter Snapshotter to stop.
+ */
+void snapshotter_stop(Snapshotter* snapshotter);
+
+#endif // SNAPSHOTTER_H
@@ -0,0 +1,95 @@
+#ifndef UUID_INDEX_H
+#define UUID_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector_storage.h"
+
+/**
+ * @struct UUIDIndexEntry
+ * @brief One bucket of the open-addressing table. The key itself is read back from the storage slot.
+ */
+typedef struct UUIDIndexEntry {
+    uint64_t hash; /**< Hash of the UUID stored in the slot */
+    size_t slot;   /**< Storage slot, or one of the empty/tombstone markers */
+} UUIDIndexEntry;
+
+/**
+ * @struct UUIDIndex
+ * @brief Open-addressing hash table (linear probing) mapping a UUID to its storage slot.
+ */
+typedef struct UUIDIndex {
+    UUIDIndexEntry* entries;        /**< Bucket array, capacity is a power of two */
+    size_t capacity;                /**< Number of buckets */
+    size_t count;                   /**< Number of live entries */
+    size_t tombstones;              /**< Number of removed entries still occupying a bucket */
+    const VectorStorage* storage;   /**< Storage holding the UUID of each slot */
+} UUIDIndex;
+
+/**
+ * @brief Create a new UUID index.
+ *
+ * @param storage Storage the slots refer to.
+ * @param initial_capacity Number of entries to size the table for.
+ * @return Pointer to the index, or NULL on failure.
+ */
+UUIDIndex* uuid_index_create(const VectorStorage* storage, size_t initial_capacity);
+
+/**
+ * @brief Free the index.
+ *
+ * @param index Index to free.
+ */
+void uuid_index_free(UUIDIndex* index);
+
+/**
+ * @brief Grow the table so that `count` entries fit without rehashing.
+ *
+ * @param index Index to grow.
+ * @param count Number of entries to make room for.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int uuid_index_reserve(UUIDIndex* index, size_t count);
+
+/**
+ * @brief Map a UUID to a slot. The UUID must already be written to the slot.
+ *
+ * @param index Index to insert into.
+ * @param uuid UUID of the vector.
+ * @param slot Storage slot of the vector.
+ * @return 0 on success, 1 if the UUID is already present, -1 on allocation failure.
+ */
+int uuid_index_insert(UUIDIndex* index, const char* uuid, size_t slot);
+
+/**
+ * @brief Look up the slot of a UUID.
+ *
+ * @param index Index to search.
+ * @param uuid UUID to look up.
+ * @return Storage slot, or (size_t)-1 if the UUID is unknown.
+ */
+size_t uuid_index_find(const UUIDIndex* index, const char* uuid);
+
+/**
+ * @brief Remove a UUID from the index.
+ *
+ * @param index Index to remove from.
+ * @param uuid UUID to remove.
+ * @return Slot the UUID was mapped to, or (size_t)-1 if it was unknown.
+ */
+size_t uuid_index_remove(UUIDIndex* index, const char* uuid);
+
+/**
+ * @brief Point an existing entry at a new slot after the vector was moved.
+ *
+ * The entry is matched by hash and old slot, so the storage may already hold other data at old_slot.
+ *
+ * @param index Index to update.
+ * @param uuid UUID of the moved vector.
+ * @param old_slot Slot the vector was moved from.
+ * @param new_slot Slot the vector was moved to.
+ */
+void uuid_index_remap(UUIDIndex* index, const char* uuid, size_t old_slot, size_t new_slot);
+
+#endif // UUID_INDEX_H
@@ -4,39 +4,116 @@
 #include <stddef.h>
 #include <pthread.h>
 #include "kdtree.h"
+#include "kd_forest.h"
+#include "hnsw.h"
+#include "ivf_index.h"
+#include "diskann.h"
+#include "vector_element.h"
+#include "vector_storage.h"
+#include "uuid_index.h"
+#include "scalar_quantizer.h"
+#include "pq_index.h"
+#include "wal.h"
 
 #define UUID_SIZE 37  // UUID Size(36 chars + 1 for '\0')
+#define VECTOR_DB_DEFAULT_FLAT_THRESHOLD 2048  // Live vectors up to which every search is an exact scan
+
+/**
+ * @enum VectorDBWarmup
+ * @brief How the pages of a mapped database file are pre-faulted at startup.
+ */
+typedef enum VectorDBWarmup {
+    VECTOR_DB_WARMUP_NONE = 0,  /**< Fault pages in on first access */
+    VECTOR_DB_WARMUP_WILLNEED,  /**< Ask the kernel to read the file ahead (madvise) */
+    VECTOR_DB_WARMUP_POPULATE   /**< Fault every page before returning (MAP_POPULATE) */
+} VectorDBWarmup;
+
+/**
+ * @enum VectorDBSearchMethod
+ * @brief How vector_db_nearest looks for the nearest vectors.
+ */
+typedef enum VectorDBSearchMethod {
+    VECTOR_DB_SEARCH_KDTREE = 0, /**< KD-Tree over the first KD-Tree dimension components */
+    VECTOR_DB_SEARCH_QUANTIZED,  /**< Scan of the int8 codes, rescored over all components */
+    VECTOR_DB_SEARCH_PQ,         /**< Scan of the product quantization codes, rescored over all components */
+    VECTOR_DB_SEARCH_FOREST,     /**< Best-bin-first search of the randomized KD-forest over all components */
+    VECTOR_DB_SEARCH_HNSW,       /**< Beam search of the HNSW graph over all components */
+    VECTOR_DB_SEARCH_IVF,        /**< Scan of the IVF lists nearest to the query over all components */
+    VECTOR_DB_SEARCH_DISKANN,    /**< Beam search of the on-disk Vamana graph over all components */
+    VECTOR_DB_SEARCH_FLAT        /**< Exact scan of every vector over all components */
+} VectorDBSearchMethod;
+
+/**
+ * @struct VectorDBSearchParams
+ * @brief Per-query knobs of vector_db_nearest; a field left at 0 takes the method's default.
+ */
+typedef struct VectorDBSearchParams {
+    size_t candidates;  /**< Size of the KD-Tree candidate pool re-ranked over all components */
+    size_t max_checks;  /**< Vectors compared by a KD-forest search before it stops */
+    size_t ef_search;   /**< Candidates kept by an HNSW search */
+    size_t nprobe;      /**< Lists scanned by an IVF search */
+    size_t search_list; /**< Candidates kept by a Vamana graph search */
+    size_t beam_width;  /**< Nodes read from disk per round of a Vamana graph search */
+} VectorDBSearchParams;
 
 /**
  * @struct Vector
  * @brief Represents a vector with its data.
+ *
+ * Vectors returned by the database are slot headers whose data points into the chunked storage,
+ * in the element type of the database. Vectors passed in may use any element type.
  */
 typedef struct Vector {
-    char uuid[UUID_SIZE];  /**< UUID of the vector */
-    size_t dimension;      /**< Dimension of the vector */
-    double* data;          /**< Array of vector data */
+    char uuid[UUID_SIZE];   /**< UUID of the vector */
+    size_t dimension;       /**< Dimension of the vector */
+    VectorElementType type; /**< Element type of data */
+    void* data;             /**< Array of vector data */
 } Vector;
 
 /**
  * @struct VectorDatabase
  * @brief Represents a database of vectors with dynamic resizing and KD-Tree for efficient search.
+ *
+ * Reads and searches share `lock` and run in parallel; inserts, updates, deletes, compaction and
+ * index maintenance take it exclusively.
  */
 typedef struct VectorDatabase {
-    Vector* vectors;       /**< Array of vectors */
-    size_t size;           /**< Current size of the vector array */
-    size_t capacity;       /**< Current capacity of the vector array */
+    VectorStorage* storage; /**< Chunked slab holding every vector */
+    size_t size;           /**< Number of slots in use, tombstones included */
+    size_t capacity;       /**< Number of slots reserved in the storage */
+    size_t deleted_count;  /**< Number of tombstones below size */
+    size_t compact_cursor; /**< No tombstone exists below this slot */
+    size_t dirty_writes;   /**< Mutations since the last successful save */
+    size_t vector_size;    /**< Number of components per vector */
+    VectorElementType element_type; /**< Storage type of every component */
+    UUIDIndex* uuid_index; /**< Hash index from UUID to storage slot */
     KDTree* kdtree;        /**< KD-Tree for efficient search operations */
-    pthread_mutex_t mutex;  // Add mutex to protect shared resources
+    KDForest* forest;      /**< Randomized KD-forest over all components, or NULL until built */
+    HNSW* hnsw;            /**< HNSW graph over all components, or NULL until built or loaded */
+    IVFIndex* ivf;         /**< Inverted file index over all components, or NULL until built */
+    DiskANN* diskann;      /**< Vamana graph on disk over all components, or NULL until built or loaded */
+    double* kd_point;      /**< Scratch buffer of two KD-Tree points (current and previous), guarded by the write lock */
+    WAL* wal;              /**< Write-ahead log of mutations, or NULL */
+    ScalarQuantizer* quantizer; /**< Int8 codes of every slot, or NULL when quantization is off */
+    size_t rescore_factor; /**< Quantized or KD-Tree candidates rescored per requested result */
+    PQIndex* pq;           /**< Product quantization index, or NULL until trained */
+    VectorDBSearchMethod search_method; /**< Method used by vector_db_nearest when none is requested */
+    size_t flat_threshold; /**< Searches over at most this many live vectors scan them all, 0 never */
+    int building;          /**< Non-zero while an index build reads every vector under the write lock; cold vectors are then not promoted */
+    pthread_rwlock_t lock;  /**< Shared by readers and searches, exclusive for writers */
+    pthread_mutex_t save_mutex; /**< Serializes vector_db_save calls */
 } VectorDatabase;
 
 /**
  * @brief Initializes a new vector database.
  * 
  * @param initial_capacity Initial capacity of the vector array.
- * @param dimension Dimension of the vectors and KD-Tree.
+ * @param dimension Dimension of the KD-Tree.
+ * @param vector_size Number of components of every stored vector.
+ * @param element_type Storage type of every component.
  * @return Pointer to the initialized VectorDatabase structure.
  */
-VectorDatabase* vector_db_init(size_t initial_capacity, size_t dimension);
+VectorDatabase* vector_db_init(size_t initial_capacity, size_t dimension, size_t vector_size, VectorElementType element_type);
 
 /**
  * @brief Frees the memory allocated for the vector database.
@@ -48,34 +125,94 @@ void vector_db_free(VectorDatabase* db);
 /**
  * @brief Inserts a vector into the database.
  * 
+ * The components are converted to the database element type and copied; the caller keeps
+ * ownership of vec.data.
+ *
  * @param db Pointer to the VectorDatabase structure.
  * @param vec Vector to be inserted.
- * @return Index of the inserted vector or -1 on failure.
+ * @return Index of the inserted vector or -1 on failure (including a UUID that is already stored).
  */
 size_t vector_db_insert(VectorDatabase* db, Vector vec);
 
+/**
+ * @brief Checks whether an index holds a live vector, without loading its components.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param index Index to check.
+ * @return Non-zero if the index is in bounds and not deleted.
+ */
+int vector_db_contains(VectorDatabase* db, size_t index);
+
 /**
  * @brief Reads a vector from the database.
  * 
+ * The slot header is returned in place: a concurrent update, delete or compaction may change it
+ * once the call returns. Use vector_db_get to read components while writers are running. In
+ * tiered storage the components of a cold slot are left on disk and `data` is NULL.
+ *
  * @param db Pointer to the VectorDatabase structure.
  * @param index Index of the vector to be read.
- * @return Pointer to the vector at the specified index or NULL if the index is out of bounds.
+ * @return Pointer to the vector at the specified index or NULL if the index is out of bounds or deleted.
  */
 Vector* vector_db_read(VectorDatabase* db, size_t index);
 
 /**
  * @brief Reads a vector from the database, by uuid.
  * 
+ * Same lifetime rules as vector_db_read.
+ *
  * @param db Pointer to the VectorDatabase structure.
  * @param uuid UUID of the vector to be read.
  * @return Pointer to the vector at the specified index or NULL if the index is out of bounds.
  */
 Vector* vector_db_read_by_uuid(VectorDatabase* db, const char* uuid);
 
+/**
+ * @brief Copies a vector out of the database.
+ * 
+ * The copy is taken under the shared lock, so it is consistent and stays valid whatever
+ * writers do afterwards. Its components keep the database element type.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param index Index of the vector to be copied.
+ * @return Copy to release with vector_db_release, or NULL if the index is out of bounds, deleted
+ *         or the allocation failed.
+ */
+Vector* vector_db_get(VectorDatabase* db, size_t index);
+
+/**
+ * @brief Copies a vector out of the database, by uuid.
+ * 
+ * @param db Pointer to the VectorDatabase structure.
+ * @param uuid UUID of the vector to be copied.
+ * @return Copy to release with vector_db_release, or NULL if the UUID is unknown or the
+ *         allocation failed.
+ */
+Vector* vector_db_get_by_uuid(VectorDatabase* db, const char* uuid);
+
+/**
+ * @brief Releases a copy returned by vector_db_get or vector_db_get_by_uuid.
+ * 
+ * @param vec Copy to release, may be NULL.
+ */
+void vector_db_release(Vector* vec);
+
+/**
+ * @brief Finds the index of a vector by uuid.
+ * 
+ * @param db Pointer to the VectorDatabase structure.
+ * @param uuid UUID of the vector to look up.
+ * @return Index of the vector or -1 if the UUID is unknown.
+ */
+size_t vector_db_find_index(VectorDatabase* db, const char* uuid);
+
 
 /**
  * @brief Updates a vector in the database.
  * 
+ * The components are converted to the database element type and copied; the caller keeps
+ * ownership of vec.data.
+ *
  * @param db Pointer to the VectorDatabase structure.
  * @param index Index of the vector to be updated.
  * @param vec New vector data.
@@ -85,27 +222,475 @@ void vector_db_update(VectorDatabase* db, size_t index, Vector vec);
 /**
  * @brief Deletes a vector from the database.
  * 
+ * The slot is turned into a tombstone; its space is reclaimed later by vector_db_compact_step.
+ *
  * @param db Pointer to the VectorDatabase structure.
  * @param index Index of the vector to be deleted.
  */
 void vector_db_delete(VectorDatabase* db, size_t index);
 
+/**
+ * @brief Attaches a write-ahead log to the database.
+ * 
+ * Every later insert, update and delete is appended to the log before it is acknowledged.
+ * The database does not take ownership of the log.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param wal Log to append to, or NULL to stop logging.
+ */
+void vector_db_set_wal(VectorDatabase* db, WAL* wal);
+
+/**
+ * @brief Applies the records of a write-ahead log file to the database.
+ * 
+ * Must run before vector_db_set_wal. Records are applied by UUID and are idempotent, so replaying
+ * a log over a snapshot that already contains some of its records is safe.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param filename Name of the log file.
+ * @return Number of records replayed, or -1 on failure.
+ */
+size_t vector_db_replay_wal(VectorDatabase* db, const char* filename);
+
+/**
+ * @brief Applies one write-ahead log record to the database.
+ *
+ * Used to replay a log whose records are routed to several databases. Must run before
+ * vector_db_set_wal.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param type Kind of mutation.
+ * @param uuid UUID of the vector.
+ * @param data Components (NULL for deletes).
+ * @param element_type Element type of data.
+ * @param dimension Number of components (0 for deletes).
+ */
+void vector_db_apply_wal_record(VectorDatabase* db, WALRecordType type, const char* uuid, const void* data,
+                                VectorElementType element_type, size_t dimension);
+
+/**
+ * @brief Reclaims tombstoned slots by moving the last live vectors into them.
+ * 
+ * Moved vectors get a new index; the UUID index and the KD-Tree are remapped under the same lock.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param max_moves Maximum number of vectors to move in this step.
+ * @return Number of tombstones reclaimed.
+ */
+size_t vector_db_compact_step(VectorDatabase* db, size_t max_moves);
+
+/**
+ * @brief Rebuilds the KD-Tree as a balanced tree over the live vectors.
+ * 
+ * The tree is built with median splits by a pool of threads into a complete tree, shallower than
+ * the weight-balanced tree kept by writes. Loading a database builds the tree the same way.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @return Number of vectors indexed, or -1 on failure.
+ */
+size_t vector_db_rebuild_kdtree(VectorDatabase* db);
+
+/**
+ * @brief Builds a randomized KD-forest over every live vector and all of their components.
+ * 
+ * The forest replaces any previous one and is then kept up to date by every write. It is not
+ * saved with the database, so it is rebuilt after a restart.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param tree_count Number of trees, or 0 for KD_FOREST_DEFAULT_TREES.
+ * @return Number of vectors indexed, or -1 on failure.
+ */
+size_t vector_db_build_forest(VectorDatabase* db, size_t tree_count);
+
+/**
+ * @brief Finds approximate nearest vectors over all components with the KD-forest.
+ * 
+ * The trees are searched best-bin-first until max_checks vectors were compared; raising the
+ * budget trades latency for recall. Distances are exact.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param max_checks Number of vectors compared, or 0 for KD_FOREST_DEFAULT_CHECKS.
+ * @param indices Set to the indices of the results, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the results (k entries).
+ * @param uuids Set to the UUIDs of the results, copied under the lock (k entries of UUID_SIZE
+ *              bytes), or NULL.
+ * @return Number of results, or -1 if no forest was built or the search failed.
+ */
+size_t vector_db_search_forest(VectorDatabase* db, const double* query, size_t k, size_t max_checks,
+                               size_t* indices, double* distances, char* uuids);
+
+/**
+ * @brief Builds an HNSW graph over every live vector and all of their components.
+ * 
+ * The graph replaces any previous one and is then kept up to date by every write. It is saved
+ * next to the database file, as "<filename>.hnsw", and loaded back with it.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param m Links per node and layer, or 0 for HNSW_DEFAULT_M.
+ * @param ef_construction Candidates kept while linking a vector, or 0 for HNSW_DEFAULT_EF_CONSTRUCTION.
+ * @param metric Metric the graph is built and searched with.
+ * @return Number of vectors indexed, or -1 on failure.
+ */
+size_t vector_db_build_hnsw(VectorDatabase* db, size_t m, size_t ef_construction, HNSWMetric metric);
+
+/**
+ * @brief Keeps the HNSW graph loaded with the database if it has the given shape, or builds one.
+ * 
+ * @param db Pointer to the VectorDatabase structure.
+ * @param m Links per node and layer, or 0 for HNSW_DEFAULT_M.
+ * @param ef_construction Candidates kept while linking a vector, or 0 for HNSW_DEFAULT_EF_CONSTRUCTION.
+ * @param metric Metric the graph is built and searched with.
+ * @return Number of vectors indexed, or -1 on failure.
+ */
+size_t vector_db_enable_hnsw(VectorDatabase* db, size_t m, size_t ef_construction, HNSWMetric metric);
+
+/**
+ * @brief Finds approximate nearest vectors over all components with the HNSW graph.
+ * 
+ * A greedy descent through the upper layers is followed by a beam search of the bottom layer;
+ * raising ef_search trades latency for recall.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param ef_search Candidates kept by the beam search, or 0 for HNSW_DEFAULT_EF_SEARCH.
+ * @param indices Set to the indices of the results, nearest first (k entries).
+ * @param distances Set to the distances of the results under the graph metric: Euclidean for l2,
+ *                  1 - cosine similarity for cosine, the negated inner product for ip (k entries).
+ * @param uuids Set to the UUIDs of the results, copied under the lock (k entries of UUID_SIZE
+ *              bytes), or NULL.
+ * @return Number of results, or -1 if no graph was built or the search failed.
+ */
+size_t vector_db_search_hnsw(VectorDatabase* db, const double* query, size_t k, size_t ef_search,
+                             size_t* indices, double* distances, char* uuids);
+
+/**
+ * @brief Builds an inverted file index over every live vector and all of their components.
+ * 
+ * The centroids are trained with k-means on a sample without holding the lock, and every vector
+ * is then assigned to the list of its nearest centroid. The index replaces any previous one and
+ * is then kept up to date by every write. It is not saved with the database, so it is rebuilt
+ * after a restart.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param list_count Number of lists, or 0 for the square root of the number of live vectors.
+ * @return Number of vectors indexed, or -1 on failure.
+ */
+size_t vector_db_build_ivf(VectorDatabase* db, size_t list_count);
+
+/**
+ * @brief Splits the IVF lists that grew too long since the index was built.
+ * 
+ * Inserts go to the list of their nearest centroid, so a region that keeps receiving vectors
+ * makes its list long and its searches slow. Called by the compactor.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param max_splits Maximum number of lists split in this pass.
+ * @return Number of lists split.
+ */
+size_t vector_db_rebalance_ivf(VectorDatabase* db, size_t max_splits);
+
+/**
+ * @brief Finds approximate nearest vectors over all components with the IVF index.
+ * 
+ * The query is compared with every centroid and the lists of the nprobe nearest ones are
+ * scanned; raising nprobe trades latency for recall. Distances are exact.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param nprobe Number of lists scanned, or 0 for IVF_DEFAULT_NPROBE.
+ * @param indices Set to the indices of the results, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the results (k entries).
+ * @param uuids Set to the UUIDs of the results, copied under the lock (k entries of UUID_SIZE
+ *              bytes), or NULL.
+ * @return Number of results, or -1 if no index was built or the search failed.
+ */
+size_t vector_db_search_ivf(VectorDatabase* db, const double* query, size_t k, size_t nprobe,
+                            size_t* indices, double* distances, char* uuids);
+
+/**
+ * @brief Builds a Vamana graph over every live vector and writes it to disk.
+ * 
+ * The graph is linked in memory and written to "<filename>.diskann", where node records (the
+ * vector and its neighbor list) are packed into aligned 4 KiB sectors so that one read fetches a
+ * node; only product quantization codes of the vectors stay in memory. The graph replaces any previous one. Vectors written
+ * afterwards are searched exhaustively next to it until the next build. The dataset index of
+ * every node is saved by vector_db_save to "<filename>.diskann.map", so the graph is loaded
+ * back with a database saved under the same filename.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param filename Name of the database file the graph sits next to.
+ * @param degree Largest number of neighbors per node, or 0 for DISKANN_DEFAULT_DEGREE.
+ * @param build_list Candidates kept while linking a vector, or 0 for DISKANN_DEFAULT_BUILD_LIST.
+ * @return Number of vectors indexed, or -1 on failure.
+ */
+size_t vector_db_build_diskann(VectorDatabase* db, const char* filename, size_t degree, size_t build_list);
+
+/**
+ * @brief Keeps the Vamana graph loaded with the database if it has the given degree, or builds one.
+ * 
+ * @param db Pointer to the VectorDatabase structure.
+ * @param filename Name of the database file the graph sits next to.
+ * @param degree Largest number of neighbors per node, or 0 for DISKANN_DEFAULT_DEGREE.
+ * @param build_list Candidates kept while linking a vector, or 0 for DISKANN_DEFAULT_BUILD_LIST.
+ * @return Number of vectors indexed, or -1 on failure.
+ */
+size_t vector_db_enable_diskann(VectorDatabase* db, const char* filename, size_t degree, size_t build_list);
+
+/**
+ * @brief Finds approximate nearest vectors over all components with the on-disk Vamana graph.
+ * 
+ * The beam search routes on the in-memory codes and reads beam_width node sectors from disk per
+ * round; raising search_list trades latency and reads for recall. Distances are exact.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param search_list Candidates kept by the search, or 0 for DISKANN_DEFAULT_SEARCH_LIST.
+ * @param beam_width Nodes read per round, or 0 for DISKANN_DEFAULT_BEAM_WIDTH.
+ * @param indices Set to the indices of the results, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the results (k entries).
+ * @param uuids Set to the UUIDs of the results, copied under the lock (k entries of UUID_SIZE
+ *              bytes), or NULL.
+ * @return Number of results, or -1 if no graph was built or the search failed.
+ */
+size_t vector_db_search_diskann(VectorDatabase* db, const double* query, size_t k, size_t search_list,
+                                size_t beam_width, size_t* indices, double* distances, char* uuids);
+
+/**
+ * @brief Moves the components to a cold file on disk and keeps a bounded hot set in memory.
+ * 
+ * Reads fault vectors back in while fewer than hot_limit are resident and copy them from disk
+ * past that; writes always fault them in. Flat scans, index builds and training read cold
+ * vectors without faulting them in. vector_db_demote evicts with a CLOCK sweep. Searches still
+ * read every vector they compare from disk once the hot set is full, so a tiered database is
+ * meant to be searched through its quantized or PQ codes.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param cold_filename Path of the cold file; it is unlinked at once and never reused.
+ * @param hot_limit Number of vectors kept in memory.
+ * @return 0 on success, -1 on failure.
+ */
+int vector_db_enable_tiering(VectorDatabase* db, const char* cold_filename, size_t hot_limit);
+
+/**
+ * @brief Evicts vectors not referenced recently once the hot set of a tiered database is full.
+ * 
+ * Everything beyond the hot set goes, and up to an eighth of it more, so that reads can fault
+ * vectors in again. The pass is skipped while a save is running, since the snapshot reads the
+ * cold file.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param max_demotions Maximum number of vectors evicted in this pass.
+ * @return Number of vectors evicted.
+ */
+size_t vector_db_demote(VectorDatabase* db, size_t max_demotions);
+
 /**
  * @brief Saves the database to a file.
  * 
+ * A point-in-time image is taken by forking under the lock and written by the child process,
+ * so readers and writers are only paused for the fork. The file is written to "<filename>.tmp"
+ * and atomically renamed over filename. The attached write-ahead log, if any, then drops the
+ * records captured by the image.
+ *
  * @param db Pointer to the VectorDatabase structure.
  * @param filename Name of the file to save the database to.
  */
 void vector_db_save(VectorDatabase* db, const char* filename);
 
+/**
+ * @brief Returns the number of mutations since the last successful save.
+ * 
+ * @param db Pointer to the VectorDatabase structure.
+ * @return Number of inserts, updates and deletes not yet captured by a saved file.
+ */
+size_t vector_db_dirty_writes(VectorDatabase* db);
+
+/**
+ * @brief Number of live vectors in the database.
+ * 
+ * @param db Pointer to the VectorDatabase structure.
+ * @return Number of stored vectors, tombstones excluded.
+ */
+size_t vector_db_count(VectorDatabase* db);
+
 /**
  * @brief Loads the database from a file.
  * 
+ * Files written by vector_db_save are memory-mapped and served without copying the vectors.
+ * Files stored with another element type are converted while loading.
+ *
  * @param filename Name of the file to load the database from.
- * @param dimension Dimension of the vectors and KD-Tree.
+ * @param dimension Dimension of the KD-Tree.
+ * @param vector_size Number of components of every stored vector.
+ * @param element_type Storage type of every component.
+ * @param warmup How to pre-fault the mapped file.
  * @return Pointer to the loaded VectorDatabase structure.
  */
-VectorDatabase* vector_db_load(const char* filename, size_t dimension);
+VectorDatabase* vector_db_load(const char* filename, size_t dimension, size_t vector_size,
+                               VectorElementType element_type, VectorDBWarmup warmup);
+
+/**
+ * @brief Enables or disables the int8 scalar quantization of every vector.
+ * 
+ * Enabling trains the per-dimension ranges on the stored vectors; an empty database is trained
+ * by the first quantized search. Codes loaded with the database file are kept.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param enabled Non-zero to keep quantized codes, zero to drop them.
+ * @param rescore_factor Number of quantized candidates rescored in full precision per result.
+ * @return 0 on success, -1 on failure.
+ */
+int vector_db_set_quantization(VectorDatabase* db, int enabled, size_t rescore_factor);
+
+/**
+ * @brief Sets the number of live vectors up to which vector_db_nearest scans every vector.
+ * 
+ * @param db Pointer to the VectorDatabase structure.
+ * @param threshold Largest number of live vectors scanned instead of searching an index, 0 to never scan.
+ */
+void vector_db_set_flat_threshold(VectorDatabase* db, size_t threshold);
+
+/**
+ * @brief Finds the exact nearest vectors over all components by comparing the query with every vector.
+ * 
+ * Distances are computed by the widest SIMD kernels of the running CPU (see flat_scan_isa), and
+ * large databases are split among threads. The results are the ground truth of every other method.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param indices Set to the indices of the results, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the results (k entries).
+ * @param uuids Set to the UUIDs of the results, copied under the lock (k entries of UUID_SIZE
+ *              bytes), or NULL.
+ * @return Number of results, or -1 on failure.
+ */
+size_t vector_db_search_flat(VectorDatabase* db, const double* query, size_t k, size_t* indices, double* distances,
+                             char* uuids);
+
+/**
+ * @brief Finds the nearest vectors over all components using the quantized codes.
+ * 
+ * Every code is scanned with integer dot products to pick k * rescore_factor candidates, which
+ * are then ranked by their exact Euclidean distance to the query.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param indices Set to the indices of the results, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the results (k entries).
+ * @param uuids Set to the UUIDs of the results, copied under the lock (k entries of UUID_SIZE
+ *              bytes), or NULL.
+ * @return Number of results, or -1 if quantization is disabled or failed.
+ */
+size_t vector_db_search_quantized(VectorDatabase* db, const double* query, size_t k, size_t* indices, double* distances,
+                                  char* uuids);
+
+/**
+ * @brief Trains a product quantization index on the stored vectors and encodes all of them.
+ * 
+ * The codebooks are trained on a sample without holding the lock; the vectors are then encoded
+ * in batches, so readers and writers keep running. The index replaces any previous one and is
+ * saved with the database.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param subspaces Number of subspaces (bytes per code), or 0 for one per 8 components.
+ * @return Number of vectors the codebooks were trained on, or -1 on failure.
+ */
+size_t vector_db_train_pq(VectorDatabase* db, size_t subspaces);
+
+/**
+ * @brief Finds the nearest vectors over all components using the product quantization index.
+ * 
+ * Codes are ranked with per-query distance tables (asymmetric distance computation), and the
+ * best k * rescore_factor candidates are ranked by their exact Euclidean distance to the query.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param indices Set to the indices of the results, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the results (k entries).
+ * @param uuids Set to the UUIDs of the results, copied under the lock (k entries of UUID_SIZE
+ *              bytes), or NULL.
+ * @return Number of results, or -1 if the index is not trained or the search failed.
+ */
+size_t vector_db_search_pq(VectorDatabase* db, const double* query, size_t k, size_t* indices, double* distances,
+                           char* uuids);
+
+/**
+ * @brief Parses the name of a search method ("kdtree", "quantized", "pq", "forest", "hnsw", "ivf", "diskann" or "flat").
+ * 
+ * @param name Name to parse.
+ * @param method Set to the parsed method on success.
+ * @return 0 on success, -1 if the name is unknown.
+ */
+int vector_db_search_method_parse(const char* name, VectorDBSearchMethod* method);
+
+/**
+ * @brief Finds the nearest vectors with the given search method.
+ * 
+ * The KD-Tree method is a two-stage search: one walk collects a pool of nearest neighbors over
+ * the tree's dimensions, which is then re-ranked by exact distance over all components. The pool
+ * holds max(k, params->candidates) neighbors, or k * rescore_factor (k when the tree covers every
+ * component) if no candidate count is given. The KD-forest method stops after params->max_checks
+ * comparisons, the HNSW method keeps params->ef_search candidates and reports distances under
+ * the metric of its graph, the IVF method scans params->nprobe lists and the Vamana method keeps
+ * params->search_list candidates and reads params->beam_width nodes per round.
+ *
+ * Whatever the method, a database with at most flat_threshold live vectors is scanned exactly,
+ * except for an HNSW graph of another metric than l2, whose distances a scan would not match.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param method Search method.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param params Per-query knobs, or NULL for the defaults.
+ * @param indices Set to the indices of the results, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the results over all components (k entries).
+ * @param uuids Set to the UUIDs of the results, copied under the lock (k entries of UUID_SIZE
+ *              bytes), or NULL.
+ * @return Number of results, or -1 if the method is unavailable or failed.
+ */
+size_t vector_db_nearest(VectorDatabase* db, VectorDBSearchMethod method, const double* query, size_t k,
+                         const VectorDBSearchParams* params, size_t* indices, double* distances, char* uuids);
+
+/**
+ * @brief Computes the distance between a query and a vector as vector_db_nearest reports it.
+ * 
+ * Results identified by UUID can be rescored with it once their components are read again.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param method Search method the distance is reported for.
+ * @param query Query vector of vector_size components.
+ * @param vec Vector of vector_size components, such as a copy from vector_db_get.
+ * @return Euclidean distance over all components, or the distance under the graph metric for the
+ *         HNSW method.
+ */
+double vector_db_distance(VectorDatabase* db, VectorDBSearchMethod method, const double* query, const Vector* vec);
+
+/**
+ * @brief Finds every vector within a radius of a query with the KD-Tree.
+ * 
+ * Subtrees beyond the radius over the tree's dimensions are pruned; the vectors found are then
+ * checked over all components.
+ *
+ * @param db Pointer to the VectorDatabase structure.
+ * @param query Query vector of vector_size components.
+ * @param radius Largest Euclidean distance over all components.
+ * @param max_results Keep only the nearest max_results vectors, or 0 to keep all of them.
+ * @param indices Set to a newly allocated array of the indices of the results, nearest first, to free.
+ * @param distances Set to a newly allocated array of the distances of the results, to free.
+ * @param uuids Set to a newly allocated array of the UUIDs of the results, UUID_SIZE bytes each,
+ *              copied under the lock so that they identify the vectors found, to free.
+ * @return Number of results, or -1 on failure.
+ */
+size_t vector_db_range(VectorDatabase* db, const double* query, double radius, size_t max_results,
+                       size_t** indices, double** distances, char** uuids);
 
 /**
  * @brief Calculates the cosine similarity between two vectors.
@@ -0,0 +1,68 @@
+#ifndef VECTOR_ELEMENT_H
+#define VECTOR_ELEMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @enum VectorElementType
+ * @brief Storage type of vector components. The values are stored in database files and logs.
+ */
+typedef enum VectorElementType {
+    VECTOR_ELEMENT_FLOAT64 = 0, /**< IEEE 754 double */
+    VECTOR_ELEMENT_FLOAT32 = 1, /**< IEEE 754 single */
+    VECTOR_ELEMENT_FLOAT16 = 2, /**< IEEE 754 half (1-5-10) */
+    VECTOR_ELEMENT_BFLOAT16 = 3 /**< Brain float (1-8-7), the upper half of a float32 */
+} VectorElementType;
+
+#define VECTOR_ELEMENT_TYPE_COUNT 4
+
+/**
+ * @brief Size of one component in bytes.
+ *
+ * @param type Element type.
+ * @return Size in bytes, or 0 for an unknown type.
+ */
+size_t vector_element_size(VectorElementType type);
+
+/**
+ * @brief Name of an element type as used in config.json and JSON responses.
+ *
+ * @param type Element type.
+ * @return "float64", "float32", "float16" or "bfloat16".
+ */
+const char* vector_element_name(VectorElementType type);
+
+/**
+ * @brief Parse the name of an element type.
+ *
+ * @param name Name to parse.
+ * @param type Set to the parsed type on success.
+ * @return 0 on success, -1 if the name is unknown.
+ */
+int vector_element_parse(const char* name, VectorElementType* type);
+
+/**
+ * @brief Read one component as a double.
+ *
+ * @param type Element type of the array.
+ * @param data Component array.
+ * @param i Component number.
+ * @return Value of the component.
+ */
+double vector_element_get(VectorElementType type, const void* data, size_t i);
+
+/**
+ * @brief Convert an array of components from one element type to another.
+ *
+ * Narrowing conversions round to nearest, ties to even. Arrays of the same type are copied.
+ *
+ * @param dst_type Element type of the destination.
+ * @param dst Destination array, `count` components.
+ * @param src_type Element type of the source.
+ * @param src Source array, `count` components. Must not overlap dst.
+ * @param count Number of components.
+ */
+void vector_element_convert(VectorElementType dst_type, void* dst, VectorElementType src_type, const void* src, size_t count);
+
+#endif // VECTOR_ELEMENT_H
@@ -0,0 +1,252 @@
+#ifndef VECTOR_STORAGE_H
+#define VECTOR_STORAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "vector_element.h"
+
+#define VECTOR_STORAGE_CHUNK_SHIFT 12                                      // 4096 vectors per chunk
+#define VECTOR_STORAGE_CHUNK_VECTORS ((size_t)1 << VECTOR_STORAGE_CHUNK_SHIFT)
+#define VECTOR_STORAGE_CHUNK_MASK (VECTOR_STORAGE_CHUNK_VECTORS - 1)
+#define VECTOR_STORAGE_ALIGNMENT 64                                        // Cache line size
+#define VECTOR_STORAGE_HOT_RESERVE 8                                       // A full hot set frees 1/8 of itself for new promotions
+
+#define VECTOR_SLOT_DELETED 0x01 // Slot holds a tombstone
+#define VECTOR_SLOT_DIRTY 0x02   // Resident components differ from the cold file (tiered storage)
+
+struct Vector;
+
+/**
+ * @struct VectorChunk
+ * @brief A fixed-size block of vector slots. Chunks are never moved or resized once allocated.
+ */
+typedef struct VectorChunk {
+    struct Vector* headers; /**< Slot headers (uuid, dimension, pointer into data) */
+    unsigned char* data;    /**< VECTOR_STORAGE_CHUNK_VECTORS * stride components, cache-line aligned */
+    unsigned char* flags;   /**< Per-slot state bits (VECTOR_SLOT_*) */
+    unsigned char* referenced; /**< Per-slot CLOCK reference bit, tiered storage only */
+} VectorChunk;
+
+/**
+ * @struct VectorStorageTier
+ * @brief Cold tier of a storage: a disk file behind a pool of resident vectors.
+ *
+ * In tiered storage the chunks keep no components. Slot i is stored in the cold file at offset
+ * i * vector_bytes and is read into its own frame on first access (promotion); the slot header
+ * then points at the frame. Reads promote only while fewer than hot_limit slots are resident;
+ * past that they copy the cold slot into a caller buffer. Every access to a frame sets its
+ * reference bit, and vector_storage_demote sweeps the resident list with a CLOCK hand, clearing
+ * the bits it passes and evicting the slots whose bit was already clear, writing back the ones
+ * that were modified.
+ */
+typedef struct VectorStorageTier {
+    int fd;                   /**< Cold file, unlinked once opened */
+    size_t hot_limit;         /**< Resident vectors past which reads stop promoting */
+    size_t* resident;         /**< Slots holding a frame, guarded by lock */
+    size_t resident_count;    /**< Number of entries in resident */
+    size_t resident_capacity; /**< Number of entries available in resident */
+    size_t hand;              /**< Position of the CLOCK hand in resident */
+    size_t promotions;        /**< Slots read from the cold file, guarded by lock */
+    size_t demotions;         /**< Frames evicted */
+    size_t writebacks;        /**< Evicted frames written back to the cold file */
+    pthread_mutex_t lock;     /**< Protects the resident list and the promotion count */
+} VectorStorageTier;
+
+/**
+ * @struct VectorStorage
+ * @brief Chunked slab holding the components of every vector at a fixed stride, in one element type.
+ *
+ * Slot i lives in chunk (i >> VECTOR_STORAGE_CHUNK_SHIFT) at offset (i & VECTOR_STORAGE_CHUNK_MASK).
+ * Growing only appends chunks to the directory, so the address of a slot never changes.
+ */
+typedef struct VectorStorage {
+    VectorChunk* chunks;   /**< Chunk directory */
+    size_t chunk_count;    /**< Number of allocated chunks */
+    size_t chunk_capacity; /**< Number of entries available in the chunk directory */
+    size_t stride;         /**< Number of components per vector (db_vector_size) */
+    VectorElementType element_type; /**< Type of every component */
+    size_t vector_bytes;   /**< stride * element size */
+    size_t mapped_chunks;  /**< Leading chunks whose data lives in the file mapping */
+    void* map_base;        /**< Base of the file mapping, or NULL */
+    size_t map_length;     /**< Length of the file mapping in bytes */
+    VectorStorageTier* tier; /**< Cold tier, or NULL if every vector is kept in memory */
+} VectorStorage;
+
+/**
+ * @brief Create a new chunked vector storage.
+ *
+ * @param stride Number of components per vector.
+ * @param element_type Type of every component.
+ * @param initial_capacity Number of slots to reserve up front.
+ * @return Pointer to the storage, or NULL on failure.
+ */
+VectorStorage* vector_storage_create(size_t stride, VectorElementType element_type, size_t initial_capacity);
+
+/**
+ * @brief Serve the first `count` slots of an empty storage from a file mapping.
+ *
+ * Every full chunk points straight into `data`; only the slot headers are allocated and the
+ * UUIDs copied into them. The trailing partial chunk is copied to the heap so that it can grow.
+ * The storage takes ownership of the mapping, even on failure, and unmaps it when freed.
+ *
+ * @param storage Empty storage to populate.
+ * @param map_base Base address of the mapping.
+ * @param map_length Length of the mapping in bytes.
+ * @param data First component of slot 0 inside the mapping, `vector_bytes` bytes per slot.
+ * @param uuids UUID of slot 0 inside the mapping.
+ * @param uuid_stride Distance in bytes between two consecutive UUIDs.
+ * @param count Number of slots stored in the mapping.
+ * @return 0 on success, -1 on failure.
+ */
+int vector_storage_map_region(VectorStorage* storage, void* map_base, size_t map_length,
+                              void* data, const char* uuids, size_t uuid_stride, size_t count);
+
+/**
+ * @brief Free the storage and every chunk it owns.
+ *
+ * @param storage Storage to free.
+ */
+void vector_storage_free(VectorStorage* storage);
+
+/**
+ * @brief Make sure at least `slots` slots are addressable.
+ *
+ * @param storage Storage to grow.
+ * @param slots Required number of slots.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int vector_storage_reserve(VectorStorage* storage, size_t slots);
+
+/**
+ * @brief Number of slots currently addressable without allocating.
+ *
+ * @param storage Storage to query.
+ * @return Capacity in slots.
+ */
+size_t vector_storage_capacity(const VectorStorage* storage);
+
+/**
+ * @brief Get the header of a slot. The slot must be below the reserved capacity.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number.
+ * @return Pointer to the slot header. The address is stable for the lifetime of the storage.
+ */
+struct Vector* vector_storage_slot(const VectorStorage* storage, size_t slot);
+
+/**
+ * @brief Get the components of a slot in place. The slot must be below the reserved capacity.
+ *
+ * In tiered storage a cold slot is promoted first, even past hot_limit, which is safe under a
+ * shared lock. The pointer stays valid until vector_storage_demote runs. Reads that do not need
+ * the slot to stay in place use vector_storage_read, which keeps within hot_limit.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number.
+ * @return Pointer to `stride` contiguous components of the storage element type, or NULL if a
+ *         cold slot could not be read.
+ */
+void* vector_storage_data(const VectorStorage* storage, size_t slot);
+
+/**
+ * @brief Get the components of a slot, copying a cold slot into a buffer rather than promoting it.
+ *
+ * A resident slot is returned in place. In tiered storage a cold slot is promoted only if
+ * `promote` is set and fewer than hot_limit slots are resident; otherwise it is read into
+ * `buffer`. Safe under a shared lock. The result stays valid until vector_storage_demote runs or
+ * the buffer is reused.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ * @param promote Non-zero to let a point read promote the slot, zero for scans over many slots.
+ * @param buffer Scratch space of vector_bytes bytes; may be NULL in storage without a tier.
+ * @return Pointer to `stride` contiguous components, or NULL if a cold slot could not be read.
+ */
+const void* vector_storage_read(const VectorStorage* storage, size_t slot, int promote, void* buffer);
+
+/**
+ * @brief Start loading the components of a slot into the cache without waiting for them.
+ *
+ * Tiered storage only prefetches the slot header and never promotes the slot.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ */
+void vector_storage_prefetch(const VectorStorage* storage, size_t slot);
+
+/**
+ * @brief Get the components of a slot that the caller is about to overwrite entirely.
+ *
+ * In tiered storage the slot is marked dirty, and a cold slot gets a frame without being read.
+ * The caller must have exclusive access to the storage.
+ *
+ * @param storage Storage to modify.
+ * @param slot Slot number, below the reserved capacity.
+ * @return Pointer to `stride` contiguous components, or NULL on allocation failure.
+ */
+void* vector_storage_data_for_write(VectorStorage* storage, size_t slot);
+
+/**
+ * @brief Copy part of the components of a slot without promoting it.
+ *
+ * Makes no allocation and takes no lock, so it can run in a forked child.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ * @param offset First byte to copy within the components.
+ * @param buffer Destination of length bytes.
+ * @param length Number of bytes to copy.
+ * @return 0 on success, -1 on a read error.
+ */
+int vector_storage_copy_out(const VectorStorage* storage, size_t slot, size_t offset, void* buffer, size_t length);
+
+/**
+ * @brief Move the components of every slot to a cold file and keep at most hot_limit resident.
+ *
+ * The file is unlinked as soon as it is open, so it never outlives the process. A file mapping
+ * is released once its slots were copied. The caller must have exclusive access to the storage.
+ *
+ * @param storage Storage to convert.
+ * @param filename Path of the cold file, on the disk meant to hold the cold vectors.
+ * @param count Number of slots in use.
+ * @param hot_limit Number of vectors kept in memory once demotion catches up.
+ * @return 0 on success, -1 on failure, in which case the storage is unchanged.
+ */
+int vector_storage_enable_tier(VectorStorage* storage, const char* filename, size_t count, size_t hot_limit);
+
+/**
+ * @brief Sweep the CLOCK hand over a full hot set and evict the slots not referenced since.
+ *
+ * Runs only once hot_limit slots are resident. Evicts every slot beyond hot_limit, even recently
+ * referenced ones, then up to hot_limit / VECTOR_STORAGE_HOT_RESERVE more that were not
+ * referenced since the hand last passed them, so that reads can promote again. Deleted slots
+ * are evicted whenever the hand reaches them and dirty slots are written back to the cold file.
+ * The caller must have exclusive access to the storage.
+ *
+ * @param storage Tiered storage.
+ * @param max_demotions Maximum number of slots to evict in this pass.
+ * @return Number of slots evicted, or (size_t)-1 on a write error.
+ */
+size_t vector_storage_demote(VectorStorage* storage, size_t max_demotions);
+
+/**
+ * @brief Check whether a slot holds a tombstone.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ * @return Non-zero if the slot was deleted.
+ */
+int vector_storage_is_deleted(const VectorStorage* storage, size_t slot);
+
+/**
+ * @brief Set or clear the tombstone of a slot.
+ *
+ * @param storage Storage to modify.
+ * @param slot Slot number, below the reserved capacity.
+ * @param deleted Non-zero to mark the slot deleted, zero to mark it live.
+ */
+void vector_storage_set_deleted(VectorStorage* storage, size_t slot, int deleted);
+
+#endif // VECTOR_STORAGE_H
@@ -0,0 +1,144 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "vector_element.h"
+
+/**
+ * @enum WALDurability
+ * @brief When a mutation is acknowledged relative to its log record reaching the disk.
+ */
+typedef enum WALDurability {
+    WAL_DURABILITY_OFF = 0, /**< No write-ahead log */
+    WAL_DURABILITY_ASYNC,   /**< Acknowledge immediately, fsync every sync interval */
+    WAL_DURABILITY_GROUP    /**< Acknowledge after fsync; concurrent writers share one fsync */
+} WALDurability;
+
+/**
+ * @enum WALRecordType
+ * @brief Kind of mutation stored in a log record. Records are keyed by UUID, not by index.
+ */
+typedef enum WALRecordType {
+    WAL_RECORD_INSERT = 1, /**< UUID and components of a new vector */
+    WAL_RECORD_UPDATE = 2, /**< UUID and new components of an existing vector */
+    WAL_RECORD_DELETE = 3  /**< UUID of a deleted vector */
+} WALRecordType;
+
+/**
+ * @struct WAL
+ * @brief Append-only write-ahead log with a background flusher thread.
+ *
+ * Appends go to an in-memory buffer; the flusher writes the buffer and fsyncs it, so every
+ * writer that appended while the previous fsync was running is made durable by the next one.
+ */
+typedef struct WAL {
+    int fd;                        /**< Log file descriptor */
+    char* path;                    /**< Path of the log file */
+    WALDurability durability;      /**< Durability level */
+    unsigned int sync_interval_ms; /**< fsync period in WAL_DURABILITY_ASYNC mode */
+    char* buffer;                  /**< Records appended but not yet written */
+    size_t buffer_length;          /**< Bytes used in buffer */
+    size_t buffer_capacity;        /**< Bytes allocated for buffer */
+    char* spare;                   /**< Buffer being written by the flusher */
+    size_t spare_capacity;         /**< Bytes allocated for spare */
+    int flushing;                  /**< Set while the flusher writes spare outside the lock */
+    uint64_t next_lsn;             /**< Sequence number of the next record */
+    uint64_t durable_lsn;          /**< Every record below this sequence number is on disk */
+    int failed;                    /**< Set once a write or fsync failed */
+    int running;                   /**< Cleared to stop the flusher */
+    pthread_t flusher;             /**< Flusher thread */
+    pthread_mutex_t lock;          /**< Protects every field above */
+    pthread_cond_t work;           /**< Signalled when records are appended */
+    pthread_cond_t flushed;        /**< Broadcast when durable_lsn advances */
+} WAL;
+
+/**
+ * @brief Callback invoked for every valid record during replay.
+ *
+ * @param ctx User context.
+ * @param type Kind of mutation.
+ * @param uuid UUID of the vector.
+ * @param data Components (NULL for deletes).
+ * @param element_type Element type of data.
+ * @param dimension Number of components (0 for deletes).
+ */
+typedef void (*WALReplayCallback)(void* ctx, WALRecordType type, const char* uuid, const void* data,
+                                  VectorElementType element_type, size_t dimension);
+
+/**
+ * @brief Open (or create) a log file for appending and start its flusher.
+ *
+ * @param filename Path of the log file.
+ * @param durability Durability level, must not be WAL_DURABILITY_OFF.
+ * @param sync_interval_ms fsync period in WAL_DURABILITY_ASYNC mode.
+ * @return Pointer to the log, or NULL on failure.
+ */
+WAL* wal_open(const char* filename, WALDurability durability, unsigned int sync_interval_ms);
+
+/**
+ * @brief Flush every pending record, stop the flusher and close the log.
+ *
+ * @param wal Log to close.
+ */
+void wal_close(WAL* wal);
+
+/**
+ * @brief Append one record to the log buffer.
+ *
+ * @param wal Log to append to.
+ * @param type Kind of mutation.
+ * @param uuid UUID of the vector.
+ * @param data Components (NULL for deletes).
+ * @param element_type Element type of data, stored in the record.
+ * @param dimension Number of components (0 for deletes).
+ * @return Sequence number to pass to wal_wait, or 0 on failure.
+ */
+uint64_t wal_append(WAL* wal, WALRecordType type, const char* uuid, const void* data,
+                    VectorElementType element_type, size_t dimension);
+
+/**
+ * @brief Block until a record is durable, according to the durability level.
+ *
+ * @param wal Log the record was appended to.
+ * @param lsn Sequence number returned by wal_append.
+ * @return 0 on success, -1 if the log failed.
+ */
+int wal_wait(WAL* wal, uint64_t lsn);
+
+/**
+ * @brief Sequence number the next appended record will get.
+ *
+ * Every record appended so far has a smaller sequence number, which makes it a checkpoint cutoff.
+ *
+ * @param wal Log to query.
+ * @return Next sequence number.
+ */
+uint64_t wal_next_lsn(WAL* wal);
+
+/**
+ * @brief Discard the records captured by a snapshot.
+ *
+ * Records with a sequence number below `lsn` are dropped; later ones are kept in order.
+ *
+ * @param wal Log to checkpoint.
+ * @param lsn Cutoff returned by wal_next_lsn when the snapshot was taken.
+ * @return 0 on success, -1 on failure.
+ */
+int wal_checkpoint(WAL* wal, uint64_t lsn);
+
+/**
+ * @brief Replay every valid record of a log file.
+ *
+ * A torn or corrupt tail is cut off so that new records follow the last valid one.
+ *
+ * @param filename Path of the log file. A missing file replays nothing.
+ * @param callback Function called for each record, in log order.
+ * @param ctx User context passed to the callback.
+ * @return Number of records replayed, or (size_t)-1 on failure.
+ */
+size_t wal_replay(const char* filename, WALReplayCallback callback, void* ctx);
+
+#endif // WAL_H
@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <microhttpd.h>
+#include <cjson/cJSON.h>
+
+#include "../include/vector_database.h"
+#include "../include/sharded_db.h"
+#include "../include/admin_handler.h"
+#include "../include/connection_data.h"
+#include "../include/flat_scan.h"
+
+#define ADMIN_MAX_FOREST_TREES 64 // Largest number of trees a forest build may ask for
+#define ADMIN_MAX_EF_CONSTRUCTION 10000 // Largest HNSW construction beam an HNSW build may ask for
+#define ADMIN_MAX_BUILD_LIST 10000 // Largest candidate list a Vamana graph build may ask for
+#define ADMIN_MAX_RECALL_K 1000 // Largest number of neighbors per query a recall measure may ask for
+#define ADMIN_MAX_RECALL_QUERIES 10000 // Largest number of queries a recall measure may ask for
+#define ADMIN_DEFAULT_RECALL_K 10 // Neighbors per query of a recall measure when none are requested
+#define ADMIN_DEFAULT_RECALL_QUERIES 100 // Queries of a recall measure when none are requested
+#define ADMIN_MAX_CANDIDATES 100000 // Largest KD-Tree candidate pool a recall measure may ask for
+#define ADMIN_MAX_CHECKS 10000000 // Largest KD-forest comparison budget a recall measure may ask for
+#define ADMIN_MAX_EF_SEARCH 100000 // Largest HNSW beam width a recall measure may ask for
+#define ADMIN_MAX_SEARCH_LIST 100000 // Largest Vamana candidate list a recall measure may ask for
+
+/**
+ * @brief Queue a JSON error response.
+ * 
+ * @param connection Pointer to MHD_Connection object.
+ * @param status HTTP status code.
+ * @param error_msg Persistent JSON body.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result admin_handler_error(struct MHD_Connection* connection, unsigned int status, const char* error_msg) {
+    struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
+                                                                    (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    int ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret == MHD_YES ? MHD_YES : MHD_NO;
+}
+
+/**
+ * @brief Train the PQ index and report the result.
+ * 
+ * The optional 'subspaces' query parameter sets the code size in bytes.
+ *
+ * @param db Pointer to the vector database.
+ * @param connection Pointer to MHD_Connection object.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result admin_train_pq(ShardedDatabase* db, struct MHD_Connection* connection) {
+    size_t subspaces = 0;
+    const char* subspaces_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "subspaces");
+    if (subspaces_str) {
+        int value = atoi(subspaces_str);
+        if (value <= 0 || (size_t)value > db->vector_size) {
+            return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"Invalid 'subspaces' query parameter\"}");
+        }
+        subspaces = (size_t)value;
+    }
+
+    size_t code_bytes = 0;
+    size_t trained = sharded_db_train_pq(db, subspaces, &code_bytes);
+    if (trained == (size_t)-1) {
+        return admin_handler_error(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\": \"Failed to train the PQ index\"}");
+    }
+
+    // Report the code size next to the size of a stored vector
+    cJSON* json_response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json_response, "trained_on", trained);
+    cJSON_AddNumberToObject(json_response, "code_bytes", code_bytes);
+    cJSON_AddNumberToObject(json_response, "vector_bytes", db->shards[0]->storage->vector_bytes);
+    char* response_str = cJSON_PrintUnformatted(json_response);
+    cJSON_Delete(json_response);
+
+    struct MHD_Response* response = MHD_create_response_from_buffer(strlen(response_str),
+                                                                    (void*)response_str, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret == MHD_YES ? MHD_YES : MHD_NO;
+}
+
+/**
+ * @brief Rebuild the balanced KD-tree and report the result.
+ * 
+ * @param db Pointer to the vector database.
+ * @param connection Pointer to MHD_Connection object.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result admin_rebuild_kdtree(ShardedDatabase* db, struct MHD_Connection* connection) {
+    size_t indexed = sharded_db_rebuild_kdtree(db);
+    if (indexed == (size_t)-1) {
+        return admin_handler_error(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\": \"Failed to rebuild the KD-tree\"}");
+    }
+
+    cJSON* json_response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json_response, "indexed", indexed);
+    char* response_str = cJSON_PrintUnformatted(json_response);
+    cJSON_Delete(json_response);
+
+    struct MHD_Response* response = MHD_create_response_from_buffer(strlen(response_str),
+                                                                    (void*)response_str, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret == MHD_YES ? MHD_YES : MHD_NO;
+}
+
+/**
+ * @brief Build the randomized KD-forest and report the result.
+ * 
+ * The optional 'trees' query parameter sets the number of trees per shard.
+ *
+ * @param db Pointer to the vector database.
+ * @param connection Pointer to MHD_Connection object.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result admin_build_forest(ShardedDatabase* db, struct MHD_Connection* connection) {
+    size_t trees = 0;
+    const char* trees_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "trees");
+    if (trees_str) {
+        int value = atoi(trees_str);
+        if (value <= 0 || value > ADMIN_MAX_FOREST_TREES) {
+            return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"Invalid 'trees' query parameter\"}");
+        }
+        trees = (size_t)value;
+    }
+
+    size_t indexed = sharded_db_build_forest(db, trees);
+    if (indexed == (size_t)-1) {
+        return admin_handler_error(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\": \"Failed to build the KD-forest\"}");
+    }
+
+    cJSON* json_response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json_response, "indexed", indexed);
+    cJSON_AddNumberToObject(json_response, "trees", trees > 0 ? trees : KD_FOREST_DEFAULT_TREES);
+    char* response_str = cJSON_PrintUnformatted(json_response);
+    cJSON_Delete(json_response);
+
+    struct MHD_Response* response = MHD_create_response_from_buffer(strlen(response_str),
+                                                                    (void*)response_str, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret == MHD_YES ? MHD_YES : MHD_NO;
+}
+
+/**
+ * @brief Build the HNSW graph and report the result.
+ * 
+ * The optional 'm', 'ef_construction' and 'metric' (l2, cosine or ip) query parameters shape the
+ * graph of every shard.
+ *
+ * @param db Pointer to the vector database.
+ * @param connection Pointer to MHD_Connection object.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result admin_build_hnsw(ShardedDatabase* db, struct MHD_Connection* connection) {
+    size_t m = 0;
+    const char* m_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "m");
+    if (m_str) {
+        int value = atoi(m_str);
+        if (value < 2 || value > HNSW_MAX_M) {
+            return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"Invalid 'm' query parameter\"}");
+        }
+        m = (size_t)value;
+    }
+    size_t ef_construction = 0;
+    const char* ef_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "ef_construction");
+    if (ef_str) {
+        int value = atoi(ef_str);
+        if (value <= 0 || value > ADMIN_MAX_EF_CONSTRUCTION) {
+            return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST,
+                                       "{\"error\": \"Invalid 'ef_construction' query parameter\"}");
+        }
+        ef_construction = (size_t)value;
+    }
+    HNSWMetric metric = HNSW_METRIC_L2;
+    const char* metric_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "metric");
+    if (metric_str && hnsw_metric_parse(metric_str, &metric) != 0) {
+        return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST,
+                                   "{\"error\": \"Unknown metric, expected l2, cosine or ip\"}");
+    }
+
+    size_t indexed = sharded_db_build_hnsw(db, m, ef_construction, metric);
+    if (indexed == (size_t)-1) {
+        return admin_handler_error(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\": \"Failed to build the HNSW graph\"}");
+    }
+
+    cJSON* json_response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json_response, "indexed", indexed);
+    cJSON_AddNumberToObject(json_response, "m", m > 0 ? m : HNSW_DEFAULT_M);
+    cJSON_AddNumberToObject(json_response, "ef_construction", ef_construction > 0 ? ef_construction : HNSW_DEFAULT_EF_CONSTRUCTION);
+    cJSON_AddStringToObject(json_response, "metric", hnsw_metric_name(metric));
+    char* response_str = cJSON_PrintUnformatted(json_response);
+    cJSON_Delete(json_response);
+
+    struct MHD_Response* response = MHD_create_response_from_buffer(strlen(response_str),
+                                                                    (void*)response_str, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret == MHD_YES ? MHD_YES : MHD_NO;
+}
+
+/**
+ * @brief Build the inverted file index and report the result.
+ * 
+ * The optional 'lists' query parameter sets the number of lists per shard; without it every
+ * shard gets the square root of its number of vectors.
+ *
+ * @param db Pointer to the vector database.
+ * @param connection Pointer to MHD_Connection object.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result admin_build_ivf(ShardedDatabase* db, struct MHD_Connection* connection) {
+    size_t lists = 0;
+    const char* lists_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "lists");
+    if (lists_str) {
+        int value = atoi(lists_str);
+        if (value <= 0 || value > IVF_MAX_LISTS) {
+            return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"Invalid 'lists' query parameter\"}");
+        }
+        lists = (size_t)value;
+    }
+
+    size_t indexed = sharded_db_build_ivf(db, lists);
+    if (indexed == (size_t)-1) {
+        return admin_handler_error(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\": \"Failed to build the IVF index\"}");
+    }
+
+    cJSON* json_response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json_response, "indexed", indexed);
+    if (lists > 0) {
+        cJSON_AddNumberToObject(json_response, "lists", lists);
+    }
+    char* response_str = cJSON_PrintUnformatted(json_response);
+    cJSON_Delete(json_response);
+
+    struct MHD_Response* response = MHD_create_response_from_buffer(strlen(response_str),
+                                                                    (void*)response_str, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret == MHD_YES ? MHD_YES : MHD_NO;
+}
+
+/**
+ * @brief Build the on-disk Vamana graph and report the result.
+ * 
+ * The optional 'degree' and 'build_list' query parameters shape the graph of every shard. Each
+ * graph is written next to the database file of its shard.
+ *
+ * @param db Pointer to the vector database.
+ * @param connection Pointer to MHD_Connection object.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result admin_build_diskann(ShardedDatabase* db, struct MHD_Connection* connection) {
+    size_t degree = 0;
+    const char* degree_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "degree");
+    if (degree_str) {
+        int value = atoi(degree_str);
+        if (value < 2 || value > DISKANN_MAX_DEGREE) {
+            return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"Invalid 'degree' query parameter\"}");
+        }
+        degree = (size_t)value;
+    }
+    size_t build_list = 0;
+    const char* build_list_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "build_list");
+    if (build_list_str) {
+        int value = atoi(build_list_str);
+        if (value <= 0 || value > ADMIN_MAX_BUILD_LIST) {
+            return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST,
+                                       "{\"error\": \"Invalid 'build_list' query parameter\"}");
+        }
+        build_list = (size_t)value;
+    }
+
+    size_t indexed = sharded_db_build_diskann(db, degree, build_list);
+    if (indexed == (size_t)-1) {
+        return admin_handler_error(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\": \"Failed to build the Vamana graph\"}");
+    }
+
+    degree = degree > 0 ? degree : DISKANN_DEFAULT_DEGREE;
+    build_list = build_list > 0 ? build_list : DISKANN_DEFAULT_BUILD_LIST;
+    cJSON* json_response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json_response, "indexed", indexed);
+    cJSON_AddNumberToObject(json_response, "degree", degree);
+    cJSON_AddNumberToObject(json_response, "build_list", build_list > degree ? build_list : degree);
+    char* response_str = cJSON_PrintUnformatted(json_response);
+    cJSON_Delete(json_response);
+
+    struct MHD_Response* response = MHD_create_response_from_buffer(strlen(response_str),
+                                                                    (void*)response_str, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret == MHD_YES ? MHD_YES : MHD_NO;
+}
+
+/**
+ * @brief Read an optional positive query parameter.
+ *
+ * @param connection Pointer to MHD_Connection object.
+ * @param name Name of the query parameter.
+ * @param max Largest value accepted.
+ * @param value Set to the parameter, left unchanged if it is absent.
+ * @return int 0 if the parameter is absent or valid, -1 otherwise.
+ */
+static int admin_size_param(struct MHD_Connection* connection, const char* name, int max, size_t* value) {
+    const char* str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, name);
+    if (!str) {
+        return 0;
+    }
+    int parsed = atoi(str);
+    if (parsed < 1 || parsed > max) {
+        return -1;
+    }
+    *value = (size_t)parsed;
+    return 0;
+}
+
+/**
+ * @brief Measure the recall of a search method against the exact flat scan and report it.
+ * 
+ * The 'method', 'k' and 'queries' query parameters choose what is measured; 'candidates',
+ * 'max_checks', 'ef_search', 'nprobe', 'search_list' and 'beam_width' tune the method as they
+ * do on /nearest.
+ *
+ * @param db Pointer to the vector database.
+ * @param connection Pointer to MHD_Connection object.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result admin_measure_recall(ShardedDatabase* db, struct MHD_Connection* connection) {
+    VectorDBSearchMethod search_method = db->search_method;
+    const char* method_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "method");
+    if (method_str && vector_db_search_method_parse(method_str, &search_method) != 0) {
+        return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST,
+                                   "{\"error\": \"Unknown search method, expected kdtree, quantized, pq, forest, hnsw, ivf, diskann or flat\"}");
+    }
+    size_t k = ADMIN_DEFAULT_RECALL_K;
+    if (admin_size_param(connection, "k", ADMIN_MAX_RECALL_K, &k) != 0) {
+        return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"Invalid 'k' query parameter\"}");
+    }
+    size_t queries = ADMIN_DEFAULT_RECALL_QUERIES;
+    if (admin_size_param(connection, "queries", ADMIN_MAX_RECALL_QUERIES, &queries) != 0) {
+        return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"Invalid 'queries' query parameter\"}");
+    }
+    VectorDBSearchParams params;
+    memset(&params, 0, sizeof(params));
+    if (admin_size_param(connection, "candidates", ADMIN_MAX_CANDIDATES, &params.candidates) != 0 ||
+        admin_size_param(connection, "max_checks", ADMIN_MAX_CHECKS, &params.max_checks) != 0 ||
+        admin_size_param(connection, "ef_search", ADMIN_MAX_EF_SEARCH, &params.ef_search) != 0 ||
+        admin_size_param(connection, "nprobe", IVF_MAX_LISTS, &params.nprobe) != 0 ||
+        admin_size_param(connection, "search_list", ADMIN_MAX_SEARCH_LIST, &params.search_list) != 0 ||
+        admin_size_param(connection, "beam_width", DISKANN_MAX_BEAM_WIDTH, &params.beam_width) != 0) {
+        return admin_handler_error(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"Invalid search query parameter\"}");
+    }
+
+    double recall = 0.0;
+    size_t measured = sharded_db_measure_recall(db, search_method, k, queries, &params, &recall);
+    if (measured == (size_t)-1) {
+        return admin_handler_error(connection, MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                   "{\"error\": \"Failed to search, the index may not be built\"}");
+    }
+
+    cJSON* json_response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json_response, "queries", measured);
+    cJSON_AddNumberToObject(json_response, "k", k);
+    cJSON_AddNumberToObject(json_response, "recall", recall);
+    cJSON_AddStringToObject(json_response, "isa", flat_scan_isa_name(flat_scan_isa()));
+    char* response_str = cJSON_PrintUnformatted(json_response);
+    cJSON_Delete(json_response);
+
+    struct MHD_Response* response = MHD_create_response_from_buffer(strlen(response_str),
+                                                                    (void*)response_str, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret == MHD_YES ? MHD_YES : MHD_NO;
+}
+
+/**
+ * @brief Function to handle administrative requests.
+ * 
+ * @param cls User-defined data, in this case, the handler data.
+ * @param connection Pointer to MHD_Connection object.
+ * @param url URL of the request.
+ * @param method HTTP method (should be "POST").
+ * @param version HTTP version.
+ * @param upload_data Data being uploaded in the request (ignored).
+ * @param upload_data_size Size of the upload data.
+ * @param con_cls Connection-specific data.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+enum MHD_Result admin_handler(void* cls, struct MHD_Connection* connection,
+                              const char* url, const char* method,
+                              const char* version, const char* upload_data,
+                              size_t* upload_data_size, void** con_cls) {
+    // Initialize connection data if it's the first call for this connection
+    if (*con_cls == NULL) {
+        ConnectionData *con_data = (ConnectionData *)malloc(sizeof(ConnectionData));
+        if (con_data == NULL) {
+            return MHD_NO;
+        }
+        con_data->data = NULL;
+        con_data->data_size = 0;
+        *con_cls = (void *)con_data;
+        return MHD_YES;
+    }
+
+    // The request body is not used, skip it
+    if (*upload_data_size != 0) {
+        *upload_data_size = 0;
+        return MHD_YES;
+    }
+
+    AdminHandlerData* handler_data = (AdminHandlerData*)cls;
+    if (strcmp(url, "/admin/pq/train") == 0) {
+        return admin_train_pq(handler_data->db, connection);
+    } else if (strcmp(url, "/admin/kdtree/rebuild") == 0) {
+        return admin_rebuild_kdtree(handler_data->db, connection);
+    } else if (strcmp(url, "/admin/forest/build") == 0) {
+        return admin_build_forest(handler_data->db, connection);
+    } else if (strcmp(url, "/admin/hnsw/build") == 0) {
+        return admin_build_hnsw(handler_data->db, connection);
+    } else if (strcmp(url, "/admin/ivf/build") == 0) {
+        return admin_build_ivf(handler_data->db, connection);
+    } else if (strcmp(url, "/admin/diskann/build") == 0) {
+        return admin_build_diskann(handler_data->db, connection);
+    } else if (strcmp(url, "/admin/recall") == 0) {
+        return admin_measure_recall(handler_data->db, connection);
+    }
+    return admin_handler_error(connection, MHD_HTTP_NOT_FOUND, "{\"error\": \"Unknown admin operation\"}");
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../include/compactor.h"
+#include "../include/vector_database.h"
+
+/**
+ * @brief Compactor thread body.
+ * 
+ * Runs one bounded compaction step at a time, releasing the database lock between steps so
+ * that readers and writers interleave with compaction. Every pass also evicts cold vectors from
+ * the full hot set of a tiered database in the same bounded steps, since writes fault vectors in
+ * regardless of the hot set size. Once there is nothing to reclaim or evict, splits oversized
+ * IVF lists one at a time, then sleeps.
+ *
+ * @param arg Pointer to the Compactor.
+ * @return Always NULL.
+ */
+static void* compactor_run(void* arg) {
+    Compactor* compactor = (Compactor*)arg;
+
+    pthread_mutex_lock(&compactor->lock);
+    while (compactor->running) {
+        pthread_mutex_unlock(&compactor->lock);
+        size_t reclaimed = vector_db_compact_step(compactor->db, compactor->batch_size);
+        size_t demoted = vector_db_demote(compactor->db, compactor->batch_size);
+        size_t split = reclaimed > 0 || demoted > 0 ? 0 : vector_db_rebalance_ivf(compactor->db, 1);
+        pthread_mutex_lock(&compactor->lock);
+
+        if (reclaimed > 0 || demoted > 0 || split > 0) {
+            if (reclaimed > 0) {
+                printf("Compactor reclaimed %zu slots\n", reclaimed);
+            }
+            if (demoted > 0) {
+                printf("Compactor demoted %zu vectors to the cold tier\n", demoted);
+            }
+            if (split > 0) {
+                printf("Compactor split %zu oversized IVF lists\n", split);
+            }
+            pthread_mutex_unlock(&compactor->lock);
+            sched_yield();
+            pthread_mutex_lock(&compactor->lock);
+            continue;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += compactor->interval_ms / 1000;
+        deadline.tv_nsec += (long)(compactor->interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (compactor->running) {
+            pthread_cond_timedwait(&compactor->wakeup, &compactor->lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&compactor->lock);
+    return NULL;
+}
+
+/**
+ * @brief Start the background compactor.
+ * 
+ * @param db Database to compact.
+ * @param batch_size Maximum number of vectors moved each time the database lock is taken.
+ * @param interval_ms Idle sleep between passes, in milliseconds.
+ * @return Compactor* Pointer to the running compactor, or NULL on failure.
+ */
+Compactor* compactor_start(VectorDatabase* db, size_t batch_size, unsigned int interval_ms) {
+    Compactor* compactor = (Compactor*)malloc(sizeof(Compactor));
+    if (!compactor) {
+        fprintf(stderr, "Failed to allocate memory for compactor\n");
+        return NULL;
+    }
+    compactor->db = db;
+    compactor->batch_size = batch_size > 0 ? batch_size : 1;
+    compactor->interval_ms = interval_ms;
+    compactor->running = 1;
+    pthread_mutex_init(&compactor->lock, NULL);
+    pthread_cond_init(&compactor->wakeup, NULL);
+
+    if (pthread_create(&compactor->thread, NULL, compactor_run, compactor) != 0) {
+        fprintf(stderr, "Failed to start compactor thread\n");
+        pthread_cond_destroy(&compactor->wakeup);
+        pthread_mutex_destroy(&compactor->lock);
+        free(compactor);
+        return NULL;
+    }
+    return compactor;
+}
+
+/**
+ * @brief Stop the compactor thread and free it.
+ * 
+ * @param compactor Compactor to stop.
+ */
+void compactor_stop(Compactor* compactor) {
+    if (compactor) {
+        pthread_mutex_lock(&compactor->lock);
+        compactor->running = 0;
+        pthread_cond_signal(&compactor->wakeup);
+        pthread_mutex_unlock(&compactor->lock);
+        pthread_join(compactor->thread, NULL);
+        pthread_cond_destroy(&compactor->wakeup);
+        pthread_mutex_destroy(&compactor->lock);
+        free(compactor);
+    }
+}
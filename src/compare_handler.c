@@ -7,14 +7,23 @@
 
 #include "../include/compare_handler.h"
 #include "../include/vector_database.h"
+#include "../include/sharded_db.h"
 #include "../include/connection_data.h"
 
+#define NEAREST_MAX_K 1000 // Largest number of neighbors a /nearest request may ask for
+#define NEAREST_MAX_CANDIDATES 100000 // Largest KD-Tree candidate pool a /nearest request may ask for
+#define NEAREST_MAX_CHECKS 10000000 // Largest KD-forest comparison budget a /nearest request may ask for
+#define NEAREST_MAX_EF_SEARCH 100000 // Largest HNSW beam width a /nearest request may ask for
+#define NEAREST_MAX_NPROBE IVF_MAX_LISTS // Largest number of IVF lists a /nearest request may ask to scan
+#define NEAREST_MAX_SEARCH_LIST 100000 // Largest Vamana candidate list a /nearest request may ask for
+#define RANGE_STREAM_BLOCK 16384 // Bytes of a /range response handed to the HTTP library at a time
+
 /**
  * @struct PostHandlerData
  * @brief Structure to hold data for the POST handler
  */
 typedef struct {
-    VectorDatabase* db;
+    ShardedDatabase* db;
     size_t db_vector_size;
 } PostHandlerData;
 
@@ -76,16 +85,18 @@ static enum MHD_Result compare_handler_callback(void* cls, struct MHD_Connection
                                                 const char* version, const char* upload_data,
                                                 size_t* upload_data_size, void** con_cls) {
     PostHandlerData* handler_data = (PostHandlerData*)cls;
-    VectorDatabase* db = handler_data->db;
+    ShardedDatabase* db = handler_data->db;
     size_t expected_vector_size = handler_data->db_vector_size;
 
-    // Retrieve 'index1' and 'index2' query parameters
+    // Retrieve 'index1' and 'index2' (or 'uuid1' and 'uuid2') query parameters
     const char* index1_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "index1");
     const char* index2_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "index2");
+    const char* uuid1_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "uuid1");
+    const char* uuid2_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "uuid2");
 
-    if (!index1_str || !index2_str) {
-        // Respond with an error if 'index1' or 'index2' is missing
-        const char* error_msg = "{\"error\": \"Missing 'index1' or 'index2' query parameter\"}";
+    if ((!index1_str || !index2_str) && (!uuid1_str || !uuid2_str)) {
+        // Respond with an error if neither pair is complete
+        const char* error_msg = "{\"error\": \"Missing 'index1'/'index2' or 'uuid1'/'uuid2' query parameters\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
         MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
@@ -94,27 +105,38 @@ static enum MHD_Result compare_handler_callback(void* cls, struct MHD_Connection
         return ret == MHD_YES ? MHD_YES : MHD_NO;
     }
 
-    // Convert 'index1' and 'index2' to size_t values
-    size_t index1 = atoi(index1_str);
-    size_t index2 = atoi(index2_str);
-
-    if (index1 >= db->size || index2 >= db->size) {
-        // Respond with an error if the indices are out of bounds
-        const char* error_msg = "{\"error\": \"Index out of bounds\"}";
-        struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
-                                                                        (void*)error_msg, MHD_RESPMEM_PERSISTENT);
-        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
-        int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
-        MHD_destroy_response(response);
-        return ret == MHD_YES ? MHD_YES : MHD_NO;
+    size_t index1 = 0;
+    size_t index2 = 0;
+    if (index1_str && index2_str) {
+        // Convert 'index1' and 'index2' to size_t values
+        index1 = atoi(index1_str);
+        index2 = atoi(index2_str);
+
+        size_t index_bound = sharded_db_index_bound(db);
+        if (index1 >= index_bound || index2 >= index_bound) {
+            // Respond with an error if the indices are out of bounds
+            const char* error_msg = "{\"error\": \"Index out of bounds\"}";
+            struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
+                                                                            (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+            int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
+            MHD_destroy_response(response);
+            return ret == MHD_YES ? MHD_YES : MHD_NO;
+        }
+    } else {
+        // Resolve 'uuid1' and 'uuid2' through the hash index; unknown UUIDs fall through to "Vector not found"
+        index1 = sharded_db_find_index(db, uuid1_str);
+        index2 = sharded_db_find_index(db, uuid2_str);
     }
 
-    // Retrieve the vectors from the database
-    Vector* vec1 = vector_db_read(db, index1);
-    Vector* vec2 = vector_db_read(db, index2);
+    // Copy the vectors out of the database, so that concurrent writes cannot change them
+    Vector* vec1 = sharded_db_get(db, index1);
+    Vector* vec2 = sharded_db_get(db, index2);
 
     if (!vec1 || !vec2) {
         // Respond with an error if one of the vectors is not found
+        vector_db_release(vec1);
+        vector_db_release(vec2);
         const char* error_msg = "{\"error\": \"Vector not found\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
@@ -126,6 +148,8 @@ static enum MHD_Result compare_handler_callback(void* cls, struct MHD_Connection
 
     if (vec1->dimension != vec2->dimension) {
         // Respond with an error if the vectors have different dimensions
+        vector_db_release(vec1);
+        vector_db_release(vec2);
         const char* error_msg = "{\"error\": \"Vectors have different dimensions\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
@@ -137,6 +161,8 @@ static enum MHD_Result compare_handler_callback(void* cls, struct MHD_Connection
 
     // Check if the vectors match the expected size
     if (vec1->dimension != expected_vector_size || vec2->dimension != expected_vector_size) {
+        vector_db_release(vec1);
+        vector_db_release(vec2);
         const char* error_msg = "{\"error\": \"Vector size mismatch\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
@@ -158,7 +184,10 @@ static enum MHD_Result compare_handler_callback(void* cls, struct MHD_Connection
     } else if (strcmp(url, "/compare/dot_product") == 0) {
         result = dot_product(*vec1, *vec2);
         key = "dot_product";
-    } else {
+    }
+    vector_db_release(vec1);
+    vector_db_release(vec2);
+    if (!key) {
         // Respond with an error if the comparison method is unknown
         const char* error_msg = "{\"error\": \"Unknown comparison method\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
@@ -213,7 +242,7 @@ static enum MHD_Result nearest_handler_callback(void* cls, struct MHD_Connection
                                                 size_t* upload_data_size, void** con_cls);
 
 /**
- * @brief Function to handle nearest neighbor requests.
+ * @brief Function to handle nearest neighbor and range requests.
  * 
  * @param cls User-defined data, in this case, the handler data.
  * @param connection Pointer to MHD_Connection object.
@@ -247,6 +276,282 @@ enum MHD_Result nearest_handler(void* cls, struct MHD_Connection* connection,
                                     upload_data, upload_data_size, con_cls);
 }
 
+/**
+ * @brief Add the index, components, uuid and distance of a vector to a JSON object.
+ * 
+ * @param object JSON object to fill.
+ * @param index Global index of the vector.
+ * @param vec Copy of the vector.
+ * @param distance Distance of the vector to the query.
+ */
+static void nearest_add_vector(cJSON* object, size_t index, const Vector* vec, double distance) {
+    cJSON* vector_array = cJSON_CreateArray();
+    for (size_t i = 0; i < vec->dimension; ++i) {
+        cJSON_AddItemToArray(vector_array, cJSON_CreateNumber(vector_element_get(vec->type, vec->data, i)));
+    }
+    cJSON_AddNumberToObject(object, "index", index);
+    cJSON_AddItemToObject(object, "vector", vector_array);
+    cJSON_AddStringToObject(object, "uuid", vec->uuid);
+    cJSON_AddNumberToObject(object, "distance", distance);
+}
+
+/**
+ * @brief Copy a search result out of the database by the UUID captured during the search.
+ * 
+ * The lookup is retried once if the compactor moved the vector between finding its index and
+ * copying it, so the index and the copy always belong together.
+ *
+ * @param db Pointer to the vector database.
+ * @param uuid UUID of the result.
+ * @param index Set to the global index of the copy.
+ * @return Vector* Copy to release with vector_db_release, or NULL if the vector was deleted.
+ */
+static Vector* nearest_resolve(ShardedDatabase* db, const char* uuid, size_t* index) {
+    *index = sharded_db_find_index(db, uuid);
+    Vector* vec = *index == (size_t)-1 ? NULL : sharded_db_get(db, *index);
+    if (vec && strcmp(vec->uuid, uuid) != 0) {
+        vector_db_release(vec); // Moved by the compactor between the lookup and the copy
+        *index = sharded_db_find_index(db, uuid);
+        vec = *index == (size_t)-1 ? NULL : sharded_db_get(db, *index);
+    }
+    if (vec && strcmp(vec->uuid, uuid) != 0) {
+        vector_db_release(vec);
+        vec = NULL;
+    }
+    return vec;
+}
+
+/**
+ * @brief Add the index, components, uuid and distance of a search result to a JSON object.
+ * 
+ * The result is read again by the UUID the search captured, and its distance recomputed from
+ * the components read now, so a vector moved or updated since the search is reported as it is.
+ *
+ * @param db Pointer to the vector database.
+ * @param object JSON object to fill.
+ * @param method Search method that found the result.
+ * @param query Query vector.
+ * @param uuid UUID of the result.
+ * @return int 0 on success, -1 if the vector no longer exists.
+ */
+static int nearest_add_result(ShardedDatabase* db, cJSON* object, VectorDBSearchMethod method,
+                              const double* query, const char* uuid) {
+    size_t index;
+    Vector* nearest_vector = nearest_resolve(db, uuid, &index);
+    if (!nearest_vector) {
+        return -1;
+    }
+    nearest_add_vector(object, index, nearest_vector, sharded_db_distance(db, method, query, nearest_vector));
+    vector_db_release(nearest_vector);
+    return 0;
+}
+
+/**
+ * @struct RangeStream
+ * @brief Results of a /range request, serialized one at a time as the response is sent.
+ *
+ * Only the UUIDs of the results are kept: by the time a result is sent, the compactor may have
+ * moved it to another index and an update may have changed its components.
+ */
+typedef struct RangeStream {
+    ShardedDatabase* db; /**< Database the results come from */
+    double* query;       /**< Copy of the query vector */
+    double radius;       /**< Largest Euclidean distance */
+    char* uuids;         /**< UUIDs of the results, nearest first, UUID_SIZE bytes each */
+    size_t count;        /**< Number of results */
+    size_t next;         /**< Next result to serialize; count once the closing text is queued */
+    size_t emitted;      /**< Number of results written */
+    int finished;        /**< Set once the closing text is queued */
+    char* pending;       /**< Serialized text not sent yet */
+    size_t pending_size; /**< Length of pending */
+    size_t pending_sent; /**< Bytes of pending already sent */
+} RangeStream;
+
+/**
+ * @brief Euclidean distance between the query of a /range request and a vector.
+ * 
+ * @param stream Stream holding the query.
+ * @param vec Vector of the database vector size.
+ * @return double The distance.
+ */
+static double range_stream_distance(const RangeStream* stream, const Vector* vec) {
+    double sum = 0.0;
+    for (size_t i = 0; i < vec->dimension; ++i) {
+        double diff = vector_element_get(vec->type, vec->data, i) - stream->query[i];
+        sum += diff * diff;
+    }
+    return sqrt(sum);
+}
+
+/**
+ * @brief Queue the next piece of a /range response.
+ * 
+ * Each result is looked up again by its UUID and its distance recomputed from the components
+ * read now, so the index, components, UUID and distance sent always belong together. Results
+ * deleted or moved beyond the radius since the search are skipped.
+ *
+ * @param stream Stream to advance; pending must be empty.
+ * @return int 1 if text was queued, 0 at the end of the response, -1 on allocation failure.
+ */
+static int range_stream_next(RangeStream* stream) {
+    while (stream->next < stream->count) {
+        size_t i = stream->next++;
+        size_t index;
+        Vector* vec = nearest_resolve(stream->db, stream->uuids + i * UUID_SIZE, &index);
+        double distance = vec ? range_stream_distance(stream, vec) : INFINITY;
+        if (!vec || !(distance <= stream->radius)) {
+            vector_db_release(vec); // Deleted or moved away since the search
+            continue;
+        }
+        cJSON* result = cJSON_CreateObject();
+        nearest_add_vector(result, index, vec, distance);
+        vector_db_release(vec);
+        char* text = cJSON_PrintUnformatted(result);
+        cJSON_Delete(result);
+        if (!text) {
+            return -1;
+        }
+        size_t length = strlen(text) + 2;
+        stream->pending = (char*)malloc(length);
+        if (stream->pending) {
+            snprintf(stream->pending, length, "%s%s", stream->emitted > 0 ? "," : "", text);
+            stream->pending_size = strlen(stream->pending);
+        }
+        free(text);
+        stream->emitted++;
+        return stream->pending ? 1 : -1;
+    }
+    if (stream->finished) {
+        return 0;
+    }
+    stream->finished = 1;
+    stream->pending = strdup("]}");
+    stream->pending_size = 2;
+    return stream->pending ? 1 : -1;
+}
+
+/**
+ * @brief Content reader of a /range response.
+ * 
+ * @param cls Pointer to the RangeStream.
+ * @param pos Offset of the requested bytes in the response.
+ * @param buf Buffer to fill.
+ * @param max Size of the buffer.
+ * @return ssize_t Number of bytes written, or an MHD_CONTENT_READER_END_* code.
+ */
+static ssize_t range_stream_read(void* cls, uint64_t pos, char* buf, size_t max) {
+    RangeStream* stream = (RangeStream*)cls;
+    (void)pos;
+    while (stream->pending_sent == stream->pending_size) {
+        free(stream->pending);
+        stream->pending = NULL;
+        stream->pending_size = 0;
+        stream->pending_sent = 0;
+        int status = range_stream_next(stream);
+        if (status == 0) {
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        } else if (status < 0) {
+            return MHD_CONTENT_READER_END_WITH_ERROR;
+        }
+    }
+    size_t length = stream->pending_size - stream->pending_sent;
+    if (length > max) {
+        length = max;
+    }
+    memcpy(buf, stream->pending + stream->pending_sent, length);
+    stream->pending_sent += length;
+    return (ssize_t)length;
+}
+
+/**
+ * @brief Free a /range response stream once the response is done.
+ * 
+ * @param cls Pointer to the RangeStream.
+ */
+static void range_stream_free(void* cls) {
+    RangeStream* stream = (RangeStream*)cls;
+    free(stream->pending);
+    free(stream->query);
+    free(stream->uuids);
+    free(stream);
+}
+
+/**
+ * @brief Answer a /range request with every vector within 'radius' of the query, nearest first.
+ * 
+ * The optional 'limit' query parameter keeps only the nearest vectors. The results are
+ * serialized as the response is sent, so large result sets are never held as one document.
+ *
+ * @param db Pointer to the vector database.
+ * @param connection Pointer to MHD_Connection object.
+ * @param components Query vector.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result range_respond(ShardedDatabase* db, struct MHD_Connection* connection, const double* components) {
+    const char* radius_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "radius");
+    const char* limit_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "limit");
+    double radius = radius_str ? strtod(radius_str, NULL) : -1.0;
+    int limit = limit_str ? atoi(limit_str) : 0;
+    const char* error_msg = NULL;
+    unsigned int status = MHD_HTTP_BAD_REQUEST;
+    if (!(radius >= 0.0) || isinf(radius)) {
+        error_msg = "{\"error\": \"Missing or invalid 'radius' query parameter\"}";
+    } else if (limit_str && limit <= 0) {
+        error_msg = "{\"error\": \"Invalid 'limit' query parameter\"}";
+    }
+
+    RangeStream* stream = NULL;
+    if (!error_msg) {
+        stream = (RangeStream*)calloc(1, sizeof(RangeStream));
+        if (stream) {
+            stream->db = db;
+            stream->radius = radius;
+            stream->query = (double*)malloc(db->vector_size * sizeof(double));
+            if (stream->query) {
+                size_t* indices = NULL;
+                double* distances = NULL;
+                memcpy(stream->query, components, db->vector_size * sizeof(double));
+                stream->count = sharded_db_range(db, components, radius, (size_t)limit, &indices, &distances, &stream->uuids);
+                free(indices);
+                free(distances);
+            }
+            stream->pending = strdup("{\"results\":[");
+            stream->pending_size = strlen("{\"results\":[");
+        }
+        if (!stream || !stream->query || stream->count == (size_t)-1 || !stream->pending) {
+            if (stream) {
+                stream->count = 0;
+                range_stream_free(stream);
+            }
+            stream = NULL;
+            error_msg = "{\"error\": \"Range search failed\"}";
+            status = MHD_HTTP_INTERNAL_SERVER_ERROR;
+        } else {
+            printf("Range search found %zu vectors within %f\n", stream->count, radius);
+        }
+    }
+
+    struct MHD_Response* response;
+    if (error_msg) {
+        response = MHD_create_response_from_buffer(strlen(error_msg), (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+    } else {
+        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, RANGE_STREAM_BLOCK, range_stream_read,
+                                                     stream, range_stream_free);
+        status = MHD_HTTP_OK;
+        if (!response) {
+            range_stream_free(stream);
+        }
+    }
+    if (!response) {
+        fprintf(stderr, "range_respond: Failed to create response\n");
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+    int ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret == MHD_YES ? MHD_YES : MHD_NO;
+}
+
 /**
  * @brief Callback function to handle nearest neighbor requests.
  * 
@@ -266,7 +571,7 @@ static enum MHD_Result nearest_handler_callback(void* cls, struct MHD_Connection
                                                 size_t* upload_data_size, void** con_cls) {
     ConnectionData *con_data = (ConnectionData *)*con_cls;
     PostHandlerData* handler_data = (PostHandlerData*)cls;
-    VectorDatabase* db = handler_data->db;
+    ShardedDatabase* db = handler_data->db;
     size_t expected_vector_size = handler_data->db_vector_size;
 
     // Check if there's data to be uploaded
@@ -342,9 +647,11 @@ static enum MHD_Result nearest_handler_callback(void* cls, struct MHD_Connection
 
     Vector vec;
     vec.dimension = dimension;
+    vec.type = VECTOR_ELEMENT_FLOAT64;
     // Allocate memory for the vector data
-    vec.data = (double*)malloc(dimension * sizeof(double));
-    if (!vec.data) {
+    double* components = (double*)malloc(dimension * sizeof(double));
+    vec.data = components;
+    if (!components) {
         // Respond with an error if memory allocation fails
         const char* error_msg = "{\"error\": \"Memory allocation failed\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
@@ -386,40 +693,119 @@ static enum MHD_Result nearest_handler_callback(void* cls, struct MHD_Connection
             return ret == MHD_YES ? MHD_YES : MHD_NO;
         }
         // Store the vector data
-        vec.data[i] = item->valuedouble;
+        components[i] = item->valuedouble;
     }
 
     // Debug: Print out the vector
     printf("Received vector for nearest neighbor search: [");
     for (size_t i = 0; i < dimension; ++i) {
-        printf("%f", vec.data[i]);
+        printf("%f", components[i]);
         if (i < dimension - 1) {
             printf(", ");
         }
     }
     printf("]\n");
+    cJSON_Delete(json);
+
+    // Radius searches stream their results instead of building one JSON document
+    if (strcmp(url, "/range") == 0) {
+        enum MHD_Result result = range_respond(db, connection, components);
+        free(vec.data);
+        free(con_data->data);
+        free(con_data);
+        *con_cls = NULL;
+        return result;
+    }
 
-    // Use KD-Tree to find the nearest neighbor
-    size_t nearest_index = kdtree_nearest(db->kdtree, vec.data);
+    // Find the k nearest neighbors with the requested method, the KD-Tree by default
+    VectorDBSearchMethod search_method = db->search_method;
+    const char* method_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "method");
+    int method_valid = !method_str || vector_db_search_method_parse(method_str, &search_method) == 0;
+    const char* k_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "k");
+    int k_value = k_str ? atoi(k_str) : 1;
+    int k_valid = k_value >= 1 && k_value <= NEAREST_MAX_K;
+    size_t k = k_valid ? (size_t)k_value : 1;
+    const char* candidates_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "candidates");
+    int candidates_value = candidates_str ? atoi(candidates_str) : 0;
+    int candidates_valid = !candidates_str || (candidates_value >= 1 && candidates_value <= NEAREST_MAX_CANDIDATES);
+    const char* max_checks_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "max_checks");
+    int max_checks_value = max_checks_str ? atoi(max_checks_str) : 0;
+    int max_checks_valid = !max_checks_str || (max_checks_value >= 1 && max_checks_value <= NEAREST_MAX_CHECKS);
+    const char* ef_search_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "ef_search");
+    int ef_search_value = ef_search_str ? atoi(ef_search_str) : 0;
+    int ef_search_valid = !ef_search_str || (ef_search_value >= 1 && ef_search_value <= NEAREST_MAX_EF_SEARCH);
+    const char* nprobe_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "nprobe");
+    int nprobe_value = nprobe_str ? atoi(nprobe_str) : 0;
+    int nprobe_valid = !nprobe_str || (nprobe_value >= 1 && nprobe_value <= NEAREST_MAX_NPROBE);
+    const char* search_list_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "search_list");
+    int search_list_value = search_list_str ? atoi(search_list_str) : 0;
+    int search_list_valid = !search_list_str || (search_list_value >= 1 && search_list_value <= NEAREST_MAX_SEARCH_LIST);
+    const char* beam_width_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "beam_width");
+    int beam_width_value = beam_width_str ? atoi(beam_width_str) : 0;
+    int beam_width_valid = !beam_width_str || (beam_width_value >= 1 && beam_width_value <= DISKANN_MAX_BEAM_WIDTH);
+    VectorDBSearchParams params;
+    params.candidates = (size_t)candidates_value;
+    params.max_checks = (size_t)max_checks_value;
+    params.ef_search = (size_t)ef_search_value;
+    params.nprobe = (size_t)nprobe_value;
+    params.search_list = (size_t)search_list_value;
+    params.beam_width = (size_t)beam_width_value;
+    size_t* nearest_indices = (size_t*)malloc(k * sizeof(size_t));
+    double* nearest_distances = (double*)malloc(k * sizeof(double));
+    char* nearest_uuids = (char*)malloc(k * UUID_SIZE);
+    size_t found = 0;
+    if (!nearest_indices || !nearest_distances || !nearest_uuids) {
+        found = (size_t)-1;
+    } else if (method_valid && k_valid && candidates_valid && max_checks_valid && ef_search_valid && nprobe_valid &&
+               search_list_valid && beam_width_valid) {
+        found = sharded_db_nearest(db, search_method, components, k, &params, nearest_indices, nearest_distances,
+                                   nearest_uuids);
+    }
 
-    // Debug: Print the nearest index
-    printf("Nearest neighbor index: %zu\n", nearest_index);
+    // Debug: Print the number of neighbors found
+    printf("Nearest neighbors found: %zu\n", found);
 
-    // Create the JSON response
+    // Create the JSON response: one object without 'k', a list of results nearest first with it
     cJSON* json_response = cJSON_CreateObject();
-    if (nearest_index != (size_t)-1) {
-        Vector* nearest_vector = vector_db_read(db, nearest_index);
-        if (nearest_vector) {
-            cJSON* vector_array = cJSON_CreateDoubleArray(nearest_vector->data, nearest_vector->dimension);
-            cJSON_AddNumberToObject(json_response, "index", nearest_index);
-            cJSON_AddItemToObject(json_response, "vector", vector_array);
-            cJSON_AddStringToObject(json_response, "uuid", nearest_vector->uuid);
-        } else {
+    if (!method_valid) {
+        cJSON_AddStringToObject(json_response, "error", "Unknown search method, expected kdtree, quantized, pq, forest, hnsw, ivf, diskann or flat");
+    } else if (!k_valid) {
+        cJSON_AddStringToObject(json_response, "error", "Invalid 'k' query parameter");
+    } else if (!candidates_valid) {
+        cJSON_AddStringToObject(json_response, "error", "Invalid 'candidates' query parameter");
+    } else if (!max_checks_valid) {
+        cJSON_AddStringToObject(json_response, "error", "Invalid 'max_checks' query parameter");
+    } else if (!ef_search_valid) {
+        cJSON_AddStringToObject(json_response, "error", "Invalid 'ef_search' query parameter");
+    } else if (!nprobe_valid) {
+        cJSON_AddStringToObject(json_response, "error", "Invalid 'nprobe' query parameter");
+    } else if (!search_list_valid) {
+        cJSON_AddStringToObject(json_response, "error", "Invalid 'search_list' query parameter");
+    } else if (!beam_width_valid) {
+        cJSON_AddStringToObject(json_response, "error", "Invalid 'beam_width' query parameter");
+    } else if (found == (size_t)-1) {
+        cJSON_AddStringToObject(json_response, "error", "Search method is not enabled or not trained");
+    } else if (k_str) {
+        cJSON* results = cJSON_CreateArray();
+        for (size_t i = 0; i < found; ++i) {
+            cJSON* result = cJSON_CreateObject();
+            if (nearest_add_result(db, result, search_method, components, nearest_uuids + i * UUID_SIZE) == 0) {
+                cJSON_AddItemToArray(results, result);
+            } else {
+                cJSON_Delete(result); // Deleted since the search
+            }
+        }
+        cJSON_AddItemToObject(json_response, "results", results);
+    } else if (found == 1) {
+        if (nearest_add_result(db, json_response, search_method, components, nearest_uuids) != 0) {
             cJSON_AddStringToObject(json_response, "error", "Nearest neighbor not found");
         }
     } else {
         cJSON_AddStringToObject(json_response, "error", "No nearest neighbor found");
     }
+    free(nearest_indices);
+    free(nearest_distances);
+    free(nearest_uuids);
 
     // Convert the JSON response to a string
     char* response_str = cJSON_PrintUnformatted(json_response);
@@ -0,0 +1,57 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../include/crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78u // Reflected Castagnoli polynomial
+
+static uint32_t crc32c_table[8][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Build the slicing-by-8 lookup tables.
+ */
+static void crc32c_init_tables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t prev = crc32c_table[t - 1][i];
+            crc32c_table[t][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xFF];
+        }
+    }
+}
+
+/**
+ * @brief Extend a CRC32C (Castagnoli) checksum with more data.
+ * 
+ * @param crc Checksum of the data seen so far (0 to start).
+ * @param data Data to add.
+ * @param length Number of bytes to add.
+ * @return uint32_t Updated checksum.
+ */
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t length) {
+    pthread_once(&crc32c_once, crc32c_init_tables);
+
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+    while (length >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^
+              crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
@@ -5,6 +5,7 @@
 #include <microhttpd.h>
 
 #include "../include/vector_database.h"
+#include "../include/sharded_db.h"
 #include "../include/delete_handler.h"
 
 /**
@@ -64,13 +65,14 @@ static enum MHD_Result delete_handler_callback(void* cls, struct MHD_Connection*
                                                const char* url, const char* method,
                                                const char* version, const char* upload_data,
                                                size_t* upload_data_size, void** con_cls) {
-    VectorDatabase* db = (VectorDatabase*)cls;
+    ShardedDatabase* db = (ShardedDatabase*)cls;
 
-    // Retrieve the 'index' query parameter
+    // Retrieve the 'index' or 'uuid' query parameter
     const char* index_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "index");
-    if (!index_str) {
-        // Respond with an error if 'index' is missing
-        const char* error_msg = "Missing 'index' query parameter";
+    const char* uuid_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "uuid");
+    if (!index_str && !uuid_str) {
+        // Respond with an error if both 'index' and 'uuid' are missing
+        const char* error_msg = "Missing 'index' or 'uuid' query parameter";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
         MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain");
@@ -79,21 +81,47 @@ static enum MHD_Result delete_handler_callback(void* cls, struct MHD_Connection*
         return ret == MHD_YES ? MHD_YES : MHD_NO;
     }
 
-    // Convert the 'index' query parameter to a size_t value
-    size_t index = atoi(index_str);
-    if (index >= db->size) {
-        // Respond with an error if the index is out of bounds
-        const char* error_msg = "Index out of bounds";
-        struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
-                                                                        (void*)error_msg, MHD_RESPMEM_PERSISTENT);
-        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain");
-        int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
-        MHD_destroy_response(response);
-        return ret == MHD_YES ? MHD_YES : MHD_NO;
+    size_t index = 0;
+    if (index_str) {
+        // Convert the 'index' query parameter to a size_t value
+        index = atoi(index_str);
+        if (index >= sharded_db_index_bound(db)) {
+            // Respond with an error if the index is out of bounds
+            const char* error_msg = "Index out of bounds";
+            struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
+                                                                            (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain");
+            int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
+            MHD_destroy_response(response);
+            return ret == MHD_YES ? MHD_YES : MHD_NO;
+        }
+
+        // Check if the vector at the index was deleted
+        if (!sharded_db_contains(db, index)) {
+            const char* error_msg = "Vector not found";
+            struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
+                                                                            (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain");
+            int ret = MHD_queue_response(connection, MHD_HTTP_NOT_FOUND, response);
+            MHD_destroy_response(response);
+            return ret == MHD_YES ? MHD_YES : MHD_NO;
+        }
+    } else {
+        // Resolve the 'uuid' query parameter through the hash index
+        index = sharded_db_find_index(db, uuid_str);
+        if (index == (size_t)-1) {
+            const char* error_msg = "Vector not found";
+            struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
+                                                                            (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain");
+            int ret = MHD_queue_response(connection, MHD_HTTP_NOT_FOUND, response);
+            MHD_destroy_response(response);
+            return ret == MHD_YES ? MHD_YES : MHD_NO;
+        }
     }
 
     // Delete the vector from the database
-    vector_db_delete(db, index);
+    sharded_db_delete(db, index);
 
     // Respond with an empty response to indicate success
     struct MHD_Response* response = MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
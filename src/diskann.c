@@ -0,0 +1,1523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../include/diskann.h"
+#include "../include/crc32c.h"
+
+#define DISKANN_BUILD_BATCH 64       // Nodes taken at a time by a build thread
+#define DISKANN_BUILD_SEQUENTIAL 1000 // Nodes linked on the caller's thread before the pool starts
+#define DISKANN_BUILD_SLACK 4        // A list may grow by degree / DISKANN_BUILD_SLACK back links before it is pruned
+#define DISKANN_LOCK_STRIPES 4096    // Mutexes guarding the neighbor lists during a build, shared by node number
+#define DISKANN_MIN_VISITED_BITS 8   // log2 of the initial size of the visited set of a search
+#define DISKANN_MIN_CAPACITY 1024    // Smallest number of entries of the index maps and the delta list
+#define DISKANN_FILE_WRITE_BUFFER (1 << 16) // Bytes buffered by the map file writer
+
+/**
+ * @struct DiskANNFileHeader
+ * @brief First sector of a graph file.
+ *
+ * Blocks of node records follow from offset DISKANN_SECTOR, then the PQ section at pq_offset:
+ * the codebooks (PQ_INDEX_CENTROIDS * dimension floats) and the code of every node. A node
+ * record is its neighbor count (uint32), `degree` neighbor numbers (uint32) and, from the next
+ * multiple of 8 bytes, the vector in element_type.
+ */
+typedef struct DiskANNFileHeader {
+    char magic[8];          /**< DISKANN_FILE_MAGIC */
+    uint32_t version;       /**< DISKANN_FILE_VERSION */
+    uint32_t element_type;  /**< VectorElementType of the vectors in the records */
+    uint64_t dimension;     /**< Number of components per vector */
+    uint64_t degree;        /**< Largest number of neighbors per node */
+    uint64_t build_list;    /**< Candidates kept while linking a node */
+    uint64_t node_count;    /**< Number of node records */
+    uint64_t entry;         /**< Node where searches start */
+    uint64_t id;            /**< Random identifier of the file */
+    uint64_t record_bytes;  /**< Bytes of one node record */
+    uint64_t block_nodes;   /**< Node records per block */
+    uint64_t block_bytes;   /**< Bytes per block, a multiple of DISKANN_SECTOR */
+    uint64_t pq_offset;     /**< Offset of the PQ section */
+    uint64_t pq_subspaces;  /**< Bytes per routing code */
+    uint32_t pq_crc;        /**< CRC32C of the PQ section */
+    uint32_t header_crc;    /**< CRC32C of this header with header_crc set to 0 */
+} DiskANNFileHeader;
+
+/**
+ * @struct DiskANNMapHeader
+ * @brief Header of a map file, followed by the dataset index of every node (uint32).
+ */
+typedef struct DiskANNMapHeader {
+    char magic[8];        /**< DISKANN_MAP_MAGIC */
+    uint32_t version;     /**< DISKANN_FILE_VERSION */
+    uint32_t body_crc;    /**< CRC32C of the indices */
+    uint64_t id;          /**< Identifier of the graph file */
+    uint64_t node_count;  /**< Number of indices */
+    uint64_t tag;         /**< Identifier of the dataset */
+} DiskANNMapHeader;
+
+/**
+ * @struct DiskANNMapWriter
+ * @brief Buffered writer over a raw file descriptor that checksums what it writes.
+ */
+typedef struct DiskANNMapWriter {
+    int fd;            /**< Destination file */
+    size_t used;       /**< Bytes pending in buffer */
+    int failed;        /**< Set once a write failed */
+    uint32_t crc;      /**< CRC32C of the bytes written */
+    char buffer[DISKANN_FILE_WRITE_BUFFER];
+} DiskANNMapWriter;
+
+/**
+ * @struct DiskANNCandidate
+ * @brief A node with its distance to the vector being searched or linked.
+ */
+typedef struct DiskANNCandidate {
+    double distance; /**< Distance to the query */
+    uint32_t node;   /**< Node number */
+    uint32_t flag;   /**< Set once expanded by a search, or once pruned */
+} DiskANNCandidate;
+
+/**
+ * @struct DiskANNResult
+ * @brief A dataset index with its exact distance to the query.
+ */
+typedef struct DiskANNResult {
+    double distance; /**< Squared distance to the query */
+    size_t index;    /**< Index of the vector in the original dataset */
+} DiskANNResult;
+
+/**
+ * @struct DiskANNVisited
+ * @brief Open-addressing set of the nodes seen by a search.
+ */
+typedef struct DiskANNVisited {
+    uint32_t* entries; /**< Node numbers, DISKANN_NONE for empty entries */
+    size_t bits;       /**< log2 of the number of entries */
+    size_t count;      /**< Number of nodes in the set */
+} DiskANNVisited;
+
+/**
+ * @struct DiskANNGraph
+ * @brief Graph being linked in memory before it is written.
+ */
+typedef struct DiskANNGraph {
+    size_t dimension;            /**< Number of components per vector */
+    size_t degree;               /**< Largest number of neighbors per node once the graph is linked */
+    size_t capacity;             /**< Neighbors a list may hold before it is pruned back to degree */
+    size_t build_list;           /**< Candidates kept while linking a node */
+    const size_t* indices;       /**< Dataset index of every node */
+    size_t node_count;           /**< Number of nodes */
+    uint32_t* links;             /**< capacity + 1 entries per node: a count, then the neighbors */
+    uint32_t entry;              /**< Node where searches start */
+    const PQIndex* pq;           /**< Trained codebooks of the routing codes */
+    uint8_t* codes;              /**< pq->subspaces bytes per node */
+    DiskANNPointFunc point_func; /**< Reads a vector */
+    DiskANNDistanceFunc distance_func; /**< Compares a query with a vector */
+    void* context;               /**< Context passed to the callbacks */
+    pthread_mutex_t* locks;      /**< DISKANN_LOCK_STRIPES locks; node n's list is guarded by locks[n % DISKANN_LOCK_STRIPES] */
+} DiskANNGraph;
+
+/**
+ * @struct DiskANNLinker
+ * @brief Buffers of one build thread, reused across nodes.
+ */
+typedef struct DiskANNLinker {
+    DiskANNCandidate* list;   /**< Nearest candidates of the greedy search, sorted (build_list entries) */
+    size_t list_count;        /**< Number of entries in list */
+    DiskANNCandidate* pool;   /**< Nodes expanded by the greedy search, the pruning candidates */
+    size_t pool_count;        /**< Number of entries in pool */
+    size_t pool_capacity;     /**< Entries available in pool */
+    DiskANNCandidate* back;   /**< Neighbors of a node being pruned (capacity + 1 entries) */
+    DiskANNVisited visited;   /**< Nodes seen by the greedy search */
+    uint32_t* links;          /**< Copy of a neighbor list (capacity + 1 entries) */
+    uint32_t* kept;           /**< Neighbors kept by a prune (degree entries) */
+    double* buffers;          /**< 2 * dimension doubles: the node being linked and a candidate */
+} DiskANNLinker;
+
+/**
+ * @struct DiskANNBuildJob
+ * @brief Work shared by the build threads; each thread takes the next batch of nodes.
+ */
+typedef struct DiskANNBuildJob {
+    DiskANNGraph* graph;    /**< Graph being linked */
+    const uint32_t* order;  /**< Nodes in the order they are linked */
+    size_t count;           /**< Number of entries in order */
+    size_t next;            /**< Next entry of order to link, guarded by lock */
+    int trim;               /**< Non-zero to prune the lists longer than degree instead of linking */
+    int failed;             /**< Set if a node could not be linked */
+    pthread_mutex_t lock;   /**< Protects next and failed */
+} DiskANNBuildJob;
+
+/**
+ * @brief Prepare an empty visited set.
+ *
+ * @param visited Set to initialize.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int diskann_visited_init(DiskANNVisited* visited) {
+    visited->bits = DISKANN_MIN_VISITED_BITS;
+    visited->count = 0;
+    visited->entries = (uint32_t*)malloc(((size_t)1 << visited->bits) * sizeof(uint32_t));
+    if (!visited->entries) {
+        return -1;
+    }
+    memset(visited->entries, 0xff, ((size_t)1 << visited->bits) * sizeof(uint32_t));
+    return 0;
+}
+
+/**
+ * @brief Empty a visited set, keeping its size.
+ *
+ * @param visited Set to empty.
+ */
+static void diskann_visited_clear(DiskANNVisited* visited) {
+    memset(visited->entries, 0xff, ((size_t)1 << visited->bits) * sizeof(uint32_t));
+    visited->count = 0;
+}
+
+/**
+ * @brief Record a node as seen, unless it already was.
+ *
+ * @param visited Set of the nodes seen.
+ * @param node Node number.
+ * @return int 1 if the node is new, 0 if it was seen already, -1 on allocation failure.
+ */
+static int diskann_visit(DiskANNVisited* visited, uint32_t node) {
+    // Keep the set at most half full
+    if (2 * (visited->count + 1) > ((size_t)1 << visited->bits)) {
+        size_t bits = visited->bits + 1;
+        uint32_t* entries = (uint32_t*)malloc(((size_t)1 << bits) * sizeof(uint32_t));
+        if (!entries) {
+            return -1;
+        }
+        memset(entries, 0xff, ((size_t)1 << bits) * sizeof(uint32_t));
+        for (size_t i = 0; i < ((size_t)1 << visited->bits); i++) {
+            uint32_t entry = visited->entries[i];
+            if (entry != DISKANN_NONE) {
+                size_t pos = (size_t)(((uint64_t)entry * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+                while (entries[pos] != DISKANN_NONE) {
+                    pos = (pos + 1) & (((size_t)1 << bits) - 1);
+                }
+                entries[pos] = entry;
+            }
+        }
+        free(visited->entries);
+        visited->entries = entries;
+        visited->bits = bits;
+    }
+
+    size_t mask = ((size_t)1 << visited->bits) - 1;
+    size_t pos = (size_t)(((uint64_t)node * 0x9E3779B97F4A7C15ull) >> (64 - visited->bits));
+    while (visited->entries[pos] != DISKANN_NONE) {
+        if (visited->entries[pos] == node) {
+            return 0;
+        }
+        pos = (pos + 1) & mask;
+    }
+    visited->entries[pos] = node;
+    visited->count++;
+    return 1;
+}
+
+/**
+ * @brief Insert a candidate into a list sorted by increasing distance, dropping the farthest if full.
+ *
+ * @param list Sorted list.
+ * @param count Number of entries, incremented unless the list was full.
+ * @param capacity Largest number of entries.
+ * @param distance Distance of the candidate.
+ * @param node Node number of the candidate.
+ */
+static void diskann_list_insert(DiskANNCandidate* list, size_t* count, size_t capacity, double distance, uint32_t node) {
+    if (*count == capacity && distance >= list[capacity - 1].distance) {
+        return;
+    }
+    size_t pos = *count < capacity ? (*count)++ : capacity - 1;
+    while (pos > 0 && list[pos - 1].distance > distance) {
+        list[pos] = list[pos - 1];
+        pos--;
+    }
+    list[pos].distance = distance;
+    list[pos].node = node;
+    list[pos].flag = 0;
+}
+
+/**
+ * @brief Push a result into a max-heap of at most capacity entries, farthest at the root.
+ *
+ * @param heap Heap with room for capacity entries.
+ * @param count Number of entries, incremented unless the heap was full.
+ * @param capacity Largest number of entries.
+ * @param distance Distance of the result.
+ * @param index Dataset index of the result.
+ */
+static void diskann_result_push(DiskANNResult* heap, size_t* count, size_t capacity, double distance, size_t index) {
+    if (*count == capacity) {
+        if (distance >= heap[0].distance) {
+            return;
+        }
+        // Replace the root and sift it down
+        size_t pos = 0;
+        for (;;) {
+            size_t child = 2 * pos + 1;
+            if (child >= capacity) {
+                break;
+            }
+            if (child + 1 < capacity && heap[child + 1].distance > heap[child].distance) {
+                child++;
+            }
+            if (heap[child].distance <= distance) {
+                break;
+            }
+            heap[pos] = heap[child];
+            pos = child;
+        }
+        heap[pos].distance = distance;
+        heap[pos].index = index;
+        return;
+    }
+    size_t pos = (*count)++;
+    while (pos > 0 && heap[(pos - 1) / 2].distance < distance) {
+        heap[pos] = heap[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
+    }
+    heap[pos].distance = distance;
+    heap[pos].index = index;
+}
+
+/**
+ * @brief Order candidates by increasing distance.
+ *
+ * @param a First DiskANNCandidate.
+ * @param b Second DiskANNCandidate.
+ * @return int Negative, zero or positive as a is nearer, as near or farther than b.
+ */
+static int diskann_candidate_compare(const void* a, const void* b) {
+    double da = ((const DiskANNCandidate*)a)->distance;
+    double db = ((const DiskANNCandidate*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+/**
+ * @brief Order results by increasing distance.
+ *
+ * @param a First DiskANNResult.
+ * @param b Second DiskANNResult.
+ * @return int Negative, zero or positive as a is nearer, as near or farther than b.
+ */
+static int diskann_result_compare(const void* a, const void* b) {
+    double da = ((const DiskANNResult*)a)->distance;
+    double db = ((const DiskANNResult*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+/**
+ * @brief Offset of the first neighbor-free byte of a record, where its vector starts.
+ *
+ * @param degree Largest number of neighbors per node.
+ * @return size_t Offset of the vector within a record.
+ */
+static size_t diskann_vector_offset(size_t degree) {
+    return ((degree + 1) * sizeof(uint32_t) + 7) / 8 * 8;
+}
+
+/**
+ * @brief Size of the records and blocks of a graph file.
+ *
+ * Records are packed into sectors when they fit in one, and a record larger than a sector gets
+ * whole sectors of its own, so that a node is always read with one aligned read.
+ *
+ * @param degree Largest number of neighbors per node.
+ * @param vector_bytes Bytes of one vector.
+ * @param block_nodes Set to the number of records per block.
+ * @param block_bytes Set to the bytes of one block.
+ * @return size_t Bytes of one record.
+ */
+static size_t diskann_layout(size_t degree, size_t vector_bytes, size_t* block_nodes, size_t* block_bytes) {
+    size_t record_bytes = (diskann_vector_offset(degree) + vector_bytes + 7) / 8 * 8;
+    *block_nodes = record_bytes <= DISKANN_SECTOR ? DISKANN_SECTOR / record_bytes : 1;
+    *block_bytes = (record_bytes + DISKANN_SECTOR - 1) / DISKANN_SECTOR * DISKANN_SECTOR;
+    return record_bytes;
+}
+
+/**
+ * @brief Offset of the block holding a node in the graph file.
+ *
+ * @param ann Graph.
+ * @param node Node number.
+ * @return off_t Offset of the block.
+ */
+static off_t diskann_block_offset(const DiskANN* ann, uint32_t node) {
+    return (off_t)(DISKANN_SECTOR + (size_t)(node / ann->block_nodes) * ann->block_bytes);
+}
+
+/**
+ * @brief Read exactly length bytes at an offset.
+ *
+ * @param fd File to read from.
+ * @param data Destination.
+ * @param length Number of bytes.
+ * @param offset Offset in the file.
+ * @return int 0 on success, -1 on failure or a short read.
+ */
+static int diskann_pread(int fd, void* data, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, (char*)data + done, length - done, offset + (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Write exactly length bytes.
+ *
+ * @param fd File to write to.
+ * @param data Bytes to write.
+ * @param length Number of bytes.
+ * @return int 0 on success, -1 on failure.
+ */
+static int diskann_write_all(int fd, const void* data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = write(fd, (const char*)data + done, length - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Make sure the index maps cover the dataset indices below a bound.
+ *
+ * @param ann Graph to grow.
+ * @param index_bound Required number of entries.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int diskann_reserve(DiskANN* ann, size_t index_bound) {
+    if (index_bound <= ann->index_capacity) {
+        return 0;
+    }
+    size_t capacity = ann->index_capacity > 0 ? ann->index_capacity : DISKANN_MIN_CAPACITY;
+    while (capacity < index_bound) {
+        capacity *= 2;
+    }
+    uint32_t* node_of = (uint32_t*)realloc(ann->node_of, capacity * sizeof(uint32_t));
+    if (!node_of) {
+        return -1;
+    }
+    ann->node_of = node_of;
+    uint32_t* delta_of = (uint32_t*)realloc(ann->delta_of, capacity * sizeof(uint32_t));
+    if (!delta_of) {
+        return -1;
+    }
+    ann->delta_of = delta_of;
+    memset(ann->node_of + ann->index_capacity, 0xff, (capacity - ann->index_capacity) * sizeof(uint32_t));
+    memset(ann->delta_of + ann->index_capacity, 0xff, (capacity - ann->index_capacity) * sizeof(uint32_t));
+    ann->index_capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Copy the neighbor list of a node under its stripe lock.
+ *
+ * @param graph Graph being linked.
+ * @param node Node number.
+ * @param links Set to the count and the neighbors (degree + 1 entries).
+ */
+static void diskann_copy_links(DiskANNGraph* graph, uint32_t node, uint32_t* links) {
+    pthread_mutex_t* lock = &graph->locks[node % DISKANN_LOCK_STRIPES];
+    const uint32_t* list = graph->links + (size_t)node * (graph->capacity + 1);
+    pthread_mutex_lock(lock);
+    memcpy(links, list, (list[0] + 1) * sizeof(uint32_t));
+    pthread_mutex_unlock(lock);
+}
+
+/**
+ * @brief Prepare the buffers of a build thread.
+ *
+ * @param linker Buffers to initialize.
+ * @param graph Graph being linked.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int diskann_linker_init(DiskANNLinker* linker, const DiskANNGraph* graph) {
+    memset(linker, 0, sizeof(*linker));
+    linker->pool_capacity = 2 * graph->build_list;
+    linker->list = (DiskANNCandidate*)malloc(graph->build_list * sizeof(DiskANNCandidate));
+    linker->pool = (DiskANNCandidate*)malloc(linker->pool_capacity * sizeof(DiskANNCandidate));
+    linker->back = (DiskANNCandidate*)malloc((graph->capacity + 1) * sizeof(DiskANNCandidate));
+    linker->links = (uint32_t*)malloc((graph->capacity + 1) * sizeof(uint32_t));
+    linker->kept = (uint32_t*)malloc(graph->degree * sizeof(uint32_t));
+    linker->buffers = (double*)malloc(2 * graph->dimension * sizeof(double));
+    if (!linker->list || !linker->pool || !linker->back || !linker->links || !linker->kept || !linker->buffers ||
+        diskann_visited_init(&linker->visited) != 0) {
+        free(linker->list);
+        free(linker->pool);
+        free(linker->back);
+        free(linker->links);
+        free(linker->kept);
+        free(linker->buffers);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Release the buffers of a build thread.
+ *
+ * @param linker Buffers to release.
+ */
+static void diskann_linker_destroy(DiskANNLinker* linker) {
+    free(linker->list);
+    free(linker->pool);
+    free(linker->back);
+    free(linker->links);
+    free(linker->kept);
+    free(linker->buffers);
+    free(linker->visited.entries);
+}
+
+/**
+ * @brief Greedy search of the graph from the entry node, collecting the expanded nodes into the pool.
+ *
+ * @param graph Graph being linked.
+ * @param linker Buffers of the calling thread.
+ * @param query Vector being linked.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int diskann_greedy(DiskANNGraph* graph, DiskANNLinker* linker, const double* query) {
+    linker->list_count = 0;
+    linker->pool_count = 0;
+    diskann_visited_clear(&linker->visited);
+    if (diskann_visit(&linker->visited, graph->entry) < 0) {
+        return -1;
+    }
+    diskann_list_insert(linker->list, &linker->list_count, graph->build_list,
+                        graph->distance_func(graph->context, graph->indices[graph->entry], query), graph->entry);
+
+    for (;;) {
+        size_t i = 0;
+        while (i < linker->list_count && linker->list[i].flag) {
+            i++;
+        }
+        if (i == linker->list_count) {
+            return 0;
+        }
+        linker->list[i].flag = 1;
+        if (linker->pool_count == linker->pool_capacity) {
+            size_t capacity = 2 * linker->pool_capacity;
+            DiskANNCandidate* pool = (DiskANNCandidate*)realloc(linker->pool, capacity * sizeof(DiskANNCandidate));
+            if (!pool) {
+                return -1;
+            }
+            linker->pool = pool;
+            linker->pool_capacity = capacity;
+        }
+        linker->pool[linker->pool_count++] = linker->list[i];
+
+        diskann_copy_links(graph, linker->list[i].node, linker->links);
+        for (uint32_t j = 1; j <= linker->links[0]; j++) {
+            uint32_t neighbor = linker->links[j];
+            int seen = diskann_visit(&linker->visited, neighbor);
+            if (seen < 0) {
+                return -1;
+            }
+            if (seen > 0) {
+                double distance = graph->distance_func(graph->context, graph->indices[neighbor], query);
+                diskann_list_insert(linker->list, &linker->list_count, graph->build_list, distance, neighbor);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Pick the neighbors of a node among candidates with the alpha-relaxed occlusion rule.
+ *
+ * Candidates are taken nearest first; a kept candidate c prunes every farther candidate v with
+ * DISKANN_ALPHA * d(c, v) <= d(node, v), so the kept neighbors point in diverse directions and
+ * long edges survive.
+ *
+ * @param graph Graph being linked.
+ * @param linker Buffers of the calling thread; the second buffer is overwritten.
+ * @param node Node whose neighbors are picked, skipped if among the candidates.
+ * @param candidates Candidates with their distance to the node, reordered and flagged.
+ * @param count Number of candidates.
+ * @return size_t Number of neighbors written to linker->kept.
+ */
+static size_t diskann_prune(DiskANNGraph* graph, DiskANNLinker* linker, uint32_t node, DiskANNCandidate* candidates,
+                            size_t count) {
+    qsort(candidates, count, sizeof(DiskANNCandidate), diskann_candidate_compare);
+    for (size_t i = 0; i < count; i++) {
+        candidates[i].flag = candidates[i].node == node;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < count && kept < graph->degree; i++) {
+        if (candidates[i].flag) {
+            continue;
+        }
+        linker->kept[kept++] = candidates[i].node;
+        const double* point = graph->point_func(graph->context, graph->indices[candidates[i].node],
+                                                linker->buffers + graph->dimension);
+        for (size_t j = i + 1; point && j < count; j++) {
+            if (!candidates[j].flag &&
+                DISKANN_ALPHA * graph->distance_func(graph->context, graph->indices[candidates[j].node], point) <=
+                    candidates[j].distance) {
+                candidates[j].flag = 1;
+            }
+        }
+    }
+    return kept;
+}
+
+/**
+ * @brief Prune the neighbor list of a node back to degree entries.
+ *
+ * Must be called with the stripe lock of the node held.
+ *
+ * @param graph Graph being linked.
+ * @param linker Buffers of the calling thread.
+ * @param node Node whose list is pruned.
+ * @param extra Node to consider along with the current neighbors, or DISKANN_NONE.
+ * @param extra_distance Distance between node and extra.
+ */
+static void diskann_shrink(DiskANNGraph* graph, DiskANNLinker* linker, uint32_t node, uint32_t extra,
+                           double extra_distance) {
+    uint32_t* list = graph->links + (size_t)node * (graph->capacity + 1);
+    const double* point = graph->point_func(graph->context, graph->indices[node], linker->buffers);
+    if (!point) {
+        return;
+    }
+    size_t count = 0;
+    for (uint32_t i = 1; i <= list[0]; i++) {
+        linker->back[count].node = list[i];
+        linker->back[count++].distance = graph->distance_func(graph->context, graph->indices[list[i]], point);
+    }
+    if (extra != DISKANN_NONE) {
+        linker->back[count].node = extra;
+        linker->back[count++].distance = extra_distance;
+    }
+    size_t kept = diskann_prune(graph, linker, node, linker->back, count);
+    memcpy(list + 1, linker->kept, kept * sizeof(uint32_t));
+    list[0] = (uint32_t)kept;
+}
+
+/**
+ * @brief Add a back link from a neighbor to a newly linked node, pruning the neighbor's list if full.
+ *
+ * @param graph Graph being linked.
+ * @param linker Buffers of the calling thread.
+ * @param neighbor Node gaining the link.
+ * @param node Newly linked node.
+ * @param distance Distance between the two.
+ */
+static void diskann_link_back(DiskANNGraph* graph, DiskANNLinker* linker, uint32_t neighbor, uint32_t node,
+                              double distance) {
+    pthread_mutex_t* lock = &graph->locks[neighbor % DISKANN_LOCK_STRIPES];
+    uint32_t* list = graph->links + (size_t)neighbor * (graph->capacity + 1);
+    pthread_mutex_lock(lock);
+    int present = 0;
+    for (uint32_t i = 1; i <= list[0] && !present; i++) {
+        present = list[i] == node;
+    }
+    if (!present && list[0] < graph->capacity) {
+        list[++list[0]] = node;
+    } else if (!present) {
+        diskann_shrink(graph, linker, neighbor, node, distance);
+    }
+    pthread_mutex_unlock(lock);
+}
+
+/**
+ * @brief Encode a node and link it into the graph.
+ *
+ * @param graph Graph being linked.
+ * @param linker Buffers of the calling thread.
+ * @param node Node to link.
+ * @return int 0 on success, -1 on failure.
+ */
+static int diskann_link(DiskANNGraph* graph, DiskANNLinker* linker, uint32_t node) {
+    const double* point = graph->point_func(graph->context, graph->indices[node], linker->buffers);
+    if (!point) {
+        return -1;
+    }
+    pq_index_code(graph->pq, point, graph->codes + (size_t)node * graph->pq->subspaces);
+    if (node == graph->entry) {
+        return 0; // Linked to by the others
+    }
+    if (diskann_greedy(graph, linker, point) != 0) {
+        return -1;
+    }
+    size_t kept = diskann_prune(graph, linker, node, linker->pool, linker->pool_count);
+    memcpy(linker->links, linker->kept, kept * sizeof(uint32_t)); // Back links prune into kept again
+
+    pthread_mutex_t* lock = &graph->locks[node % DISKANN_LOCK_STRIPES];
+    uint32_t* list = graph->links + (size_t)node * (graph->capacity + 1);
+    pthread_mutex_lock(lock);
+    memcpy(list + 1, linker->links, kept * sizeof(uint32_t));
+    list[0] = (uint32_t)kept;
+    pthread_mutex_unlock(lock);
+
+    // The prune sorted the pool; the kept neighbors appear in it in the same order
+    for (size_t i = 0, j = 0; i < kept; i++) {
+        while (linker->pool[j].node != linker->links[i]) {
+            j++;
+        }
+        diskann_link_back(graph, linker, linker->links[i], node, linker->pool[j].distance);
+    }
+    return 0;
+}
+
+/**
+ * @brief Prune the neighbor list of a node back to degree entries if back links made it longer.
+ *
+ * @param graph Linked graph.
+ * @param linker Buffers of the calling thread.
+ * @param node Node to trim.
+ */
+static void diskann_trim(DiskANNGraph* graph, DiskANNLinker* linker, uint32_t node) {
+    pthread_mutex_t* lock = &graph->locks[node % DISKANN_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    if (graph->links[(size_t)node * (graph->capacity + 1)] > graph->degree) {
+        diskann_shrink(graph, linker, node, DISKANN_NONE, 0.0);
+    }
+    pthread_mutex_unlock(lock);
+}
+
+/**
+ * @brief Thread body linking or trimming batches of nodes until none is left.
+ *
+ * @param arg Pointer to the DiskANNBuildJob.
+ * @return void* NULL.
+ */
+static void* diskann_build_thread(void* arg) {
+    DiskANNBuildJob* job = (DiskANNBuildJob*)arg;
+    DiskANNLinker linker;
+    int ready = diskann_linker_init(&linker, job->graph) == 0;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        if (!ready) {
+            job->failed = 1;
+        }
+        size_t first = job->failed ? job->count : job->next;
+        job->next = first + DISKANN_BUILD_BATCH < job->count ? first + DISKANN_BUILD_BATCH : job->count;
+        size_t end = job->next;
+        pthread_mutex_unlock(&job->lock);
+        if (first >= end) {
+            break;
+        }
+        for (size_t i = first; i < end; i++) {
+            if (job->trim) {
+                diskann_trim(job->graph, &linker, job->order[i]);
+            } else if (diskann_link(job->graph, &linker, job->order[i]) != 0) {
+                pthread_mutex_lock(&job->lock);
+                job->failed = 1;
+                pthread_mutex_unlock(&job->lock);
+                break;
+            }
+        }
+    }
+    if (ready) {
+        diskann_linker_destroy(&linker);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Link every node of a graph.
+ *
+ * Nodes are linked in a random order. The first DISKANN_BUILD_SEQUENTIAL are linked on the
+ * caller's thread, so that the pool starts from a connected graph; the others are linked
+ * concurrently. Back links let a list grow past degree, up to capacity, before it is pruned, so
+ * a second pass of the pool prunes the lists left longer than degree.
+ *
+ * @param graph Graph with empty neighbor lists.
+ * @param thread_count Number of threads, at least 1.
+ * @return int 0 on success, -1 on failure.
+ */
+static int diskann_link_all(DiskANNGraph* graph, size_t thread_count) {
+    uint32_t* order = (uint32_t*)malloc(graph->node_count * sizeof(uint32_t));
+    if (!order) {
+        return -1;
+    }
+    for (size_t i = 0; i < graph->node_count; i++) {
+        order[i] = (uint32_t)i;
+    }
+    uint64_t seed = 0x9E3779B97F4A7C15ULL ^ graph->node_count;
+    for (size_t i = graph->node_count - 1; i > 0; i--) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t j = (size_t)((seed >> 33) % (i + 1));
+        uint32_t swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    DiskANNBuildJob job;
+    job.graph = graph;
+    job.order = order;
+    job.count = graph->node_count < DISKANN_BUILD_SEQUENTIAL ? graph->node_count : DISKANN_BUILD_SEQUENTIAL;
+    job.next = 0;
+    job.trim = 0;
+    job.failed = 0;
+    if (pthread_mutex_init(&job.lock, NULL) != 0) {
+        free(order);
+        return -1;
+    }
+    diskann_build_thread(&job);
+    job.count = graph->node_count;
+    job.next = job.failed ? job.count : job.next;
+
+    pthread_t* threads = (pthread_t*)malloc((thread_count > 0 ? thread_count : 1) * sizeof(pthread_t));
+    for (job.trim = 0; job.trim <= 1 && !job.failed; job.trim++) {
+        size_t started = 0;
+        while (threads && started < thread_count &&
+               pthread_create(&threads[started], NULL, diskann_build_thread, &job) == 0) {
+            started++;
+        }
+        if (started == 0) {
+            diskann_build_thread(&job); // No thread could be started, link on the caller's
+        }
+        for (size_t i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        job.next = 0;
+    }
+    free(threads);
+    free(order);
+    pthread_mutex_destroy(&job.lock);
+    return job.failed ? -1 : 0;
+}
+
+/**
+ * @brief Find the node nearest to the mean of the samples, where searches start.
+ *
+ * @param graph Graph being built.
+ * @param samples Training vectors.
+ * @param sample_count Number of training vectors.
+ * @return uint32_t The entry node, or DISKANN_NONE on allocation failure.
+ */
+static uint32_t diskann_medoid(const DiskANNGraph* graph, const float* samples, size_t sample_count) {
+    double* mean = (double*)calloc(graph->dimension, sizeof(double));
+    if (!mean) {
+        return DISKANN_NONE;
+    }
+    for (size_t i = 0; i < sample_count; i++) {
+        for (size_t d = 0; d < graph->dimension; d++) {
+            mean[d] += samples[i * graph->dimension + d];
+        }
+    }
+    for (size_t d = 0; d < graph->dimension; d++) {
+        mean[d] /= (double)sample_count;
+    }
+    uint32_t best = 0;
+    double best_distance = INFINITY;
+    for (size_t n = 0; n < graph->node_count; n++) {
+        double distance = graph->distance_func(graph->context, graph->indices[n], mean);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = (uint32_t)n;
+        }
+    }
+    free(mean);
+    return best;
+}
+
+/**
+ * @brief Fill the header of a graph file, except its identifier and checksums.
+ *
+ * @param header Header to fill.
+ * @param graph Linked graph.
+ * @param element_type Type of the vectors in the records.
+ */
+static void diskann_fill_header(DiskANNFileHeader* header, const DiskANNGraph* graph, VectorElementType element_type) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, DISKANN_FILE_MAGIC, sizeof(header->magic));
+    header->version = DISKANN_FILE_VERSION;
+    header->element_type = (uint32_t)element_type;
+    header->dimension = graph->dimension;
+    header->degree = graph->degree;
+    header->build_list = graph->build_list;
+    header->node_count = graph->node_count;
+    header->entry = graph->entry;
+    size_t block_nodes;
+    size_t block_bytes;
+    header->record_bytes = diskann_layout(graph->degree, graph->dimension * vector_element_size(element_type),
+                                          &block_nodes, &block_bytes);
+    header->block_nodes = block_nodes;
+    header->block_bytes = block_bytes;
+    header->pq_offset = DISKANN_SECTOR + (graph->node_count + header->block_nodes - 1) / header->block_nodes * header->block_bytes;
+    header->pq_subspaces = graph->pq->subspaces;
+}
+
+/**
+ * @brief Write a linked graph to a file.
+ *
+ * @param graph Linked graph with encoded nodes.
+ * @param fd File to write to, positioned at offset 0.
+ * @param element_type Type the vectors are stored with in the records.
+ * @param id Identifier of the file.
+ * @return int 0 on success, -1 on failure.
+ */
+static int diskann_write_graph(const DiskANNGraph* graph, int fd, VectorElementType element_type, uint64_t id) {
+    DiskANNFileHeader header;
+    diskann_fill_header(&header, graph, element_type);
+    header.id = id;
+    size_t centroid_bytes = PQ_INDEX_CENTROIDS * graph->dimension * sizeof(float);
+    size_t code_bytes = graph->node_count * graph->pq->subspaces;
+    header.pq_crc = crc32c_update(crc32c_update(0, graph->pq->centroids, centroid_bytes), graph->codes, code_bytes);
+    header.header_crc = crc32c_update(0, &header, sizeof(header));
+
+    char* block = (char*)calloc(1, header.block_bytes);
+    double* buffer = (double*)malloc(graph->dimension * sizeof(double));
+    if (!block || !buffer) {
+        free(block);
+        free(buffer);
+        return -1;
+    }
+    memcpy(block, &header, sizeof(header));
+    int status = diskann_write_all(fd, block, DISKANN_SECTOR);
+
+    size_t vector_offset = diskann_vector_offset(graph->degree);
+    for (size_t first = 0; status == 0 && first < graph->node_count; first += header.block_nodes) {
+        memset(block, 0, header.block_bytes);
+        for (size_t n = first; n < graph->node_count && n < first + header.block_nodes; n++) {
+            char* record = block + (n - first) * header.record_bytes;
+            const uint32_t* list = graph->links + n * (graph->capacity + 1);
+            memcpy(record, list, (list[0] + 1) * sizeof(uint32_t));
+            const double* point = graph->point_func(graph->context, graph->indices[n], buffer);
+            if (!point) {
+                status = -1;
+                break;
+            }
+            vector_element_convert(element_type, record + vector_offset, VECTOR_ELEMENT_FLOAT64, point, graph->dimension);
+        }
+        if (status == 0) {
+            status = diskann_write_all(fd, block, header.block_bytes);
+        }
+    }
+    if (status == 0) {
+        status = diskann_write_all(fd, graph->pq->centroids, centroid_bytes) | diskann_write_all(fd, graph->codes, code_bytes);
+    }
+    free(block);
+    free(buffer);
+    return status;
+}
+
+/**
+ * @brief Draw a file identifier.
+ *
+ * @param salt Value mixed into the identifier.
+ * @return uint64_t The identifier.
+ */
+static uint64_t diskann_draw_id(uint64_t salt) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t x = ((uint64_t)now.tv_sec << 30) ^ (uint64_t)now.tv_nsec ^ ((uint64_t)getpid() << 48) ^ salt;
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    return x ^ (x >> 33);
+}
+
+/**
+ * @brief Give the nodes of a graph the dataset indices they were built with.
+ *
+ * @param ann Opened graph without indices.
+ * @param indices Dataset index of every node.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int diskann_bind(DiskANN* ann, const size_t* indices) {
+    size_t index_bound = 0;
+    for (size_t n = 0; n < ann->node_count; n++) {
+        if (indices[n] >= index_bound) {
+            index_bound = indices[n] + 1;
+        }
+    }
+    if (diskann_reserve(ann, index_bound) != 0) {
+        return -1;
+    }
+    for (size_t n = 0; n < ann->node_count; n++) {
+        ann->index_of[n] = (uint32_t)indices[n];
+        ann->node_of[indices[n]] = (uint32_t)n;
+    }
+    ann->count = ann->node_count;
+    return 0;
+}
+
+/**
+ * @brief Build a graph over a set of vectors, write it to a file and open it.
+ *
+ * @param filename Graph file to write.
+ * @param dimension Number of components per vector.
+ * @param element_type Type the vectors are stored with in the node records.
+ * @param degree Largest number of neighbors per node, from 2 to DISKANN_MAX_DEGREE.
+ * @param build_list Candidates kept while linking a node, at least degree.
+ * @param indices Indices of the vectors in the original dataset, below DISKANN_NONE.
+ * @param count Number of vectors, at least 1.
+ * @param samples `sample_count` training vectors of `dimension` floats each.
+ * @param sample_count Number of training vectors, at least 1.
+ * @param thread_count Number of threads, at least 1.
+ * @param point_func Reads a vector.
+ * @param distance_func Compares a query with a vector.
+ * @param context Context passed to the callbacks.
+ * @return DiskANN* Pointer to the graph, or NULL on failure.
+ */
+DiskANN* diskann_build(const char* filename, size_t dimension, VectorElementType element_type, size_t degree,
+                       size_t build_list, const size_t* indices, size_t count, const float* samples,
+                       size_t sample_count, size_t thread_count, DiskANNPointFunc point_func,
+                       DiskANNDistanceFunc distance_func, void* context) {
+    if (degree < 2 || degree > DISKANN_MAX_DEGREE || build_list < degree || count == 0 || count >= DISKANN_NONE ||
+        sample_count == 0 || dimension == 0 || vector_element_size(element_type) == 0) {
+        fprintf(stderr, "Invalid Vamana graph parameters\n");
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (indices[i] >= DISKANN_NONE) {
+            fprintf(stderr, "Vector index %zu is too large for a Vamana graph\n", indices[i]);
+            return NULL;
+        }
+    }
+    size_t subspaces = (dimension + DISKANN_PQ_COMPONENTS - 1) / DISKANN_PQ_COMPONENTS;
+
+    DiskANNGraph graph;
+    graph.dimension = dimension;
+    graph.degree = degree;
+    graph.capacity = degree + (degree + DISKANN_BUILD_SLACK - 1) / DISKANN_BUILD_SLACK;
+    graph.build_list = build_list;
+    graph.indices = indices;
+    graph.node_count = count;
+    graph.point_func = point_func;
+    graph.distance_func = distance_func;
+    graph.context = context;
+    PQIndex* pq = pq_index_create(dimension, subspaces);
+    graph.pq = pq;
+    graph.links = (uint32_t*)calloc(count * (graph.capacity + 1), sizeof(uint32_t));
+    graph.codes = (uint8_t*)malloc(count * subspaces);
+    graph.locks = (pthread_mutex_t*)malloc(DISKANN_LOCK_STRIPES * sizeof(pthread_mutex_t));
+    size_t locks = 0;
+    while (graph.locks && locks < DISKANN_LOCK_STRIPES && pthread_mutex_init(&graph.locks[locks], NULL) == 0) {
+        locks++;
+    }
+    int status = pq && graph.links && graph.codes && locks == DISKANN_LOCK_STRIPES ? 0 : -1;
+    if (status != 0) {
+        fprintf(stderr, "Failed to allocate memory for the Vamana graph\n");
+    }
+    if (status == 0) {
+        status = pq_index_train(pq, samples, sample_count);
+    }
+    if (status == 0) {
+        graph.entry = diskann_medoid(&graph, samples, sample_count);
+        status = graph.entry != DISKANN_NONE ? diskann_link_all(&graph, thread_count) : -1;
+        if (status != 0) {
+            fprintf(stderr, "Failed to link the Vamana graph\n");
+        }
+    }
+
+    // Write next to the target and rename, so that a graph being searched stays valid
+    size_t length = strlen(filename) + sizeof(".tmp");
+    char* tmp_filename = status == 0 ? (char*)malloc(length) : NULL;
+    if (tmp_filename) {
+        snprintf(tmp_filename, length, "%s.tmp", filename);
+        int fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        status = fd >= 0 ? diskann_write_graph(&graph, fd, element_type, diskann_draw_id((uint64_t)count)) : -1;
+        if (fd >= 0) {
+            status = fsync(fd) == 0 && status == 0 ? 0 : -1;
+            status = close(fd) == 0 && status == 0 ? 0 : -1;
+        }
+        if (status != 0 || rename(tmp_filename, filename) != 0) {
+            fprintf(stderr, "Failed to write Vamana graph file %s\n", filename);
+            unlink(tmp_filename);
+            status = -1;
+        }
+        free(tmp_filename);
+    } else {
+        status = -1;
+    }
+
+    while (locks > 0) {
+        pthread_mutex_destroy(&graph.locks[--locks]);
+    }
+    free(graph.locks);
+    free(graph.links);
+    free(graph.codes);
+    pq_index_free(pq);
+    if (status != 0) {
+        return NULL;
+    }
+
+    DiskANN* ann = diskann_open(filename, dimension, distance_func, context);
+    if (ann && diskann_bind(ann, indices) != 0) {
+        fprintf(stderr, "Failed to allocate memory for the Vamana graph\n");
+        diskann_free(ann);
+        return NULL;
+    }
+    if (ann) {
+        printf("Vamana graph over %zu vectors written to %s, %zu bytes of routing codes in memory\n",
+               count, filename, count * subspaces);
+    }
+    return ann;
+}
+
+/**
+ * @brief Open a graph file written by diskann_build.
+ *
+ * The header and the PQ section are read and checked; node records are only read by searches.
+ *
+ * @param filename Graph file to open.
+ * @param dimension Number of components per vector.
+ * @param distance_func Compares a query with a vector.
+ * @param context Context passed to the callbacks.
+ * @return DiskANN* Pointer to the graph, or NULL if the file is missing, invalid or on failure.
+ */
+DiskANN* diskann_open(const char* filename, size_t dimension, DiskANNDistanceFunc distance_func, void* context) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open Vamana graph file");
+        return NULL;
+    }
+    struct stat st;
+    DiskANNFileHeader header;
+    if (fstat(fd, &st) != 0 || diskann_pread(fd, &header, sizeof(header), 0) != 0) {
+        fprintf(stderr, "Invalid Vamana graph file %s\n", filename);
+        close(fd);
+        return NULL;
+    }
+    uint32_t header_crc = header.header_crc;
+    header.header_crc = 0;
+    size_t element_size = header.element_type < VECTOR_ELEMENT_TYPE_COUNT ? vector_element_size((VectorElementType)header.element_type) : 0;
+    size_t block_nodes;
+    size_t block_bytes;
+    size_t record_bytes = diskann_layout((size_t)header.degree, (size_t)header.dimension * element_size, &block_nodes, &block_bytes);
+    if (memcmp(header.magic, DISKANN_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != DISKANN_FILE_VERSION ||
+        crc32c_update(0, &header, sizeof(header)) != header_crc || element_size == 0 || header.dimension != dimension ||
+        header.degree < 2 || header.degree > DISKANN_MAX_DEGREE || header.node_count == 0 ||
+        header.node_count >= DISKANN_NONE || header.entry >= header.node_count || header.record_bytes != record_bytes ||
+        header.block_nodes != block_nodes || header.block_bytes != block_bytes ||
+        header.pq_offset != DISKANN_SECTOR + (header.node_count + block_nodes - 1) / block_nodes * block_bytes ||
+        header.pq_subspaces == 0 || header.pq_subspaces > dimension ||
+        (uint64_t)st.st_size < header.pq_offset + PQ_INDEX_CENTROIDS * dimension * sizeof(float) +
+                                  header.node_count * header.pq_subspaces) {
+        fprintf(stderr, "Invalid or incompatible Vamana graph file %s\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    DiskANN* ann = (DiskANN*)calloc(1, sizeof(DiskANN));
+    if (!ann) {
+        close(fd);
+        return NULL;
+    }
+    ann->fd = fd;
+    ann->dimension = dimension;
+    ann->element_type = (VectorElementType)header.element_type;
+    ann->degree = (size_t)header.degree;
+    ann->build_list = (size_t)header.build_list;
+    ann->node_count = (size_t)header.node_count;
+    ann->entry = (uint32_t)header.entry;
+    ann->id = header.id;
+    ann->record_bytes = record_bytes;
+    ann->block_nodes = block_nodes;
+    ann->block_bytes = block_bytes;
+    ann->distance_func = distance_func;
+    ann->context = context;
+
+    size_t centroid_bytes = PQ_INDEX_CENTROIDS * dimension * sizeof(float);
+    size_t code_bytes = ann->node_count * (size_t)header.pq_subspaces;
+    float* centroids = (float*)malloc(centroid_bytes);
+    ann->pq = pq_index_create(dimension, (size_t)header.pq_subspaces);
+    ann->codes = (uint8_t*)malloc(code_bytes);
+    ann->index_of = (uint32_t*)malloc(ann->node_count * sizeof(uint32_t));
+    if (!centroids || !ann->pq || !ann->codes || !ann->index_of ||
+        diskann_pread(fd, centroids, centroid_bytes, (off_t)header.pq_offset) != 0 ||
+        diskann_pread(fd, ann->codes, code_bytes, (off_t)(header.pq_offset + centroid_bytes)) != 0 ||
+        crc32c_update(crc32c_update(0, centroids, centroid_bytes), ann->codes, code_bytes) != header.pq_crc ||
+        pq_index_restore(ann->pq, centroids, NULL, 0) != 0) {
+        fprintf(stderr, "Failed to read the routing codes of Vamana graph file %s\n", filename);
+        free(centroids);
+        diskann_free(ann);
+        return NULL;
+    }
+    free(centroids);
+    memset(ann->index_of, 0xff, ann->node_count * sizeof(uint32_t));
+
+    // Searches read scattered sectors, read-ahead would only pollute the page cache
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    return ann;
+}
+
+/**
+ * @brief Close the graph file and free a graph.
+ *
+ * @param ann Graph to free, may be NULL.
+ */
+void diskann_free(DiskANN* ann) {
+    if (ann) {
+        if (ann->fd >= 0) {
+            close(ann->fd);
+        }
+        pq_index_free(ann->pq);
+        free(ann->codes);
+        free(ann->index_of);
+        free(ann->node_of);
+        free(ann->delta_of);
+        free(ann->delta);
+        free(ann);
+    }
+}
+
+/**
+ * @brief Add a vector to the delta list.
+ *
+ * @param ann Graph to update.
+ * @param index Index of the vector, not in the graph.
+ * @return int 0 on success, -1 on failure.
+ */
+int diskann_insert(DiskANN* ann, size_t index) {
+    if (index >= DISKANN_NONE || diskann_reserve(ann, index + 1) != 0) {
+        return -1;
+    }
+    if (ann->delta_of[index] != DISKANN_NONE) {
+        return 0;
+    }
+    if (ann->delta_count == ann->delta_capacity) {
+        size_t capacity = ann->delta_capacity > 0 ? 2 * ann->delta_capacity : DISKANN_MIN_CAPACITY;
+        size_t* delta = (size_t*)realloc(ann->delta, capacity * sizeof(size_t));
+        if (!delta) {
+            return -1;
+        }
+        ann->delta = delta;
+        ann->delta_capacity = capacity;
+    }
+    ann->delta_of[index] = (uint32_t)ann->delta_count;
+    ann->delta[ann->delta_count++] = index;
+    return 0;
+}
+
+/**
+ * @brief Remove a vector, from its node or from the delta list.
+ *
+ * A node keeps its record and links, so searches still route through it.
+ *
+ * @param ann Graph to update.
+ * @param index Index of the vector.
+ */
+void diskann_remove(DiskANN* ann, size_t index) {
+    if (index >= ann->index_capacity) {
+        return;
+    }
+    uint32_t node = ann->node_of[index];
+    if (node != DISKANN_NONE) {
+        ann->index_of[node] = DISKANN_NONE;
+        ann->node_of[index] = DISKANN_NONE;
+        ann->count--;
+    }
+    uint32_t pos = ann->delta_of[index];
+    if (pos != DISKANN_NONE) {
+        size_t last = ann->delta[--ann->delta_count];
+        ann->delta[pos] = last;
+        ann->delta_of[last] = pos;
+        ann->delta_of[index] = DISKANN_NONE;
+    }
+}
+
+/**
+ * @brief Change the index stored for a vector after it was moved.
+ *
+ * @param ann Graph to update.
+ * @param old_index Index the vector was inserted with.
+ * @param new_index New index of the vector, below old_index.
+ */
+void diskann_remap(DiskANN* ann, size_t old_index, size_t new_index) {
+    if (old_index >= ann->index_capacity || new_index >= ann->index_capacity) {
+        return;
+    }
+    uint32_t node = ann->node_of[old_index];
+    if (node != DISKANN_NONE) {
+        ann->index_of[node] = (uint32_t)new_index;
+        ann->node_of[new_index] = node;
+        ann->node_of[old_index] = DISKANN_NONE;
+    }
+    uint32_t pos = ann->delta_of[old_index];
+    if (pos != DISKANN_NONE) {
+        ann->delta[pos] = new_index;
+        ann->delta_of[new_index] = pos;
+        ann->delta_of[old_index] = DISKANN_NONE;
+    }
+}
+
+/**
+ * @brief Find approximate nearest neighbors.
+ *
+ * Every round hints all the blocks of the beam to the kernel before reading the first one, so
+ * the reads of a round are in flight together.
+ *
+ * @param ann Graph to search.
+ * @param query Query of dimension components.
+ * @param k Maximum number of neighbors.
+ * @param search_list Candidates kept by the beam search.
+ * @param beam_width Nodes read per round, from 1 to DISKANN_MAX_BEAM_WIDTH.
+ * @param indices Set to the indices of the neighbors, nearest first.
+ * @param distances Set to the squared distances of the neighbors.
+ * @return size_t Number of neighbors found, or (size_t)-1 on failure.
+ */
+size_t diskann_search(const DiskANN* ann, const double* query, size_t k, size_t search_list, size_t beam_width,
+                      size_t* indices, double* distances) {
+    if (k == 0) {
+        return 0;
+    }
+    size_t list_capacity = search_list > k ? search_list : k;
+    if (beam_width < 1) {
+        beam_width = 1;
+    } else if (beam_width > DISKANN_MAX_BEAM_WIDTH) {
+        beam_width = DISKANN_MAX_BEAM_WIDTH;
+    }
+    size_t subspaces = ann->pq->subspaces;
+    float* table = (float*)malloc(subspaces * PQ_INDEX_CENTROIDS * sizeof(float));
+    DiskANNCandidate* list = (DiskANNCandidate*)malloc(list_capacity * sizeof(DiskANNCandidate));
+    DiskANNResult* results = (DiskANNResult*)malloc(k * sizeof(DiskANNResult));
+    double* vector = (double*)malloc(ann->dimension * sizeof(double));
+    void* blocks = NULL;
+    DiskANNVisited visited;
+    visited.entries = NULL;
+    if (!table || !list || !results || !vector || posix_memalign(&blocks, DISKANN_SECTOR, beam_width * ann->block_bytes) != 0 ||
+        diskann_visited_init(&visited) != 0) {
+        free(table);
+        free(list);
+        free(results);
+        free(vector);
+        free(blocks);
+        return (size_t)-1;
+    }
+
+    pq_index_table(ann->pq, query, table);
+    size_t list_count = 0;
+    size_t result_count = 0;
+    int status = diskann_visit(&visited, ann->entry) < 0 ? -1 : 0;
+    diskann_list_insert(list, &list_count, list_capacity,
+                        pq_index_code_distance(ann->pq, table, ann->codes + (size_t)ann->entry * subspaces), ann->entry);
+    size_t vector_offset = diskann_vector_offset(ann->degree);
+    while (status == 0) {
+        uint32_t beam[DISKANN_MAX_BEAM_WIDTH];
+        size_t width = 0;
+        for (size_t i = 0; i < list_count && width < beam_width; i++) {
+            if (!list[i].flag) {
+                list[i].flag = 1;
+                beam[width++] = list[i].node;
+            }
+        }
+        if (width == 0) {
+            break;
+        }
+        for (size_t b = 0; b < width; b++) {
+            posix_fadvise(ann->fd, diskann_block_offset(ann, beam[b]), (off_t)ann->block_bytes, POSIX_FADV_WILLNEED);
+        }
+        for (size_t b = 0; b < width && status == 0; b++) {
+            char* block = (char*)blocks + b * ann->block_bytes;
+            status = diskann_pread(ann->fd, block, ann->block_bytes, diskann_block_offset(ann, beam[b]));
+        }
+        for (size_t b = 0; b < width && status == 0; b++) {
+            const char* record = (const char*)blocks + b * ann->block_bytes + (beam[b] % ann->block_nodes) * ann->record_bytes;
+            uint32_t index = ann->index_of[beam[b]];
+            if (index != DISKANN_NONE) {
+                vector_element_convert(VECTOR_ELEMENT_FLOAT64, vector, ann->element_type, record + vector_offset, ann->dimension);
+                double distance = 0.0;
+                for (size_t d = 0; d < ann->dimension; d++) {
+                    double diff = vector[d] - query[d];
+                    distance += diff * diff;
+                }
+                diskann_result_push(results, &result_count, k, distance, index);
+            }
+            const uint32_t* links = (const uint32_t*)record;
+            uint32_t degree = links[0] <= ann->degree ? links[0] : 0;
+            for (uint32_t j = 1; j <= degree && status == 0; j++) {
+                uint32_t neighbor = links[j];
+                int seen = neighbor < ann->node_count ? diskann_visit(&visited, neighbor) : 0;
+                if (seen < 0) {
+                    status = -1;
+                } else if (seen > 0) {
+                    float distance = pq_index_code_distance(ann->pq, table, ann->codes + (size_t)neighbor * subspaces);
+                    diskann_list_insert(list, &list_count, list_capacity, distance, neighbor);
+                }
+            }
+        }
+    }
+
+    // Vectors written since the build are not in the graph
+    for (size_t i = 0; status == 0 && i < ann->delta_count; i++) {
+        double distance = ann->distance_func(ann->context, ann->delta[i], query);
+        if (distance < INFINITY) {
+            diskann_result_push(results, &result_count, k, distance, ann->delta[i]);
+        }
+    }
+    qsort(results, result_count, sizeof(DiskANNResult), diskann_result_compare);
+    for (size_t i = 0; i < result_count; i++) {
+        indices[i] = results[i].index;
+        distances[i] = results[i].distance;
+    }
+
+    free(table);
+    free(list);
+    free(results);
+    free(vector);
+    free(blocks);
+    free(visited.entries);
+    return status == 0 ? result_count : (size_t)-1;
+}
+
+/**
+ * @brief Write the pending bytes of a writer.
+ *
+ * @param writer Writer to flush.
+ */
+static void diskann_writer_flush(DiskANNMapWriter* writer) {
+    size_t done = 0;
+    while (!writer->failed && done < writer->used) {
+        ssize_t written = write(writer->fd, writer->buffer + done, writer->used - done);
+        if (written < 0 && errno != EINTR) {
+            writer->failed = 1;
+        } else if (written > 0) {
+            done += (size_t)written;
+        }
+    }
+    writer->used = 0;
+}
+
+/**
+ * @brief Append bytes to a writer.
+ *
+ * @param writer Writer to append to.
+ * @param data Bytes to append.
+ * @param length Number of bytes.
+ */
+static void diskann_writer_put(DiskANNMapWriter* writer, const void* data, size_t length) {
+    const char* bytes = (const char*)data;
+    writer->crc = crc32c_update(writer->crc, data, length);
+    while (length > 0 && !writer->failed) {
+        size_t room = sizeof(writer->buffer) - writer->used;
+        size_t n = length < room ? length : room;
+        memcpy(writer->buffer + writer->used, bytes, n);
+        writer->used += n;
+        bytes += n;
+        length -= n;
+        if (writer->used == sizeof(writer->buffer)) {
+            diskann_writer_flush(writer);
+        }
+    }
+}
+
+/**
+ * @brief Write the dataset index of every node to a map file.
+ *
+ * Makes no allocation and goes through no stdio, so it can run in a forked child. The buffer is
+ * static: callers in the same process must not write two maps at once.
+ *
+ * @param ann Graph to write the map of.
+ * @param fd File to write to, positioned at offset 0.
+ * @param index_map New index of every dataset index below index_bound, SIZE_MAX for vectors left out.
+ * @param index_bound Number of entries of index_map.
+ * @param tag Identifier of the dataset the map belongs to.
+ * @return int 0 on success, -1 on failure.
+ */
+int diskann_write_map(const DiskANN* ann, int fd, const size_t* index_map, size_t index_bound, uint64_t tag) {
+    static DiskANNMapWriter writer;
+    writer.fd = fd;
+    writer.used = 0;
+    writer.failed = 0;
+
+    DiskANNMapHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DISKANN_MAP_MAGIC, sizeof(header.magic));
+    header.version = DISKANN_FILE_VERSION;
+    header.id = ann->id;
+    header.node_count = ann->node_count;
+    diskann_writer_put(&writer, &header, sizeof(header));
+
+    writer.crc = 0;
+    for (size_t n = 0; n < ann->node_count && !writer.failed; n++) {
+        uint32_t index = ann->index_of[n];
+        uint32_t saved = index < index_bound && index_map[index] < DISKANN_NONE ? (uint32_t)index_map[index] : DISKANN_NONE;
+        diskann_writer_put(&writer, &saved, sizeof(saved));
+    }
+    diskann_writer_flush(&writer);
+
+    header.tag = tag;
+    header.body_crc = writer.crc;
+    if (writer.failed || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Give the nodes of a freshly opened graph the dataset indices of a map file.
+ *
+ * @param ann Graph opened by diskann_open.
+ * @param file Map file written by diskann_write_map.
+ * @param tag Identifier the map must carry.
+ * @return int 0 on success, -1 if the map is invalid, belongs to another file or dataset, or on failure.
+ */
+int diskann_read_map(DiskANN* ann, FILE* file, uint64_t tag) {
+    DiskANNMapHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, DISKANN_MAP_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != DISKANN_FILE_VERSION || header.node_count != ann->node_count) {
+        fprintf(stderr, "Invalid Vamana map file\n");
+        return -1;
+    }
+    if (header.id != ann->id || header.tag != tag) {
+        fprintf(stderr, "Vamana map file belongs to another graph or database file\n");
+        return -1;
+    }
+    if (fread(ann->index_of, sizeof(uint32_t), ann->node_count, file) != ann->node_count ||
+        crc32c_update(0, ann->index_of, ann->node_count * sizeof(uint32_t)) != header.body_crc) {
+        fprintf(stderr, "Corrupt Vamana map file\n");
+        memset(ann->index_of, 0xff, ann->node_count * sizeof(uint32_t));
+        return -1;
+    }
+
+    size_t index_bound = 0;
+    for (size_t n = 0; n < ann->node_count; n++) {
+        if (ann->index_of[n] != DISKANN_NONE && ann->index_of[n] >= index_bound) {
+            index_bound = (size_t)ann->index_of[n] + 1;
+        }
+    }
+    int status = diskann_reserve(ann, index_bound);
+    ann->count = 0;
+    for (size_t n = 0; status == 0 && n < ann->node_count; n++) {
+        uint32_t index = ann->index_of[n];
+        if (index == DISKANN_NONE) {
+            continue;
+        }
+        if (ann->node_of[index] != DISKANN_NONE) {
+            fprintf(stderr, "Corrupt Vamana map file\n");
+            status = -1;
+            break;
+        }
+        ann->node_of[index] = (uint32_t)n;
+        ann->count++;
+    }
+    if (status != 0) {
+        memset(ann->index_of, 0xff, ann->node_count * sizeof(uint32_t));
+        if (ann->node_of) {
+            memset(ann->node_of, 0xff, ann->index_capacity * sizeof(uint32_t));
+        }
+        ann->count = 0;
+    }
+    return status;
+}
@@ -0,0 +1,847 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define FLAT_SCAN_X86 1
+#define FLAT_SCAN_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define FLAT_SCAN_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma,f16c")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FLAT_SCAN_NEON 1
+#endif
+
+#include "../include/flat_scan.h"
+
+#define FLAT_SCAN_BLOCK 64 // Components decoded at a time by the scalar kernels and the kernel tails
+
+/**
+ * @struct FlatScanCandidate
+ * @brief A vector with its distance to the query.
+ */
+typedef struct FlatScanCandidate {
+    double distance; /**< Squared distance to the query */
+    size_t index;    /**< Index of the vector */
+} FlatScanCandidate;
+
+/**
+ * @struct FlatScanJob
+ * @brief Scan shared by the threads; each thread takes the next batch of indices into its own heap.
+ */
+typedef struct FlatScanJob {
+    const double* query;         /**< Query of dimension components */
+    size_t dimension;            /**< Number of components per vector */
+    size_t count;                /**< Number of indices to compare */
+    size_t k;                    /**< Entries of every heap */
+    FlatScanKernel kernel;       /**< Distance kernel of the element type */
+    FlatScanDataFunc data_func;  /**< Reads a vector */
+    void* context;               /**< Context passed to data_func */
+    unsigned char* buffers;      /**< One vector of scratch space per thread, for data_func */
+    size_t buffer_bytes;         /**< Size of each buffer */
+    FlatScanCandidate* heaps;    /**< k entries per thread, largest distance at the root */
+    size_t* heap_counts;         /**< Number of entries in the heap of every thread */
+    size_t next;                 /**< Next index to compare, guarded by lock */
+    size_t threads;              /**< Heaps handed out to threads, guarded by lock */
+    pthread_mutex_t lock;        /**< Protects next and threads */
+    size_t helpers;              /**< Pool workers still wanted, guarded by the pool lock */
+    size_t active;               /**< Pool workers running the job, guarded by the pool lock */
+    int queued;                  /**< Set while the job waits in the pool queue */
+    struct FlatScanJob* queue_next;  /**< Next job in the pool queue */
+} FlatScanJob;
+
+/**
+ * @struct FlatScanPool
+ * @brief Workers shared by every scan of the process, started on first use and never stopped.
+ *
+ * A scan queues its job, then compares batches on its own thread too; workers join the job at
+ * the head of the queue. Concurrent scans (one per shard) therefore share the same workers
+ * instead of each starting a thread per CPU.
+ */
+typedef struct FlatScanPool {
+    pthread_mutex_t lock;   /**< Protects every other field and the pool fields of queued jobs */
+    pthread_cond_t work;    /**< Signalled when a job is queued */
+    pthread_cond_t done;    /**< Broadcast when a worker leaves a job */
+    FlatScanJob* queue;     /**< Jobs still wanting workers, oldest first */
+    size_t workers;         /**< Number of workers started */
+} FlatScanPool;
+
+static FlatScanPool flat_scan_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0};
+
+static pthread_once_t flat_scan_once = PTHREAD_ONCE_INIT;
+static FlatScanISA flat_scan_selected = FLAT_SCAN_ISA_SCALAR;
+static FlatScanKernel flat_scan_kernels[VECTOR_ELEMENT_TYPE_COUNT];
+
+/**
+ * @brief Squared distance between doubles and stored components of any type, decoded in blocks.
+ *
+ * @param type Element type of the stored components.
+ * @param query Query of n doubles.
+ * @param data Stored components.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double flat_scan_l2_decoded(VectorElementType type, const double* query, const void* data, size_t n) {
+    double decoded[FLAT_SCAN_BLOCK];
+    size_t size = vector_element_size(type);
+    double sum = 0.0;
+    for (size_t start = 0; start < n; start += FLAT_SCAN_BLOCK) {
+        size_t count = n - start < FLAT_SCAN_BLOCK ? n - start : FLAT_SCAN_BLOCK;
+        vector_element_convert(VECTOR_ELEMENT_FLOAT64, decoded, type, (const char*)data + start * size, count);
+        for (size_t i = 0; i < count; i++) {
+            double diff = query[start + i] - decoded[i];
+            sum += diff * diff;
+        }
+    }
+    return sum;
+}
+
+/**
+ * @brief Scalar kernel for float64 components, with four independent sums.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored doubles.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double flat_scan_l2_f64_scalar(const double* query, const void* data, size_t n) {
+    const double* b = (const double*)data;
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        double d0 = query[i] - b[i], d1 = query[i + 1] - b[i + 1];
+        double d2 = query[i + 2] - b[i + 2], d3 = query[i + 3] - b[i + 3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; i < n; i++) {
+        double diff = query[i] - b[i];
+        s0 += diff * diff;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/**
+ * @brief Scalar kernel for float32 components, widened to doubles.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored floats.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double flat_scan_l2_f32_scalar(const double* query, const void* data, size_t n) {
+    const float* b = (const float*)data;
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        double d0 = query[i] - (double)b[i], d1 = query[i + 1] - (double)b[i + 1];
+        double d2 = query[i + 2] - (double)b[i + 2], d3 = query[i + 3] - (double)b[i + 3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; i < n; i++) {
+        double diff = query[i] - (double)b[i];
+        s0 += diff * diff;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/**
+ * @brief Scalar kernel for float16 components.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored halves.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double flat_scan_l2_f16_scalar(const double* query, const void* data, size_t n) {
+    return flat_scan_l2_decoded(VECTOR_ELEMENT_FLOAT16, query, data, n);
+}
+
+/**
+ * @brief Scalar kernel for bfloat16 components.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored brain floats.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double flat_scan_l2_bf16_scalar(const double* query, const void* data, size_t n) {
+    return flat_scan_l2_decoded(VECTOR_ELEMENT_BFLOAT16, query, data, n);
+}
+
+#if defined(FLAT_SCAN_X86)
+/**
+ * @brief Add the four lanes of an AVX accumulator.
+ *
+ * @param v Accumulator.
+ * @return double The sum of the lanes.
+ */
+FLAT_SCAN_TARGET_AVX2 static inline double flat_scan_sum_avx2(__m256d v) {
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+}
+
+/**
+ * @brief Accumulate the squared differences of 8 query components and 8 floats.
+ *
+ * @param query 8 query components.
+ * @param wide 8 stored components, already widened to floats.
+ * @param acc0 Accumulator of the first 4 components.
+ * @param acc1 Accumulator of the last 4 components.
+ */
+FLAT_SCAN_TARGET_AVX2 static inline void flat_scan_step_avx2(const double* query, __m256 wide, __m256d* acc0, __m256d* acc1) {
+    __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(query), _mm256_cvtps_pd(_mm256_castps256_ps128(wide)));
+    __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(query + 4), _mm256_cvtps_pd(_mm256_extractf128_ps(wide, 1)));
+    *acc0 = _mm256_fmadd_pd(d0, d0, *acc0);
+    *acc1 = _mm256_fmadd_pd(d1, d1, *acc1);
+}
+
+/**
+ * @brief AVX2 kernel for float64 components, with two fused multiply-add accumulators.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored doubles.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+FLAT_SCAN_TARGET_AVX2 static double flat_scan_l2_f64_avx2(const double* query, const void* data, size_t n) {
+    const double* b = (const double*)data;
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(query + i), _mm256_loadu_pd(b + i));
+        __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(query + i + 4), _mm256_loadu_pd(b + i + 4));
+        acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+        acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+    }
+    if (i + 4 <= n) {
+        __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(query + i), _mm256_loadu_pd(b + i));
+        acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+        i += 4;
+    }
+    double sum = flat_scan_sum_avx2(_mm256_add_pd(acc0, acc1));
+    for (; i < n; i++) {
+        double diff = query[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/**
+ * @brief AVX2 kernel for float32 components, widened to doubles in the lanes.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored floats.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+FLAT_SCAN_TARGET_AVX2 static double flat_scan_l2_f32_avx2(const double* query, const void* data, size_t n) {
+    const float* b = (const float*)data;
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        flat_scan_step_avx2(query + i, _mm256_loadu_ps(b + i), &acc0, &acc1);
+    }
+    double sum = flat_scan_sum_avx2(_mm256_add_pd(acc0, acc1));
+    for (; i < n; i++) {
+        double diff = query[i] - (double)b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/**
+ * @brief AVX2 kernel for float16 components, converted by F16C.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored halves.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+FLAT_SCAN_TARGET_AVX2 static double flat_scan_l2_f16_avx2(const double* query, const void* data, size_t n) {
+    const uint16_t* b = (const uint16_t*)data;
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        flat_scan_step_avx2(query + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(b + i))), &acc0, &acc1);
+    }
+    return flat_scan_sum_avx2(_mm256_add_pd(acc0, acc1)) +
+           flat_scan_l2_decoded(VECTOR_ELEMENT_FLOAT16, query + i, b + i, n - i);
+}
+
+/**
+ * @brief AVX2 kernel for bfloat16 components, widened by shifting them into the upper half of floats.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored brain floats.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+FLAT_SCAN_TARGET_AVX2 static double flat_scan_l2_bf16_avx2(const double* query, const void* data, size_t n) {
+    const uint16_t* b = (const uint16_t*)data;
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i bits = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(b + i))), 16);
+        flat_scan_step_avx2(query + i, _mm256_castsi256_ps(bits), &acc0, &acc1);
+    }
+    return flat_scan_sum_avx2(_mm256_add_pd(acc0, acc1)) +
+           flat_scan_l2_decoded(VECTOR_ELEMENT_BFLOAT16, query + i, b + i, n - i);
+}
+
+/**
+ * @brief Accumulate the squared differences of 16 query components and 16 floats.
+ *
+ * @param query 16 query components, or fewer with a mask.
+ * @param mask Query components to load, one bit per double of each half.
+ * @param wide 16 stored components, already widened to floats.
+ * @param acc0 Accumulator of the first 8 components.
+ * @param acc1 Accumulator of the last 8 components.
+ */
+FLAT_SCAN_TARGET_AVX512 static inline void flat_scan_step_avx512(const double* query, __mmask16 mask, __m512 wide,
+                                                                 __m512d* acc0, __m512d* acc1) {
+    __m256 low = _mm512_castps512_ps256(wide);
+    __m256 high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(wide), 1));
+    __m512d d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd((__mmask8)mask, query), _mm512_cvtps_pd(low));
+    __m512d d1 = _mm512_sub_pd(_mm512_maskz_loadu_pd((__mmask8)(mask >> 8), query + 8), _mm512_cvtps_pd(high));
+    *acc0 = _mm512_fmadd_pd(d0, d0, *acc0);
+    *acc1 = _mm512_fmadd_pd(d1, d1, *acc1);
+}
+
+/**
+ * @brief AVX-512 kernel for float64 components; the last partial lane is loaded with a mask.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored doubles.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+FLAT_SCAN_TARGET_AVX512 static double flat_scan_l2_f64_avx512(const double* query, const void* data, size_t n) {
+    const double* b = (const double*)data;
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(query + i), _mm512_loadu_pd(b + i));
+        __m512d d1 = _mm512_sub_pd(_mm512_loadu_pd(query + i + 8), _mm512_loadu_pd(b + i + 8));
+        acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+        acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+    }
+    for (; i < n; i += 8) {
+        __mmask8 mask = n - i >= 8 ? (__mmask8)0xFF : (__mmask8)((1u << (n - i)) - 1);
+        __m512d d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, query + i), _mm512_maskz_loadu_pd(mask, b + i));
+        acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+}
+
+/**
+ * @brief AVX-512 kernel for float32 components, widened to doubles in the lanes.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored floats.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+FLAT_SCAN_TARGET_AVX512 static double flat_scan_l2_f32_avx512(const double* query, const void* data, size_t n) {
+    const float* b = (const float*)data;
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    for (size_t i = 0; i < n; i += 16) {
+        __mmask16 mask = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        flat_scan_step_avx512(query + i, mask, _mm512_maskz_loadu_ps(mask, b + i), &acc0, &acc1);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+}
+
+/**
+ * @brief AVX-512 kernel for float16 components.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored halves.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+FLAT_SCAN_TARGET_AVX512 static double flat_scan_l2_f16_avx512(const double* query, const void* data, size_t n) {
+    const uint16_t* b = (const uint16_t*)data;
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 wide = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(b + i)));
+        flat_scan_step_avx512(query + i, (__mmask16)0xFFFF, wide, &acc0, &acc1);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)) +
+           flat_scan_l2_decoded(VECTOR_ELEMENT_FLOAT16, query + i, b + i, n - i);
+}
+
+/**
+ * @brief AVX-512 kernel for bfloat16 components.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored brain floats.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+FLAT_SCAN_TARGET_AVX512 static double flat_scan_l2_bf16_avx512(const double* query, const void* data, size_t n) {
+    const uint16_t* b = (const uint16_t*)data;
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i bits = _mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(b + i))), 16);
+        flat_scan_step_avx512(query + i, (__mmask16)0xFFFF, _mm512_castsi512_ps(bits), &acc0, &acc1);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)) +
+           flat_scan_l2_decoded(VECTOR_ELEMENT_BFLOAT16, query + i, b + i, n - i);
+}
+#elif defined(FLAT_SCAN_NEON)
+/**
+ * @brief Accumulate the squared differences of 4 query components and 4 floats.
+ *
+ * @param query 4 query components.
+ * @param wide 4 stored components, already widened to floats.
+ * @param acc0 Accumulator of the first 2 components.
+ * @param acc1 Accumulator of the last 2 components.
+ */
+static inline void flat_scan_step_neon(const double* query, float32x4_t wide, float64x2_t* acc0, float64x2_t* acc1) {
+    float64x2_t d0 = vsubq_f64(vld1q_f64(query), vcvt_f64_f32(vget_low_f32(wide)));
+    float64x2_t d1 = vsubq_f64(vld1q_f64(query + 2), vcvt_high_f64_f32(wide));
+    *acc0 = vfmaq_f64(*acc0, d0, d0);
+    *acc1 = vfmaq_f64(*acc1, d1, d1);
+}
+
+/**
+ * @brief NEON kernel for float64 components, with two fused multiply-add accumulators.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored doubles.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double flat_scan_l2_f64_neon(const double* query, const void* data, size_t n) {
+    const double* b = (const double*)data;
+    float64x2_t acc0 = vdupq_n_f64(0.0), acc1 = vdupq_n_f64(0.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float64x2_t d0 = vsubq_f64(vld1q_f64(query + i), vld1q_f64(b + i));
+        float64x2_t d1 = vsubq_f64(vld1q_f64(query + i + 2), vld1q_f64(b + i + 2));
+        acc0 = vfmaq_f64(acc0, d0, d0);
+        acc1 = vfmaq_f64(acc1, d1, d1);
+    }
+    double sum = vaddvq_f64(vaddq_f64(acc0, acc1));
+    for (; i < n; i++) {
+        double diff = query[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/**
+ * @brief NEON kernel for float32 components, widened to doubles in the lanes.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored floats.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double flat_scan_l2_f32_neon(const double* query, const void* data, size_t n) {
+    const float* b = (const float*)data;
+    float64x2_t acc0 = vdupq_n_f64(0.0), acc1 = vdupq_n_f64(0.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        flat_scan_step_neon(query + i, vld1q_f32(b + i), &acc0, &acc1);
+    }
+    double sum = vaddvq_f64(vaddq_f64(acc0, acc1));
+    for (; i < n; i++) {
+        double diff = query[i] - (double)b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/**
+ * @brief NEON kernel for float16 components.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored halves.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double flat_scan_l2_f16_neon(const double* query, const void* data, size_t n) {
+    const uint16_t* b = (const uint16_t*)data;
+    float64x2_t acc0 = vdupq_n_f64(0.0), acc1 = vdupq_n_f64(0.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        flat_scan_step_neon(query + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(b + i))), &acc0, &acc1);
+    }
+    return vaddvq_f64(vaddq_f64(acc0, acc1)) + flat_scan_l2_decoded(VECTOR_ELEMENT_FLOAT16, query + i, b + i, n - i);
+}
+
+/**
+ * @brief NEON kernel for bfloat16 components, widened by shifting them into the upper half of floats.
+ *
+ * @param query Query of n doubles.
+ * @param data Stored brain floats.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double flat_scan_l2_bf16_neon(const double* query, const void* data, size_t n) {
+    const uint16_t* b = (const uint16_t*)data;
+    float64x2_t acc0 = vdupq_n_f64(0.0), acc1 = vdupq_n_f64(0.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        flat_scan_step_neon(query + i, vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(b + i), 16)), &acc0, &acc1);
+    }
+    return vaddvq_f64(vaddq_f64(acc0, acc1)) + flat_scan_l2_decoded(VECTOR_ELEMENT_BFLOAT16, query + i, b + i, n - i);
+}
+#endif
+
+/**
+ * @brief Choose the kernels of the running CPU, once.
+ *
+ * On x86 the CPUID feature bits are checked together with XGETBV, so that wide registers the
+ * operating system does not save are never used.
+ */
+static void flat_scan_select(void) {
+    flat_scan_selected = FLAT_SCAN_ISA_SCALAR;
+    flat_scan_kernels[VECTOR_ELEMENT_FLOAT64] = flat_scan_l2_f64_scalar;
+    flat_scan_kernels[VECTOR_ELEMENT_FLOAT32] = flat_scan_l2_f32_scalar;
+    flat_scan_kernels[VECTOR_ELEMENT_FLOAT16] = flat_scan_l2_f16_scalar;
+    flat_scan_kernels[VECTOR_ELEMENT_BFLOAT16] = flat_scan_l2_bf16_scalar;
+#if defined(FLAT_SCAN_X86)
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX) ||
+        !(ecx & bit_FMA) || !(ecx & bit_F16C)) {
+        return;
+    }
+    unsigned int xcr0_low, xcr0_high;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    unsigned int ymm_saved = (xcr0_low & 0x6) == 0x6;     // SSE and AVX state
+    unsigned int zmm_saved = (xcr0_low & 0xE6) == 0xE6;   // Plus the opmask and upper ZMM state
+    if (!ymm_saved || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_AVX2)) {
+        return;
+    }
+    if (zmm_saved && (ebx & bit_AVX512F)) {
+        flat_scan_selected = FLAT_SCAN_ISA_AVX512;
+        flat_scan_kernels[VECTOR_ELEMENT_FLOAT64] = flat_scan_l2_f64_avx512;
+        flat_scan_kernels[VECTOR_ELEMENT_FLOAT32] = flat_scan_l2_f32_avx512;
+        flat_scan_kernels[VECTOR_ELEMENT_FLOAT16] = flat_scan_l2_f16_avx512;
+        flat_scan_kernels[VECTOR_ELEMENT_BFLOAT16] = flat_scan_l2_bf16_avx512;
+    } else {
+        flat_scan_selected = FLAT_SCAN_ISA_AVX2;
+        flat_scan_kernels[VECTOR_ELEMENT_FLOAT64] = flat_scan_l2_f64_avx2;
+        flat_scan_kernels[VECTOR_ELEMENT_FLOAT32] = flat_scan_l2_f32_avx2;
+        flat_scan_kernels[VECTOR_ELEMENT_FLOAT16] = flat_scan_l2_f16_avx2;
+        flat_scan_kernels[VECTOR_ELEMENT_BFLOAT16] = flat_scan_l2_bf16_avx2;
+    }
+#elif defined(FLAT_SCAN_NEON)
+    flat_scan_selected = FLAT_SCAN_ISA_NEON;
+    flat_scan_kernels[VECTOR_ELEMENT_FLOAT64] = flat_scan_l2_f64_neon;
+    flat_scan_kernels[VECTOR_ELEMENT_FLOAT32] = flat_scan_l2_f32_neon;
+    flat_scan_kernels[VECTOR_ELEMENT_FLOAT16] = flat_scan_l2_f16_neon;
+    flat_scan_kernels[VECTOR_ELEMENT_BFLOAT16] = flat_scan_l2_bf16_neon;
+#endif
+}
+
+/**
+ * @brief Instruction set the kernels use on this CPU.
+ *
+ * @return FlatScanISA The instruction set.
+ */
+FlatScanISA flat_scan_isa(void) {
+    pthread_once(&flat_scan_once, flat_scan_select);
+    return flat_scan_selected;
+}
+
+/**
+ * @brief Name of an instruction set as reported by the server.
+ *
+ * @param isa Instruction set.
+ * @return const char* "scalar", "neon", "avx2" or "avx512".
+ */
+const char* flat_scan_isa_name(FlatScanISA isa) {
+    switch (isa) {
+        case FLAT_SCAN_ISA_NEON: return "neon";
+        case FLAT_SCAN_ISA_AVX2: return "avx2";
+        case FLAT_SCAN_ISA_AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+/**
+ * @brief Distance kernel for an element type on this CPU.
+ *
+ * @param type Element type of the stored components.
+ * @return FlatScanKernel The kernel.
+ */
+FlatScanKernel flat_scan_kernel(VectorElementType type) {
+    pthread_once(&flat_scan_once, flat_scan_select);
+    return (unsigned)type < VECTOR_ELEMENT_TYPE_COUNT ? flat_scan_kernels[type] : flat_scan_l2_f64_scalar;
+}
+
+/**
+ * @brief Whether a candidate ranks before another: nearer, or as near with a smaller index.
+ *
+ * @param a First candidate.
+ * @param b Second candidate.
+ * @return int Non-zero if a ranks before b.
+ */
+static int flat_scan_before(const FlatScanCandidate* a, const FlatScanCandidate* b) {
+    return a->distance < b->distance || (a->distance == b->distance && a->index < b->index);
+}
+
+/**
+ * @brief Push a candidate into a bounded max-heap keeping the candidates that rank first.
+ *
+ * @param heap Heap array of `capacity` entries, last-ranked candidate at the root.
+ * @param count Number of entries in the heap, updated.
+ * @param capacity Maximum number of entries.
+ * @param candidate Candidate to push.
+ */
+static void flat_scan_push(FlatScanCandidate* heap, size_t* count, size_t capacity, FlatScanCandidate candidate) {
+    size_t pos;
+    if (*count < capacity) {
+        pos = (*count)++;
+        while (pos > 0 && flat_scan_before(&heap[(pos - 1) / 2], &candidate)) {
+            heap[pos] = heap[(pos - 1) / 2];
+            pos = (pos - 1) / 2;
+        }
+    } else if (flat_scan_before(&candidate, &heap[0])) {
+        pos = 0;
+        for (;;) {
+            size_t child = 2 * pos + 1;
+            if (child >= *count) {
+                break;
+            }
+            if (child + 1 < *count && flat_scan_before(&heap[child], &heap[child + 1])) {
+                child++;
+            }
+            if (!flat_scan_before(&candidate, &heap[child])) {
+                break;
+            }
+            heap[pos] = heap[child];
+            pos = child;
+        }
+    } else {
+        return;
+    }
+    heap[pos] = candidate;
+}
+
+/**
+ * @brief Order candidates by rank, see flat_scan_before.
+ *
+ * @param a First FlatScanCandidate.
+ * @param b Second FlatScanCandidate.
+ * @return int Negative, zero or positive as a ranks before, with or after b.
+ */
+static int flat_scan_compare(const void* a, const void* b) {
+    const FlatScanCandidate* ca = (const FlatScanCandidate*)a;
+    const FlatScanCandidate* cb = (const FlatScanCandidate*)b;
+    return flat_scan_before(cb, ca) - flat_scan_before(ca, cb);
+}
+
+/**
+ * @brief Thread body comparing batches of indices with the query until none is left.
+ *
+ * @param arg Pointer to the FlatScanJob.
+ * @return void* NULL.
+ */
+static void* flat_scan_thread(void* arg) {
+    FlatScanJob* job = (FlatScanJob*)arg;
+    pthread_mutex_lock(&job->lock);
+    size_t slot = job->threads++;
+    pthread_mutex_unlock(&job->lock);
+    FlatScanCandidate* heap = job->heaps + slot * job->k;
+    void* buffer = job->buffers + slot * job->buffer_bytes;
+    size_t count = 0;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t first = job->next;
+        job->next = first + FLAT_SCAN_BATCH < job->count ? first + FLAT_SCAN_BATCH : job->count;
+        size_t end = job->next;
+        pthread_mutex_unlock(&job->lock);
+        if (first >= end) {
+            break;
+        }
+        for (size_t i = first; i < end; i++) {
+            const void* data = job->data_func(job->context, i, buffer);
+            if (data) {
+                FlatScanCandidate candidate = {job->kernel(job->query, data, job->dimension), i};
+                flat_scan_push(heap, &count, job->k, candidate);
+            }
+        }
+    }
+    job->heap_counts[slot] = count;
+    return NULL;
+}
+
+/**
+ * @brief Pool worker body: join the oldest queued job, scan with it, and wait for the next one.
+ *
+ * @param arg Unused.
+ * @return void* Never returns.
+ */
+static void* flat_scan_worker(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&flat_scan_pool.lock);
+    for (;;) {
+        while (!flat_scan_pool.queue) {
+            pthread_cond_wait(&flat_scan_pool.work, &flat_scan_pool.lock);
+        }
+        FlatScanJob* job = flat_scan_pool.queue;
+        if (--job->helpers == 0) {
+            flat_scan_pool.queue = job->queue_next;
+            job->queued = 0;
+        }
+        job->active++;
+        pthread_mutex_unlock(&flat_scan_pool.lock);
+
+        flat_scan_thread(job);
+
+        pthread_mutex_lock(&flat_scan_pool.lock);
+        if (--job->active == 0) {
+            pthread_cond_broadcast(&flat_scan_pool.done);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Queue a job for pool workers, starting workers up to the number wanted.
+ *
+ * @param job Job to queue.
+ * @param helpers Number of workers wanted besides the calling thread.
+ * @return int 0 if the job was queued, -1 if no worker could be started.
+ */
+static int flat_scan_pool_submit(FlatScanJob* job, size_t helpers) {
+    pthread_mutex_lock(&flat_scan_pool.lock);
+    while (flat_scan_pool.workers < helpers) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, flat_scan_worker, NULL) != 0) {
+            break;
+        }
+        pthread_detach(thread);
+        flat_scan_pool.workers++;
+    }
+    if (flat_scan_pool.workers == 0) {
+        pthread_mutex_unlock(&flat_scan_pool.lock);
+        return -1;
+    }
+
+    job->helpers = helpers < flat_scan_pool.workers ? helpers : flat_scan_pool.workers;
+    job->active = 0;
+    job->queued = 1;
+    job->queue_next = NULL;
+    FlatScanJob** link = &flat_scan_pool.queue;
+    while (*link) {
+        link = &(*link)->queue_next;
+    }
+    *link = job;
+    pthread_cond_broadcast(&flat_scan_pool.work);
+    pthread_mutex_unlock(&flat_scan_pool.lock);
+    return 0;
+}
+
+/**
+ * @brief Take a job out of the pool queue and wait for the workers still scanning it.
+ *
+ * @param job Job queued by flat_scan_pool_submit.
+ */
+static void flat_scan_pool_retire(FlatScanJob* job) {
+    pthread_mutex_lock(&flat_scan_pool.lock);
+    if (job->queued) {
+        FlatScanJob** link = &flat_scan_pool.queue;
+        while (*link != job) {
+            link = &(*link)->queue_next;
+        }
+        *link = job->queue_next;
+        job->queued = 0;
+    }
+    while (job->active > 0) {
+        pthread_cond_wait(&flat_scan_pool.done, &flat_scan_pool.lock);
+    }
+    pthread_mutex_unlock(&flat_scan_pool.lock);
+}
+
+/**
+ * @brief Find the exact k nearest vectors by comparing the query with every index.
+ *
+ * @param query Query of dimension components.
+ * @param dimension Number of components per vector.
+ * @param type Element type of the stored components.
+ * @param count Number of indices, from 0 to count - 1.
+ * @param k Maximum number of neighbors.
+ * @param thread_count Largest number of threads, the caller's included, at least 1; lowered for small counts.
+ * @param data_func Reads a vector.
+ * @param context Context passed to data_func.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the squared distances of the neighbors (k entries).
+ * @return size_t Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t flat_scan_search(const double* query, size_t dimension, VectorElementType type, size_t count, size_t k,
+                        size_t thread_count, FlatScanDataFunc data_func, void* context,
+                        size_t* indices, double* distances) {
+    if (k == 0 || count == 0) {
+        return 0;
+    }
+    size_t wanted = (count + FLAT_SCAN_SLOTS_PER_THREAD - 1) / FLAT_SCAN_SLOTS_PER_THREAD;
+    if (thread_count > wanted) {
+        thread_count = wanted;
+    }
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    FlatScanJob job;
+    job.query = query;
+    job.dimension = dimension;
+    job.count = count;
+    job.k = k;
+    job.kernel = flat_scan_kernel(type);
+    job.data_func = data_func;
+    job.context = context;
+    job.heaps = (FlatScanCandidate*)malloc(thread_count * k * sizeof(FlatScanCandidate));
+    job.heap_counts = (size_t*)calloc(thread_count, sizeof(size_t));
+    job.buffer_bytes = dimension * vector_element_size(type);
+    job.buffers = (unsigned char*)malloc(thread_count * job.buffer_bytes);
+    job.next = 0;
+    job.threads = 0;
+    if (!job.heaps || !job.heap_counts || !job.buffers || pthread_mutex_init(&job.lock, NULL) != 0) {
+        fprintf(stderr, "Failed to allocate memory for flat scan\n");
+        free(job.heaps);
+        free(job.heap_counts);
+        free(job.buffers);
+        return (size_t)-1;
+    }
+
+    // Small scans run on the caller's thread alone; larger ones are shared with the pool workers
+    int pooled = thread_count > 1 && flat_scan_pool_submit(&job, thread_count - 1) == 0;
+    flat_scan_thread(&job);
+    if (pooled) {
+        flat_scan_pool_retire(&job);
+    }
+    free(job.buffers);
+    pthread_mutex_destroy(&job.lock);
+
+    // Merge the heaps: the k nearest overall are among the k nearest of every thread
+    size_t total = 0;
+    for (size_t t = 0; t < job.threads; t++) {
+        for (size_t i = 0; i < job.heap_counts[t]; i++) {
+            job.heaps[total++] = job.heaps[t * k + i];
+        }
+    }
+    qsort(job.heaps, total, sizeof(FlatScanCandidate), flat_scan_compare);
+    size_t results = total < k ? total : k;
+    for (size_t i = 0; i < results; i++) {
+        indices[i] = job.heaps[i].index;
+        distances[i] = job.heaps[i].distance;
+    }
+    free(job.heaps);
+    free(job.heap_counts);
+    return results;
+}
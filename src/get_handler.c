@@ -6,6 +6,7 @@
 #include "cjson/cJSON.h"
 
 #include "../include/vector_database.h"
+#include "../include/sharded_db.h"
 #include "../include/get_handler.h"
 
 
@@ -69,7 +70,7 @@ static enum MHD_Result get_handler_callback(void* cls, struct MHD_Connection* co
                                             const char* version,
                                             const char* upload_data,
                                             size_t* upload_data_size, void** con_cls) {
-    VectorDatabase* db = (VectorDatabase*)cls;
+    ShardedDatabase* db = (ShardedDatabase*)cls;
     if (!db) {
         fprintf(stderr, "Database pointer is NULL in handler callback\n");
         return MHD_NO;
@@ -85,7 +86,7 @@ static enum MHD_Result get_handler_callback(void* cls, struct MHD_Connection* co
     if (index_str) {
         // Handle request by index
         vec_index = (size_t)atoi(index_str);
-        if (vec_index >= db->size) {
+        if (vec_index >= sharded_db_index_bound(db)) {
             // Respond with an error if the index is out of bounds
             const char* error_msg = "{\"error\": \"Index out of bounds\"}";
             struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
@@ -95,10 +96,14 @@ static enum MHD_Result get_handler_callback(void* cls, struct MHD_Connection* co
             MHD_destroy_response(response);
             return ret == MHD_YES ? MHD_YES : MHD_NO;
         }
-        vec = vector_db_read(db, vec_index);
+        vec = sharded_db_get(db, vec_index);
     } else if (uuid_str) {
-        // Handle request by UUID
-        vec = vector_db_read_by_uuid(db, uuid_str);
+        // Handle request by UUID through the hash index
+        vec_index = sharded_db_find_index(db, uuid_str);
+        if (vec_index != (size_t)-1) {
+            // Copy by UUID, so that a concurrent compaction cannot hand back another vector
+            vec = sharded_db_get_by_uuid(db, uuid_str);
+        }
         if (!vec) {
             // Respond with an error if the vector is not found
             const char* error_msg = "{\"error\": \"Vector not found\"}";
@@ -109,13 +114,6 @@ static enum MHD_Result get_handler_callback(void* cls, struct MHD_Connection* co
             MHD_destroy_response(response);
             return ret == MHD_YES ? MHD_YES : MHD_NO;
         }
-        // Find the index of the vector with the given UUID
-        for (size_t i = 0; i < db->size; ++i) {
-            if (strcmp(db->vectors[i].uuid, uuid_str) == 0) {
-                vec_index = i;
-                break;
-            }
-        }
     } else {
         // Respond with an error if neither 'index' nor 'uuid' is provided
         const char* error_msg = "{\"error\": \"Missing 'index' or 'uuid' query parameter\"}";
@@ -129,6 +127,7 @@ static enum MHD_Result get_handler_callback(void* cls, struct MHD_Connection* co
 
     if (!vec || !vec->data) {
         // Respond with an error if the vector data is invalid
+        vector_db_release(vec);
         const char* error_msg = "{\"error\": \"Vector data is invalid\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
@@ -142,6 +141,7 @@ static enum MHD_Result get_handler_callback(void* cls, struct MHD_Connection* co
     cJSON* json_response = cJSON_CreateObject();
     if (!json_response) {
         // Respond with an error if JSON creation fails
+        vector_db_release(vec);
         const char* error_msg = "{\"error\": \"Failed to create JSON object\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
@@ -155,6 +155,7 @@ static enum MHD_Result get_handler_callback(void* cls, struct MHD_Connection* co
     cJSON* json_array = cJSON_CreateArray();
     if (!json_array) {
         cJSON_Delete(json_response);
+        vector_db_release(vec);
         const char* error_msg = "{\"error\": \"Failed to create JSON array\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
@@ -166,13 +167,15 @@ static enum MHD_Result get_handler_callback(void* cls, struct MHD_Connection* co
 
     // Add vector data to the JSON array
     for (size_t i = 0; i < vec->dimension; ++i) {
-        cJSON_AddItemToArray(json_array, cJSON_CreateNumber(vec->data[i]));
+        cJSON_AddItemToArray(json_array, cJSON_CreateNumber(vector_element_get(vec->type, vec->data, i)));
     }
 
     // Add vector details to the JSON response
     cJSON_AddStringToObject(json_response, "uuid", vec->uuid);  // Add UUID
     cJSON_AddNumberToObject(json_response, "index", vec_index); // Add index
+    cJSON_AddStringToObject(json_response, "element_type", vector_element_name(vec->type)); // Storage precision
     cJSON_AddItemToObject(json_response, "vector", json_array);
+    vector_db_release(vec);
 
     // Convert JSON object to string
     char* response_str = cJSON_PrintUnformatted(json_response);
@@ -0,0 +1,1299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../include/hnsw.h"
+#include "../include/crc32c.h"
+
+#define HNSW_BUILD_BATCH 64     // Points taken at a time by a build thread
+#define HNSW_MIN_VISITED_BITS 8 // log2 of the initial size of the visited set of a search
+#define HNSW_FILE_WRITE_BUFFER (1 << 16) // Bytes buffered by the graph file writer
+
+/**
+ * @struct HNSWCandidate
+ * @brief A node with its distance to the point being searched or linked.
+ */
+typedef struct HNSWCandidate {
+    double distance; /**< Distance to the query */
+    uint32_t node;   /**< Node number */
+} HNSWCandidate;
+
+/**
+ * @struct HNSWSearch
+ * @brief Buffers of a layer search, reused across layers and, by build threads, across inserts.
+ */
+typedef struct HNSWSearch {
+    HNSWCandidate* candidates; /**< Min-heap of the nodes left to expand */
+    size_t candidate_count;    /**< Number of nodes in candidates */
+    size_t candidate_capacity; /**< Entries available in candidates */
+    HNSWCandidate* results;    /**< Max-heap of the nearest nodes found, farthest at the root */
+    size_t result_count;       /**< Number of nodes in results */
+    size_t result_capacity;    /**< Entries available in results */
+    uint32_t* visited;         /**< Open-addressing set of the nodes seen, HNSW_NONE for empty entries */
+    size_t visited_bits;       /**< log2 of the number of entries of visited */
+    size_t visited_count;      /**< Number of nodes in visited */
+    int locked;                /**< Non-zero to read link lists under their stripe lock */
+    uint32_t links[2 * HNSW_MAX_M + 1]; /**< Copy of the link list being expanded */
+} HNSWSearch;
+
+/**
+ * @struct HNSWBuildJob
+ * @brief Work shared by the build threads; each thread takes the next batch of points.
+ */
+typedef struct HNSWBuildJob {
+    HNSW* graph;            /**< Graph being built */
+    const size_t* indices;  /**< Points to insert */
+    size_t count;           /**< Number of points */
+    size_t next;            /**< Next point to insert, guarded by lock */
+    int failed;             /**< Set if a point could not be inserted */
+    pthread_mutex_t lock;   /**< Protects next and failed */
+} HNSWBuildJob;
+
+/**
+ * @brief Parse the name of a metric.
+ *
+ * @param name Name to parse.
+ * @param metric Set to the parsed metric on success.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int hnsw_metric_parse(const char* name, HNSWMetric* metric) {
+    if (strcmp(name, "l2") == 0) {
+        *metric = HNSW_METRIC_L2;
+    } else if (strcmp(name, "cosine") == 0) {
+        *metric = HNSW_METRIC_COSINE;
+    } else if (strcmp(name, "ip") == 0) {
+        *metric = HNSW_METRIC_IP;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Return the name of a metric.
+ *
+ * @param metric Metric.
+ * @return const char* "l2", "cosine" or "ip".
+ */
+const char* hnsw_metric_name(HNSWMetric metric) {
+    if (metric == HNSW_METRIC_COSINE) {
+        return "cosine";
+    } else if (metric == HNSW_METRIC_IP) {
+        return "ip";
+    }
+    return "l2";
+}
+
+/**
+ * @brief Number of links a node keeps on a layer.
+ *
+ * @param graph Graph.
+ * @param level Layer.
+ * @return size_t 2 * m on layer 0, m above.
+ */
+static size_t hnsw_layer_capacity(const HNSW* graph, size_t level) {
+    return level == 0 ? 2 * graph->m : graph->m;
+}
+
+/**
+ * @brief Locate the link list of a node on a layer: a count followed by node numbers.
+ *
+ * @param graph Graph.
+ * @param node Node number.
+ * @param level Layer, at most the level of the node.
+ * @return uint32_t* The list.
+ */
+static uint32_t* hnsw_links(const HNSW* graph, uint32_t node, size_t level) {
+    uint32_t* links = graph->nodes[node].links;
+    return level == 0 ? links : links + (2 * graph->m + 1) + (level - 1) * (graph->m + 1);
+}
+
+/**
+ * @brief Allocate the empty link lists of a node.
+ *
+ * @param graph Graph.
+ * @param level Level of the node.
+ * @return uint32_t* The lists, or NULL on allocation failure.
+ */
+static uint32_t* hnsw_alloc_links(const HNSW* graph, size_t level) {
+    return (uint32_t*)calloc((2 * graph->m + 1) + level * (graph->m + 1), sizeof(uint32_t));
+}
+
+/**
+ * @brief Draw the level of a new node: floor(-ln(u) / ln(m)) for u uniform in (0, 1].
+ *
+ * The caller must hold entry_lock.
+ *
+ * @param graph Graph whose seed advances.
+ * @return size_t The level, at most HNSW_MAX_LEVEL.
+ */
+static size_t hnsw_draw_level(HNSW* graph) {
+    // splitmix64
+    uint64_t z = (graph->seed += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    double u = ((double)(z >> 11) + 1.0) / 9007199254740992.0;
+    double level = floor(-log(u) * graph->level_factor);
+    return level < HNSW_MAX_LEVEL ? (size_t)level : HNSW_MAX_LEVEL;
+}
+
+/**
+ * @brief Make room for more nodes and dataset indices.
+ *
+ * Must not run while other threads use the graph.
+ *
+ * @param graph Graph to grow.
+ * @param node_count Number of node numbers needed.
+ * @param index_bound Every dataset index to insert is below this value.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int hnsw_reserve(HNSW* graph, size_t node_count, size_t index_bound) {
+    if (node_count >= HNSW_NONE) {
+        fprintf(stderr, "HNSW graph is limited to %u nodes\n", HNSW_NONE - 1);
+        return -1;
+    }
+    if (node_count > graph->node_capacity) {
+        size_t capacity = graph->node_capacity > 0 ? graph->node_capacity : 64;
+        while (capacity < node_count) {
+            capacity *= 2;
+        }
+        HNSWNode* nodes = (HNSWNode*)realloc(graph->nodes, capacity * sizeof(HNSWNode));
+        if (!nodes) {
+            return -1;
+        }
+        graph->nodes = nodes;
+        graph->node_capacity = capacity;
+    }
+    if (index_bound > graph->index_capacity) {
+        size_t capacity = graph->index_capacity > 0 ? graph->index_capacity : 64;
+        while (capacity < index_bound) {
+            capacity *= 2;
+        }
+        uint32_t* node_of = (uint32_t*)realloc(graph->node_of, capacity * sizeof(uint32_t));
+        if (!node_of) {
+            return -1;
+        }
+        memset(node_of + graph->index_capacity, 0xff, (capacity - graph->index_capacity) * sizeof(uint32_t));
+        graph->node_of = node_of;
+        graph->index_capacity = capacity;
+    }
+    return 0;
+}
+
+/**
+ * @brief Create an empty graph.
+ *
+ * @param dimension Number of components per point.
+ * @param m Links per node and layer, from 2 to HNSW_MAX_M.
+ * @param ef_construction Candidates kept while linking an insert, at least m.
+ * @param metric Metric implemented by distance_func.
+ * @param point_func Reads a point.
+ * @param distance_func Compares a query with a point.
+ * @param context Context passed to the callbacks.
+ * @return HNSW* Pointer to the graph, or NULL on failure.
+ */
+HNSW* hnsw_create(size_t dimension, size_t m, size_t ef_construction, HNSWMetric metric,
+                  HNSWPointFunc point_func, HNSWDistanceFunc distance_func, void* context) {
+    if (dimension == 0 || m < 2 || m > HNSW_MAX_M || !point_func || !distance_func) {
+        return NULL;
+    }
+    HNSW* graph = (HNSW*)calloc(1, sizeof(HNSW));
+    if (!graph) {
+        return NULL;
+    }
+    graph->dimension = dimension;
+    graph->m = m;
+    graph->ef_construction = ef_construction > m ? ef_construction : m;
+    graph->metric = metric;
+    graph->level_factor = 1.0 / log((double)m);
+    graph->entry = HNSW_NONE;
+    graph->seed = 0x5DEECE66Dull;
+    graph->point_func = point_func;
+    graph->distance_func = distance_func;
+    graph->context = context;
+    graph->scratch = (double*)malloc(3 * dimension * sizeof(double));
+    graph->locks = (pthread_mutex_t*)malloc(HNSW_LOCK_STRIPES * sizeof(pthread_mutex_t));
+    if (!graph->scratch || !graph->locks || pthread_mutex_init(&graph->entry_lock, NULL) != 0) {
+        free(graph->locks);
+        free(graph->scratch);
+        free(graph);
+        return NULL;
+    }
+    for (size_t i = 0; i < HNSW_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&graph->locks[i], NULL);
+    }
+    return graph;
+}
+
+/**
+ * @brief Free a graph.
+ *
+ * @param graph Graph to free, may be NULL.
+ */
+void hnsw_free(HNSW* graph) {
+    if (!graph) {
+        return;
+    }
+    for (size_t i = 0; i < graph->node_count; i++) {
+        free(graph->nodes[i].links);
+    }
+    for (size_t i = 0; i < HNSW_LOCK_STRIPES; i++) {
+        pthread_mutex_destroy(&graph->locks[i]);
+    }
+    pthread_mutex_destroy(&graph->entry_lock);
+    free(graph->locks);
+    free(graph->scratch);
+    free(graph->free_nodes);
+    free(graph->node_of);
+    free(graph->nodes);
+    free(graph);
+}
+
+/**
+ * @brief Prepare the buffers of a search.
+ *
+ * @param search Search to initialize.
+ * @param ef Largest beam width it will run with.
+ * @param locked Non-zero to read link lists under their stripe lock.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int hnsw_search_init(HNSWSearch* search, size_t ef, int locked) {
+    search->candidate_capacity = ef > 64 ? ef : 64;
+    search->candidates = (HNSWCandidate*)malloc(search->candidate_capacity * sizeof(HNSWCandidate));
+    search->result_capacity = ef;
+    search->results = (HNSWCandidate*)malloc((ef + 1) * sizeof(HNSWCandidate));
+    search->visited_bits = HNSW_MIN_VISITED_BITS;
+    search->visited = (uint32_t*)malloc(((size_t)1 << search->visited_bits) * sizeof(uint32_t));
+    search->locked = locked;
+    if (!search->candidates || !search->results || !search->visited) {
+        free(search->candidates);
+        free(search->results);
+        free(search->visited);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Release the buffers of a search.
+ *
+ * @param search Search to release.
+ */
+static void hnsw_search_destroy(HNSWSearch* search) {
+    free(search->candidates);
+    free(search->results);
+    free(search->visited);
+}
+
+/**
+ * @brief Record a node as seen, unless it already was.
+ *
+ * @param search Search state.
+ * @param node Node number.
+ * @return int 1 if the node is new, 0 if it was seen already, -1 on allocation failure.
+ */
+static int hnsw_visit(HNSWSearch* search, uint32_t node) {
+    // Keep the set at most half full
+    if (2 * (search->visited_count + 1) > ((size_t)1 << search->visited_bits)) {
+        size_t bits = search->visited_bits + 1;
+        uint32_t* visited = (uint32_t*)malloc(((size_t)1 << bits) * sizeof(uint32_t));
+        if (!visited) {
+            return -1;
+        }
+        memset(visited, 0xff, ((size_t)1 << bits) * sizeof(uint32_t));
+        for (size_t i = 0; i < ((size_t)1 << search->visited_bits); i++) {
+            uint32_t entry = search->visited[i];
+            if (entry != HNSW_NONE) {
+                size_t pos = (size_t)(((uint64_t)entry * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+                while (visited[pos] != HNSW_NONE) {
+                    pos = (pos + 1) & (((size_t)1 << bits) - 1);
+                }
+                visited[pos] = entry;
+            }
+        }
+        free(search->visited);
+        search->visited = visited;
+        search->visited_bits = bits;
+    }
+
+    size_t mask = ((size_t)1 << search->visited_bits) - 1;
+    size_t pos = (size_t)(((uint64_t)node * 0x9E3779B97F4A7C15ull) >> (64 - search->visited_bits));
+    while (search->visited[pos] != HNSW_NONE) {
+        if (search->visited[pos] == node) {
+            return 0;
+        }
+        pos = (pos + 1) & mask;
+    }
+    search->visited[pos] = node;
+    search->visited_count++;
+    return 1;
+}
+
+/**
+ * @brief Push a node into a binary heap.
+ *
+ * @param heap Heap with room for one more entry.
+ * @param count Number of entries, incremented.
+ * @param item Node to push.
+ * @param max_heap Non-zero for a max-heap, zero for a min-heap.
+ */
+static void hnsw_heap_push(HNSWCandidate* heap, size_t* count, HNSWCandidate item, int max_heap) {
+    size_t pos = (*count)++;
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (max_heap ? heap[parent].distance >= item.distance : heap[parent].distance <= item.distance) {
+            break;
+        }
+        heap[pos] = heap[parent];
+        pos = parent;
+    }
+    heap[pos] = item;
+}
+
+/**
+ * @brief Take the root out of a binary heap.
+ *
+ * @param heap Non-empty heap.
+ * @param count Number of entries, decremented.
+ * @param max_heap Non-zero for a max-heap, zero for a min-heap.
+ * @return HNSWCandidate The farthest node of a max-heap, the nearest of a min-heap.
+ */
+static HNSWCandidate hnsw_heap_pop(HNSWCandidate* heap, size_t* count, int max_heap) {
+    HNSWCandidate top = heap[0];
+    HNSWCandidate last = heap[--(*count)];
+    size_t pos = 0;
+    for (;;) {
+        size_t child = 2 * pos + 1;
+        if (child >= *count) {
+            break;
+        }
+        if (child + 1 < *count && (max_heap ? heap[child + 1].distance > heap[child].distance
+                                            : heap[child + 1].distance < heap[child].distance)) {
+            child++;
+        }
+        if (max_heap ? heap[child].distance <= last.distance : heap[child].distance >= last.distance) {
+            break;
+        }
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = last;
+    return top;
+}
+
+/**
+ * @brief Compare two candidates by distance, for sorting.
+ *
+ * @param a Pointer to the first HNSWCandidate.
+ * @param b Pointer to the second HNSWCandidate.
+ * @return int Negative, zero or positive as a is nearer than, as near as or farther than b.
+ */
+static int hnsw_candidate_compare(const void* a, const void* b) {
+    double da = ((const HNSWCandidate*)a)->distance;
+    double db = ((const HNSWCandidate*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+/**
+ * @brief Copy the link list of a node on a layer.
+ *
+ * @param graph Graph.
+ * @param search Search whose links buffer receives the list.
+ * @param node Node number.
+ * @param level Layer.
+ * @return size_t Number of links copied, 0 if the node is removed or has no such layer.
+ */
+static size_t hnsw_copy_links(HNSW* graph, HNSWSearch* search, uint32_t node, size_t level) {
+    pthread_mutex_t* lock = &graph->locks[node % HNSW_LOCK_STRIPES];
+    if (search->locked) {
+        pthread_mutex_lock(lock);
+    }
+    size_t count = 0;
+    const HNSWNode* entry = &graph->nodes[node];
+    if (!entry->removed && entry->level >= level) {
+        const uint32_t* links = hnsw_links(graph, node, level);
+        count = links[0];
+        memcpy(search->links, links + 1, count * sizeof(uint32_t));
+    }
+    if (search->locked) {
+        pthread_mutex_unlock(lock);
+    }
+    return count;
+}
+
+/**
+ * @brief Walk one layer greedily towards a query, moving to any nearer neighbor until none is.
+ *
+ * @param graph Graph.
+ * @param search Search state providing the link buffer.
+ * @param query Query point.
+ * @param start Starting node and its distance, updated to the nearest node reached.
+ * @param level Layer.
+ */
+static void hnsw_greedy(HNSW* graph, HNSWSearch* search, const double* query, HNSWCandidate* start, size_t level) {
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        size_t count = hnsw_copy_links(graph, search, start->node, level);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t neighbor = search->links[i];
+            if (graph->nodes[neighbor].removed || graph->nodes[neighbor].level < level) {
+                continue; // Removed, or a stale link to a reused number
+            }
+            double distance = graph->distance_func(graph->context, graph->nodes[neighbor].index, query);
+            if (distance < start->distance) {
+                start->distance = distance;
+                start->node = neighbor;
+                changed = 1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Beam search of one layer: keep the ef nearest nodes found, expanding the nearest unexpanded one.
+ *
+ * @param graph Graph.
+ * @param search Search state; results holds the nodes found, as a max-heap.
+ * @param query Query point.
+ * @param start Starting node and its distance.
+ * @param ef Beam width, at most the width the search was initialized with.
+ * @param level Layer.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int hnsw_search_layer(HNSW* graph, HNSWSearch* search, const double* query, HNSWCandidate start,
+                             size_t ef, size_t level) {
+    search->candidate_count = 0;
+    search->result_count = 0;
+    search->visited_count = 0;
+    memset(search->visited, 0xff, ((size_t)1 << search->visited_bits) * sizeof(uint32_t));
+
+    hnsw_visit(search, start.node);
+    hnsw_heap_push(search->candidates, &search->candidate_count, start, 0);
+    hnsw_heap_push(search->results, &search->result_count, start, 1);
+    while (search->candidate_count > 0) {
+        HNSWCandidate nearest = hnsw_heap_pop(search->candidates, &search->candidate_count, 0);
+        if (search->result_count == ef && nearest.distance > search->results[0].distance) {
+            break; // Every node left is farther than the beam
+        }
+        size_t count = hnsw_copy_links(graph, search, nearest.node, level);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t neighbor = search->links[i];
+            int fresh = hnsw_visit(search, neighbor);
+            if (fresh < 0) {
+                return -1;
+            }
+            if (!fresh || graph->nodes[neighbor].removed || graph->nodes[neighbor].level < level) {
+                continue;
+            }
+            HNSWCandidate candidate;
+            candidate.node = neighbor;
+            candidate.distance = graph->distance_func(graph->context, graph->nodes[neighbor].index, query);
+            if (candidate.distance == INFINITY ||
+                (search->result_count == ef && candidate.distance >= search->results[0].distance)) {
+                continue;
+            }
+            if (search->candidate_count == search->candidate_capacity) {
+                size_t capacity = search->candidate_capacity * 2;
+                HNSWCandidate* candidates = (HNSWCandidate*)realloc(search->candidates, capacity * sizeof(HNSWCandidate));
+                if (!candidates) {
+                    return -1;
+                }
+                search->candidates = candidates;
+                search->candidate_capacity = capacity;
+            }
+            hnsw_heap_push(search->candidates, &search->candidate_count, candidate, 0);
+            hnsw_heap_push(search->results, &search->result_count, candidate, 1);
+            if (search->result_count > ef) {
+                hnsw_heap_pop(search->results, &search->result_count, 1);
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Pick the neighbors of a point among candidates with the HNSW heuristic.
+ *
+ * A candidate is kept only if it is nearer to the point than to every candidate kept before it,
+ * so links spread in different directions instead of crowding one cluster. Under the inner
+ * product the nearest candidates are kept as they are.
+ *
+ * @param graph Graph.
+ * @param candidates Candidates with their distance to the point, sorted nearest first; the kept ones are moved to the front.
+ * @param count Number of candidates.
+ * @param capacity Largest number of neighbors.
+ * @param buffer Scratch space of dimension doubles.
+ * @return size_t Number of neighbors kept.
+ */
+static size_t hnsw_select(HNSW* graph, HNSWCandidate* candidates, size_t count, size_t capacity, double* buffer) {
+    if (graph->metric == HNSW_METRIC_IP) {
+        // Not a metric: a point may be nearer to others than to itself, so the spread test drops good links
+        return count < capacity ? count : capacity;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < count && kept < capacity; i++) {
+        const double* point = graph->point_func(graph->context, graph->nodes[candidates[i].node].index, buffer);
+        if (!point) {
+            continue;
+        }
+        int diverse = 1;
+        for (size_t j = 0; j < kept && diverse; j++) {
+            double distance = graph->distance_func(graph->context, graph->nodes[candidates[j].node].index, point);
+            diverse = distance >= candidates[i].distance;
+        }
+        if (diverse) {
+            candidates[kept++] = candidates[i];
+        }
+    }
+    return kept;
+}
+
+/**
+ * @brief Rewrite the link list of a node on a layer from candidates, pruning them to the layer capacity.
+ *
+ * The caller must hold the stripe lock of the node, if other threads use the graph.
+ *
+ * @param graph Graph.
+ * @param node Node whose list is rewritten.
+ * @param level Layer.
+ * @param candidates Candidates with their distance to the node, reordered.
+ * @param count Number of candidates.
+ * @param buffer Scratch space of dimension doubles.
+ */
+static void hnsw_set_links(HNSW* graph, uint32_t node, size_t level, HNSWCandidate* candidates, size_t count,
+                           double* buffer) {
+    size_t capacity = hnsw_layer_capacity(graph, level);
+    qsort(candidates, count, sizeof(HNSWCandidate), hnsw_candidate_compare);
+    size_t kept = count > capacity ? hnsw_select(graph, candidates, count, capacity, buffer) : count;
+    uint32_t* links = hnsw_links(graph, node, level);
+    links[0] = (uint32_t)kept;
+    for (size_t i = 0; i < kept; i++) {
+        links[i + 1] = candidates[i].node;
+    }
+}
+
+/**
+ * @brief Add a link from a neighbor back to a new node, pruning the neighbor's list when it is full.
+ *
+ * @param graph Graph.
+ * @param search Search state, for its locking mode.
+ * @param neighbor Node that gains the link.
+ * @param node New node.
+ * @param distance Distance between the two.
+ * @param level Layer.
+ * @param base Scratch space of dimension doubles.
+ * @param buffer Scratch space of dimension doubles.
+ */
+static void hnsw_link_back(HNSW* graph, HNSWSearch* search, uint32_t neighbor, uint32_t node, double distance,
+                           size_t level, double* base, double* buffer) {
+    pthread_mutex_t* lock = &graph->locks[neighbor % HNSW_LOCK_STRIPES];
+    if (search->locked) {
+        pthread_mutex_lock(lock);
+    }
+    uint32_t* links = hnsw_links(graph, neighbor, level);
+    size_t count = links[0];
+    int present = 0;
+    for (size_t i = 0; i < count && !present; i++) {
+        present = links[i + 1] == node; // A stale link to the reused number now reaches the new node
+    }
+    if (!present && count < hnsw_layer_capacity(graph, level)) {
+        links[++links[0]] = node;
+    } else if (!present) {
+        // Full: keep the best spread of the current links and the new one, dropping removed nodes
+        HNSWCandidate candidates[2 * HNSW_MAX_M + 1];
+        size_t candidate_count = 0;
+        const double* point = graph->point_func(graph->context, graph->nodes[neighbor].index, base);
+        for (size_t i = 0; point && i < count; i++) {
+            uint32_t other = links[i + 1];
+            if (graph->nodes[other].removed || graph->nodes[other].level < level) {
+                continue;
+            }
+            candidates[candidate_count].node = other;
+            candidates[candidate_count++].distance = graph->distance_func(graph->context, graph->nodes[other].index, point);
+        }
+        if (point) {
+            candidates[candidate_count].node = node;
+            candidates[candidate_count++].distance = distance;
+            hnsw_set_links(graph, neighbor, level, candidates, candidate_count, buffer);
+        }
+    }
+    if (search->locked) {
+        pthread_mutex_unlock(lock);
+    }
+}
+
+/**
+ * @brief Insert a point: draw its level, find its neighbors layer by layer from the top and link them both ways.
+ *
+ * @param graph Graph with room for one more node and for the index.
+ * @param search Search state sized for ef_construction.
+ * @param index Index of the point.
+ * @param buffers Scratch space of 3 * dimension doubles.
+ * @return int 0 on success, -1 on failure.
+ */
+static int hnsw_insert_point(HNSW* graph, HNSWSearch* search, size_t index, double* buffers) {
+    size_t dimension = graph->dimension;
+    const double* point = graph->point_func(graph->context, index, buffers);
+    if (!point) {
+        return -1;
+    }
+    if (point != buffers) {
+        memcpy(buffers, point, dimension * sizeof(double)); // The other buffers are reused meanwhile
+        point = buffers;
+    }
+
+    pthread_mutex_lock(&graph->entry_lock);
+    size_t level = hnsw_draw_level(graph);
+    uint32_t* links = hnsw_alloc_links(graph, level);
+    if (!links) {
+        pthread_mutex_unlock(&graph->entry_lock);
+        return -1;
+    }
+    uint32_t node = graph->free_count > 0 ? graph->free_nodes[--graph->free_count] : (uint32_t)graph->node_count++;
+    if (graph->node_count > graph->node_capacity) {
+        // Callers reserve room first; this only guards the invariant
+        graph->node_count--;
+        pthread_mutex_unlock(&graph->entry_lock);
+        free(links);
+        return -1;
+    }
+    pthread_mutex_t* lock = &graph->locks[node % HNSW_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    graph->nodes[node].index = index;
+    graph->nodes[node].links = links;
+    graph->nodes[node].level = (uint8_t)level;
+    graph->nodes[node].removed = 0;
+    pthread_mutex_unlock(lock);
+    graph->node_of[index] = node;
+    graph->count++;
+    uint32_t entry = graph->entry;
+    size_t max_level = graph->max_level;
+    if (entry == HNSW_NONE) {
+        graph->entry = node;
+        graph->max_level = level;
+        pthread_mutex_unlock(&graph->entry_lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&graph->entry_lock);
+
+    HNSWCandidate nearest;
+    nearest.node = entry;
+    nearest.distance = graph->distance_func(graph->context, graph->nodes[entry].index, point);
+    for (size_t l = max_level; l > level; l--) {
+        hnsw_greedy(graph, search, point, &nearest, l);
+    }
+    for (size_t l = level < max_level ? level : max_level; l != (size_t)-1; l--) {
+        if (hnsw_search_layer(graph, search, point, nearest, graph->ef_construction, l) != 0) {
+            return -1;
+        }
+        // Stale links to a reused number may lead the search back to the new node itself
+        HNSWCandidate* found = search->results;
+        size_t count = 0;
+        for (size_t i = 0; i < search->result_count; i++) {
+            if (found[i].node != node) {
+                found[count++] = found[i];
+            }
+        }
+        if (count == 0) {
+            continue;
+        }
+        qsort(found, count, sizeof(HNSWCandidate), hnsw_candidate_compare);
+        nearest = found[0];
+        size_t kept = hnsw_select(graph, found, count, graph->m, buffers + dimension);
+
+        if (search->locked) {
+            pthread_mutex_lock(lock);
+        }
+        uint32_t* list = hnsw_links(graph, node, l);
+        list[0] = (uint32_t)kept;
+        for (size_t i = 0; i < kept; i++) {
+            list[i + 1] = found[i].node;
+        }
+        if (search->locked) {
+            pthread_mutex_unlock(lock);
+        }
+        for (size_t i = 0; i < kept; i++) {
+            hnsw_link_back(graph, search, found[i].node, node, found[i].distance, l,
+                           buffers + dimension, buffers + 2 * dimension);
+        }
+    }
+
+    if (level > max_level) {
+        pthread_mutex_lock(&graph->entry_lock);
+        if (level > graph->max_level) {
+            graph->entry = node;
+            graph->max_level = level;
+        }
+        pthread_mutex_unlock(&graph->entry_lock);
+    }
+    return 0;
+}
+
+/**
+ * @brief Thread body inserting batches of points until none is left.
+ *
+ * @param arg Pointer to the HNSWBuildJob.
+ * @return void* NULL.
+ */
+static void* hnsw_build_thread(void* arg) {
+    HNSWBuildJob* job = (HNSWBuildJob*)arg;
+    HNSW* graph = job->graph;
+    HNSWSearch search;
+    double* buffers = (double*)malloc(3 * graph->dimension * sizeof(double));
+    int ready = buffers && hnsw_search_init(&search, graph->ef_construction, 1) == 0;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        if (!ready) {
+            job->failed = 1;
+        }
+        size_t first = job->failed ? job->count : job->next;
+        job->next = first + HNSW_BUILD_BATCH < job->count ? first + HNSW_BUILD_BATCH : job->count;
+        size_t end = job->next;
+        pthread_mutex_unlock(&job->lock);
+        if (first >= end) {
+            break;
+        }
+        for (size_t i = first; i < end; i++) {
+            if (hnsw_insert_point(graph, &search, job->indices[i], buffers) != 0) {
+                pthread_mutex_lock(&job->lock);
+                job->failed = 1;
+                pthread_mutex_unlock(&job->lock);
+                break;
+            }
+        }
+    }
+    if (ready) {
+        hnsw_search_destroy(&search);
+    }
+    free(buffers);
+    return NULL;
+}
+
+/**
+ * @brief Insert a set of points with a pool of threads inserting concurrently.
+ *
+ * Room for every point is reserved first, so the node arrays never move while threads run.
+ *
+ * @param graph Graph to fill, not used by anyone else meanwhile.
+ * @param indices Indices of the points in the original dataset.
+ * @param count Number of points.
+ * @param thread_count Number of threads, at least 1.
+ * @return int 0 on success, -1 on failure.
+ */
+int hnsw_build(HNSW* graph, const size_t* indices, size_t count, size_t thread_count) {
+    size_t index_bound = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (indices[i] >= index_bound) {
+            index_bound = indices[i] + 1;
+        }
+    }
+    if (hnsw_reserve(graph, graph->node_count + count, index_bound) != 0) {
+        fprintf(stderr, "Failed to allocate memory for the HNSW graph\n");
+        return -1;
+    }
+
+    HNSWBuildJob job;
+    job.graph = graph;
+    job.indices = indices;
+    job.count = count;
+    job.next = 0;
+    job.failed = 0;
+    if (pthread_mutex_init(&job.lock, NULL) != 0) {
+        return -1;
+    }
+    pthread_t* threads = (pthread_t*)malloc((thread_count > 0 ? thread_count : 1) * sizeof(pthread_t));
+    size_t started = 0;
+    while (threads && started < thread_count &&
+           pthread_create(&threads[started], NULL, hnsw_build_thread, &job) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        hnsw_build_thread(&job); // No thread could be started, build on the caller's
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+
+    if (job.failed) {
+        fprintf(stderr, "Failed to insert into the HNSW graph\n");
+        return -1;
+    }
+    printf("HNSW graph built over %zu points, top layer %zu\n", count, graph->max_level);
+    return 0;
+}
+
+/**
+ * @brief Insert a point.
+ *
+ * @param graph Graph to update.
+ * @param index Index of the point, whose components must be readable.
+ * @return int 0 on success, -1 on failure.
+ */
+int hnsw_insert(HNSW* graph, size_t index) {
+    if (index < graph->index_capacity && graph->node_of[index] != HNSW_NONE) {
+        return -1;
+    }
+    size_t node_count = graph->free_count > 0 ? graph->node_count : graph->node_count + 1;
+    HNSWSearch search;
+    if (hnsw_reserve(graph, node_count, index + 1) != 0 || hnsw_search_init(&search, graph->ef_construction, 0) != 0) {
+        return -1;
+    }
+    int status = hnsw_insert_point(graph, &search, index, graph->scratch);
+    hnsw_search_destroy(&search);
+    return status;
+}
+
+/**
+ * @brief Remove a point, relinking its neighbors to each other.
+ *
+ * Every neighbor loses its link to the node and picks new links among its remaining ones and
+ * the node's other neighbors. A new entry point is taken among the node's top-layer neighbors,
+ * which share its level, or found by a scan when it had none.
+ *
+ * @param graph Graph to update.
+ * @param index Index of the point.
+ */
+void hnsw_remove(HNSW* graph, size_t index) {
+    if (index >= graph->index_capacity || graph->node_of[index] == HNSW_NONE) {
+        return;
+    }
+    uint32_t node = graph->node_of[index];
+    HNSWNode* removed = &graph->nodes[node];
+    double* base = graph->scratch;
+    double* buffer = graph->scratch + graph->dimension;
+    removed->removed = 1;
+
+    HNSWCandidate candidates[4 * HNSW_MAX_M + 1];
+    for (size_t l = 0; l <= removed->level; l++) {
+        const uint32_t* links = hnsw_links(graph, node, l);
+        for (size_t i = 0; i < links[0]; i++) {
+            uint32_t neighbor = links[i + 1];
+            if (graph->nodes[neighbor].removed || graph->nodes[neighbor].level < l) {
+                continue;
+            }
+            const double* point = graph->point_func(graph->context, graph->nodes[neighbor].index, base);
+            uint32_t* own = hnsw_links(graph, neighbor, l);
+            if (!point) {
+                continue;
+            }
+            // Union of the neighbor's links and the removed node's, without duplicates or removed nodes
+            size_t count = 0;
+            for (size_t pass = 0; pass < 2; pass++) {
+                const uint32_t* list = pass == 0 ? own : links;
+                for (size_t j = 0; j < list[0]; j++) {
+                    uint32_t other = list[j + 1];
+                    int skip = other == neighbor || graph->nodes[other].removed || graph->nodes[other].level < l;
+                    for (size_t c = 0; c < count && !skip; c++) {
+                        skip = candidates[c].node == other;
+                    }
+                    if (!skip) {
+                        candidates[count].node = other;
+                        candidates[count++].distance =
+                            graph->distance_func(graph->context, graph->nodes[other].index, point);
+                    }
+                }
+            }
+            hnsw_set_links(graph, neighbor, l, candidates, count, buffer);
+        }
+    }
+
+    if (graph->entry == node) {
+        graph->entry = HNSW_NONE;
+        const uint32_t* top = hnsw_links(graph, node, removed->level);
+        for (size_t i = 0; i < top[0] && graph->entry == HNSW_NONE; i++) {
+            if (!graph->nodes[top[i + 1]].removed && graph->nodes[top[i + 1]].level >= removed->level) {
+                graph->entry = top[i + 1];
+            }
+        }
+        if (graph->entry == HNSW_NONE) {
+            graph->max_level = 0;
+            for (size_t n = 0; n < graph->node_count; n++) {
+                if (!graph->nodes[n].removed && (graph->entry == HNSW_NONE || graph->nodes[n].level > graph->max_level)) {
+                    graph->entry = (uint32_t)n;
+                    graph->max_level = graph->nodes[n].level;
+                }
+            }
+        }
+    }
+
+    // Keep the number for reuse; links still reaching it are skipped until pruned
+    if (graph->free_count == graph->free_capacity) {
+        size_t capacity = graph->free_capacity > 0 ? graph->free_capacity * 2 : 64;
+        uint32_t* free_nodes = (uint32_t*)realloc(graph->free_nodes, capacity * sizeof(uint32_t));
+        if (free_nodes) {
+            graph->free_nodes = free_nodes;
+            graph->free_capacity = capacity;
+        }
+    }
+    if (graph->free_count < graph->free_capacity) {
+        graph->free_nodes[graph->free_count++] = node;
+    }
+    free(removed->links);
+    removed->links = NULL;
+    removed->level = 0;
+    graph->node_of[index] = HNSW_NONE;
+    graph->count--;
+}
+
+/**
+ * @brief Change the index stored for a point after it was moved.
+ *
+ * @param graph Graph to update.
+ * @param old_index Index the point was inserted with.
+ * @param new_index New index of the point.
+ */
+void hnsw_remap(HNSW* graph, size_t old_index, size_t new_index) {
+    if (old_index >= graph->index_capacity || graph->node_of[old_index] == HNSW_NONE ||
+        hnsw_reserve(graph, graph->node_count, new_index + 1) != 0) {
+        return;
+    }
+    uint32_t node = graph->node_of[old_index];
+    graph->node_of[old_index] = HNSW_NONE;
+    graph->node_of[new_index] = node;
+    graph->nodes[node].index = new_index;
+}
+
+/**
+ * @brief Find approximate nearest neighbors.
+ *
+ * Searches may run concurrently with each other but not with inserts or removals, so link
+ * lists are read without their locks.
+ *
+ * @param graph Graph to search.
+ * @param query Query of dimension components, in the form the distance function expects.
+ * @param k Maximum number of neighbors.
+ * @param ef_search Candidates kept by the beam search.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the metric distances of the neighbors (k entries).
+ * @return size_t Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t hnsw_search(HNSW* graph, const double* query, size_t k, size_t ef_search, size_t* indices, double* distances) {
+    if (k == 0 || graph->entry == HNSW_NONE) {
+        return 0;
+    }
+    size_t ef = ef_search > k ? ef_search : k;
+    HNSWSearch search;
+    if (hnsw_search_init(&search, ef, 0) != 0) {
+        return (size_t)-1;
+    }
+
+    HNSWCandidate nearest;
+    nearest.node = graph->entry;
+    nearest.distance = graph->distance_func(graph->context, graph->nodes[graph->entry].index, query);
+    for (size_t l = graph->max_level; l > 0; l--) {
+        hnsw_greedy(graph, &search, query, &nearest, l);
+    }
+    size_t found = (size_t)-1;
+    if (hnsw_search_layer(graph, &search, query, nearest, ef, 0) == 0) {
+        qsort(search.results, search.result_count, sizeof(HNSWCandidate), hnsw_candidate_compare);
+        found = search.result_count < k ? search.result_count : k;
+        for (size_t i = 0; i < found; i++) {
+            indices[i] = graph->nodes[search.results[i].node].index;
+            distances[i] = search.results[i].distance;
+        }
+    }
+    hnsw_search_destroy(&search);
+    return found;
+}
+
+/**
+ * @struct HNSWFileHeader
+ * @brief Header of a graph file, followed by one record per node.
+ *
+ * A node record is its dataset index (uint64), its level (uint32) and, for every layer from 0,
+ * a link count (uint32) followed by the dataset indices of the linked nodes (uint32).
+ */
+typedef struct HNSWFileHeader {
+    char magic[8];            /**< HNSW_FILE_MAGIC */
+    uint32_t version;         /**< HNSW_FILE_VERSION */
+    uint32_t metric;          /**< HNSWMetric */
+    uint64_t dimension;       /**< Number of components per point */
+    uint64_t m;               /**< Links per node and layer */
+    uint64_t ef_construction; /**< Candidates kept while linking an insert */
+    uint64_t node_count;      /**< Number of node records */
+    uint64_t entry;           /**< Dataset index of the entry node, or UINT64_MAX for an empty graph */
+    uint64_t tag;             /**< Identifier of the dataset */
+    uint32_t body_crc;        /**< CRC32C of the node records */
+    uint32_t reserved;        /**< Zero */
+} HNSWFileHeader;
+
+/**
+ * @struct HNSWFileWriter
+ * @brief Buffered writer over a raw file descriptor that checksums what it writes.
+ */
+typedef struct HNSWFileWriter {
+    int fd;            /**< Destination file */
+    size_t used;       /**< Bytes pending in buffer */
+    int failed;        /**< Set once a write failed */
+    uint32_t crc;      /**< CRC32C of the bytes written */
+    char buffer[HNSW_FILE_WRITE_BUFFER];
+} HNSWFileWriter;
+
+/**
+ * @brief Write the pending bytes of a writer.
+ *
+ * @param writer Writer to flush.
+ */
+static void hnsw_writer_flush(HNSWFileWriter* writer) {
+    size_t done = 0;
+    while (!writer->failed && done < writer->used) {
+        ssize_t written = write(writer->fd, writer->buffer + done, writer->used - done);
+        if (written < 0 && errno != EINTR) {
+            writer->failed = 1;
+        } else if (written > 0) {
+            done += (size_t)written;
+        }
+    }
+    writer->used = 0;
+}
+
+/**
+ * @brief Append bytes to a writer.
+ *
+ * @param writer Writer to append to.
+ * @param data Bytes to append.
+ * @param length Number of bytes.
+ */
+static void hnsw_writer_put(HNSWFileWriter* writer, const void* data, size_t length) {
+    const char* bytes = (const char*)data;
+    writer->crc = crc32c_update(writer->crc, data, length);
+    while (length > 0 && !writer->failed) {
+        size_t room = sizeof(writer->buffer) - writer->used;
+        size_t n = length < room ? length : room;
+        memcpy(writer->buffer + writer->used, bytes, n);
+        writer->used += n;
+        bytes += n;
+        length -= n;
+        if (writer->used == sizeof(writer->buffer)) {
+            hnsw_writer_flush(writer);
+        }
+    }
+}
+
+/**
+ * @brief Map a node to the index it is saved with.
+ *
+ * @param graph Graph.
+ * @param node Node number.
+ * @param index_map New index of every dataset index below index_bound, SIZE_MAX for points left out.
+ * @param index_bound Number of entries of index_map.
+ * @return size_t The saved index, or SIZE_MAX if the node is not saved.
+ */
+static size_t hnsw_saved_index(const HNSW* graph, uint32_t node, const size_t* index_map, size_t index_bound) {
+    const HNSWNode* entry = &graph->nodes[node];
+    if (entry->removed || entry->index >= index_bound || index_map[entry->index] >= HNSW_NONE) {
+        return SIZE_MAX;
+    }
+    return index_map[entry->index];
+}
+
+/**
+ * @brief Write a graph to a file.
+ *
+ * Links are saved as dataset indices rather than node numbers, so the file needs no renumbering
+ * table. Makes no allocation and goes through no stdio, so it can run in a forked child. The
+ * buffer is static: callers in the same process must not write two graphs at once.
+ *
+ * @param graph Graph to write.
+ * @param fd File to write to, positioned at offset 0.
+ * @param index_map New index of every dataset index below index_bound, SIZE_MAX for points left out.
+ * @param index_bound Number of entries of index_map.
+ * @param tag Identifier of the dataset the graph belongs to.
+ * @return int 0 on success, -1 on failure.
+ */
+int hnsw_write(const HNSW* graph, int fd, const size_t* index_map, size_t index_bound, uint64_t tag) {
+    static HNSWFileWriter writer;
+    writer.fd = fd;
+    writer.used = 0;
+    writer.failed = 0;
+
+    HNSWFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HNSW_FILE_MAGIC, sizeof(header.magic));
+    header.version = HNSW_FILE_VERSION;
+    header.metric = (uint32_t)graph->metric;
+    header.dimension = graph->dimension;
+    header.m = graph->m;
+    header.ef_construction = graph->ef_construction;
+    header.entry = UINT64_MAX;
+    for (size_t n = 0; n < graph->node_count; n++) {
+        if (hnsw_saved_index(graph, (uint32_t)n, index_map, index_bound) != SIZE_MAX) {
+            header.node_count++;
+        }
+    }
+    if (graph->entry != HNSW_NONE) {
+        size_t entry = hnsw_saved_index(graph, graph->entry, index_map, index_bound);
+        if (entry == SIZE_MAX) {
+            return -1; // Every live point is saved, the entry is live
+        }
+        header.entry = entry;
+    }
+    hnsw_writer_put(&writer, &header, sizeof(header));
+
+    writer.crc = 0;
+    uint32_t links[2 * HNSW_MAX_M];
+    for (size_t n = 0; n < graph->node_count && !writer.failed; n++) {
+        size_t saved = hnsw_saved_index(graph, (uint32_t)n, index_map, index_bound);
+        if (saved == SIZE_MAX) {
+            continue;
+        }
+        uint64_t index = saved;
+        uint32_t level = graph->nodes[n].level;
+        hnsw_writer_put(&writer, &index, sizeof(index));
+        hnsw_writer_put(&writer, &level, sizeof(level));
+        for (size_t l = 0; l <= level; l++) {
+            const uint32_t* list = hnsw_links(graph, (uint32_t)n, l);
+            uint32_t count = 0;
+            for (size_t i = 0; i < list[0]; i++) {
+                size_t other = hnsw_saved_index(graph, list[i + 1], index_map, index_bound);
+                if (other != SIZE_MAX && graph->nodes[list[i + 1]].level >= l) {
+                    links[count++] = (uint32_t)other;
+                }
+            }
+            hnsw_writer_put(&writer, &count, sizeof(count));
+            hnsw_writer_put(&writer, links, count * sizeof(uint32_t));
+        }
+    }
+    hnsw_writer_flush(&writer);
+
+    header.tag = tag;
+    header.body_crc = writer.crc;
+    if (writer.failed || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read bytes and extend a checksum with them.
+ *
+ * @param file File to read from.
+ * @param data Destination.
+ * @param length Number of bytes.
+ * @param crc Checksum to extend.
+ * @return int 0 on success, -1 on a short read.
+ */
+static int hnsw_get(FILE* file, void* data, size_t length, uint32_t* crc) {
+    if (fread(data, 1, length, file) != length) {
+        return -1;
+    }
+    *crc = crc32c_update(*crc, data, length);
+    return 0;
+}
+
+/**
+ * @brief Turn the saved links of a loaded graph from dataset indices into node numbers.
+ *
+ * @param graph Graph whose nodes were all read.
+ * @return int 0 on success, -1 if a link names a missing point or a node below its layer.
+ */
+static int hnsw_resolve_links(HNSW* graph) {
+    for (size_t n = 0; n < graph->node_count; n++) {
+        for (size_t l = 0; l <= graph->nodes[n].level; l++) {
+            uint32_t* list = hnsw_links(graph, (uint32_t)n, l);
+            for (size_t i = 0; i < list[0]; i++) {
+                uint32_t node = list[i + 1] < graph->index_capacity ? graph->node_of[list[i + 1]] : HNSW_NONE;
+                if (node == HNSW_NONE || graph->nodes[node].level < l) {
+                    return -1;
+                }
+                list[i + 1] = node;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Read a graph written by hnsw_write.
+ *
+ * @param file File to read from.
+ * @param dimension Number of components per point.
+ * @param tag Identifier the file must carry.
+ * @param point_func Reads a point.
+ * @param distance_func Compares a query with a point.
+ * @param context Context passed to the callbacks.
+ * @return HNSW* Pointer to the graph, or NULL if the file is invalid, belongs to another dataset or on failure.
+ */
+HNSW* hnsw_read(FILE* file, size_t dimension, uint64_t tag, HNSWPointFunc point_func,
+                HNSWDistanceFunc distance_func, void* context) {
+    HNSWFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, HNSW_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != HNSW_FILE_VERSION || header.metric > HNSW_METRIC_IP || header.dimension != dimension ||
+        header.m < 2 || header.m > HNSW_MAX_M || header.node_count >= HNSW_NONE ||
+        (header.node_count > 0) != (header.entry < HNSW_NONE)) {
+        fprintf(stderr, "Invalid HNSW graph file\n");
+        return NULL;
+    }
+    if (header.tag != tag) {
+        fprintf(stderr, "HNSW graph file belongs to another database file\n");
+        return NULL;
+    }
+    HNSW* graph = hnsw_create(dimension, (size_t)header.m, (size_t)header.ef_construction, (HNSWMetric)header.metric,
+                              point_func, distance_func, context);
+    if (!graph || hnsw_reserve(graph, (size_t)header.node_count, (size_t)header.node_count) != 0) {
+        hnsw_free(graph);
+        return NULL;
+    }
+
+    uint32_t crc = 0;
+    int status = 0;
+    for (uint64_t n = 0; n < header.node_count && status == 0; n++) {
+        uint64_t index;
+        uint32_t level;
+        status = hnsw_get(file, &index, sizeof(index), &crc) | hnsw_get(file, &level, sizeof(level), &crc);
+        uint32_t* links = status == 0 && level <= HNSW_MAX_LEVEL && index < HNSW_NONE ? hnsw_alloc_links(graph, level) : NULL;
+        if (!links || hnsw_reserve(graph, graph->node_count, (size_t)index + 1) != 0 ||
+            graph->node_of[index] != HNSW_NONE) {
+            free(links);
+            status = -1;
+            break;
+        }
+        HNSWNode* node = &graph->nodes[graph->node_count];
+        node->index = (size_t)index;
+        node->links = links;
+        node->level = (uint8_t)level;
+        node->removed = 0;
+        graph->node_of[index] = (uint32_t)graph->node_count++;
+        for (size_t l = 0; l <= level && status == 0; l++) {
+            uint32_t* list = hnsw_links(graph, (uint32_t)n, l);
+            status = hnsw_get(file, &list[0], sizeof(uint32_t), &crc);
+            if (status == 0 && list[0] > hnsw_layer_capacity(graph, l)) {
+                list[0] = 0;
+                status = -1;
+            }
+            if (status == 0 && hnsw_get(file, list + 1, list[0] * sizeof(uint32_t), &crc) != 0) {
+                list[0] = 0;
+                status = -1;
+            }
+        }
+    }
+    uint32_t entry = status == 0 && header.entry < graph->index_capacity ? graph->node_of[header.entry] : HNSW_NONE;
+    if (status != 0 || crc != header.body_crc || (header.node_count > 0 && entry == HNSW_NONE) ||
+        hnsw_resolve_links(graph) != 0) {
+        fprintf(stderr, "Corrupt HNSW graph file\n");
+        hnsw_free(graph);
+        return NULL;
+    }
+
+    graph->count = graph->node_count;
+    if (entry != HNSW_NONE) {
+        graph->entry = entry;
+        graph->max_level = graph->nodes[entry].level;
+        for (size_t n = 0; n < graph->node_count; n++) {
+            if (graph->nodes[n].level > graph->max_level) {
+                fprintf(stderr, "Corrupt HNSW graph file\n");
+                hnsw_free(graph);
+                return NULL;
+            }
+        }
+    }
+    return graph;
+}
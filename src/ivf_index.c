@@ -0,0 +1,861 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "../include/ivf_index.h"
+
+#define IVF_TRAIN_ITERATIONS 16    // Rounds of k-means when training the centroids
+#define IVF_SPLIT_ITERATIONS 8     // Rounds of 2-means when splitting a list
+#define IVF_JOB_BATCH 256          // Vectors taken at a time by a training or build thread
+#define IVF_MIN_LIST_CAPACITY 16   // Entries of a list when it first grows
+#define IVF_MIN_INDEX_CAPACITY 1024 // Entries of the index maps when they first grow
+
+/**
+ * @struct IVFCandidate
+ * @brief A vector or a list with its distance to the query.
+ */
+typedef struct IVFCandidate {
+    double distance; /**< Squared distance to the query */
+    size_t index;    /**< Dataset index of the vector, or number of the list */
+} IVFCandidate;
+
+/**
+ * @struct IVFJob
+ * @brief Work shared by the assignment threads; each thread takes the next batch of vectors.
+ */
+typedef struct IVFJob {
+    IVFIndex* ivf;          /**< Index whose centroids are compared */
+    const float* samples;   /**< Training vectors, or NULL to assign stored vectors */
+    const size_t* indices;  /**< Stored vectors to assign when samples is NULL */
+    size_t count;           /**< Number of vectors */
+    uint32_t* assignment;   /**< Nearest list of every vector, updated */
+    size_t next;            /**< Next vector to assign, guarded by lock */
+    size_t changed;         /**< Assignments changed by the current round, guarded by lock */
+    int failed;             /**< Set if a thread could not allocate or read a vector */
+    pthread_mutex_t lock;   /**< Protects next, changed and failed */
+} IVFJob;
+
+/**
+ * @brief Find the centroid nearest to a training vector.
+ *
+ * @param ivf Index.
+ * @param x Vector of dimension floats.
+ * @return uint32_t Number of the nearest list.
+ */
+static uint32_t ivf_index_nearest_float(const IVFIndex* ivf, const float* x) {
+    uint32_t best = 0;
+    float best_distance = FLT_MAX;
+    for (size_t c = 0; c < ivf->list_count; c++) {
+        const float* centroid = ivf->centroids + c * ivf->dimension;
+        float distance = 0.0f;
+        for (size_t i = 0; i < ivf->dimension; i++) {
+            float diff = x[i] - centroid[i];
+            distance += diff * diff;
+        }
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = (uint32_t)c;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Find the centroid nearest to a stored vector.
+ *
+ * @param ivf Index.
+ * @param x Vector of dimension doubles.
+ * @return uint32_t Number of the nearest list.
+ */
+static uint32_t ivf_index_nearest(const IVFIndex* ivf, const double* x) {
+    uint32_t best = 0;
+    double best_distance = DBL_MAX;
+    for (size_t c = 0; c < ivf->list_count; c++) {
+        const float* centroid = ivf->centroids + c * ivf->dimension;
+        double distance = 0.0;
+        for (size_t i = 0; i < ivf->dimension; i++) {
+            double diff = x[i] - centroid[i];
+            distance += diff * diff;
+        }
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = (uint32_t)c;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Squared distance between a vector and a double centroid.
+ *
+ * @param x Vector.
+ * @param centroid Centroid.
+ * @param n Number of components.
+ * @return double Squared distance.
+ */
+static double ivf_index_distance(const double* x, const double* centroid, size_t n) {
+    double distance = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double diff = x[i] - centroid[i];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+/**
+ * @brief Push a candidate into a bounded max-heap keeping the smallest distances.
+ *
+ * @param heap Heap array of `capacity` entries, largest distance at the root.
+ * @param count Number of entries in the heap, updated.
+ * @param capacity Maximum number of entries.
+ * @param distance Distance of the candidate.
+ * @param index Index of the candidate.
+ */
+static void ivf_index_push(IVFCandidate* heap, size_t* count, size_t capacity, double distance, size_t index) {
+    size_t pos;
+    if (*count < capacity) {
+        pos = (*count)++;
+        while (pos > 0 && heap[(pos - 1) / 2].distance < distance) {
+            heap[pos] = heap[(pos - 1) / 2];
+            pos = (pos - 1) / 2;
+        }
+    } else if (distance < heap[0].distance) {
+        pos = 0;
+        for (;;) {
+            size_t child = 2 * pos + 1;
+            if (child >= *count) {
+                break;
+            }
+            if (child + 1 < *count && heap[child + 1].distance > heap[child].distance) {
+                child++;
+            }
+            if (heap[child].distance <= distance) {
+                break;
+            }
+            heap[pos] = heap[child];
+            pos = child;
+        }
+    } else {
+        return;
+    }
+    heap[pos].distance = distance;
+    heap[pos].index = index;
+}
+
+/**
+ * @brief Order candidates by increasing distance.
+ *
+ * @param a First IVFCandidate.
+ * @param b Second IVFCandidate.
+ * @return int Negative, zero or positive as a is nearer, as near or farther than b.
+ */
+static int ivf_index_compare(const void* a, const void* b) {
+    double da = ((const IVFCandidate*)a)->distance;
+    double db = ((const IVFCandidate*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+/**
+ * @brief Make room for at least list_count lists and centroids.
+ *
+ * @param ivf Index to grow.
+ * @param list_count Required number of lists, at most IVF_MAX_LISTS.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int ivf_index_reserve_lists(IVFIndex* ivf, size_t list_count) {
+    if (list_count <= ivf->list_capacity) {
+        return 0;
+    }
+    size_t capacity = ivf->list_capacity > 0 ? ivf->list_capacity : IVF_MIN_LIST_CAPACITY;
+    while (capacity < list_count) {
+        capacity *= 2;
+    }
+    float* centroids = (float*)realloc(ivf->centroids, capacity * ivf->dimension * sizeof(float));
+    if (!centroids) {
+        return -1;
+    }
+    ivf->centroids = centroids;
+    IVFList* lists = (IVFList*)realloc(ivf->lists, capacity * sizeof(IVFList));
+    if (!lists) {
+        return -1;
+    }
+    memset(lists + ivf->list_capacity, 0, (capacity - ivf->list_capacity) * sizeof(IVFList));
+    ivf->lists = lists;
+    ivf->list_capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Make room in the index maps for every dataset index below index_bound.
+ *
+ * @param ivf Index to grow.
+ * @param index_bound Required number of entries.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int ivf_index_reserve_indices(IVFIndex* ivf, size_t index_bound) {
+    if (index_bound <= ivf->index_capacity) {
+        return 0;
+    }
+    size_t capacity = ivf->index_capacity > 0 ? ivf->index_capacity : IVF_MIN_INDEX_CAPACITY;
+    while (capacity < index_bound) {
+        capacity *= 2;
+    }
+    uint32_t* list_of = (uint32_t*)realloc(ivf->list_of, capacity * sizeof(uint32_t));
+    if (!list_of) {
+        return -1;
+    }
+    ivf->list_of = list_of;
+    size_t* position_of = (size_t*)realloc(ivf->position_of, capacity * sizeof(size_t));
+    if (!position_of) {
+        return -1;
+    }
+    ivf->position_of = position_of;
+    for (size_t i = ivf->index_capacity; i < capacity; i++) {
+        list_of[i] = IVF_NONE;
+    }
+    ivf->index_capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Append a vector to a list. The index maps must cover the vector.
+ *
+ * @param ivf Index to update.
+ * @param list Number of the list.
+ * @param index Dataset index of the vector.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int ivf_index_append(IVFIndex* ivf, uint32_t list, size_t index) {
+    IVFList* entries = &ivf->lists[list];
+    if (entries->count == entries->capacity) {
+        size_t capacity = entries->capacity > 0 ? entries->capacity * 2 : IVF_MIN_LIST_CAPACITY;
+        size_t* indices = (size_t*)realloc(entries->indices, capacity * sizeof(size_t));
+        if (!indices) {
+            return -1;
+        }
+        entries->indices = indices;
+        entries->capacity = capacity;
+    }
+    ivf->list_of[index] = list;
+    ivf->position_of[index] = entries->count;
+    entries->indices[entries->count++] = index;
+    return 0;
+}
+
+/**
+ * @brief Thread body assigning batches of vectors to their nearest centroid until none is left.
+ *
+ * @param arg Pointer to the IVFJob.
+ * @return void* NULL.
+ */
+static void* ivf_index_job_thread(void* arg) {
+    IVFJob* job = (IVFJob*)arg;
+    const IVFIndex* ivf = job->ivf;
+    double* buffer = job->samples ? NULL : (double*)malloc(ivf->dimension * sizeof(double));
+    int ready = job->samples || buffer;
+    size_t changed = 0;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        if (!ready) {
+            job->failed = 1;
+        }
+        size_t first = job->failed ? job->count : job->next;
+        job->next = first + IVF_JOB_BATCH < job->count ? first + IVF_JOB_BATCH : job->count;
+        size_t end = job->next;
+        pthread_mutex_unlock(&job->lock);
+        if (first >= end) {
+            break;
+        }
+        for (size_t i = first; i < end; i++) {
+            uint32_t list;
+            if (job->samples) {
+                list = ivf_index_nearest_float(ivf, job->samples + i * ivf->dimension);
+            } else {
+                const double* x = ivf->point_func(ivf->context, job->indices[i], buffer);
+                if (!x) {
+                    pthread_mutex_lock(&job->lock);
+                    job->failed = 1;
+                    pthread_mutex_unlock(&job->lock);
+                    break;
+                }
+                list = ivf_index_nearest(ivf, x);
+            }
+            if (list != job->assignment[i]) {
+                job->assignment[i] = list;
+                changed++;
+            }
+        }
+    }
+    pthread_mutex_lock(&job->lock);
+    job->changed += changed;
+    pthread_mutex_unlock(&job->lock);
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * @brief Run one assignment round of a job with a pool of threads.
+ *
+ * @param job Job to run; next and changed are reset.
+ * @param thread_count Number of threads, at least 1.
+ * @return int 0 on success, -1 on failure.
+ */
+static int ivf_index_run(IVFJob* job, size_t thread_count) {
+    job->next = 0;
+    job->changed = 0;
+    size_t batches = (job->count + IVF_JOB_BATCH - 1) / IVF_JOB_BATCH;
+    if (thread_count > batches) {
+        thread_count = batches > 0 ? batches : 1;
+    }
+    pthread_t* threads = (pthread_t*)malloc(thread_count * sizeof(pthread_t));
+    size_t started = 0;
+    while (threads && started < thread_count &&
+           pthread_create(&threads[started], NULL, ivf_index_job_thread, job) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        ivf_index_job_thread(job); // No thread could be started, assign on the caller's
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return job->failed ? -1 : 0;
+}
+
+/**
+ * @brief Create an index without lists.
+ *
+ * @param dimension Number of components per vector.
+ * @param point_func Reads a vector.
+ * @param distance_func Compares a query with a vector.
+ * @param prefetch_func Prefetches a vector, or NULL.
+ * @param context Context passed to the callbacks.
+ * @return IVFIndex* Pointer to the index, or NULL on failure.
+ */
+IVFIndex* ivf_index_create(size_t dimension, IVFPointFunc point_func, IVFDistanceFunc distance_func,
+                           IVFPrefetchFunc prefetch_func, void* context) {
+    if (dimension == 0) {
+        fprintf(stderr, "Cannot create an IVF index over 0 components\n");
+        return NULL;
+    }
+    IVFIndex* ivf = (IVFIndex*)calloc(1, sizeof(IVFIndex));
+    if (!ivf) {
+        fprintf(stderr, "Failed to allocate IVF index\n");
+        return NULL;
+    }
+    ivf->dimension = dimension;
+    ivf->point_func = point_func;
+    ivf->distance_func = distance_func;
+    ivf->prefetch_func = prefetch_func;
+    ivf->context = context;
+    ivf->scratch = (double*)malloc(3 * dimension * sizeof(double));
+    if (!ivf->scratch) {
+        fprintf(stderr, "Failed to allocate IVF index\n");
+        ivf_index_free(ivf);
+        return NULL;
+    }
+    return ivf;
+}
+
+/**
+ * @brief Free an index and its lists.
+ *
+ * @param ivf Index to free, may be NULL.
+ */
+void ivf_index_free(IVFIndex* ivf) {
+    if (ivf) {
+        for (size_t c = 0; c < ivf->list_capacity; c++) {
+            free(ivf->lists[c].indices);
+        }
+        free(ivf->lists);
+        free(ivf->centroids);
+        free(ivf->list_of);
+        free(ivf->position_of);
+        free(ivf->scratch);
+        free(ivf);
+    }
+}
+
+/**
+ * @brief Train the centroids with k-means, leaving every list empty.
+ *
+ * Centroids start on evenly spaced samples; an empty cluster is moved onto another sample.
+ * Stops after IVF_TRAIN_ITERATIONS rounds or when no assignment changes.
+ *
+ * @param ivf Index to train, without vectors.
+ * @param samples `count` training vectors of `dimension` floats each.
+ * @param count Number of training vectors.
+ * @param list_count Number of centroids, from 1 to IVF_MAX_LISTS; lowered to count if larger.
+ * @param thread_count Number of threads, at least 1.
+ * @return int 0 on success, -1 on failure.
+ */
+int ivf_index_train(IVFIndex* ivf, const float* samples, size_t count, size_t list_count, size_t thread_count) {
+    if (count == 0 || list_count == 0 || list_count > IVF_MAX_LISTS || ivf->count > 0) {
+        fprintf(stderr, "Cannot train an IVF index of %zu lists on %zu vectors\n", list_count, count);
+        return -1;
+    }
+    if (list_count > count) {
+        list_count = count;
+    }
+    size_t dimension = ivf->dimension;
+    uint32_t* assignment = (uint32_t*)malloc(count * sizeof(uint32_t));
+    double* sums = (double*)malloc(list_count * dimension * sizeof(double));
+    size_t* sizes = (size_t*)malloc(list_count * sizeof(size_t));
+    if (!assignment || !sums || !sizes || ivf_index_reserve_lists(ivf, list_count) != 0) {
+        fprintf(stderr, "Failed to allocate IVF training buffers\n");
+        free(assignment);
+        free(sums);
+        free(sizes);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        assignment[i] = IVF_NONE;
+    }
+    for (size_t c = 0; c < list_count; c++) {
+        memcpy(ivf->centroids + c * dimension, samples + (c * count / list_count) * dimension, dimension * sizeof(float));
+    }
+    ivf->list_count = list_count;
+
+    IVFJob job;
+    job.ivf = ivf;
+    job.samples = samples;
+    job.indices = NULL;
+    job.count = count;
+    job.assignment = assignment;
+    job.failed = 0;
+    int status = pthread_mutex_init(&job.lock, NULL) == 0 ? 0 : -1;
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (int iteration = 0; status == 0 && iteration < IVF_TRAIN_ITERATIONS; iteration++) {
+        if (ivf_index_run(&job, thread_count) != 0) {
+            status = -1;
+            break;
+        }
+        if (job.changed == 0) {
+            break;
+        }
+        memset(sums, 0, list_count * dimension * sizeof(double));
+        memset(sizes, 0, list_count * sizeof(size_t));
+        for (size_t i = 0; i < count; i++) {
+            size_t c = assignment[i];
+            sizes[c]++;
+            for (size_t d = 0; d < dimension; d++) {
+                sums[c * dimension + d] += samples[i * dimension + d];
+            }
+        }
+        for (size_t c = 0; c < list_count; c++) {
+            float* centroid = ivf->centroids + c * dimension;
+            if (sizes[c] == 0) {
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                memcpy(centroid, samples + ((seed >> 33) % count) * dimension, dimension * sizeof(float));
+                continue;
+            }
+            for (size_t d = 0; d < dimension; d++) {
+                centroid[d] = (float)(sums[c * dimension + d] / (double)sizes[c]);
+            }
+        }
+    }
+    if (status == 0) {
+        pthread_mutex_destroy(&job.lock);
+    }
+
+    free(assignment);
+    free(sums);
+    free(sizes);
+    if (status != 0) {
+        fprintf(stderr, "Failed to train IVF index\n");
+        ivf->list_count = 0;
+        return -1;
+    }
+    printf("IVF index trained on %zu vectors, %zu lists\n", count, list_count);
+    return 0;
+}
+
+/**
+ * @brief Assign a set of vectors to their lists with a pool of threads.
+ *
+ * The nearest centroids are found in parallel; every list is then sized once and filled, so
+ * that it is one exact allocation.
+ *
+ * @param ivf Trained index, not used by anyone else meanwhile.
+ * @param indices Indices of the vectors in the original dataset.
+ * @param count Number of vectors.
+ * @param thread_count Number of threads, at least 1.
+ * @return int 0 on success, -1 on failure.
+ */
+int ivf_index_build(IVFIndex* ivf, const size_t* indices, size_t count, size_t thread_count) {
+    if (ivf->list_count == 0 || ivf->count > 0) {
+        fprintf(stderr, "IVF index must be trained and empty before it is built\n");
+        return -1;
+    }
+    size_t index_bound = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (indices[i] >= index_bound) {
+            index_bound = indices[i] + 1;
+        }
+    }
+    uint32_t* assignment = (uint32_t*)malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+    size_t* sizes = (size_t*)calloc(ivf->list_count, sizeof(size_t));
+    if (!assignment || !sizes || ivf_index_reserve_indices(ivf, index_bound) != 0) {
+        fprintf(stderr, "Failed to allocate memory for the IVF index\n");
+        free(assignment);
+        free(sizes);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        assignment[i] = IVF_NONE;
+    }
+
+    IVFJob job;
+    job.ivf = ivf;
+    job.samples = NULL;
+    job.indices = indices;
+    job.count = count;
+    job.assignment = assignment;
+    job.failed = 0;
+    if (pthread_mutex_init(&job.lock, NULL) != 0) {
+        free(assignment);
+        free(sizes);
+        return -1;
+    }
+    int status = ivf_index_run(&job, thread_count);
+    pthread_mutex_destroy(&job.lock);
+
+    for (size_t i = 0; status == 0 && i < count; i++) {
+        sizes[assignment[i]]++;
+    }
+    for (size_t c = 0; status == 0 && c < ivf->list_count; c++) {
+        IVFList* list = &ivf->lists[c];
+        if (sizes[c] > list->capacity) {
+            size_t* entries = (size_t*)realloc(list->indices, sizes[c] * sizeof(size_t));
+            if (!entries) {
+                status = -1;
+                break;
+            }
+            list->indices = entries;
+            list->capacity = sizes[c];
+        }
+    }
+    for (size_t i = 0; status == 0 && i < count; i++) {
+        ivf_index_append(ivf, assignment[i], indices[i]); // Cannot fail, every list was sized
+    }
+    free(assignment);
+    free(sizes);
+    if (status != 0) {
+        fprintf(stderr, "Failed to build IVF index\n");
+        return -1;
+    }
+    ivf->count = count;
+    printf("IVF index built over %zu vectors, %zu lists\n", count, ivf->list_count);
+    return 0;
+}
+
+/**
+ * @brief Append a vector to the list of its nearest centroid.
+ *
+ * @param ivf Trained index.
+ * @param index Index of the vector, whose components must be readable.
+ * @return int 0 on success, -1 on failure.
+ */
+int ivf_index_insert(IVFIndex* ivf, size_t index) {
+    if (ivf->list_count == 0 || (index < ivf->index_capacity && ivf->list_of[index] != IVF_NONE)) {
+        return -1;
+    }
+    if (ivf_index_reserve_indices(ivf, index + 1) != 0) {
+        return -1;
+    }
+    const double* x = ivf->point_func(ivf->context, index, ivf->scratch);
+    if (!x || ivf_index_append(ivf, ivf_index_nearest(ivf, x), index) != 0) {
+        return -1;
+    }
+    ivf->count++;
+    return 0;
+}
+
+/**
+ * @brief Remove a vector from its list.
+ *
+ * The last entry of the list takes its place, so lists stay contiguous.
+ *
+ * @param ivf Index to update.
+ * @param index Index of the vector.
+ */
+void ivf_index_remove(IVFIndex* ivf, size_t index) {
+    if (index >= ivf->index_capacity || ivf->list_of[index] == IVF_NONE) {
+        return;
+    }
+    IVFList* list = &ivf->lists[ivf->list_of[index]];
+    size_t position = ivf->position_of[index];
+    size_t last = list->indices[--list->count];
+    list->indices[position] = last;
+    ivf->position_of[last] = position;
+    ivf->list_of[index] = IVF_NONE;
+    ivf->count--;
+}
+
+/**
+ * @brief Change the index stored for a vector after it was moved.
+ *
+ * @param ivf Index to update.
+ * @param old_index Index the vector was inserted with.
+ * @param new_index New index of the vector.
+ */
+void ivf_index_remap(IVFIndex* ivf, size_t old_index, size_t new_index) {
+    if (old_index >= ivf->index_capacity || ivf->list_of[old_index] == IVF_NONE ||
+        ivf_index_reserve_indices(ivf, new_index + 1) != 0) {
+        return;
+    }
+    uint32_t list = ivf->list_of[old_index];
+    size_t position = ivf->position_of[old_index];
+    ivf->lists[list].indices[position] = new_index;
+    ivf->list_of[new_index] = list;
+    ivf->position_of[new_index] = position;
+    ivf->list_of[old_index] = IVF_NONE;
+}
+
+/**
+ * @brief Copy a stored vector into a buffer.
+ *
+ * @param ivf Index.
+ * @param index Dataset index of the vector.
+ * @param buffer Destination of dimension doubles.
+ * @return int 0 on success, -1 if the vector cannot be read.
+ */
+static int ivf_index_copy_point(IVFIndex* ivf, size_t index, double* buffer) {
+    const double* x = ivf->point_func(ivf->context, index, buffer);
+    if (!x) {
+        return -1;
+    }
+    if (x != buffer) {
+        memcpy(buffer, x, ivf->dimension * sizeof(double));
+    }
+    return 0;
+}
+
+/**
+ * @brief Split a list in two with 2-means over its vectors.
+ *
+ * The two means start on the vector farthest from the centroid and the vector farthest from
+ * that one. Vectors nearer to the first mean keep the list, the others move to a new list. If
+ * the vectors cannot be told apart, the second half of the list moves.
+ *
+ * @param ivf Index to update, with fewer than IVF_MAX_LISTS lists.
+ * @param number Number of the list to split.
+ * @return int 0 on success, -1 on failure.
+ */
+static int ivf_index_split(IVFIndex* ivf, uint32_t number) {
+    size_t dimension = ivf->dimension;
+    size_t n = ivf->lists[number].count;
+    double* x = ivf->scratch;
+    double* means = ivf->scratch + dimension; // Two means, one after the other
+    uint8_t* side = (uint8_t*)malloc(n);
+    double* sums = (double*)malloc(2 * dimension * sizeof(double));
+    if (!side || !sums || ivf_index_reserve_lists(ivf, ivf->list_count + 1) != 0) {
+        free(side);
+        free(sums);
+        return -1;
+    }
+    IVFList* list = &ivf->lists[number];
+
+    // Seed the means on two far apart vectors
+    for (size_t d = 0; d < dimension; d++) {
+        means[d] = ivf->centroids[number * dimension + d];
+    }
+    for (int seed = 0; seed < 2; seed++) {
+        double farthest = -1.0;
+        size_t chosen = 0;
+        for (size_t i = 0; i < n; i++) {
+            const double* point = ivf->point_func(ivf->context, list->indices[i], x);
+            double distance = point ? ivf_index_distance(point, means, dimension) : -1.0;
+            if (distance > farthest) {
+                farthest = distance;
+                chosen = i;
+            }
+        }
+        if (ivf_index_copy_point(ivf, list->indices[chosen], means + seed * dimension) != 0) {
+            free(side);
+            free(sums);
+            return -1;
+        }
+    }
+
+    size_t sizes[2] = {0, 0};
+    for (int iteration = 0; iteration < IVF_SPLIT_ITERATIONS; iteration++) {
+        size_t changed = 0;
+        sizes[0] = 0;
+        sizes[1] = 0;
+        memset(sums, 0, 2 * dimension * sizeof(double));
+        for (size_t i = 0; i < n; i++) {
+            if (i + 1 < n && ivf->prefetch_func) {
+                ivf->prefetch_func(ivf->context, list->indices[i + 1]);
+            }
+            const double* point = ivf->point_func(ivf->context, list->indices[i], x);
+            uint8_t s = point && ivf_index_distance(point, means + dimension, dimension) <
+                                 ivf_index_distance(point, means, dimension);
+            if (iteration == 0 || s != side[i]) {
+                side[i] = s;
+                changed++;
+            }
+            sizes[s]++;
+            for (size_t d = 0; point && d < dimension; d++) {
+                sums[s * dimension + d] += point[d];
+            }
+        }
+        if (sizes[0] == 0 || sizes[1] == 0 || changed == 0) {
+            break;
+        }
+        for (size_t d = 0; d < 2 * dimension; d++) {
+            means[d] = sums[d] / (double)sizes[d / dimension];
+        }
+    }
+    free(sums);
+    if (sizes[0] == 0 || sizes[1] == 0) {
+        // Identical vectors: any half is as good as the other
+        for (size_t i = 0; i < n; i++) {
+            side[i] = i >= n / 2;
+        }
+        sizes[0] = n / 2;
+        sizes[1] = n - n / 2;
+        memcpy(means + dimension, means, dimension * sizeof(double));
+    }
+
+    uint32_t added = (uint32_t)ivf->list_count;
+    IVFList* moved = &ivf->lists[added];
+    if (sizes[1] > moved->capacity) {
+        size_t* entries = (size_t*)realloc(moved->indices, sizes[1] * sizeof(size_t));
+        if (!entries) {
+            free(side);
+            return -1;
+        }
+        moved->indices = entries;
+        moved->capacity = sizes[1];
+    }
+    moved->count = 0;
+    ivf->list_count++;
+    for (size_t d = 0; d < dimension; d++) {
+        ivf->centroids[number * dimension + d] = (float)means[d];
+        ivf->centroids[added * dimension + d] = (float)means[dimension + d];
+    }
+
+    // Keep the first half in place, in order, and move the second to the new list
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t index = list->indices[i];
+        if (side[i]) {
+            ivf_index_append(ivf, added, index); // Cannot fail, the list was sized
+        } else {
+            list->indices[kept] = index;
+            ivf->position_of[index] = kept++;
+        }
+    }
+    list->count = kept;
+    free(side);
+    return 0;
+}
+
+/**
+ * @brief Split the longest lists that outgrew the others.
+ *
+ * @param ivf Index to update.
+ * @param max_splits Maximum number of lists split.
+ * @return size_t Number of lists split, or (size_t)-1 on failure.
+ */
+size_t ivf_index_rebalance(IVFIndex* ivf, size_t max_splits) {
+    size_t splits = 0;
+    while (splits < max_splits && ivf->list_count > 0 && ivf->list_count < IVF_MAX_LISTS) {
+        uint32_t longest = 0;
+        for (size_t c = 1; c < ivf->list_count; c++) {
+            if (ivf->lists[c].count > ivf->lists[longest].count) {
+                longest = (uint32_t)c;
+            }
+        }
+        size_t length = ivf->lists[longest].count;
+        if (length <= IVF_MIN_SPLIT || length * ivf->list_count <= IVF_SPLIT_FACTOR * ivf->count) {
+            break;
+        }
+        if (ivf_index_split(ivf, longest) != 0) {
+            fprintf(stderr, "Failed to split IVF list %u\n", longest);
+            return splits > 0 ? splits : (size_t)-1;
+        }
+        splits++;
+    }
+    return splits;
+}
+
+/**
+ * @brief Find approximate nearest neighbors by scanning the lists nearest to the query.
+ *
+ * The query is compared with every centroid, and the vectors of the nprobe nearest lists are
+ * compared exactly.
+ *
+ * @param ivf Index to search.
+ * @param query Query of dimension components.
+ * @param k Maximum number of neighbors.
+ * @param nprobe Number of lists scanned.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the squared distances of the neighbors (k entries).
+ * @return size_t Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t ivf_index_search(const IVFIndex* ivf, const double* query, size_t k, size_t nprobe,
+                        size_t* indices, double* distances) {
+    if (k == 0 || ivf->count == 0) {
+        return 0;
+    }
+    if (nprobe == 0) {
+        nprobe = 1;
+    }
+    if (nprobe > ivf->list_count) {
+        nprobe = ivf->list_count;
+    }
+    if (k > ivf->count) {
+        k = ivf->count;
+    }
+    IVFCandidate* probes = (IVFCandidate*)malloc(nprobe * sizeof(IVFCandidate));
+    IVFCandidate* results = (IVFCandidate*)malloc(k * sizeof(IVFCandidate));
+    if (!probes || !results) {
+        free(probes);
+        free(results);
+        return (size_t)-1;
+    }
+
+    // Pick the nearest lists
+    size_t probe_count = 0;
+    for (size_t c = 0; c < ivf->list_count; c++) {
+        const float* centroid = ivf->centroids + c * ivf->dimension;
+        double distance = 0.0;
+        for (size_t d = 0; d < ivf->dimension; d++) {
+            double diff = query[d] - centroid[d];
+            distance += diff * diff;
+        }
+        ivf_index_push(probes, &probe_count, nprobe, distance, c);
+    }
+
+    // Scan their vectors, loading the next one while this one is compared
+    size_t count = 0;
+    for (size_t p = 0; p < probe_count; p++) {
+        const IVFList* list = &ivf->lists[probes[p].index];
+        for (size_t i = 0; i < list->count; i++) {
+            if (i + 1 < list->count && ivf->prefetch_func) {
+                ivf->prefetch_func(ivf->context, list->indices[i + 1]);
+            }
+            double distance = ivf->distance_func(ivf->context, list->indices[i], query);
+            if (!isinf(distance)) {
+                ivf_index_push(results, &count, k, distance, list->indices[i]);
+            }
+        }
+    }
+    free(probes);
+
+    qsort(results, count, sizeof(IVFCandidate), ivf_index_compare);
+    for (size_t i = 0; i < count; i++) {
+        indices[i] = results[i].index;
+        distances[i] = results[i].distance;
+    }
+    free(results);
+    return count;
+}
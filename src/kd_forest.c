@@ -0,0 +1,832 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../include/kd_forest.h"
+
+#define KD_FOREST_MIN_BRANCHES 64 // Initial capacity of the branch queue of a search
+
+/**
+ * @struct KDForestBuildJob
+ * @brief Work shared by the build threads; each thread takes the next unbuilt tree.
+ */
+typedef struct KDForestBuildJob {
+    KDForest* forest;       /**< Forest being built */
+    const size_t* indices;  /**< Points of every tree */
+    size_t count;           /**< Number of points */
+    size_t next_tree;       /**< Next tree to build, guarded by lock */
+    int failed;             /**< Set if a tree could not be built */
+    pthread_mutex_t lock;   /**< Protects next_tree and failed */
+} KDForestBuildJob;
+
+/**
+ * @struct KDForestBranch
+ * @brief A subtree left for later by a best-bin-first search.
+ */
+typedef struct KDForestBranch {
+    double bound;   /**< Sum of the squared distances to the splitting planes crossed to reach it */
+    uint32_t tree;  /**< Tree of the subtree */
+    uint32_t node;  /**< Subtree root */
+} KDForestBranch;
+
+/**
+ * @struct KDForestNeighbor
+ * @brief A candidate nearest neighbor kept by a search.
+ */
+typedef struct KDForestNeighbor {
+    double distance; /**< Squared distance to the query */
+    size_t index;    /**< Index of the point in the original dataset */
+} KDForestNeighbor;
+
+/**
+ * @struct KDForestSearch
+ * @brief State of a best-bin-first search.
+ */
+typedef struct KDForestSearch {
+    const KDForest* forest;     /**< Forest being searched */
+    const double* query;        /**< Query point */
+    KDForestBranch* branches;   /**< Min-heap of pending subtrees, nearest at the root */
+    size_t branch_count;        /**< Number of pending subtrees */
+    size_t branch_capacity;     /**< Entries available in branches */
+    KDForestNeighbor* heap;     /**< Max-heap of the nearest points found so far, farthest at the root */
+    size_t count;               /**< Number of points in the heap */
+    size_t k;                   /**< Capacity of the heap */
+    size_t* visited;            /**< Open-addressing set of the points compared, SIZE_MAX for empty entries */
+    size_t visited_bits;        /**< log2 of the number of entries of visited */
+    size_t visited_count;       /**< Number of points in visited */
+    size_t checks;              /**< Number of points compared */
+} KDForestSearch;
+
+/**
+ * @brief Release the nodes and leaves of a tree, leaving it empty.
+ *
+ * @param tree Tree to empty.
+ */
+static void kd_forest_tree_clear(KDForestTree* tree) {
+    for (size_t i = 0; i < tree->leaf_count; i++) {
+        free(tree->leaves[i].indices);
+    }
+    free(tree->leaves);
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->node_count = 0;
+    tree->node_capacity = 0;
+    tree->leaves = NULL;
+    tree->leaf_count = 0;
+    tree->leaf_capacity = 0;
+}
+
+/**
+ * @brief Append nodes to a tree.
+ *
+ * @param tree Tree to grow.
+ * @param count Number of nodes to append.
+ * @return size_t Number of the first new node, or SIZE_MAX on allocation failure.
+ */
+static size_t kd_forest_add_nodes(KDForestTree* tree, size_t count) {
+    if (tree->node_count + count > tree->node_capacity) {
+        size_t capacity = tree->node_capacity > 0 ? tree->node_capacity * 2 : 64;
+        while (capacity < tree->node_count + count) {
+            capacity *= 2;
+        }
+        KDForestNode* nodes = (KDForestNode*)realloc(tree->nodes, capacity * sizeof(KDForestNode));
+        if (!nodes) {
+            return SIZE_MAX;
+        }
+        tree->nodes = nodes;
+        tree->node_capacity = capacity;
+    }
+    size_t first = tree->node_count;
+    tree->node_count += count;
+    return first;
+}
+
+/**
+ * @brief Append a leaf holding a copy of some indices.
+ *
+ * @param tree Tree to grow.
+ * @param indices Indices held by the leaf.
+ * @param count Number of indices.
+ * @return size_t Number of the new leaf, or SIZE_MAX on allocation failure.
+ */
+static size_t kd_forest_add_leaf(KDForestTree* tree, const size_t* indices, size_t count) {
+    if (tree->leaf_count == tree->leaf_capacity) {
+        size_t capacity = tree->leaf_capacity > 0 ? tree->leaf_capacity * 2 : 64;
+        KDForestLeaf* leaves = (KDForestLeaf*)realloc(tree->leaves, capacity * sizeof(KDForestLeaf));
+        if (!leaves) {
+            return SIZE_MAX;
+        }
+        tree->leaves = leaves;
+        tree->leaf_capacity = capacity;
+    }
+    size_t capacity = count > KD_FOREST_LEAF_SIZE ? count : KD_FOREST_LEAF_SIZE;
+    size_t* copy = (size_t*)malloc(capacity * sizeof(size_t));
+    if (!copy) {
+        return SIZE_MAX;
+    }
+    if (count > 0) {
+        memcpy(copy, indices, count * sizeof(size_t));
+    }
+    KDForestLeaf* leaf = &tree->leaves[tree->leaf_count];
+    leaf->indices = copy;
+    leaf->count = (uint32_t)count;
+    leaf->capacity = (uint32_t)capacity;
+    return tree->leaf_count++;
+}
+
+/**
+ * @brief Choose the split of a set of points: a component drawn among the highest-variance ones, at its mean.
+ *
+ * Mean and variance are estimated on at most KD_FOREST_VARIANCE_SAMPLES points spread over the set.
+ *
+ * @param forest Forest whose callbacks read the points.
+ * @param tree Tree whose random state draws the component.
+ * @param indices Points to split.
+ * @param count Number of points.
+ * @param scratch 2 * dimension doubles.
+ * @param axis Set to the chosen component.
+ * @param split Set to the split value.
+ * @return int 0 on success, -1 if every sampled point is the same.
+ */
+static int kd_forest_choose_split(const KDForest* forest, KDForestTree* tree, const size_t* indices, size_t count,
+                                  double* scratch, uint32_t* axis, double* split) {
+    size_t dimension = forest->dimension;
+    double* mean = scratch;
+    double* variance = scratch + dimension;
+    memset(scratch, 0, 2 * dimension * sizeof(double));
+
+    size_t samples = count < KD_FOREST_VARIANCE_SAMPLES ? count : KD_FOREST_VARIANCE_SAMPLES;
+    for (size_t s = 0; s < samples; s++) {
+        size_t index = indices[s * count / samples];
+        for (size_t j = 0; j < dimension; j++) {
+            double value = forest->component_func(forest->context, index, j);
+            mean[j] += value;
+            variance[j] += value * value;
+        }
+    }
+
+    // Keep the KD_FOREST_TOP_AXES highest variances, in decreasing order
+    uint32_t top[KD_FOREST_TOP_AXES];
+    size_t top_count = 0;
+    for (size_t j = 0; j < dimension; j++) {
+        mean[j] /= (double)samples;
+        variance[j] = variance[j] / (double)samples - mean[j] * mean[j];
+        if (variance[j] <= 0.0) {
+            continue;
+        }
+        size_t pos = top_count < KD_FOREST_TOP_AXES ? top_count++ : KD_FOREST_TOP_AXES;
+        while (pos > 0 && variance[top[pos - 1]] < variance[j]) {
+            if (pos < KD_FOREST_TOP_AXES) {
+                top[pos] = top[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < KD_FOREST_TOP_AXES) {
+            top[pos] = (uint32_t)j;
+        }
+    }
+    if (top_count == 0) {
+        return -1;
+    }
+
+    *axis = top[(size_t)rand_r(&tree->seed) % top_count];
+    *split = mean[*axis];
+    return 0;
+}
+
+/**
+ * @brief Move the points below a split value to the front.
+ *
+ * @param forest Forest whose callbacks read the points.
+ * @param indices Points to reorder.
+ * @param count Number of points.
+ * @param axis Component compared.
+ * @param split Split value.
+ * @return size_t Number of points below the split value.
+ */
+static size_t kd_forest_partition(const KDForest* forest, size_t* indices, size_t count, uint32_t axis, double split) {
+    size_t left = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (forest->component_func(forest->context, indices[i], axis) < split) {
+            size_t index = indices[i];
+            indices[i] = indices[left];
+            indices[left++] = index;
+        }
+    }
+    return left;
+}
+
+/**
+ * @brief Build the subtree of a node over a set of points.
+ *
+ * @param forest Forest whose callbacks read the points.
+ * @param tree Tree being built.
+ * @param node Node to fill.
+ * @param indices Points of the subtree, reordered.
+ * @param count Number of points.
+ * @param scratch 2 * dimension doubles.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int kd_forest_build_rec(const KDForest* forest, KDForestTree* tree, size_t node, size_t* indices, size_t count,
+                               double* scratch) {
+    uint32_t axis = 0;
+    double split = 0.0;
+    size_t left = 0;
+    if (count > KD_FOREST_LEAF_SIZE && kd_forest_choose_split(forest, tree, indices, count, scratch, &axis, &split) == 0) {
+        left = kd_forest_partition(forest, indices, count, axis, split);
+    }
+    if (left == 0 || left == count) {
+        // Small enough, or the points cannot be told apart
+        size_t leaf = kd_forest_add_leaf(tree, indices, count);
+        if (leaf == SIZE_MAX) {
+            return -1;
+        }
+        tree->nodes[node].axis = KD_FOREST_LEAF;
+        tree->nodes[node].child = (uint32_t)leaf;
+        tree->nodes[node].split = 0.0;
+        return 0;
+    }
+
+    size_t child = kd_forest_add_nodes(tree, 2);
+    if (child == SIZE_MAX) {
+        return -1;
+    }
+    tree->nodes[node].axis = axis;
+    tree->nodes[node].child = (uint32_t)child;
+    tree->nodes[node].split = split;
+    if (kd_forest_build_rec(forest, tree, child, indices, left, scratch) != 0) {
+        return -1;
+    }
+    return kd_forest_build_rec(forest, tree, child + 1, indices + left, count - left, scratch);
+}
+
+/**
+ * @brief Thread body building trees until none is left.
+ *
+ * @param arg Pointer to the KDForestBuildJob.
+ * @return void* NULL.
+ */
+static void* kd_forest_build_thread(void* arg) {
+    KDForestBuildJob* job = (KDForestBuildJob*)arg;
+    KDForest* forest = job->forest;
+    size_t* indices = (size_t*)malloc((job->count > 0 ? job->count : 1) * sizeof(size_t));
+    double* scratch = (double*)malloc(2 * forest->dimension * sizeof(double));
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        if (!indices || !scratch) {
+            job->failed = 1;
+        }
+        size_t next = job->failed ? forest->tree_count : job->next_tree++;
+        pthread_mutex_unlock(&job->lock);
+        if (next >= forest->tree_count) {
+            break;
+        }
+
+        // Every tree partitions its own copy of the points
+        KDForestTree* tree = &forest->trees[next];
+        memcpy(indices, job->indices, job->count * sizeof(size_t));
+        if (kd_forest_add_nodes(tree, 1) == SIZE_MAX ||
+            kd_forest_build_rec(forest, tree, 0, indices, job->count, scratch) != 0) {
+            pthread_mutex_lock(&job->lock);
+            job->failed = 1;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+    free(scratch);
+    free(indices);
+    return NULL;
+}
+
+/**
+ * @brief Create an empty forest.
+ *
+ * @param dimension Number of components per point.
+ * @param tree_count Number of trees, at least 1.
+ * @param component_func Reads a component of a point.
+ * @param distance_func Compares a query with a point.
+ * @param prefetch_func Prefetches a point, or NULL.
+ * @param context Context passed to the callbacks.
+ * @return KDForest* Pointer to the forest, or NULL on failure.
+ */
+KDForest* kd_forest_create(size_t dimension, size_t tree_count, KDForestComponentFunc component_func,
+                           KDForestDistanceFunc distance_func, KDForestPrefetchFunc prefetch_func, void* context) {
+    if (dimension == 0 || tree_count == 0 || !component_func || !distance_func) {
+        return NULL;
+    }
+    KDForest* forest = (KDForest*)calloc(1, sizeof(KDForest));
+    if (!forest) {
+        return NULL;
+    }
+    forest->dimension = dimension;
+    forest->tree_count = tree_count;
+    forest->component_func = component_func;
+    forest->distance_func = distance_func;
+    forest->prefetch_func = prefetch_func;
+    forest->context = context;
+    forest->trees = (KDForestTree*)calloc(tree_count, sizeof(KDForestTree));
+    forest->scratch = (double*)malloc(2 * dimension * sizeof(double));
+    if (!forest->trees || !forest->scratch) {
+        kd_forest_free(forest);
+        return NULL;
+    }
+    for (size_t t = 0; t < tree_count; t++) {
+        forest->trees[t].seed = (unsigned int)(t * 2654435761u + 1);
+    }
+    return forest;
+}
+
+/**
+ * @brief Free a forest.
+ *
+ * @param forest Forest to free, may be NULL.
+ */
+void kd_forest_free(KDForest* forest) {
+    if (!forest) {
+        return;
+    }
+    if (forest->trees) {
+        for (size_t t = 0; t < forest->tree_count; t++) {
+            kd_forest_tree_clear(&forest->trees[t]);
+        }
+    }
+    free(forest->trees);
+    free(forest->scratch);
+    free(forest);
+}
+
+/**
+ * @brief Replace the content of every tree with a tree built over a set of points.
+ *
+ * @param forest Forest to build.
+ * @param indices Indices of the points in the original dataset.
+ * @param count Number of points.
+ * @return int 0 on success, -1 on allocation failure, in which case the forest is empty.
+ */
+int kd_forest_build(KDForest* forest, const size_t* indices, size_t count) {
+    for (size_t t = 0; t < forest->tree_count; t++) {
+        kd_forest_tree_clear(&forest->trees[t]);
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    KDForestBuildJob job;
+    job.forest = forest;
+    job.indices = indices;
+    job.count = count;
+    job.next_tree = 0;
+    job.failed = 0;
+    if (pthread_mutex_init(&job.lock, NULL) != 0) {
+        return -1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = cpus > 1 ? (size_t)cpus : 1;
+    if (thread_count > forest->tree_count) {
+        thread_count = forest->tree_count;
+    }
+    pthread_t* threads = (pthread_t*)malloc(thread_count * sizeof(pthread_t));
+    size_t started = 0;
+    while (threads && started < thread_count &&
+           pthread_create(&threads[started], NULL, kd_forest_build_thread, &job) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        kd_forest_build_thread(&job); // No thread could be started, build on the caller's
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+
+    if (job.failed) {
+        fprintf(stderr, "Failed to allocate memory for the KD-forest\n");
+        for (size_t t = 0; t < forest->tree_count; t++) {
+            kd_forest_tree_clear(&forest->trees[t]);
+        }
+        return -1;
+    }
+    printf("KD-forest built with %zu trees over %zu points\n", forest->tree_count, count);
+    return 0;
+}
+
+/**
+ * @brief Find the leaf node a point falls in.
+ *
+ * @param forest Forest whose callbacks read the point.
+ * @param tree Non-empty tree to descend.
+ * @param index Index of the point.
+ * @return size_t Number of the leaf node.
+ */
+static size_t kd_forest_find_leaf(const KDForest* forest, const KDForestTree* tree, size_t index) {
+    size_t node = 0;
+    while (tree->nodes[node].axis != KD_FOREST_LEAF) {
+        const KDForestNode* inner = &tree->nodes[node];
+        double value = forest->component_func(forest->context, index, inner->axis);
+        node = inner->child + (value < inner->split ? 0 : 1);
+    }
+    return node;
+}
+
+/**
+ * @brief Split a full leaf in two on one of its high-variance components.
+ *
+ * @param forest Forest whose callbacks read the points.
+ * @param tree Tree holding the leaf.
+ * @param node Leaf node, which becomes an inner node.
+ * @return int 0 on success, -1 if the points cannot be told apart or on allocation failure.
+ */
+static int kd_forest_split_leaf(KDForest* forest, KDForestTree* tree, size_t node) {
+    uint32_t number = tree->nodes[node].child;
+    KDForestLeaf* leaf = &tree->leaves[number];
+    uint32_t axis;
+    double split;
+    if (kd_forest_choose_split(forest, tree, leaf->indices, leaf->count, forest->scratch, &axis, &split) != 0) {
+        return -1;
+    }
+    size_t left = kd_forest_partition(forest, leaf->indices, leaf->count, axis, split);
+    if (left == 0 || left == leaf->count) {
+        return -1;
+    }
+
+    size_t right_leaf = kd_forest_add_leaf(tree, leaf->indices + left, leaf->count - left);
+    size_t child = right_leaf != SIZE_MAX ? kd_forest_add_nodes(tree, 2) : SIZE_MAX;
+    if (child == SIZE_MAX) {
+        return -1; // A leaf added without its node stays unreferenced and empty-handed
+    }
+    tree->leaves[number].count = (uint32_t)left; // The array may have moved
+    tree->nodes[child].axis = KD_FOREST_LEAF;
+    tree->nodes[child].child = number;
+    tree->nodes[child].split = 0.0;
+    tree->nodes[child + 1].axis = KD_FOREST_LEAF;
+    tree->nodes[child + 1].child = (uint32_t)right_leaf;
+    tree->nodes[child + 1].split = 0.0;
+    tree->nodes[node].axis = axis;
+    tree->nodes[node].child = (uint32_t)child;
+    tree->nodes[node].split = split;
+    return 0;
+}
+
+/**
+ * @brief Add a point to every tree.
+ *
+ * @param forest Forest to update.
+ * @param index Index of the point, whose components must be readable.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int kd_forest_insert(KDForest* forest, size_t index) {
+    for (size_t t = 0; t < forest->tree_count; t++) {
+        KDForestTree* tree = &forest->trees[t];
+        if (tree->node_count == 0) {
+            size_t leaf = kd_forest_add_leaf(tree, &index, 1);
+            if (leaf == SIZE_MAX || kd_forest_add_nodes(tree, 1) == SIZE_MAX) {
+                return -1;
+            }
+            tree->nodes[0].axis = KD_FOREST_LEAF;
+            tree->nodes[0].child = (uint32_t)leaf;
+            tree->nodes[0].split = 0.0;
+            continue;
+        }
+
+        size_t node = kd_forest_find_leaf(forest, tree, index);
+        KDForestLeaf* leaf = &tree->leaves[tree->nodes[node].child];
+        if (leaf->count == leaf->capacity) {
+            // Split a leaf that outgrew the build size, or make room for points that cannot be told apart
+            if (leaf->count >= 2 * KD_FOREST_LEAF_SIZE && kd_forest_split_leaf(forest, tree, node) == 0) {
+                node = kd_forest_find_leaf(forest, tree, index);
+                leaf = &tree->leaves[tree->nodes[node].child];
+            }
+            if (leaf->count == leaf->capacity) {
+                size_t* indices = (size_t*)realloc(leaf->indices, 2 * (size_t)leaf->capacity * sizeof(size_t));
+                if (!indices) {
+                    return -1;
+                }
+                leaf->indices = indices;
+                leaf->capacity *= 2;
+            }
+        }
+        leaf->indices[leaf->count++] = index;
+    }
+    return 0;
+}
+
+/**
+ * @brief Remove a point from every tree.
+ *
+ * @param forest Forest to update.
+ * @param index Index of the point, whose components must still be readable.
+ */
+void kd_forest_remove(KDForest* forest, size_t index) {
+    for (size_t t = 0; t < forest->tree_count; t++) {
+        KDForestTree* tree = &forest->trees[t];
+        if (tree->node_count == 0) {
+            continue;
+        }
+        KDForestLeaf* leaf = &tree->leaves[tree->nodes[kd_forest_find_leaf(forest, tree, index)].child];
+        for (uint32_t i = 0; i < leaf->count; i++) {
+            if (leaf->indices[i] == index) {
+                leaf->indices[i] = leaf->indices[--leaf->count];
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Change the index stored for a point after it was moved.
+ *
+ * @param forest Forest to update.
+ * @param old_index Index the point was inserted with.
+ * @param new_index New index of the point, whose components must be readable.
+ */
+void kd_forest_remap(KDForest* forest, size_t old_index, size_t new_index) {
+    for (size_t t = 0; t < forest->tree_count; t++) {
+        KDForestTree* tree = &forest->trees[t];
+        if (tree->node_count == 0) {
+            continue;
+        }
+        KDForestLeaf* leaf = &tree->leaves[tree->nodes[kd_forest_find_leaf(forest, tree, new_index)].child];
+        for (uint32_t i = 0; i < leaf->count; i++) {
+            if (leaf->indices[i] == old_index) {
+                leaf->indices[i] = new_index;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Queue a subtree in the branch min-heap of a search.
+ *
+ * @param search Search state.
+ * @param bound Distance estimate of the subtree.
+ * @param tree Tree of the subtree.
+ * @param node Subtree root.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int kd_forest_push_branch(KDForestSearch* search, double bound, size_t tree, size_t node) {
+    if (search->branch_count == search->branch_capacity) {
+        size_t capacity = search->branch_capacity * 2;
+        KDForestBranch* branches = (KDForestBranch*)realloc(search->branches, capacity * sizeof(KDForestBranch));
+        if (!branches) {
+            return -1;
+        }
+        search->branches = branches;
+        search->branch_capacity = capacity;
+    }
+    KDForestBranch* heap = search->branches;
+    size_t pos = search->branch_count++;
+    while (pos > 0 && heap[(pos - 1) / 2].bound > bound) {
+        heap[pos] = heap[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
+    }
+    heap[pos].bound = bound;
+    heap[pos].tree = (uint32_t)tree;
+    heap[pos].node = (uint32_t)node;
+    return 0;
+}
+
+/**
+ * @brief Take the nearest subtree out of the branch min-heap of a search.
+ *
+ * @param search Search state with at least one pending subtree.
+ * @return KDForestBranch The nearest pending subtree.
+ */
+static KDForestBranch kd_forest_pop_branch(KDForestSearch* search) {
+    KDForestBranch* heap = search->branches;
+    KDForestBranch top = heap[0];
+    KDForestBranch last = heap[--search->branch_count];
+    size_t pos = 0;
+    for (;;) {
+        size_t child = 2 * pos + 1;
+        if (child >= search->branch_count) {
+            break;
+        }
+        if (child + 1 < search->branch_count && heap[child + 1].bound < heap[child].bound) {
+            child++;
+        }
+        if (heap[child].bound >= last.bound) {
+            break;
+        }
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = last;
+    return top;
+}
+
+/**
+ * @brief Record a point as compared, unless it already was.
+ *
+ * @param search Search state.
+ * @param index Index of the point.
+ * @return int 1 if the point is new, 0 if it was compared already, -1 on allocation failure.
+ */
+static int kd_forest_visit(KDForestSearch* search, size_t index) {
+    // Keep the set at most half full
+    if (2 * (search->visited_count + 1) > ((size_t)1 << search->visited_bits)) {
+        size_t bits = search->visited_bits + 1;
+        size_t* visited = (size_t*)malloc(((size_t)1 << bits) * sizeof(size_t));
+        if (!visited) {
+            return -1;
+        }
+        memset(visited, 0xff, ((size_t)1 << bits) * sizeof(size_t));
+        for (size_t i = 0; i < ((size_t)1 << search->visited_bits); i++) {
+            size_t entry = search->visited[i];
+            if (entry != SIZE_MAX) {
+                size_t pos = (size_t)(((uint64_t)entry * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+                while (visited[pos] != SIZE_MAX) {
+                    pos = (pos + 1) & (((size_t)1 << bits) - 1);
+                }
+                visited[pos] = entry;
+            }
+        }
+        free(search->visited);
+        search->visited = visited;
+        search->visited_bits = bits;
+    }
+
+    size_t mask = ((size_t)1 << search->visited_bits) - 1;
+    size_t pos = (size_t)(((uint64_t)index * 0x9E3779B97F4A7C15ull) >> (64 - search->visited_bits));
+    while (search->visited[pos] != SIZE_MAX) {
+        if (search->visited[pos] == index) {
+            return 0;
+        }
+        pos = (pos + 1) & mask;
+    }
+    search->visited[pos] = index;
+    search->visited_count++;
+    return 1;
+}
+
+/**
+ * @brief Push a point into the bounded max-heap of a search, keeping the smallest distances.
+ *
+ * @param search Search state.
+ * @param distance Squared distance of the point to the query.
+ * @param index Index of the point.
+ */
+static void kd_forest_push_neighbor(KDForestSearch* search, double distance, size_t index) {
+    KDForestNeighbor* heap = search->heap;
+    size_t pos;
+    if (search->count < search->k) {
+        pos = search->count++;
+        while (pos > 0 && heap[(pos - 1) / 2].distance < distance) {
+            heap[pos] = heap[(pos - 1) / 2];
+            pos = (pos - 1) / 2;
+        }
+    } else if (distance < heap[0].distance) {
+        pos = 0;
+        for (;;) {
+            size_t child = 2 * pos + 1;
+            if (child >= search->count) {
+                break;
+            }
+            if (child + 1 < search->count && heap[child + 1].distance > heap[child].distance) {
+                child++;
+            }
+            if (heap[child].distance <= distance) {
+                break;
+            }
+            heap[pos] = heap[child];
+            pos = child;
+        }
+    } else {
+        return;
+    }
+    heap[pos].distance = distance;
+    heap[pos].index = index;
+}
+
+/**
+ * @brief Descend from a subtree root to the leaf of the query, queueing the other sides, and compare the leaf's points.
+ *
+ * @param search Search state.
+ * @param branch Subtree to explore.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int kd_forest_explore(KDForestSearch* search, KDForestBranch branch) {
+    const KDForest* forest = search->forest;
+    const KDForestTree* tree = &forest->trees[branch.tree];
+    size_t node = branch.node;
+    while (tree->nodes[node].axis != KD_FOREST_LEAF) {
+        const KDForestNode* inner = &tree->nodes[node];
+        double offset = search->query[inner->axis] - inner->split;
+        size_t near = inner->child + (offset < 0 ? 0 : 1);
+        size_t far = inner->child + (offset < 0 ? 1 : 0);
+        double bound = branch.bound + offset * offset;
+        if ((search->count < search->k || bound < search->heap[0].distance) &&
+            kd_forest_push_branch(search, bound, branch.tree, far) != 0) {
+            return -1;
+        }
+        node = near;
+    }
+
+    const KDForestLeaf* leaf = &tree->leaves[tree->nodes[node].child];
+    if (forest->prefetch_func) {
+        for (uint32_t i = 0; i < leaf->count; i++) {
+            forest->prefetch_func(forest->context, leaf->indices[i]);
+        }
+    }
+    for (uint32_t i = 0; i < leaf->count; i++) {
+        int fresh = kd_forest_visit(search, leaf->indices[i]);
+        if (fresh < 0) {
+            return -1;
+        }
+        if (fresh) {
+            double distance = forest->distance_func(forest->context, leaf->indices[i], search->query);
+            search->checks++;
+            if (distance < INFINITY) {
+                kd_forest_push_neighbor(search, distance, leaf->indices[i]);
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Compare two neighbors by distance, for sorting.
+ *
+ * @param a Pointer to the first KDForestNeighbor.
+ * @param b Pointer to the second KDForestNeighbor.
+ * @return int Negative, zero or positive as a is nearer than, as near as or farther than b.
+ */
+static int kd_forest_neighbor_compare(const void* a, const void* b) {
+    double da = ((const KDForestNeighbor*)a)->distance;
+    double db = ((const KDForestNeighbor*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+/**
+ * @brief Find approximate nearest neighbors with a best-bin-first search over every tree.
+ *
+ * The search stops once max_checks points were compared and k neighbors are known, or once the
+ * nearest pending branch is farther than the k-th neighbor. Branch distances add up the squared
+ * distances to every plane crossed, as in FLANN, so they are estimates rather than strict bounds.
+ *
+ * @param forest Forest to search.
+ * @param query Query of dimension components.
+ * @param k Maximum number of neighbors.
+ * @param max_checks Number of points compared before the search stops, at least 1.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the neighbors (k entries).
+ * @return size_t Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t kd_forest_search(const KDForest* forest, const double* query, size_t k, size_t max_checks,
+                        size_t* indices, double* distances) {
+    if (k == 0) {
+        return 0;
+    }
+    KDForestSearch search;
+    search.forest = forest;
+    search.query = query;
+    search.branch_count = 0;
+    search.branch_capacity = KD_FOREST_MIN_BRANCHES;
+    search.branches = (KDForestBranch*)malloc(search.branch_capacity * sizeof(KDForestBranch));
+    search.heap = (KDForestNeighbor*)malloc(k * sizeof(KDForestNeighbor));
+    search.count = 0;
+    search.k = k;
+    search.visited_bits = 6;
+    while (((size_t)1 << search.visited_bits) < 2 * max_checks && search.visited_bits < 30) {
+        search.visited_bits++;
+    }
+    search.visited = (size_t*)malloc(((size_t)1 << search.visited_bits) * sizeof(size_t));
+    search.visited_count = 0;
+    search.checks = 0;
+    int status = search.branches && search.heap && search.visited ? 0 : -1;
+    if (search.visited) {
+        memset(search.visited, 0xff, ((size_t)1 << search.visited_bits) * sizeof(size_t));
+    }
+
+    // Every tree starts at its root, so the first descents follow the query in each tree
+    for (size_t t = 0; t < forest->tree_count && status == 0; t++) {
+        if (forest->trees[t].node_count > 0) {
+            status = kd_forest_push_branch(&search, 0.0, t, 0);
+        }
+    }
+    while (status == 0 && search.branch_count > 0) {
+        KDForestBranch branch = kd_forest_pop_branch(&search);
+        if (search.count == k && (search.checks >= max_checks || branch.bound >= search.heap[0].distance)) {
+            break;
+        }
+        status = kd_forest_explore(&search, branch);
+    }
+
+    size_t found = (size_t)-1;
+    if (status == 0) {
+        qsort(search.heap, search.count, sizeof(KDForestNeighbor), kd_forest_neighbor_compare);
+        for (size_t i = 0; i < search.count; i++) {
+            indices[i] = search.heap[i].index;
+            distances[i] = sqrt(search.heap[i].distance);
+        }
+        found = search.count;
+    }
+    free(search.visited);
+    free(search.heap);
+    free(search.branches);
+    return found;
+}
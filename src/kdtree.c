@@ -1,164 +1,1184 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "../include/kdtree.h"
 
+#define KDTREE_BUILD_MIN_PARALLEL 65536 // Smaller trees are built on the caller's thread
+#define KDTREE_BUILD_TASKS_PER_THREAD 4 // Subtrees queued per thread, to balance uneven splits
+#define KDTREE_STACK_ENTRIES 64          // Pending subtrees a search keeps on the C stack before using the heap
+#define KDTREE_PATH_BATCH 16             // Nodes a search descends through, prefetching their points, before comparing them
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KDTREE_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define KDTREE_PREFETCH(address) ((void)(address))
+#endif
+
+/**
+ * @struct KDTreeBuildItem
+ * @brief A point being placed by the bulk builder.
+ */
+typedef struct KDTreeBuildItem {
+    double key;   /**< Coordinate of the point on the axis being split */
+    size_t index; /**< Index of the point in the original dataset */
+} KDTreeBuildItem;
+
+/**
+ * @struct KDTreeBuildTask
+ * @brief A subtree left to a worker thread by the bulk builder.
+ */
+typedef struct KDTreeBuildTask {
+    size_t lo;          /**< First item of the subtree */
+    size_t hi;          /**< One past the last item of the subtree */
+    size_t depth;       /**< Depth of the subtree root */
+    size_t position;    /**< Breadth-first position of the subtree root */
+} KDTreeBuildTask;
+
+/**
+ * @struct KDTreeBuildJob
+ * @brief Work shared by the bulk build threads; each thread takes the next queued subtree.
+ */
+typedef struct KDTreeBuildJob {
+    KDTree *tree;             /**< Tree being built */
+    KDTreeBuildItem *items;   /**< Points, reordered in place */
+    KDTreeNode *nodes;        /**< One node per item, in breadth-first order */
+    KDTreeNode **slots;       /**< Nodes reused by a subtree rebuild in breadth-first order, or NULL to use nodes */
+    size_t count;             /**< Number of items and nodes */
+    KDTreeBuildTask *tasks;   /**< Queued subtrees, or NULL to build everything on one thread */
+    size_t task_depth;        /**< Depth at which subtrees are queued */
+    size_t task_count;        /**< Number of queued subtrees */
+    size_t next_task;         /**< Next subtree to build, guarded by lock */
+    int failed;               /**< Set if a thread could not allocate its buffer */
+    pthread_mutex_t lock;     /**< Protects next_task and failed */
+} KDTreeBuildJob;
+
+/**
+ * @struct KDTreeNeighbor
+ * @brief A point kept by a k-nearest-neighbor search.
+ */
+typedef struct KDTreeNeighbor {
+    double distance; /**< Squared distance to the query over the tree's dimension */
+    size_t index;    /**< Index of the point in the original dataset */
+} KDTreeNeighbor;
+
 /**
- * @brief Create a new KD-tree node.
+ * @struct KDTreeKnnSearch
+ * @brief State of a k-nearest-neighbor search, shared by the recursive walk.
+ */
+typedef struct KDTreeKnnSearch {
+    KDTree *tree;          /**< Tree being searched */
+    const double *point;   /**< Query point */
+    double *buffer;        /**< Scratch space of dimension doubles for the point function */
+    KDTreeNeighbor *heap;  /**< Max-heap of the nearest points found so far, farthest at the root */
+    size_t count;          /**< Number of points in the heap */
+    size_t k;              /**< Capacity of the heap */
+} KDTreeKnnSearch;
+
+/**
+ * @struct KDTreeRangeSearch
+ * @brief State of a range search, shared by the recursive walk.
+ */
+typedef struct KDTreeRangeSearch {
+    KDTree *tree;          /**< Tree being searched */
+    const double *point;   /**< Query point */
+    double *buffer;        /**< Scratch space of dimension doubles for the point function */
+    double radius2;        /**< Squared search radius */
+    KDTreeRangeFunc func;  /**< Receives every point found */
+    void *context;         /**< Context passed to func */
+    size_t reported;       /**< Number of points reported */
+    int stopped;           /**< Set once func asked to stop */
+} KDTreeRangeSearch;
+
+/**
+ * @struct KDTreeStackEntry
+ * @brief A subtree left for later by an iterative search.
+ */
+typedef struct KDTreeStackEntry {
+    KDTreeNode *node; /**< Subtree root */
+    size_t depth;     /**< Depth of the subtree root */
+    double bound;     /**< Squared distance from the query to the splitting plane in front of it */
+} KDTreeStackEntry;
+
+/**
+ * @struct KDTreeStack
+ * @brief Explicit stack of an iterative search, on the C stack until it outgrows it.
+ */
+typedef struct KDTreeStack {
+    KDTreeStackEntry *entries;                     /**< local, or a heap copy once it overflowed */
+    size_t count;                                  /**< Number of pending subtrees */
+    size_t capacity;                               /**< Entries available */
+    KDTreeStackEntry local[KDTREE_STACK_ENTRIES];  /**< Initial storage */
+} KDTreeStack;
+
+/**
+ * @struct KDTreeRebalance
+ * @brief Highest subtree found out of balance on the path of an insert or a removal.
+ */
+typedef struct KDTreeRebalance {
+    KDTreeNode *node; /**< Subtree root to rebuild, or NULL */
+    size_t depth;     /**< Depth of the subtree root */
+} KDTreeRebalance;
+
+/**
+ * @brief Allocate a KD-tree node, reusing a removed one if any.
  * 
+ * @param tree KD-tree owning the node.
  * @param point Point in the k-dimensional space.
  * @param index Index of the point in the original dataset.
- * @param dimension Dimensionality of the points.
+ * @param depth Depth of the node, which selects its split axis.
  * @return Pointer to the newly created KD-tree node.
  */
-KDTreeNode* kdtree_create_node(const double *point, size_t index, size_t dimension) {
-    printf("Creating KDTreeNode with index %zu and dimension %zu\n", index, dimension);
-    KDTreeNode *node = (KDTreeNode*)malloc(sizeof(KDTreeNode));
-    if (!node) return NULL;
-
-    node->point = (double*)malloc(dimension * sizeof(double));
-    if (!node->point) {
-        free(node);
-        return NULL;
-    }
-
-    for (size_t i = 0; i < dimension; i++) {
-        node->point[i] = point[i];
+KDTreeNode* kdtree_create_node(KDTree *tree, const double *point, size_t index, size_t depth) {
+    KDTreeNode *node = tree->free_nodes;
+    if (node) {
+        tree->free_nodes = node->left;
+    } else {
+        if (tree->block_count == 0 || tree->block_used == KDTREE_ARENA_BLOCK_NODES) {
+            if (tree->block_count == tree->block_capacity) {
+                size_t capacity = tree->block_capacity > 0 ? tree->block_capacity * 2 : 16;
+                KDTreeNode **blocks = (KDTreeNode**)realloc(tree->blocks, capacity * sizeof(KDTreeNode*));
+                if (!blocks) return NULL;
+                tree->blocks = blocks;
+                tree->block_capacity = capacity;
+            }
+            KDTreeNode *block = (KDTreeNode*)malloc(KDTREE_ARENA_BLOCK_NODES * sizeof(KDTreeNode));
+            if (!block) return NULL;
+            tree->blocks[tree->block_count++] = block;
+            tree->block_used = 0;
+        }
+        node = &tree->blocks[tree->block_count - 1][tree->block_used++];
     }
 
+    node->split = point[depth % tree->dimension];
     node->index = index;
+    node->size = 1;
     node->left = NULL;
     node->right = NULL;
 
     return node;
 }
 
+/**
+ * @brief Create a new KD-tree.
+ * 
+ * @param dimension Dimensionality of the points.
+ * @param point_func Reads the coordinates of a point from the dataset.
+ * @param prefetch_func Prefetches the coordinates of a point, or NULL.
+ * @param point_context Context passed to point_func and prefetch_func.
+ * @return Pointer to the newly created KD-tree.
+ */
+KDTree* kdtree_create(size_t dimension, KDTreePointFunc point_func, KDTreePrefetchFunc prefetch_func,
+                      void *point_context) {
+    if (!point_func) return NULL;
+    KDTree *tree = (KDTree*)malloc(sizeof(KDTree));
+    if (!tree) return NULL;
+
+    tree->root = NULL;
+    tree->dimension = dimension;
+    tree->point_func = point_func;
+    tree->prefetch_func = prefetch_func;
+    tree->point_context = point_context;
+    tree->blocks = NULL;
+    tree->block_count = 0;
+    tree->block_capacity = 0;
+    tree->block_used = 0;
+    tree->free_nodes = NULL;
+
+    return tree;
+}
+
+/**
+ * @brief Release every node of the KD-tree at once.
+ * 
+ * @param tree KD-tree whose arena is emptied.
+ */
+static void kdtree_release_nodes(KDTree *tree) {
+    for (size_t i = 0; i < tree->block_count; i++) {
+        free(tree->blocks[i]);
+    }
+    free(tree->blocks);
+    tree->root = NULL; // Avoid dangling pointer
+    tree->blocks = NULL;
+    tree->block_count = 0;
+    tree->block_capacity = 0;
+    tree->block_used = 0;
+    tree->free_nodes = NULL;
+}
+
+/**
+ * @brief Free the memory allocated for the KD-tree.
+ * 
+ * Every node lives in the arena, so the whole tree is released block by block without walking it.
+ *
+ * @param tree KD-tree to be freed.
+ */
+void kdtree_free(KDTree *tree) {
+    if (tree) {
+        kdtree_release_nodes(tree);
+        free(tree);
+    }
+}
+
+/**
+ * @brief Reorder items so that the one of a given rank sits at its sorted position, nth_element style.
+ * 
+ * On return, the items before nth have smaller or equal keys and the items after it greater or
+ * equal keys.
+ *
+ * @param items Items to reorder.
+ * @param lo First item of the range.
+ * @param hi One past the last item of the range.
+ * @param nth Position to settle, within the range.
+ */
+static void kdtree_select(KDTreeBuildItem *items, size_t lo, size_t hi, size_t nth) {
+    while (hi - lo > 1) {
+        // Median of three pivot
+        double a = items[lo].key, b = items[lo + (hi - lo) / 2].key, c = items[hi - 1].key;
+        double pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+        // Three-way partition: [lo, lt) < pivot, [lt, gt) == pivot, [gt, hi) > pivot
+        size_t lt = lo, i = lo, gt = hi;
+        while (i < gt) {
+            KDTreeBuildItem item = items[i];
+            if (item.key < pivot) {
+                items[i++] = items[lt];
+                items[lt++] = item;
+            } else if (item.key > pivot) {
+                items[i] = items[--gt];
+                items[gt] = item;
+            } else {
+                i++;
+            }
+        }
+
+        if (nth < lt) {
+            hi = lt;
+        } else if (nth >= gt) {
+            lo = gt;
+        } else {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Number of nodes in the left subtree of a complete binary tree.
+ * 
+ * @param count Number of nodes in the tree.
+ * @return size_t Number of nodes left of the root.
+ */
+static size_t kdtree_left_size(size_t count) {
+    size_t perfect = 1; // Nodes of the largest perfect tree that fits
+    while (2 * perfect + 1 <= count) {
+        perfect = 2 * perfect + 1;
+    }
+    size_t bottom = count - perfect;      // Nodes on the partial last level, filled from the left
+    size_t left_bottom = (perfect + 1) / 2; // Room for them under the left subtree
+    return (perfect - 1) / 2 + (bottom < left_bottom ? bottom : left_bottom);
+}
+
+/**
+ * @brief Node of a build at a breadth-first position.
+ * 
+ * @param job Shared build state.
+ * @param position Breadth-first position.
+ * @return KDTreeNode* The node, or NULL past the last position.
+ */
+static KDTreeNode* kdtree_build_node(KDTreeBuildJob *job, size_t position) {
+    if (position >= job->count) {
+        return NULL;
+    }
+    return job->slots ? job->slots[position] : &job->nodes[position];
+}
+
+/**
+ * @brief Build a complete subtree from a range of items.
+ * 
+ * The tree is left-balanced: the root takes the item whose rank leaves a complete tree on each
+ * side, so the nodes fill a breadth-first array without gaps and the children of the node at
+ * position p sit at 2p + 1 and 2p + 2. The top levels are packed at the start of the array, and
+ * the depth is ceil(log2(count + 1)) even when many points share a coordinate.
+ *
+ * @param job Shared build state.
+ * @param lo First item of the subtree.
+ * @param hi One past the last item of the subtree.
+ * @param depth Depth of the subtree root.
+ * @param position Breadth-first position of the subtree root.
+ * @param buffer Scratch space of dimension doubles for the point function.
+ * @param queue Non-zero to queue the subtrees found at the task depth instead of building them.
+ */
+static void kdtree_build_rec(KDTreeBuildJob *job, size_t lo, size_t hi, size_t depth, size_t position,
+                             double *buffer, int queue) {
+    KDTree *tree = job->tree;
+    while (lo < hi) {
+        if (queue && depth == job->task_depth) {
+            KDTreeBuildTask *task = &job->tasks[job->task_count++];
+            task->lo = lo;
+            task->hi = hi;
+            task->depth = depth;
+            task->position = position;
+            return;
+        }
+
+        size_t axis = depth % tree->dimension;
+        for (size_t i = lo; i < hi; i++) {
+            const double *coordinates = tree->point_func(tree->point_context, job->items[i].index, buffer);
+            job->items[i].key = coordinates ? coordinates[axis] : 0.0;
+        }
+        size_t mid = lo + kdtree_left_size(hi - lo);
+        kdtree_select(job->items, lo, hi, mid);
+
+        KDTreeNode *node = kdtree_build_node(job, position);
+        node->split = job->items[mid].key;
+        node->index = job->items[mid].index;
+        node->size = hi - lo;
+        node->left = kdtree_build_node(job, 2 * position + 1);
+        node->right = kdtree_build_node(job, 2 * position + 2);
+
+        kdtree_build_rec(job, lo, mid, depth + 1, 2 * position + 1, buffer, queue);
+        lo = mid + 1;
+        depth++;
+        position = 2 * position + 2;
+    }
+}
+
+/**
+ * @brief Thread body building queued subtrees until none is left.
+ * 
+ * @param arg Pointer to the KDTreeBuildJob.
+ * @return void* NULL.
+ */
+static void* kdtree_build_thread(void *arg) {
+    KDTreeBuildJob *job = (KDTreeBuildJob*)arg;
+    double *buffer = (double*)malloc(job->tree->dimension * sizeof(double));
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        if (!buffer) {
+            job->failed = 1;
+        }
+        size_t next = job->failed ? job->task_count : job->next_task++;
+        pthread_mutex_unlock(&job->lock);
+        if (next >= job->task_count) {
+            break;
+        }
+        KDTreeBuildTask *task = &job->tasks[next];
+        kdtree_build_rec(job, task->lo, task->hi, task->depth, task->position, buffer, 0);
+    }
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * @brief Replace the content of the KD-tree with a balanced tree over a set of points.
+ * 
+ * Each level splits its points around their median on its axis into a complete tree stored
+ * breadth-first, so the depth is about log2(count) and searches read the top levels from a few
+ * cache lines. The top levels are split on the caller's thread and the subtrees below them are
+ * built by a pool of worker threads. All nodes share one arena block sized to the point count.
+ *
+ * @param tree KD-tree to rebuild.
+ * @param indices Indices of the points in the original dataset.
+ * @param count Number of points.
+ * @param threads Maximum number of worker threads, 1 to build on the caller's thread.
+ * @return int 0 on success, -1 on allocation failure, in which case the tree is unchanged.
+ */
+int kdtree_build(KDTree *tree, const size_t *indices, size_t count, size_t threads) {
+    if (tree == NULL) return -1;
+    if (count == 0) {
+        kdtree_release_nodes(tree);
+        return 0;
+    }
+
+    KDTreeBuildJob job;
+    job.tree = tree;
+    job.items = (KDTreeBuildItem*)malloc(count * sizeof(KDTreeBuildItem));
+    job.nodes = (KDTreeNode*)malloc(count * sizeof(KDTreeNode));
+    job.slots = NULL;
+    job.count = count;
+    job.tasks = NULL;
+    job.task_depth = 0;
+    job.task_count = 0;
+    job.next_task = 0;
+    job.failed = 0;
+    KDTreeNode **blocks = (KDTreeNode**)malloc(16 * sizeof(KDTreeNode*));
+    double *buffer = (double*)malloc(tree->dimension * sizeof(double));
+    if (!job.items || !job.nodes || !blocks || !buffer) {
+        free(job.items);
+        free(job.nodes);
+        free(blocks);
+        free(buffer);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        job.items[i].index = indices[i];
+    }
+
+    // Queue enough subtrees to keep every thread busy
+    if (threads > 1 && count >= KDTREE_BUILD_MIN_PARALLEL) {
+        while (((size_t)1 << job.task_depth) < threads * KDTREE_BUILD_TASKS_PER_THREAD) {
+            job.task_depth++;
+        }
+        job.tasks = (KDTreeBuildTask*)malloc(((size_t)1 << job.task_depth) * sizeof(KDTreeBuildTask));
+        if (job.tasks && pthread_mutex_init(&job.lock, NULL) != 0) {
+            free(job.tasks);
+            job.tasks = NULL;
+        }
+    }
+
+    kdtree_build_rec(&job, 0, count, 0, 0, buffer, job.tasks != NULL);
+
+    if (job.tasks) {
+        size_t thread_count = threads < job.task_count ? threads : job.task_count;
+        pthread_t *workers = (pthread_t*)malloc(thread_count * sizeof(pthread_t));
+        size_t started = 0;
+        while (workers && started < thread_count &&
+               pthread_create(&workers[started], NULL, kdtree_build_thread, &job) == 0) {
+            started++;
+        }
+        if (started == 0) {
+            kdtree_build_thread(&job); // No thread could be started, build on the caller's
+        }
+        for (size_t i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        free(workers);
+        pthread_mutex_destroy(&job.lock);
+        free(job.tasks);
+    }
+    free(buffer);
+    free(job.items);
+
+    if (job.failed) {
+        free(job.nodes);
+        free(blocks);
+        return -1;
+    }
+
+    // The built block is full, so the next insert starts a new one
+    kdtree_release_nodes(tree);
+    blocks[0] = job.nodes;
+    tree->blocks = blocks;
+    tree->block_count = 1;
+    tree->block_capacity = 16;
+    tree->block_used = KDTREE_ARENA_BLOCK_NODES;
+    tree->root = job.nodes;
+    printf("KDTree built with %zu points\n", count);
+    return 0;
+}
+
+/**
+ * @brief Record a subtree for rebuilding if one of its children holds too many of its nodes.
+ * 
+ * Update paths are checked from the bottom up, so the last subtree recorded is the highest one
+ * out of balance, the scapegoat whose rebuild restores the balance of the whole path.
+ *
+ * @param node Subtree root, whose size is up to date.
+ * @param depth Depth of the subtree root.
+ * @param rebalance Set to the subtree if it is out of balance.
+ */
+static void kdtree_check_balance(KDTreeNode *node, size_t depth, KDTreeRebalance *rebalance) {
+    size_t left = node->left ? node->left->size : 0;
+    size_t right = node->right ? node->right->size : 0;
+    if ((double)(left > right ? left : right) > KDTREE_BALANCE_ALPHA * (double)node->size) {
+        rebalance->node = node;
+        rebalance->depth = depth;
+    }
+}
+
+/**
+ * @brief Rebuild a subtree into a complete tree around its medians, reusing its nodes.
+ * 
+ * The subtree root keeps its address, so the link from its parent stays valid.
+ *
+ * @param tree KD-tree holding the subtree.
+ * @param root Subtree root.
+ * @param depth Depth of the subtree root.
+ * @return int 0 on success, -1 on allocation failure, in which case the subtree is unchanged.
+ */
+static int kdtree_rebuild_subtree(KDTree *tree, KDTreeNode *root, size_t depth) {
+    size_t count = root->size;
+    KDTreeBuildJob job;
+    job.tree = tree;
+    job.items = (KDTreeBuildItem*)malloc(count * sizeof(KDTreeBuildItem));
+    job.nodes = NULL;
+    job.slots = (KDTreeNode**)malloc(count * sizeof(KDTreeNode*));
+    job.count = count;
+    job.tasks = NULL;
+    job.task_depth = 0;
+    job.task_count = 0;
+    job.next_task = 0;
+    job.failed = 0;
+    double *buffer = (double*)malloc(tree->dimension * sizeof(double));
+    if (!job.items || !job.slots || !buffer) {
+        free(job.items);
+        free(job.slots);
+        free(buffer);
+        return -1;
+    }
+
+    // Collect the nodes breadth-first, root first
+    size_t collected = 1;
+    job.slots[0] = root;
+    for (size_t i = 0; i < collected; i++) {
+        KDTreeNode *node = job.slots[i];
+        job.items[i].index = node->index;
+        if (node->left && collected < count) {
+            job.slots[collected++] = node->left;
+        }
+        if (node->right && collected < count) {
+            job.slots[collected++] = node->right;
+        }
+    }
+
+    kdtree_build_rec(&job, 0, count, depth, 0, buffer, 0);
+    free(buffer);
+    free(job.slots);
+    free(job.items);
+    return 0;
+}
+
+/**
+ * @brief Rebuild the subtree recorded by an insert or a removal, if any.
+ * 
+ * @param tree KD-tree holding the subtree.
+ * @param rebalance Subtree recorded on the update path.
+ */
+static void kdtree_rebalance(KDTree *tree, KDTreeRebalance *rebalance) {
+    if (rebalance->node && kdtree_rebuild_subtree(tree, rebalance->node, rebalance->depth) != 0) {
+        fprintf(stderr, "Failed to rebalance a KDTree subtree of %zu nodes\n", rebalance->node->size);
+    }
+}
+
 /**
  * @brief Insert a point into the KD-tree recursively.
  * 
- * @param node Current node in the KD-tree.
+ * @param tree KD-tree into which the point is to be inserted.
+ * @param link Link to the current subtree, set to the new node when it is empty.
  * @param point Point to be inserted.
  * @param index Index of the point in the original dataset.
  * @param depth Current depth in the KD-tree.
- * @param dimension Dimensionality of the points.
- * @return Pointer to the updated KD-tree node.
+ * @param rebalance Set to the highest subtree left out of balance.
+ * @return int 0 on success, -1 on allocation failure.
  */
-KDTreeNode* kdtree_insert_rec(KDTreeNode *node, const double *point, size_t index, size_t depth, size_t dimension) {
-    printf("Inserting recursively at depth %zu, dimension %zu\n", depth, dimension);
+static int kdtree_insert_rec(KDTree *tree, KDTreeNode **link, const double *point, size_t index, size_t depth,
+                             KDTreeRebalance *rebalance) {
+    KDTreeNode *node = *link;
     if (!node) {
-        return kdtree_create_node(point, index, dimension);
+        node = kdtree_create_node(tree, point, index, depth);
+        if (!node) {
+            return -1;
+        }
+        *link = node;
+        return 0;
     }
 
-    size_t cd = depth % dimension;
+    size_t cd = depth % tree->dimension;
+    KDTreeNode **child = point[cd] < node->split ? &node->left : &node->right;
+    if (kdtree_insert_rec(tree, child, point, index, depth + 1, rebalance) != 0) {
+        return -1;
+    }
+    node->size++;
+    kdtree_check_balance(node, depth, rebalance);
+    return 0;
+}
 
-    if (point[cd] < node->point[cd]) {
-        node->left = kdtree_insert_rec(node->left, point, index, depth + 1, dimension);
-    } else {
-        node->right = kdtree_insert_rec(node->right, point, index, depth + 1, dimension);
+/**
+ * @brief Insert a point into the KD-tree.
+ * 
+ * @param tree KD-tree into which the point is to be inserted.
+ * @param point Coordinates of the point, used to place it.
+ * @param index Index of the point in the original dataset.
+ */
+void kdtree_insert(KDTree *tree, const double *point, size_t index) {
+    if (tree == NULL) return;
+    KDTreeRebalance rebalance = { NULL, 0 };
+    if (kdtree_insert_rec(tree, &tree->root, point, index, 0, &rebalance) != 0) {
+        fprintf(stderr, "Failed to allocate KDTreeNode for index %zu\n", index);
+        return;
     }
+    kdtree_rebalance(tree, &rebalance);
+}
 
-    return node;
+/**
+ * @brief Find the node holding a point by following its insertion path.
+ * 
+ * A bulk-built tree may hold points equal to a split coordinate on both sides of it, so both
+ * children are searched on a tie.
+ *
+ * @param tree KD-tree to search in.
+ * @param node Subtree root.
+ * @param point Coordinates the point was inserted with.
+ * @param index Index the point was inserted with.
+ * @param depth Depth of the subtree root.
+ * @return KDTreeNode* Pointer to the node, or NULL if the point is not in the subtree.
+ */
+static KDTreeNode* kdtree_find_node(KDTree *tree, KDTreeNode *node, const double *point, size_t index, size_t depth) {
+    while (node) {
+        if (node->index == index) {
+            return node;
+        }
+        size_t cd = depth % tree->dimension;
+        if (point[cd] == node->split) {
+            KDTreeNode *found = kdtree_find_node(tree, node->left, point, index, depth + 1);
+            if (found) {
+                return found;
+            }
+        }
+        node = point[cd] < node->split ? node->left : node->right;
+        depth++;
+    }
+    return NULL;
 }
 
 /**
- * @brief Create a new KD-tree.
+ * @brief Find the point of a subtree that is lowest or highest on an axis.
  * 
- * @param dimension Dimensionality of the points.
- * @return Pointer to the newly created KD-tree.
+ * Below a node splitting that axis, only the side that can hold a lower or higher value is
+ * searched. Points that cannot be read are skipped.
+ *
+ * @param tree KD-tree holding the subtree.
+ * @param node Subtree root.
+ * @param axis Axis compared.
+ * @param depth Depth of the subtree root.
+ * @param highest Non-zero to find the highest point, zero for the lowest.
+ * @param buffer Scratch space of dimension doubles for the point function.
+ * @param best Set to the node holding the point found so far, NULL on the first call.
+ * @param value Set to the coordinate of that point on the axis.
  */
-KDTree* kdtree_create(size_t dimension) {
-    KDTree *tree = (KDTree*)malloc(sizeof(KDTree));
-    if (!tree) return NULL;
+static void kdtree_find_extreme(KDTree *tree, KDTreeNode *node, size_t axis, size_t depth, int highest,
+                                double *buffer, KDTreeNode **best, double *value) {
+    while (node) {
+        int same_axis = depth % tree->dimension == axis;
+        int readable = 1;
+        double v = node->split;
+        if (!same_axis) {
+            const double *coordinates = tree->point_func(tree->point_context, node->index, buffer);
+            readable = coordinates != NULL;
+            v = readable ? coordinates[axis] : 0.0;
+        }
+        if (readable && (!*best || (highest ? v > *value : v < *value))) {
+            *best = node;
+            *value = v;
+        }
+        if (same_axis) {
+            node = highest ? node->right : node->left;
+        } else {
+            kdtree_find_extreme(tree, node->left, axis, depth + 1, highest, buffer, best, value);
+            node = node->right;
+        }
+        depth++;
+    }
+}
 
-    tree->root = NULL;
-    tree->dimension = dimension;
+static int kdtree_remove_rec(KDTree *tree, KDTreeNode **link, const double *point, size_t index, size_t depth,
+                             double *buffer, KDTreeRebalance *rebalance);
 
-    return tree;
+/**
+ * @brief Give a node with children the point of its subtree nearest to its split, and remove that point below it.
+ * 
+ * The node takes the lowest point of its right subtree on its axis, or the highest point of its
+ * left subtree when it has no right child, so every point on its left stays at or below the new
+ * split and every point on its right at or above it.
+ *
+ * @param tree KD-tree holding the node.
+ * @param node Node whose point is removed.
+ * @param depth Depth of the node.
+ * @param buffer Scratch space of dimension doubles for the point function.
+ * @param rebalance Set to the highest subtree left out of balance.
+ * @return int 1 on success, -1 if no replacement could be read or on allocation failure.
+ */
+static int kdtree_replace_node(KDTree *tree, KDTreeNode *node, size_t depth, double *buffer,
+                               KDTreeRebalance *rebalance) {
+    size_t axis = depth % tree->dimension;
+    int highest = node->right == NULL;
+    KDTreeNode **child = highest ? &node->left : &node->right;
+    KDTreeNode *replacement = NULL;
+    double value = 0.0;
+    kdtree_find_extreme(tree, *child, axis, depth + 1, highest, buffer, &replacement, &value);
+    if (!replacement) {
+        return -1;
+    }
+
+    // Copy the coordinates, the buffer is reused while the replacement is removed
+    double *moved = (double*)malloc(tree->dimension * sizeof(double));
+    const double *coordinates = tree->point_func(tree->point_context, replacement->index, buffer);
+    if (!moved || !coordinates) {
+        free(moved);
+        return -1;
+    }
+    memcpy(moved, coordinates, tree->dimension * sizeof(double));
+    size_t moved_index = replacement->index;
+    int status = kdtree_remove_rec(tree, child, moved, moved_index, depth + 1, buffer, rebalance);
+    free(moved);
+    if (status != 1) {
+        return -1;
+    }
+    node->index = moved_index;
+    node->split = value;
+    return 1;
 }
 
 /**
- * @brief Insert a point into the KD-tree.
+ * @brief Remove a point from a subtree recursively.
  * 
- * @param tree KD-tree into which the point is to be inserted.
- * @param point Point to be inserted.
+ * @param tree KD-tree holding the subtree.
+ * @param link Link to the subtree root, cleared when the root is a removed leaf.
+ * @param point Coordinates the point was inserted with.
  * @param index Index of the point in the original dataset.
+ * @param depth Depth of the subtree root.
+ * @param buffer Scratch space of dimension doubles for the point function.
+ * @param rebalance Set to the highest subtree left out of balance.
+ * @return int 1 if the point was removed, 0 if it is not in the subtree, -1 on failure.
  */
-void kdtree_insert(KDTree *tree, const double *point, size_t index) {
+static int kdtree_remove_rec(KDTree *tree, KDTreeNode **link, const double *point, size_t index, size_t depth,
+                             double *buffer, KDTreeRebalance *rebalance) {
+    KDTreeNode *node = *link;
+    if (!node) {
+        return 0;
+    }
+
+    int status = 0;
+    if (node->index == index) {
+        if (!node->left && !node->right) {
+            // A leaf goes back to the free list
+            *link = NULL;
+            node->left = tree->free_nodes;
+            tree->free_nodes = node;
+            return 1;
+        }
+        status = kdtree_replace_node(tree, node, depth, buffer, rebalance);
+    } else {
+        // Points equal to the split may sit on either side
+        size_t cd = depth % tree->dimension;
+        if (point[cd] <= node->split) {
+            status = kdtree_remove_rec(tree, &node->left, point, index, depth + 1, buffer, rebalance);
+        }
+        if (status == 0 && point[cd] >= node->split) {
+            status = kdtree_remove_rec(tree, &node->right, point, index, depth + 1, buffer, rebalance);
+        }
+    }
+
+    if (status == 1) {
+        node->size--;
+        kdtree_check_balance(node, depth, rebalance);
+    }
+    return status;
+}
+
+/**
+ * @brief Remove a point from the KD-tree.
+ * 
+ * @param tree KD-tree to remove the point from.
+ * @param point Coordinates the point was inserted with.
+ * @param index Index of the point in the original dataset.
+ */
+void kdtree_remove(KDTree *tree, const double *point, size_t index) {
     if (tree == NULL) return;
-    printf("Inserting point into KDTree\n");
-    tree->root = kdtree_insert_rec(tree->root, point, index, 0, tree->dimension);
+    double *buffer = (double*)malloc(tree->dimension * sizeof(double));
+    if (!buffer) {
+        fprintf(stderr, "Failed to allocate memory to remove index %zu from KDTree\n", index);
+        return;
+    }
+    KDTreeRebalance rebalance = { NULL, 0 };
+    if (kdtree_remove_rec(tree, &tree->root, point, index, 0, buffer, &rebalance) < 0) {
+        fprintf(stderr, "Failed to remove index %zu from KDTree\n", index);
+    }
+    free(buffer);
+    kdtree_rebalance(tree, &rebalance);
 }
 
 /**
- * @brief Free the memory allocated for the KD-tree nodes recursively.
+ * @brief Update a node in place if its point may move to new coordinates without breaking the tree.
  * 
- * @param node Current node in the KD-tree.
+ * @param tree KD-tree holding the point.
+ * @param node Subtree root.
+ * @param old_point Coordinates the point was inserted with.
+ * @param new_point New coordinates of the point.
+ * @param index Index of the point in the original dataset.
+ * @param depth Depth of the subtree root.
+ * @param inside Non-zero if the new coordinates lie in the region covered by the subtree.
+ * @return int 1 if the node was updated, 0 if it must be moved, -1 if the point is not in the subtree.
  */
-void kdtree_free_rec(KDTreeNode *node) {
+static int kdtree_update_rec(KDTree *tree, KDTreeNode *node, const double *old_point, const double *new_point,
+                             size_t index, size_t depth, int inside) {
+    while (node) {
+        size_t cd = depth % tree->dimension;
+        if (node->index == index) {
+            // Only a leaf may change its split coordinate
+            if (inside && (new_point[cd] == node->split || (!node->left && !node->right))) {
+                node->split = new_point[cd];
+                return 1;
+            }
+            return 0;
+        }
+        if (old_point[cd] == node->split) {
+            int status = kdtree_update_rec(tree, node->left, old_point, new_point, index, depth + 1,
+                                           inside && new_point[cd] <= node->split);
+            if (status >= 0) {
+                return status;
+            }
+        }
+        if (old_point[cd] < node->split) {
+            inside = inside && new_point[cd] <= node->split;
+            node = node->left;
+        } else {
+            inside = inside && new_point[cd] >= node->split;
+            node = node->right;
+        }
+        depth++;
+    }
+    return -1;
+}
+
+/**
+ * @brief Move a point of the KD-tree to new coordinates.
+ * 
+ * @param tree KD-tree holding the point.
+ * @param old_point Coordinates the point was inserted with.
+ * @param new_point New coordinates of the point.
+ * @param index Index of the point in the original dataset.
+ */
+void kdtree_update(KDTree *tree, const double *old_point, const double *new_point, size_t index) {
+    if (tree == NULL) return;
+    int status = kdtree_update_rec(tree, tree->root, old_point, new_point, index, 0, 1);
+    if (status == 1) {
+        return;
+    }
+    if (status == 0) {
+        kdtree_remove(tree, old_point, index);
+    }
+    kdtree_insert(tree, new_point, index);
+}
+
+/**
+ * @brief Change the dataset index stored for a point after it was moved.
+ * 
+ * @param tree KD-tree holding the point.
+ * @param point Coordinates the point was inserted with.
+ * @param old_index Index the point was inserted with.
+ * @param new_index New index of the point in the original dataset.
+ */
+void kdtree_remap(KDTree *tree, const double *point, size_t old_index, size_t new_index) {
+    if (tree == NULL) return;
+    KDTreeNode *node = kdtree_find_node(tree, tree->root, point, old_index, 0);
     if (node) {
-        kdtree_free_rec(node->left);
-        kdtree_free_rec(node->right);
-        free(node->point);
-        free(node);
+        node->index = new_index;
     }
 }
 
 /**
- * @brief Free the memory allocated for the KD-tree.
+ * @brief Push a point into a bounded max-heap keeping the smallest distances.
  * 
- * @param tree KD-tree to be freed.
+ * @param search Search whose heap receives the point.
+ * @param distance Squared distance of the point to the query.
+ * @param index Index of the point in the original dataset.
  */
-void kdtree_free(KDTree *tree) {
-    if (tree) {
-        kdtree_free_rec(tree->root);
-        tree->root = NULL; // Avoid dangling pointer
-        free(tree);
+static void kdtree_knn_push(KDTreeKnnSearch *search, double distance, size_t index) {
+    KDTreeNeighbor *heap = search->heap;
+    size_t pos;
+    if (search->count < search->k) {
+        // Sift the new entry up from the end
+        pos = search->count++;
+        while (pos > 0 && heap[(pos - 1) / 2].distance < distance) {
+            heap[pos] = heap[(pos - 1) / 2];
+            pos = (pos - 1) / 2;
+        }
+    } else if (distance < heap[0].distance) {
+        // Replace the farthest neighbor and sift down from the root
+        pos = 0;
+        for (;;) {
+            size_t child = 2 * pos + 1;
+            if (child >= search->count) {
+                break;
+            }
+            if (child + 1 < search->count && heap[child + 1].distance > heap[child].distance) {
+                child++;
+            }
+            if (heap[child].distance <= distance) {
+                break;
+            }
+            heap[pos] = heap[child];
+            pos = child;
+        }
+    } else {
+        return;
     }
+    heap[pos].distance = distance;
+    heap[pos].index = index;
 }
 
 /**
- * @brief Find the nearest neighbor in the KD-tree recursively.
+ * @brief Push a subtree onto the explicit stack of a search.
  * 
- * @param node Current node in the KD-tree.
- * @param point Point to find the nearest neighbor for.
- * @param depth Current depth in the KD-tree.
- * @param dimension Dimensionality of the points.
- * @param best_node Best node found so far.
- * @param best_dist Best distance found so far.
- * @return Pointer to the best KD-tree node found so far.
+ * @param stack Stack to push onto.
+ * @param node Subtree root.
+ * @param depth Depth of the subtree root.
+ * @param bound Squared distance from the query to the splitting plane in front of the subtree.
+ * @return int 0 on success, -1 on allocation failure.
  */
-KDTreeNode* kdtree_nearest_rec(KDTreeNode *node, const double *point, size_t depth, size_t dimension, KDTreeNode *best_node, double *best_dist) {
-    if (!node) return best_node;
+static int kdtree_stack_push(KDTreeStack *stack, KDTreeNode *node, size_t depth, double bound) {
+    if (stack->count == stack->capacity) {
+        size_t capacity = stack->capacity * 2;
+        KDTreeStackEntry *entries = (KDTreeStackEntry*)malloc(capacity * sizeof(KDTreeStackEntry));
+        if (!entries) {
+            return -1;
+        }
+        memcpy(entries, stack->entries, stack->count * sizeof(KDTreeStackEntry));
+        if (stack->entries != stack->local) {
+            free(stack->entries);
+        }
+        stack->entries = entries;
+        stack->capacity = capacity;
+    }
+    KDTreeStackEntry *entry = &stack->entries[stack->count++];
+    entry->node = node;
+    entry->depth = depth;
+    entry->bound = bound;
+    return 0;
+}
 
+/**
+ * @brief Squared distance between the query and a node's point over the tree's dimension.
+ * 
+ * @param tree KD-tree holding the node.
+ * @param node Node whose point is compared.
+ * @param point Query point.
+ * @param buffer Scratch space of dimension doubles for the point function.
+ * @param limit The sum stops growing past this value.
+ * @return double The squared distance, at least limit if it is larger, or INFINITY if the node's
+ *         point cannot be read.
+ */
+static double kdtree_node_distance(KDTree *tree, KDTreeNode *node, const double *point, double *buffer, double limit) {
+    const double *coordinates = tree->point_func(tree->point_context, node->index, buffer);
+    if (!coordinates) {
+        return INFINITY;
+    }
     double d = 0;
-    for (size_t i = 0; i < dimension; i++) {
-        d += (node->point[i] - point[i]) * (node->point[i] - point[i]);
+    for (size_t i = 0; i < tree->dimension && d <= limit; i++) {
+        d += (coordinates[i] - point[i]) * (coordinates[i] - point[i]);
     }
+    return d;
+}
 
-    if (d < *best_dist) {
-        *best_dist = d;
-        best_node = node;
+/**
+ * @brief Collect the k nearest neighbors of the query.
+ * 
+ * The walk is iterative. It follows the query's side of the splits down to a leaf using only the
+ * split values held in the nodes, prefetching the point of every node on the way, and leaves the
+ * other side of each split on an explicit stack together with the distance to its plane. The
+ * points of the path are then compared while the later ones are still loading. A pending subtree
+ * is only entered while the heap is not full or its plane is closer than the k-th best distance.
+ *
+ * @param search Search state.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int kdtree_knn_walk(KDTreeKnnSearch *search) {
+    KDTree *tree = search->tree;
+    const double *point = search->point;
+    KDTreeNode *path[KDTREE_PATH_BATCH];
+    KDTreeStack stack;
+    stack.entries = stack.local;
+    stack.count = 0;
+    stack.capacity = KDTREE_STACK_ENTRIES;
+    int status = kdtree_stack_push(&stack, tree->root, 0, 0.0);
+
+    while (status == 0 && stack.count > 0) {
+        KDTreeStackEntry entry = stack.entries[--stack.count];
+        if (search->count == search->k && entry.bound >= search->heap[0].distance) {
+            continue;
+        }
+        KDTreeNode *node = entry.node;
+        size_t depth = entry.depth;
+        while (node && status == 0) {
+            size_t length = 0;
+            while (node && length < KDTREE_PATH_BATCH) {
+                if (tree->prefetch_func) {
+                    tree->prefetch_func(tree->point_context, node->index);
+                }
+                KDTREE_PREFETCH(node->left);
+                KDTREE_PREFETCH(node->right);
+                path[length++] = node;
+
+                size_t cd = depth % tree->dimension;
+                double offset = point[cd] - node->split;
+                KDTreeNode *other_node = offset < 0 ? node->right : node->left;
+                if (other_node && (search->count < search->k || offset * offset < search->heap[0].distance) &&
+                    kdtree_stack_push(&stack, other_node, depth + 1, offset * offset) != 0) {
+                    status = -1;
+                }
+                node = offset < 0 ? node->left : node->right;
+                depth++;
+            }
+            for (size_t i = 0; i < length; i++) {
+                double limit = search->count < search->k ? INFINITY : search->heap[0].distance;
+                double d = kdtree_node_distance(tree, path[i], point, search->buffer, limit);
+                if (d < INFINITY) {
+                    kdtree_knn_push(search, d, path[i]->index);
+                }
+            }
+        }
     }
 
-    size_t cd = depth % dimension;
-    KDTreeNode *next_node = NULL, *other_node = NULL;
+    if (stack.entries != stack.local) {
+        free(stack.entries);
+    }
+    return status;
+}
 
-    if (point[cd] < node->point[cd]) {
-        next_node = node->left;
-        other_node = node->right;
-    } else {
-        next_node = node->right;
-        other_node = node->left;
+/**
+ * @brief Compare two neighbors by distance, for sorting.
+ * 
+ * @param a Pointer to the first KDTreeNeighbor.
+ * @param b Pointer to the second KDTreeNeighbor.
+ * @return int Negative, zero or positive as a is nearer than, as near as or farther than b.
+ */
+static int kdtree_neighbor_compare(const void *a, const void *b) {
+    double da = ((const KDTreeNeighbor*)a)->distance;
+    double db = ((const KDTreeNeighbor*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+/**
+ * @brief Find the k nearest neighbors in the KD-tree with a single walk.
+ * 
+ * @param tree KD-tree to search in.
+ * @param point Point to find the neighbors of.
+ * @param k Maximum number of neighbors.
+ * @param indices Set to the indices of the neighbors, nearest first (k entries).
+ * @param distances Set to the Euclidean distances of the neighbors over the tree's dimension (k entries).
+ * @return size_t Number of neighbors found, or (size_t)-1 on allocation failure.
+ */
+size_t kdtree_knn(KDTree *tree, const double *point, size_t k, size_t *indices, double *distances) {
+    if (tree == NULL || tree->root == NULL || k == 0) {
+        return 0;
     }
+    KDTreeKnnSearch search;
+    search.tree = tree;
+    search.point = point;
+    search.k = k;
+    search.count = 0;
+    search.buffer = (double*)malloc(tree->dimension * sizeof(double));
+    search.heap = (KDTreeNeighbor*)malloc(k * sizeof(KDTreeNeighbor));
+    if (!search.buffer || !search.heap) {
+        fprintf(stderr, "Failed to allocate memory for KD-tree search\n");
+        free(search.buffer);
+        free(search.heap);
+        return (size_t)-1;
+    }
+
+    if (kdtree_knn_walk(&search) != 0) {
+        fprintf(stderr, "Failed to allocate memory for KD-tree search\n");
+        free(search.buffer);
+        free(search.heap);
+        return (size_t)-1;
+    }
+
+    qsort(search.heap, search.count, sizeof(KDTreeNeighbor), kdtree_neighbor_compare);
+    for (size_t i = 0; i < search.count; i++) {
+        indices[i] = search.heap[i].index;
+        distances[i] = sqrt(search.heap[i].distance);
+    }
+    free(search.buffer);
+    free(search.heap);
+    return search.count;
+}
+
+/**
+ * @brief Report the points within the radius of the query.
+ * 
+ * Iterative like kdtree_knn_walk: the far side of a split is left on the explicit stack only
+ * when its plane is within the radius.
+ *
+ * @param search Search state.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int kdtree_range_walk(KDTreeRangeSearch *search) {
+    KDTree *tree = search->tree;
+    const double *point = search->point;
+    KDTreeNode *path[KDTREE_PATH_BATCH];
+    KDTreeStack stack;
+    stack.entries = stack.local;
+    stack.count = 0;
+    stack.capacity = KDTREE_STACK_ENTRIES;
+    int status = kdtree_stack_push(&stack, tree->root, 0, 0.0);
 
-    best_node = kdtree_nearest_rec(next_node, point, depth + 1, dimension, best_node, best_dist);
+    while (status == 0 && stack.count > 0 && !search->stopped) {
+        KDTreeStackEntry entry = stack.entries[--stack.count];
+        KDTreeNode *node = entry.node;
+        size_t depth = entry.depth;
+        while (node && status == 0 && !search->stopped) {
+            size_t length = 0;
+            while (node && length < KDTREE_PATH_BATCH) {
+                if (tree->prefetch_func) {
+                    tree->prefetch_func(tree->point_context, node->index);
+                }
+                KDTREE_PREFETCH(node->left);
+                KDTREE_PREFETCH(node->right);
+                path[length++] = node;
 
-    if ((point[cd] - node->point[cd]) * (point[cd] - node->point[cd]) < *best_dist) {
-        best_node = kdtree_nearest_rec(other_node, point, depth + 1, dimension, best_node, best_dist);
+                size_t cd = depth % tree->dimension;
+                double offset = point[cd] - node->split;
+                KDTreeNode *other_node = offset < 0 ? node->right : node->left;
+                if (other_node && offset * offset <= search->radius2 &&
+                    kdtree_stack_push(&stack, other_node, depth + 1, offset * offset) != 0) {
+                    status = -1;
+                }
+                node = offset < 0 ? node->left : node->right;
+                depth++;
+            }
+            for (size_t i = 0; i < length && !search->stopped; i++) {
+                double d = kdtree_node_distance(tree, path[i], point, search->buffer, search->radius2);
+                if (d <= search->radius2) {
+                    search->reported++;
+                    search->stopped = search->func(search->context, path[i]->index, sqrt(d)) != 0;
+                }
+            }
+        }
     }
 
-    return best_node;
+    if (stack.entries != stack.local) {
+        free(stack.entries);
+    }
+    return status;
+}
+
+/**
+ * @brief Report every point within a radius of a query.
+ * 
+ * @param tree KD-tree to search in.
+ * @param point Query point.
+ * @param radius Largest Euclidean distance over the tree's dimension reported.
+ * @param func Called for every point found.
+ * @param context Context passed to func.
+ * @return size_t Number of points reported, or (size_t)-1 on allocation failure.
+ */
+size_t kdtree_range(KDTree *tree, const double *point, double radius, KDTreeRangeFunc func, void *context) {
+    if (tree == NULL || tree->root == NULL || radius < 0) {
+        return 0;
+    }
+    KDTreeRangeSearch search;
+    search.tree = tree;
+    search.point = point;
+    search.radius2 = radius * radius;
+    search.func = func;
+    search.context = context;
+    search.reported = 0;
+    search.stopped = 0;
+    search.buffer = (double*)malloc(tree->dimension * sizeof(double));
+    if (!search.buffer) {
+        fprintf(stderr, "Failed to allocate memory for KD-tree search\n");
+        return (size_t)-1;
+    }
+    int status = kdtree_range_walk(&search);
+    free(search.buffer);
+    if (status != 0) {
+        fprintf(stderr, "Failed to allocate memory for KD-tree search\n");
+        return (size_t)-1;
+    }
+    return search.reported;
 }
 
 /**
@@ -169,10 +1189,7 @@ KDTreeNode* kdtree_nearest_rec(KDTreeNode *node, const double *point, size_t dep
  * @return Index of the nearest neighbor.
  */
 size_t kdtree_nearest(KDTree *tree, const double *point) {
-    if (tree == NULL || tree->root == NULL) {
-        return (size_t)-1;
-    }
-    double best_dist = INFINITY;
-    KDTreeNode *best_node = kdtree_nearest_rec(tree->root, point, 0, tree->dimension, NULL, &best_dist);
-    return best_node ? best_node->index : (size_t)-1;
+    size_t index;
+    double distance;
+    return kdtree_knn(tree, point, 1, &index, &distance) == 1 ? index : (size_t)-1;
 }
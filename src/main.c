@@ -13,25 +13,94 @@
 #include "../include/put_handler.h"
 #include "../include/delete_handler.h"
 #include "../include/compare_handler.h"
+#include "../include/admin_handler.h"
+#include "../include/sharded_db.h"
+#include "../include/compactor.h"
+#include "../include/snapshotter.h"
+#include "../include/flat_scan.h"
 
 #define DEFAULT_PORT 8888
 #define DEFAULT_DB_FILENAME "vector_database.db"
 #define DEFAULT_KD_TREE_DIMENSION 3
 #define DEFAULT_DB_VECTOR_SIZE 128
 #define DEFAULT_CONFIG_FILENAME "config.json"
+#define DEFAULT_COMPACTION_BATCH_SIZE 1024
+#define DEFAULT_COMPACTION_INTERVAL_MS 1000
+#define DEFAULT_MMAP_WARMUP VECTOR_DB_WARMUP_NONE
+#define DEFAULT_ELEMENT_TYPE VECTOR_ELEMENT_FLOAT64
+#define DEFAULT_WAL_DURABILITY WAL_DURABILITY_GROUP
+#define DEFAULT_WAL_SYNC_INTERVAL_MS 100
+#define DEFAULT_SNAPSHOT_INTERVAL_MS 60000
+#define DEFAULT_SNAPSHOT_DIRTY_WRITES 10000
+#define DEFAULT_QUANTIZATION 0
+#define DEFAULT_QUANTIZATION_RESCORE 16
+#define DEFAULT_SEARCH_METHOD VECTOR_DB_SEARCH_KDTREE
+#define DEFAULT_KD_TREE_CANDIDATES 0
+#define DEFAULT_KD_FOREST_TREES 0
+#define DEFAULT_KD_FOREST_MAX_CHECKS KD_FOREST_DEFAULT_CHECKS
+#define DEFAULT_HNSW_M 0
+#define DEFAULT_HNSW_EF_CONSTRUCTION HNSW_DEFAULT_EF_CONSTRUCTION
+#define DEFAULT_HNSW_EF_SEARCH HNSW_DEFAULT_EF_SEARCH
+#define DEFAULT_HNSW_METRIC HNSW_METRIC_L2
+#define DEFAULT_IVF_LISTS 0
+#define DEFAULT_IVF_NPROBE IVF_DEFAULT_NPROBE
+#define DEFAULT_DISKANN_DEGREE 0
+#define DEFAULT_DISKANN_BUILD_LIST DISKANN_DEFAULT_BUILD_LIST
+#define DEFAULT_DISKANN_SEARCH_LIST DISKANN_DEFAULT_SEARCH_LIST
+#define DEFAULT_DISKANN_BEAM_WIDTH DISKANN_DEFAULT_BEAM_WIDTH
+#define DEFAULT_FLAT_SCAN_THRESHOLD VECTOR_DB_DEFAULT_FLAT_THRESHOLD
+#define DEFAULT_SHARD_COUNT 1
+#define DEFAULT_HOT_SET_SIZE 0
 
 /**
  * @struct Config
- * @brief Config file informations such as filename, listening port, kd_tree dimension deep and db_vector_size
+ * @brief Config file informations such as filename, listening port, kd_tree dimension deep, db_vector_size, compaction tuning, element type, mmap warmup, write-ahead log, snapshot triggers, quantization, search method, KD-tree candidate pool, KD-forest, HNSW graph, IVF index, Vamana graph, flat scan threshold, shard count and hot set size
  */
 typedef struct Config {
     char *db_filename;
     int port;
     size_t kd_tree_dimension;
     size_t db_vector_size;
+    VectorElementType element_type;
+    size_t compaction_batch_size;
+    unsigned int compaction_interval_ms;
+    VectorDBWarmup mmap_warmup;
+    char *wal_filename; // NULL means "<db_filename>.wal"
+    WALDurability wal_durability;
+    unsigned int wal_sync_interval_ms;
+    unsigned int snapshot_interval_ms;
+    size_t snapshot_dirty_writes;
+    int quantization; // Non-zero to keep int8 codes of every vector
+    size_t quantization_rescore;
+    VectorDBSearchMethod search_method;
+    size_t kd_tree_candidates; // 0 re-ranks k * quantization_rescore KD-tree candidates
+    size_t kd_forest_trees; // 0 builds no KD-forest at startup
+    size_t kd_forest_max_checks;
+    size_t hnsw_m; // 0 builds no HNSW graph at startup
+    size_t hnsw_ef_construction;
+    size_t hnsw_ef_search;
+    HNSWMetric hnsw_metric;
+    size_t ivf_lists; // 0 builds no IVF index at startup
+    size_t ivf_nprobe;
+    size_t diskann_degree; // 0 builds no Vamana graph at startup
+    size_t diskann_build_list;
+    size_t diskann_search_list;
+    size_t diskann_beam_width;
+    size_t flat_scan_threshold; // 0 never scans instead of searching an index
+    size_t shard_count;
+    size_t hot_set_size; // 0 keeps every vector in memory
 } Config;
 
-Config config = {DEFAULT_DB_FILENAME, DEFAULT_PORT, DEFAULT_KD_TREE_DIMENSION, DEFAULT_DB_VECTOR_SIZE};
+Config config = {DEFAULT_DB_FILENAME, DEFAULT_PORT, DEFAULT_KD_TREE_DIMENSION, DEFAULT_DB_VECTOR_SIZE,
+                 DEFAULT_ELEMENT_TYPE, DEFAULT_COMPACTION_BATCH_SIZE, DEFAULT_COMPACTION_INTERVAL_MS, DEFAULT_MMAP_WARMUP,
+                 NULL, DEFAULT_WAL_DURABILITY, DEFAULT_WAL_SYNC_INTERVAL_MS,
+                 DEFAULT_SNAPSHOT_INTERVAL_MS, DEFAULT_SNAPSHOT_DIRTY_WRITES,
+                 DEFAULT_QUANTIZATION, DEFAULT_QUANTIZATION_RESCORE, DEFAULT_SEARCH_METHOD,
+                 DEFAULT_KD_TREE_CANDIDATES, DEFAULT_KD_FOREST_TREES, DEFAULT_KD_FOREST_MAX_CHECKS,
+                 DEFAULT_HNSW_M, DEFAULT_HNSW_EF_CONSTRUCTION, DEFAULT_HNSW_EF_SEARCH, DEFAULT_HNSW_METRIC,
+                 DEFAULT_IVF_LISTS, DEFAULT_IVF_NPROBE,
+                 DEFAULT_DISKANN_DEGREE, DEFAULT_DISKANN_BUILD_LIST, DEFAULT_DISKANN_SEARCH_LIST, DEFAULT_DISKANN_BEAM_WIDTH,
+                 DEFAULT_FLAT_SCAN_THRESHOLD, DEFAULT_SHARD_COUNT, DEFAULT_HOT_SET_SIZE};
 
 /**
  * @brief Load the configuration from a JSON file.
@@ -81,6 +150,232 @@ void load_config(const char *filename, Config *config) {
         config->db_vector_size = (size_t)db_vector_size->valueint;
     }
 
+    cJSON *element_type = cJSON_GetObjectItem(json, "ELEMENT_TYPE");
+    if (cJSON_IsString(element_type) && vector_element_parse(element_type->valuestring, &config->element_type) != 0) {
+        fprintf(stderr, "Unknown ELEMENT_TYPE value '%s', expected float64, float32, float16 or bfloat16\n", element_type->valuestring);
+    }
+
+    cJSON *compaction_batch_size = cJSON_GetObjectItem(json, "COMPACTION_BATCH_SIZE");
+    if (cJSON_IsNumber(compaction_batch_size)) {
+        if (compaction_batch_size->valueint >= 1) {
+            config->compaction_batch_size = (size_t)compaction_batch_size->valueint;
+        } else {
+            fprintf(stderr, "Invalid COMPACTION_BATCH_SIZE value %d, expected at least 1\n", compaction_batch_size->valueint);
+        }
+    }
+
+    cJSON *compaction_interval_ms = cJSON_GetObjectItem(json, "COMPACTION_INTERVAL_MS");
+    if (cJSON_IsNumber(compaction_interval_ms)) {
+        config->compaction_interval_ms = (unsigned int)compaction_interval_ms->valueint;
+    }
+
+    cJSON *mmap_warmup = cJSON_GetObjectItem(json, "MMAP_WARMUP");
+    if (cJSON_IsString(mmap_warmup)) {
+        if (strcmp(mmap_warmup->valuestring, "populate") == 0) {
+            config->mmap_warmup = VECTOR_DB_WARMUP_POPULATE;
+        } else if (strcmp(mmap_warmup->valuestring, "willneed") == 0) {
+            config->mmap_warmup = VECTOR_DB_WARMUP_WILLNEED;
+        } else if (strcmp(mmap_warmup->valuestring, "none") == 0) {
+            config->mmap_warmup = VECTOR_DB_WARMUP_NONE;
+        } else {
+            fprintf(stderr, "Unknown MMAP_WARMUP value '%s', expected none, willneed or populate\n", mmap_warmup->valuestring);
+        }
+    }
+
+    cJSON *wal_filename = cJSON_GetObjectItem(json, "WAL_FILENAME");
+    if (cJSON_IsString(wal_filename)) {
+        config->wal_filename = strdup(wal_filename->valuestring);
+    }
+
+    cJSON *wal_durability = cJSON_GetObjectItem(json, "WAL_DURABILITY");
+    if (cJSON_IsString(wal_durability)) {
+        if (strcmp(wal_durability->valuestring, "group") == 0) {
+            config->wal_durability = WAL_DURABILITY_GROUP;
+        } else if (strcmp(wal_durability->valuestring, "async") == 0) {
+            config->wal_durability = WAL_DURABILITY_ASYNC;
+        } else if (strcmp(wal_durability->valuestring, "off") == 0) {
+            config->wal_durability = WAL_DURABILITY_OFF;
+        } else {
+            fprintf(stderr, "Unknown WAL_DURABILITY value '%s', expected off, async or group\n", wal_durability->valuestring);
+        }
+    }
+
+    cJSON *wal_sync_interval_ms = cJSON_GetObjectItem(json, "WAL_SYNC_INTERVAL_MS");
+    if (cJSON_IsNumber(wal_sync_interval_ms)) {
+        config->wal_sync_interval_ms = (unsigned int)wal_sync_interval_ms->valueint;
+    }
+
+    cJSON *snapshot_interval_ms = cJSON_GetObjectItem(json, "SNAPSHOT_INTERVAL_MS");
+    if (cJSON_IsNumber(snapshot_interval_ms)) {
+        config->snapshot_interval_ms = (unsigned int)snapshot_interval_ms->valueint;
+    }
+
+    cJSON *snapshot_dirty_writes = cJSON_GetObjectItem(json, "SNAPSHOT_DIRTY_WRITES");
+    if (cJSON_IsNumber(snapshot_dirty_writes)) {
+        if (snapshot_dirty_writes->valueint >= 0) {
+            config->snapshot_dirty_writes = (size_t)snapshot_dirty_writes->valueint;
+        } else {
+            fprintf(stderr, "Invalid SNAPSHOT_DIRTY_WRITES value %d, expected at least 0\n", snapshot_dirty_writes->valueint);
+        }
+    }
+
+    cJSON *quantization = cJSON_GetObjectItem(json, "QUANTIZATION");
+    if (cJSON_IsString(quantization)) {
+        if (strcmp(quantization->valuestring, "int8") == 0) {
+            config->quantization = 1;
+        } else if (strcmp(quantization->valuestring, "none") == 0) {
+            config->quantization = 0;
+        } else {
+            fprintf(stderr, "Unknown QUANTIZATION value '%s', expected none or int8\n", quantization->valuestring);
+        }
+    }
+
+    cJSON *quantization_rescore = cJSON_GetObjectItem(json, "QUANTIZATION_RESCORE");
+    if (cJSON_IsNumber(quantization_rescore)) {
+        if (quantization_rescore->valueint >= 1) {
+            config->quantization_rescore = (size_t)quantization_rescore->valueint;
+        } else {
+            fprintf(stderr, "Invalid QUANTIZATION_RESCORE value %d, expected at least 1\n", quantization_rescore->valueint);
+        }
+    }
+
+    cJSON *search_method = cJSON_GetObjectItem(json, "SEARCH_METHOD");
+    if (cJSON_IsString(search_method) && vector_db_search_method_parse(search_method->valuestring, &config->search_method) != 0) {
+        fprintf(stderr, "Unknown SEARCH_METHOD value '%s', expected kdtree, quantized, pq, forest, hnsw, ivf, diskann or flat\n", search_method->valuestring);
+    }
+
+    cJSON *kd_tree_candidates = cJSON_GetObjectItem(json, "KD_TREE_CANDIDATES");
+    if (cJSON_IsNumber(kd_tree_candidates) && kd_tree_candidates->valueint >= 0) {
+        config->kd_tree_candidates = (size_t)kd_tree_candidates->valueint;
+    }
+
+    cJSON *kd_forest_trees = cJSON_GetObjectItem(json, "KD_FOREST_TREES");
+    if (cJSON_IsNumber(kd_forest_trees) && kd_forest_trees->valueint >= 0) {
+        config->kd_forest_trees = (size_t)kd_forest_trees->valueint;
+    }
+
+    cJSON *kd_forest_max_checks = cJSON_GetObjectItem(json, "KD_FOREST_MAX_CHECKS");
+    if (cJSON_IsNumber(kd_forest_max_checks)) {
+        if (kd_forest_max_checks->valueint >= 1) {
+            config->kd_forest_max_checks = (size_t)kd_forest_max_checks->valueint;
+        } else {
+            fprintf(stderr, "Invalid KD_FOREST_MAX_CHECKS value %d, expected at least 1\n", kd_forest_max_checks->valueint);
+        }
+    }
+
+    cJSON *hnsw_m = cJSON_GetObjectItem(json, "HNSW_M");
+    if (cJSON_IsNumber(hnsw_m)) {
+        if (hnsw_m->valueint == 0 || (hnsw_m->valueint >= 2 && hnsw_m->valueint <= HNSW_MAX_M)) {
+            config->hnsw_m = (size_t)hnsw_m->valueint;
+        } else {
+            fprintf(stderr, "Invalid HNSW_M value %d, expected 0 or 2 to %d\n", hnsw_m->valueint, HNSW_MAX_M);
+        }
+    }
+
+    cJSON *hnsw_ef_construction = cJSON_GetObjectItem(json, "HNSW_EF_CONSTRUCTION");
+    if (cJSON_IsNumber(hnsw_ef_construction)) {
+        if (hnsw_ef_construction->valueint >= 1) {
+            config->hnsw_ef_construction = (size_t)hnsw_ef_construction->valueint;
+        } else {
+            fprintf(stderr, "Invalid HNSW_EF_CONSTRUCTION value %d, expected at least 1\n", hnsw_ef_construction->valueint);
+        }
+    }
+
+    cJSON *hnsw_ef_search = cJSON_GetObjectItem(json, "HNSW_EF_SEARCH");
+    if (cJSON_IsNumber(hnsw_ef_search)) {
+        if (hnsw_ef_search->valueint >= 1) {
+            config->hnsw_ef_search = (size_t)hnsw_ef_search->valueint;
+        } else {
+            fprintf(stderr, "Invalid HNSW_EF_SEARCH value %d, expected at least 1\n", hnsw_ef_search->valueint);
+        }
+    }
+
+    cJSON *hnsw_metric = cJSON_GetObjectItem(json, "HNSW_METRIC");
+    if (cJSON_IsString(hnsw_metric) && hnsw_metric_parse(hnsw_metric->valuestring, &config->hnsw_metric) != 0) {
+        fprintf(stderr, "Unknown HNSW_METRIC value '%s', expected l2, cosine or ip\n", hnsw_metric->valuestring);
+    }
+
+    cJSON *ivf_lists = cJSON_GetObjectItem(json, "IVF_LISTS");
+    if (cJSON_IsNumber(ivf_lists)) {
+        if (ivf_lists->valueint >= 0 && ivf_lists->valueint <= IVF_MAX_LISTS) {
+            config->ivf_lists = (size_t)ivf_lists->valueint;
+        } else {
+            fprintf(stderr, "Invalid IVF_LISTS value %d, expected 0 to %d\n", ivf_lists->valueint, IVF_MAX_LISTS);
+        }
+    }
+
+    cJSON *ivf_nprobe = cJSON_GetObjectItem(json, "IVF_NPROBE");
+    if (cJSON_IsNumber(ivf_nprobe)) {
+        if (ivf_nprobe->valueint >= 1) {
+            config->ivf_nprobe = (size_t)ivf_nprobe->valueint;
+        } else {
+            fprintf(stderr, "Invalid IVF_NPROBE value %d, expected at least 1\n", ivf_nprobe->valueint);
+        }
+    }
+
+    cJSON *diskann_degree = cJSON_GetObjectItem(json, "DISKANN_DEGREE");
+    if (cJSON_IsNumber(diskann_degree)) {
+        if (diskann_degree->valueint == 0 || (diskann_degree->valueint >= 2 && diskann_degree->valueint <= DISKANN_MAX_DEGREE)) {
+            config->diskann_degree = (size_t)diskann_degree->valueint;
+        } else {
+            fprintf(stderr, "Invalid DISKANN_DEGREE value %d, expected 0 or 2 to %d\n", diskann_degree->valueint, DISKANN_MAX_DEGREE);
+        }
+    }
+
+    cJSON *diskann_build_list = cJSON_GetObjectItem(json, "DISKANN_BUILD_LIST");
+    if (cJSON_IsNumber(diskann_build_list)) {
+        if (diskann_build_list->valueint >= 1) {
+            config->diskann_build_list = (size_t)diskann_build_list->valueint;
+        } else {
+            fprintf(stderr, "Invalid DISKANN_BUILD_LIST value %d, expected at least 1\n", diskann_build_list->valueint);
+        }
+    }
+
+    cJSON *diskann_search_list = cJSON_GetObjectItem(json, "DISKANN_SEARCH_LIST");
+    if (cJSON_IsNumber(diskann_search_list)) {
+        if (diskann_search_list->valueint >= 1) {
+            config->diskann_search_list = (size_t)diskann_search_list->valueint;
+        } else {
+            fprintf(stderr, "Invalid DISKANN_SEARCH_LIST value %d, expected at least 1\n", diskann_search_list->valueint);
+        }
+    }
+
+    cJSON *diskann_beam_width = cJSON_GetObjectItem(json, "DISKANN_BEAM_WIDTH");
+    if (cJSON_IsNumber(diskann_beam_width)) {
+        if (diskann_beam_width->valueint >= 1 && diskann_beam_width->valueint <= DISKANN_MAX_BEAM_WIDTH) {
+            config->diskann_beam_width = (size_t)diskann_beam_width->valueint;
+        } else {
+            fprintf(stderr, "Invalid DISKANN_BEAM_WIDTH value %d, expected 1 to %d\n", diskann_beam_width->valueint, DISKANN_MAX_BEAM_WIDTH);
+        }
+    }
+
+    cJSON *flat_scan_threshold = cJSON_GetObjectItem(json, "FLAT_SCAN_THRESHOLD");
+    if (cJSON_IsNumber(flat_scan_threshold)) {
+        if (flat_scan_threshold->valueint >= 0) {
+            config->flat_scan_threshold = (size_t)flat_scan_threshold->valueint;
+        } else {
+            fprintf(stderr, "Invalid FLAT_SCAN_THRESHOLD value %d, expected at least 0\n", flat_scan_threshold->valueint);
+        }
+    }
+
+    cJSON *shard_count = cJSON_GetObjectItem(json, "SHARD_COUNT");
+    if (cJSON_IsNumber(shard_count)) {
+        if (shard_count->valueint >= 1) {
+            config->shard_count = (size_t)shard_count->valueint;
+        } else {
+            fprintf(stderr, "Invalid SHARD_COUNT value %d, expected at least 1\n", shard_count->valueint);
+        }
+    }
+
+    cJSON *hot_set_size = cJSON_GetObjectItem(json, "HOT_SET_SIZE");
+    if (cJSON_IsNumber(hot_set_size)) {
+        if (hot_set_size->valueint >= 0) {
+            config->hot_set_size = (size_t)hot_set_size->valueint;
+        } else {
+            fprintf(stderr, "Invalid HOT_SET_SIZE value %d, expected at least 0\n", hot_set_size->valueint);
+        }
+    }
+
     cJSON_Delete(json);
     free(data);
 }
@@ -206,7 +501,7 @@ static enum MHD_Result ahc_compare(void *cls, struct MHD_Connection *connection,
 }
 
 /**
- * @brief Handler function for nearest neighbor search requests.
+ * @brief Handler function for nearest neighbor and range search requests.
  *
  * @param cls User-defined data.
  * @param connection The connection object.
@@ -225,6 +520,26 @@ static enum MHD_Result ahc_nearest(void *cls, struct MHD_Connection *connection,
     return nearest_handler(cls, connection, url, method, version, upload_data, upload_data_size, con_cls);
 }
 
+/**
+ * @brief Handler function for admin requests.
+ *
+ * @param cls User-defined data.
+ * @param connection The connection object.
+ * @param url The URL of the request.
+ * @param method The HTTP method.
+ * @param version The HTTP version.
+ * @param upload_data Data being uploaded in the request.
+ * @param upload_data_size Size of the upload data.
+ * @param con_cls Connection-specific data.
+ * @return MHD_Result indicating the success or failure of the operation.
+ */
+static enum MHD_Result ahc_admin(void *cls, struct MHD_Connection *connection,
+                                 const char *url, const char *method,
+                                 const char *version, const char *upload_data,
+                                 size_t *upload_data_size, void **con_cls) {
+    return admin_handler(cls, connection, url, method, version, upload_data, upload_data_size, con_cls);
+}
+
 /**
  * @brief Main access handler function to route HTTP requests.
  *
@@ -256,8 +571,10 @@ static enum MHD_Result access_handler(void *cls, struct MHD_Connection *connecti
     else if (strcmp(method, "POST") == 0) {
         if (strcmp(url, "/vector") == 0) {
             return ahc_post(handler_data, connection, url, method, version, upload_data, upload_data_size, con_cls);
-        } else if (strcmp(url, "/nearest") == 0) {
+        } else if (strcmp(url, "/nearest") == 0 || strcmp(url, "/range") == 0) {
             return ahc_nearest(handler_data, connection, url, method, version, upload_data, upload_data_size, con_cls);
+        } else if (strncmp(url, "/admin/", strlen("/admin/")) == 0) {
+            return ahc_admin(handler_data, connection, url, method, version, upload_data, upload_data_size, con_cls);
         }
     }
     // Handle PUT requests
@@ -346,34 +663,99 @@ int main(int argc, char* argv[]) {
         config.db_filename = db_filename;
     }
 
-    VectorDatabase *db = vector_db_load(config.db_filename, config.kd_tree_dimension);
-    if (db == NULL) {
-        db = vector_db_init(0, config.kd_tree_dimension);
-        if (!db) {
-            fprintf(stderr, "Failed to initialize vector database\n");
+    ShardedDatabase *db = sharded_db_open(config.db_filename, config.shard_count, config.kd_tree_dimension,
+                                          config.db_vector_size, config.element_type, config.mmap_warmup);
+    if (!db) {
+        fprintf(stderr, "Failed to initialize vector database\n");
+        return 1;
+    }
+
+    // Replay the mutations logged since the last snapshot, then log new ones
+    if (config.wal_durability != WAL_DURABILITY_OFF) {
+        char *wal_filename = config.wal_filename;
+        char *default_wal_filename = NULL;
+        if (!wal_filename) {
+            size_t length = strlen(config.db_filename) + sizeof(".wal");
+            default_wal_filename = (char *)malloc(length);
+            if (!default_wal_filename) {
+                fprintf(stderr, "Failed to allocate memory for file name\n");
+                sharded_db_free(db);
+                return 1;
+            }
+            snprintf(default_wal_filename, length, "%s.wal", config.db_filename);
+            wal_filename = default_wal_filename;
+        }
+
+        int status = sharded_db_open_wal(db, wal_filename, config.wal_durability, config.wal_sync_interval_ms);
+        free(default_wal_filename);
+        if (status != 0) {
+            fprintf(stderr, "Failed to open write-ahead log\n");
+            sharded_db_free(db);
             return 1;
         }
     }
 
+    // Keep int8 codes of every vector for quantized searches, or drop the ones loaded from the file
+    if (sharded_db_set_quantization(db, config.quantization, config.quantization_rescore) != 0) {
+        fprintf(stderr, "Failed to set up quantization\n");
+    }
+    db->search_method = config.search_method;
+    db->search_params.candidates = config.kd_tree_candidates;
+    db->search_params.max_checks = config.kd_forest_max_checks;
+    db->search_params.ef_search = config.hnsw_ef_search;
+    db->search_params.nprobe = config.ivf_nprobe;
+    db->search_params.search_list = config.diskann_search_list;
+    db->search_params.beam_width = config.diskann_beam_width;
+
+    // Small shards are scanned exactly whatever the search method
+    sharded_db_set_flat_threshold(db, config.flat_scan_threshold);
+    printf("Flat scan kernels: %s\n", flat_scan_isa_name(flat_scan_isa()));
+
+    // The KD-forest is not saved with the database, so it is rebuilt on every start
+    if (config.kd_forest_trees > 0 && sharded_db_build_forest(db, config.kd_forest_trees) == (size_t)-1) {
+        fprintf(stderr, "Failed to build KD-forest\n");
+    }
+
+    // The HNSW graph is saved with the database, so it is only built if none of that shape was loaded
+    if (config.hnsw_m > 0 &&
+        sharded_db_enable_hnsw(db, config.hnsw_m, config.hnsw_ef_construction, config.hnsw_metric) == (size_t)-1) {
+        fprintf(stderr, "Failed to build HNSW graph\n");
+    }
+
+    // The IVF index is not saved with the database either
+    if (config.ivf_lists > 0 && sharded_db_build_ivf(db, config.ivf_lists) == (size_t)-1) {
+        fprintf(stderr, "Failed to build IVF index\n");
+    }
+
+    // The Vamana graph stays on disk next to the database, so it is only built if none of that degree was loaded
+    if (config.diskann_degree > 0 &&
+        sharded_db_enable_diskann(db, config.diskann_degree, config.diskann_build_list) == (size_t)-1) {
+        fprintf(stderr, "Failed to build Vamana graph\n");
+    }
+
     PostHandlerData handler_data;
     handler_data.db = db;
     handler_data.db_vector_size = config.db_vector_size;
 
-    // Test initialization and reading of vectors
-    for (size_t i = 0; i < db->size; i++) {
-        Vector *vec = vector_db_read(db, i);
-        if (vec) {
-            printf("Read vector at index %zu: (", i);
-            for (size_t j = 0; j < vec->dimension; j++) {
-                printf("%f", vec->data[j]);
-                if (j < vec->dimension - 1) {
-                    printf(", ");
-                }
-            }
-            printf(")\n");
-        } else {
-            printf("Failed to read vector at index %zu\n", i);
-        }
+    // Report the size only: reading every vector back would fault in the whole file mapping
+    size_t live = 0;
+    for (size_t i = 0; i < db->shard_count; i++) {
+        live += db->shards[i]->size - db->shards[i]->deleted_count;
+    }
+    printf("Database holds %zu vectors in %zu shards\n", live, db->shard_count);
+
+    // Move the vectors to cold files on disk and keep only the hot set in memory
+    if (config.hot_set_size > 0 && sharded_db_enable_tiering(db, config.hot_set_size) != 0) {
+        fprintf(stderr, "Failed to set up tiered storage\n");
+        sharded_db_free(db);
+        return 1;
+    }
+
+    // Reclaim the slots of deleted vectors and checkpoint every shard in the background
+    if (sharded_db_start(db, config.compaction_batch_size, config.compaction_interval_ms,
+                         config.snapshot_interval_ms, config.snapshot_dirty_writes) != 0) {
+        sharded_db_free(db);
+        return 1;
     }
 
     struct MHD_Daemon *daemon;
@@ -385,7 +767,7 @@ int main(int argc, char* argv[]) {
                               MHD_OPTION_END);
     if (!daemon) {
         fprintf(stderr, "Failed to start server\n");
-        vector_db_free(db);
+        sharded_db_free(db);
         return 1;
     }
 
@@ -395,11 +777,11 @@ int main(int argc, char* argv[]) {
     getchar();
 
     // Save the database to file before shutting down
-    vector_db_save(db, config.db_filename);
+    sharded_db_save(db);
 
-    // Stop the HTTP daemon and free the database
+    // Stop the HTTP daemon, then the background threads, close the logs and free the database
     MHD_stop_daemon(daemon);
-    vector_db_free(db);
+    sharded_db_free(db);
 
     return 0;
 }
@@ -6,6 +6,7 @@
 #include "cjson/cJSON.h"
 
 #include "../include/vector_database.h"
+#include "../include/sharded_db.h"
 #include "../include/connection_data.h"
 #include "../include/post_handler.h"
 
@@ -89,11 +90,11 @@ static enum MHD_Result post_handler_callback(void* cls, struct MHD_Connection* c
 
     ConnectionData *con_data = (ConnectionData *)*con_cls;
     PostHandlerData* handler_data = (PostHandlerData*)cls;
-    VectorDatabase* db = handler_data->db;
+    ShardedDatabase* db = handler_data->db;
     size_t expected_vector_size = handler_data->db_vector_size;
 
     if (!db) {
-        fprintf(stderr, "post_handler_callback: VectorDatabase is NULL\n");
+        fprintf(stderr, "post_handler_callback: ShardedDatabase is NULL\n");
         return MHD_NO;
     }
 
@@ -241,8 +242,10 @@ static enum MHD_Result post_handler_callback(void* cls, struct MHD_Connection* c
     strncpy(vec.uuid, uuid, sizeof(vec.uuid) - 1);
     vec.uuid[sizeof(vec.uuid) - 1] = '\0'; // Ensure null-termination
     vec.dimension = dimension;
-    vec.data = (double*)malloc(dimension * sizeof(double));
-    if (!vec.data) {
+    vec.type = VECTOR_ELEMENT_FLOAT64; // Converted to the database element type on insert
+    double* components = (double*)malloc(dimension * sizeof(double));
+    vec.data = components;
+    if (!components) {
         fprintf(stderr, "post_handler_callback: Memory allocation for vector data failed\n");
         const char* error_msg = "{\"error\": \"Memory allocation failed\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
@@ -292,45 +295,37 @@ static enum MHD_Result post_handler_callback(void* cls, struct MHD_Connection* c
             *con_cls = NULL;
             return ret == MHD_YES ? MHD_YES : MHD_NO;
         }
-        vec.data[i] = item->valuedouble;
+        components[i] = item->valuedouble;
     }
     printf("post_handler_callback: Extracted vector data, dimension: %zu\n", dimension);
 
-    if (db->kdtree == NULL) {
-        fprintf(stderr, "post_handler_callback: KDTree is NULL before inserting\n");
-        if (db->size > 0 && db->vectors && db->vectors[0].data) {
-            db->kdtree = kdtree_create(db->vectors[0].dimension);
-        } else {
-            db->kdtree = kdtree_create(dimension);
-        }
-        if (db->kdtree == NULL) {
-            fprintf(stderr, "post_handler_callback: Failed to initialize KDTree\n");
-            const char* error_msg = "{\"error\": \"Failed to initialize KDTree\"}";
-            struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
-                                                                        (void*)error_msg, MHD_RESPMEM_PERSISTENT);
-            if (response == NULL) {
-                fprintf(stderr, "post_handler_callback: Failed to create response\n");
-                cJSON_Delete(json);
-                free(vec.data);
-                free(con_data->data);
-                free(con_data);
-                *con_cls = NULL;
-                return MHD_NO;
-            }
-            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
-            int ret = MHD_queue_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, response);
-            MHD_destroy_response(response);
+    if (sharded_db_find_index(db, vec.uuid) != (size_t)-1) {
+        fprintf(stderr, "post_handler_callback: UUID %s already exists\n", vec.uuid);
+        const char* error_msg = "{\"error\": \"UUID already exists\"}";
+        struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
+                                                                    (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+        if (response == NULL) {
+            fprintf(stderr, "post_handler_callback: Failed to create response\n");
             cJSON_Delete(json);
             free(vec.data);
             free(con_data->data);
             free(con_data);
             *con_cls = NULL;
-            return ret == MHD_YES ? MHD_YES : MHD_NO;
+            return MHD_NO;
         }
+        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+        int ret = MHD_queue_response(connection, MHD_HTTP_CONFLICT, response);
+        MHD_destroy_response(response);
+        cJSON_Delete(json);
+        free(vec.data);
+        free(con_data->data);
+        free(con_data);
+        *con_cls = NULL;
+        return ret == MHD_YES ? MHD_YES : MHD_NO;
     }
 
     printf("post_handler_callback: Inserting vector into database\n");
-    size_t index = vector_db_insert(db, vec);
+    size_t index = sharded_db_insert(db, vec);
     if (index == (size_t)-1) {
         fprintf(stderr, "post_handler_callback: Failed to insert vector\n");
         const char* error_msg = "{\"error\": \"Failed to insert vector\"}";
@@ -375,10 +370,11 @@ static enum MHD_Result post_handler_callback(void* cls, struct MHD_Connection* c
     cJSON *response_json = cJSON_CreateObject();
     cJSON_AddStringToObject(response_json, "uuid", vec.uuid);
     cJSON_AddNumberToObject(response_json, "index", index);
-    cJSON *vector_array = cJSON_CreateDoubleArray(vec.data, vec.dimension);
+    cJSON *vector_array = cJSON_CreateDoubleArray(components, vec.dimension);
     cJSON_AddItemToObject(response_json, "vector", vector_array);
     char *response_str = cJSON_PrintUnformatted(response_json);
     cJSON_Delete(response_json);
+    free(vec.data); // The database keeps its own copy
 
     struct MHD_Response* response = MHD_create_response_from_buffer(strlen(response_str),
                                                                     (void*)response_str, MHD_RESPMEM_MUST_FREE);
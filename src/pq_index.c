@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../include/pq_index.h"
+
+#define PQ_INDEX_TRAIN_ITERATIONS 16
+#define PQ_INDEX_MIN_CAPACITY 1024
+
+/**
+ * @struct PQTrainJob
+ * @brief Work shared by the k-means threads; each thread takes the next untrained subspace.
+ */
+typedef struct PQTrainJob {
+    PQIndex* pq;            /**< Index being trained */
+    const float* samples;   /**< Training vectors */
+    size_t count;           /**< Number of training vectors */
+    size_t next_subspace;   /**< Next subspace to train, guarded by lock */
+    int failed;             /**< Set if a thread could not allocate its buffers */
+    pthread_mutex_t lock;   /**< Protects next_subspace and failed */
+} PQTrainJob;
+
+/**
+ * @brief First component of a subspace.
+ *
+ * @param pq Index.
+ * @param subspace Subspace number, up to and including pq->subspaces.
+ * @return size_t Component number.
+ */
+static size_t pq_index_start(const PQIndex* pq, size_t subspace) {
+    return subspace * pq->dimension / pq->subspaces;
+}
+
+/**
+ * @brief Find the centroid of a subspace nearest to a sub-vector.
+ *
+ * @param centroids Codebook of the subspace, PQ_INDEX_CENTROIDS * length floats.
+ * @param length Number of components in the subspace.
+ * @param x Sub-vector.
+ * @return size_t Number of the nearest centroid.
+ */
+static size_t pq_index_nearest_float(const float* centroids, size_t length, const float* x) {
+    size_t best = 0;
+    float best_distance = FLT_MAX;
+    for (size_t c = 0; c < PQ_INDEX_CENTROIDS; c++) {
+        const float* centroid = centroids + c * length;
+        float distance = 0.0f;
+        for (size_t i = 0; i < length; i++) {
+            float diff = x[i] - centroid[i];
+            distance += diff * diff;
+        }
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = c;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Run k-means on one subspace of the training vectors.
+ *
+ * Centroids start on evenly spaced samples; an empty cluster is moved onto another sample.
+ * Stops after PQ_INDEX_TRAIN_ITERATIONS rounds or when no assignment changes.
+ *
+ * @param job Training job.
+ * @param subspace Subspace to train.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int pq_index_train_subspace(PQTrainJob* job, size_t subspace) {
+    PQIndex* pq = job->pq;
+    size_t start = pq_index_start(pq, subspace);
+    size_t length = pq_index_start(pq, subspace + 1) - start;
+    float* centroids = pq->centroids + PQ_INDEX_CENTROIDS * start;
+    size_t n = job->count;
+
+    size_t* assignment = (size_t*)malloc(n * sizeof(size_t));
+    double* sums = (double*)malloc(PQ_INDEX_CENTROIDS * length * sizeof(double));
+    size_t* sizes = (size_t*)malloc(PQ_INDEX_CENTROIDS * sizeof(size_t));
+    float* x = (float*)malloc(n * length * sizeof(float));
+    if (!assignment || !sums || !sizes || !x) {
+        free(assignment);
+        free(sums);
+        free(sizes);
+        free(x);
+        return -1;
+    }
+
+    // Gather the sub-vectors contiguously
+    for (size_t i = 0; i < n; i++) {
+        memcpy(x + i * length, job->samples + i * pq->dimension + start, length * sizeof(float));
+        assignment[i] = PQ_INDEX_CENTROIDS;
+    }
+    for (size_t c = 0; c < PQ_INDEX_CENTROIDS; c++) {
+        memcpy(centroids + c * length, x + (c * n / PQ_INDEX_CENTROIDS) * length, length * sizeof(float));
+    }
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL ^ subspace;
+    for (int iteration = 0; iteration < PQ_INDEX_TRAIN_ITERATIONS; iteration++) {
+        size_t changed = 0;
+        memset(sums, 0, PQ_INDEX_CENTROIDS * length * sizeof(double));
+        memset(sizes, 0, PQ_INDEX_CENTROIDS * sizeof(size_t));
+        for (size_t i = 0; i < n; i++) {
+            size_t c = pq_index_nearest_float(centroids, length, x + i * length);
+            if (c != assignment[i]) {
+                assignment[i] = c;
+                changed++;
+            }
+            sizes[c]++;
+            for (size_t d = 0; d < length; d++) {
+                sums[c * length + d] += x[i * length + d];
+            }
+        }
+        if (changed == 0) {
+            break;
+        }
+        for (size_t c = 0; c < PQ_INDEX_CENTROIDS; c++) {
+            if (sizes[c] == 0) {
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                memcpy(centroids + c * length, x + ((seed >> 33) % n) * length, length * sizeof(float));
+                continue;
+            }
+            for (size_t d = 0; d < length; d++) {
+                centroids[c * length + d] = (float)(sums[c * length + d] / (double)sizes[c]);
+            }
+        }
+    }
+
+    free(assignment);
+    free(sums);
+    free(sizes);
+    free(x);
+    return 0;
+}
+
+/**
+ * @brief Thread body training subspaces until none is left.
+ *
+ * @param arg Pointer to the PQTrainJob.
+ * @return void* NULL.
+ */
+static void* pq_index_train_thread(void* arg) {
+    PQTrainJob* job = (PQTrainJob*)arg;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t subspace = job->failed ? job->pq->subspaces : job->next_subspace++;
+        pthread_mutex_unlock(&job->lock);
+        if (subspace >= job->pq->subspaces) {
+            return NULL;
+        }
+        if (pq_index_train_subspace(job, subspace) != 0) {
+            pthread_mutex_lock(&job->lock);
+            job->failed = 1;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+}
+
+/**
+ * @brief Create an untrained index.
+ *
+ * @param dimension Number of components per vector.
+ * @param subspaces Number of subspaces, between 1 and dimension.
+ * @return PQIndex* Pointer to the index, or NULL on failure.
+ */
+PQIndex* pq_index_create(size_t dimension, size_t subspaces) {
+    if (subspaces == 0 || subspaces > dimension) {
+        fprintf(stderr, "Invalid number of PQ subspaces %zu for dimension %zu\n", subspaces, dimension);
+        return NULL;
+    }
+    PQIndex* pq = (PQIndex*)calloc(1, sizeof(PQIndex));
+    if (!pq) {
+        fprintf(stderr, "Failed to allocate PQ index\n");
+        return NULL;
+    }
+    pq->dimension = dimension;
+    pq->subspaces = subspaces;
+    pq->centroids = (float*)calloc(PQ_INDEX_CENTROIDS * dimension, sizeof(float));
+    pq->scratch = (double*)calloc(dimension, sizeof(double));
+    if (!pq->centroids || !pq->scratch) {
+        fprintf(stderr, "Failed to allocate PQ index\n");
+        pq_index_free(pq);
+        return NULL;
+    }
+    return pq;
+}
+
+/**
+ * @brief Free an index and its codes.
+ *
+ * @param pq Index to free.
+ */
+void pq_index_free(PQIndex* pq) {
+    if (pq) {
+        free(pq->centroids);
+        free(pq->codes);
+        free(pq->scratch);
+        free(pq);
+    }
+}
+
+/**
+ * @brief Make sure codes can be stored for at least `slots` slots.
+ *
+ * @param pq Index to grow.
+ * @param slots Required number of slots.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int pq_index_reserve(PQIndex* pq, size_t slots) {
+    if (slots <= pq->capacity) {
+        return 0;
+    }
+    size_t capacity = pq->capacity > 0 ? pq->capacity : PQ_INDEX_MIN_CAPACITY;
+    while (capacity < slots) {
+        capacity *= 2;
+    }
+    uint8_t* codes = (uint8_t*)realloc(pq->codes, capacity * pq->subspaces);
+    if (!codes) {
+        fprintf(stderr, "Failed to allocate PQ codes\n");
+        return -1;
+    }
+    pq->codes = codes;
+    pq->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Train the codebook of every subspace with k-means.
+ *
+ * @param pq Index to train.
+ * @param samples `count` training vectors of `dimension` floats each.
+ * @param count Number of training vectors.
+ * @return int 0 on success, -1 on failure.
+ */
+int pq_index_train(PQIndex* pq, const float* samples, size_t count) {
+    if (count == 0) {
+        fprintf(stderr, "Cannot train a PQ index without vectors\n");
+        return -1;
+    }
+
+    PQTrainJob job;
+    job.pq = pq;
+    job.samples = samples;
+    job.count = count;
+    job.next_subspace = 0;
+    job.failed = 0;
+    if (pthread_mutex_init(&job.lock, NULL) != 0) {
+        return -1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = cpus > 1 ? (size_t)cpus : 1;
+    if (thread_count > pq->subspaces) {
+        thread_count = pq->subspaces;
+    }
+    pthread_t* threads = (pthread_t*)malloc(thread_count * sizeof(pthread_t));
+    size_t started = 0;
+    while (threads && started < thread_count &&
+           pthread_create(&threads[started], NULL, pq_index_train_thread, &job) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        pq_index_train_thread(&job); // No thread could be started, train on the caller's
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+
+    if (job.failed) {
+        fprintf(stderr, "Failed to allocate PQ training buffers\n");
+        return -1;
+    }
+    pq->trained = 1;
+    pq->encoded = 0;
+    printf("PQ index trained on %zu vectors, %zu subspaces\n", count, pq->subspaces);
+    return 0;
+}
+
+/**
+ * @brief Load trained codebooks and codes, e.g. from a database file.
+ *
+ * @param pq Index to fill.
+ * @param centroids PQ_INDEX_CENTROIDS * dimension floats.
+ * @param codes `subspaces` bytes per slot.
+ * @param count Number of slots.
+ * @return int 0 on success, -1 on failure.
+ */
+int pq_index_restore(PQIndex* pq, const float* centroids, const uint8_t* codes, size_t count) {
+    if (pq_index_reserve(pq, count) != 0) {
+        return -1;
+    }
+    memcpy(pq->centroids, centroids, PQ_INDEX_CENTROIDS * pq->dimension * sizeof(float));
+    if (count > 0) {
+        memcpy(pq->codes, codes, count * pq->subspaces);
+    }
+    pq->trained = 1;
+    pq->encoded = count;
+    return 0;
+}
+
+/**
+ * @brief Encode a vector into a code owned by the caller.
+ *
+ * Only reads the codebooks, so threads may encode concurrently.
+ *
+ * @param pq Trained index.
+ * @param x `dimension` components.
+ * @param code `subspaces` bytes to fill.
+ */
+void pq_index_code(const PQIndex* pq, const double* x, uint8_t* code) {
+    for (size_t j = 0; j < pq->subspaces; j++) {
+        size_t start = pq_index_start(pq, j);
+        size_t length = pq_index_start(pq, j + 1) - start;
+        const float* centroids = pq->centroids + PQ_INDEX_CENTROIDS * start;
+        size_t best = 0;
+        double best_distance = DBL_MAX;
+        for (size_t c = 0; c < PQ_INDEX_CENTROIDS; c++) {
+            double distance = 0.0;
+            for (size_t i = 0; i < length; i++) {
+                double diff = x[start + i] - centroids[c * length + i];
+                distance += diff * diff;
+            }
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = c;
+            }
+        }
+        code[j] = (uint8_t)best;
+    }
+}
+
+/**
+ * @brief Encode the components of a slot. Does nothing while the index is untrained.
+ *
+ * @param pq Index to update.
+ * @param slot Storage slot of the vector.
+ * @param type Element type of data.
+ * @param data `dimension` components.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int pq_index_encode(PQIndex* pq, size_t slot, VectorElementType type, const void* data) {
+    if (!pq->trained) {
+        return 0;
+    }
+    if (pq_index_reserve(pq, slot + 1) != 0) {
+        if (slot < pq->encoded) {
+            pq->encoded = slot;
+        }
+        return -1;
+    }
+    vector_element_convert(VECTOR_ELEMENT_FLOAT64, pq->scratch, type, data, pq->dimension);
+    pq_index_code(pq, pq->scratch, pq->codes + slot * pq->subspaces);
+    if (slot == pq->encoded) {
+        pq->encoded++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Copy the code of one slot to another, after the vector was moved.
+ *
+ * @param pq Index to update.
+ * @param dst Destination slot.
+ * @param src Source slot, below pq->encoded.
+ */
+void pq_index_move(PQIndex* pq, size_t dst, size_t src) {
+    if (!pq->trained || dst >= pq->capacity || src >= pq->capacity) {
+        return;
+    }
+    memcpy(pq->codes + dst * pq->subspaces, pq->codes + src * pq->subspaces, pq->subspaces);
+}
+
+/**
+ * @brief Build the asymmetric distance table of a query.
+ *
+ * @param pq Trained index.
+ * @param query `dimension` components.
+ * @param table subspaces * PQ_INDEX_CENTROIDS floats to fill.
+ */
+void pq_index_table(const PQIndex* pq, const double* query, float* table) {
+    for (size_t j = 0; j < pq->subspaces; j++) {
+        size_t start = pq_index_start(pq, j);
+        size_t length = pq_index_start(pq, j + 1) - start;
+        const float* centroids = pq->centroids + PQ_INDEX_CENTROIDS * start;
+        for (size_t c = 0; c < PQ_INDEX_CENTROIDS; c++) {
+            double distance = 0.0;
+            for (size_t i = 0; i < length; i++) {
+                double diff = query[start + i] - centroids[c * length + i];
+                distance += diff * diff;
+            }
+            table[j * PQ_INDEX_CENTROIDS + c] = (float)distance;
+        }
+    }
+}
+
+/**
+ * @brief Approximate squared Euclidean distance between a query and the code of a slot.
+ *
+ * One table lookup per subspace: the query is never compared with the vector itself.
+ *
+ * @param pq Trained index.
+ * @param table Distance table built by pq_index_table for the query.
+ * @param slot Encoded slot.
+ * @return float Approximate squared distance.
+ */
+float pq_index_distance(const PQIndex* pq, const float* table, size_t slot) {
+    return pq_index_code_distance(pq, table, pq->codes + slot * pq->subspaces);
+}
+
+/**
+ * @brief Approximate squared Euclidean distance between a query and a code owned by the caller.
+ *
+ * @param pq Trained index.
+ * @param table Distance table built by pq_index_table for the query.
+ * @param code `subspaces` bytes.
+ * @return float Approximate squared distance.
+ */
+float pq_index_code_distance(const PQIndex* pq, const float* table, const uint8_t* code) {
+    float distance = 0.0f;
+    for (size_t j = 0; j < pq->subspaces; j++) {
+        distance += table[j * PQ_INDEX_CENTROIDS + code[j]];
+    }
+    return distance;
+}
\ No newline at end of file
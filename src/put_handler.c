@@ -6,6 +6,7 @@
 #include "cjson/cJSON.h"
 
 #include "../include/vector_database.h"
+#include "../include/sharded_db.h"
 #include "../include/connection_data.h"
 #include "../include/put_handler.h"
 
@@ -14,7 +15,7 @@
  * @brief Structure to hold data for the POST handler
  */
 typedef struct {
-    VectorDatabase* db;
+    ShardedDatabase* db;
     size_t db_vector_size;
 } PostHandlerData;
 
@@ -90,7 +91,7 @@ static enum MHD_Result put_handler_callback(void* cls, struct MHD_Connection* co
                                            size_t* upload_data_size, void** con_cls) {
     ConnectionData *con_data = (ConnectionData *)*con_cls;
     PostHandlerData* handler_data = (PostHandlerData*)cls;
-    VectorDatabase* db = handler_data->db;
+    ShardedDatabase* db = handler_data->db;
     size_t expected_vector_size = handler_data->db_vector_size;
 
     // Check if there's data to be uploaded
@@ -132,11 +133,12 @@ static enum MHD_Result put_handler_callback(void* cls, struct MHD_Connection* co
         return ret == MHD_YES ? MHD_YES : MHD_NO;
     }
 
-    // Retrieve the 'index' query parameter
+    // Retrieve the 'index' or 'uuid' query parameter
     const char* index_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "index");
-    if (!index_str) {
-        // Respond with an error if 'index' is missing
-        const char* error_msg = "{\"error\": \"Missing 'index' query parameter\"}";
+    const char* uuid_str = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "uuid");
+    if (!index_str && !uuid_str) {
+        // Respond with an error if both 'index' and 'uuid' are missing
+        const char* error_msg = "{\"error\": \"Missing 'index' or 'uuid' query parameter\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
         MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
@@ -148,21 +150,53 @@ static enum MHD_Result put_handler_callback(void* cls, struct MHD_Connection* co
         return ret == MHD_YES ? MHD_YES : MHD_NO;
     }
 
-    // Convert the 'index' query parameter to a size_t value
-    size_t index = atoi(index_str);
+    size_t index = 0;
+    if (index_str) {
+        // Convert the 'index' query parameter to a size_t value
+        index = atoi(index_str);
 
-    // Check if the index is out of bounds
-    if (index >= db->size) {
-        const char* error_msg = "{\"error\": \"Index out of bounds\"}";
-        struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
-                                                                        (void*)error_msg, MHD_RESPMEM_PERSISTENT);
-        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
-        int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
-        MHD_destroy_response(response);
-        free(con_data->data);
-        free(con_data);
-        *con_cls = NULL;
-        return ret == MHD_YES ? MHD_YES : MHD_NO;
+        // Check if the index is out of bounds
+        if (index >= sharded_db_index_bound(db)) {
+            const char* error_msg = "{\"error\": \"Index out of bounds\"}";
+            struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
+                                                                            (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+            int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
+            MHD_destroy_response(response);
+            free(con_data->data);
+            free(con_data);
+            *con_cls = NULL;
+            return ret == MHD_YES ? MHD_YES : MHD_NO;
+        }
+
+        // Check if the vector at the index was deleted
+        if (!sharded_db_contains(db, index)) {
+            const char* error_msg = "{\"error\": \"Vector not found\"}";
+            struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
+                                                                            (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+            int ret = MHD_queue_response(connection, MHD_HTTP_NOT_FOUND, response);
+            MHD_destroy_response(response);
+            free(con_data->data);
+            free(con_data);
+            *con_cls = NULL;
+            return ret == MHD_YES ? MHD_YES : MHD_NO;
+        }
+    } else {
+        // Resolve the 'uuid' query parameter through the hash index
+        index = sharded_db_find_index(db, uuid_str);
+        if (index == (size_t)-1) {
+            const char* error_msg = "{\"error\": \"Vector not found\"}";
+            struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
+                                                                            (void*)error_msg, MHD_RESPMEM_PERSISTENT);
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+            int ret = MHD_queue_response(connection, MHD_HTTP_NOT_FOUND, response);
+            MHD_destroy_response(response);
+            free(con_data->data);
+            free(con_data);
+            *con_cls = NULL;
+            return ret == MHD_YES ? MHD_YES : MHD_NO;
+        }
     }
 
     printf("put_handler_callback: Parsing JSON data\n");
@@ -205,9 +239,11 @@ static enum MHD_Result put_handler_callback(void* cls, struct MHD_Connection* co
 
     Vector vec;
     vec.dimension = dimension;
+    vec.type = VECTOR_ELEMENT_FLOAT64; // Converted to the database element type on update
     // Allocate memory for the vector data
-    vec.data = (double*)malloc(dimension * sizeof(double));
-    if (!vec.data) {
+    double* components = (double*)malloc(dimension * sizeof(double));
+    vec.data = components;
+    if (!components) {
         const char* error_msg = "{\"error\": \"Memory allocation failed\"}";
         struct MHD_Response* response = MHD_create_response_from_buffer(strlen(error_msg),
                                                                         (void*)error_msg, MHD_RESPMEM_PERSISTENT);
@@ -239,14 +275,15 @@ static enum MHD_Result put_handler_callback(void* cls, struct MHD_Connection* co
             return ret == MHD_YES ? MHD_YES : MHD_NO;
         }
         // Store the vector data
-        vec.data[i] = item->valuedouble;
+        components[i] = item->valuedouble;
     }
     printf("put_handler_callback: Extracted vector data, dimension: %zu\n", dimension);
 
     // Update the vector in the database
-    vector_db_update(db, index, vec);
+    sharded_db_update(db, index, vec);
     
-    // Clean up JSON data and connection data
+    // Clean up vector, JSON data and connection data
+    free(vec.data);
     cJSON_Delete(json);
     free(con_data->data);
     free(con_data);
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "../include/scalar_quantizer.h"
+
+#define SCALAR_QUANTIZER_MAX_CODE 127
+#define SCALAR_QUANTIZER_MIN_CAPACITY 1024
+
+/**
+ * @brief Integer dot product of two int8 arrays.
+ *
+ * Products are widened to int16 and pairwise summed into int32 lanes, 16 components per step.
+ *
+ * @param a First array.
+ * @param b Second array.
+ * @param n Number of components, a multiple of SCALAR_QUANTIZER_CODE_ALIGNMENT.
+ * @return int32_t Dot product.
+ */
+static int32_t scalar_quantizer_dot(const int8_t* a, const int8_t* b, size_t n) {
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; i += 16) {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+        __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i sign_a = _mm_cmpgt_epi8(zero, va); // Sign extension to int16
+        __m128i sign_b = _mm_cmpgt_epi8(zero, vb);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, sign_a), _mm_unpacklo_epi8(vb, sign_b)));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(va, sign_a), _mm_unpackhi_epi8(vb, sign_b)));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (size_t i = 0; i < n; i += 16) {
+        int8x16_t va = vld1q_s8(a + i);
+        int8x16_t vb = vld1q_s8(b + i);
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc = vpadalq_s16(acc, vmull_high_s8(va, vb));
+    }
+    return vaddvq_s32(acc);
+#else
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += (int32_t)a[i] * (int32_t)b[i];
+    }
+    return sum;
+#endif
+}
+
+/**
+ * @brief Create an untrained quantizer.
+ *
+ * @param dimension Number of components per vector.
+ * @return ScalarQuantizer* Pointer to the quantizer, or NULL on failure.
+ */
+ScalarQuantizer* scalar_quantizer_create(size_t dimension) {
+    ScalarQuantizer* sq = (ScalarQuantizer*)calloc(1, sizeof(ScalarQuantizer));
+    if (!sq) {
+        fprintf(stderr, "Failed to allocate scalar quantizer\n");
+        return NULL;
+    }
+    sq->dimension = dimension;
+    sq->code_stride = (dimension + SCALAR_QUANTIZER_CODE_ALIGNMENT - 1) / SCALAR_QUANTIZER_CODE_ALIGNMENT *
+                      SCALAR_QUANTIZER_CODE_ALIGNMENT;
+    sq->offset = (float*)calloc(dimension > 0 ? dimension : 1, sizeof(float));
+    sq->scale = (float*)calloc(dimension > 0 ? dimension : 1, sizeof(float));
+    sq->scratch = (double*)calloc(dimension > 0 ? dimension : 1, sizeof(double));
+    if (!sq->offset || !sq->scale || !sq->scratch) {
+        fprintf(stderr, "Failed to allocate scalar quantizer\n");
+        scalar_quantizer_free(sq);
+        return NULL;
+    }
+    return sq;
+}
+
+/**
+ * @brief Free a quantizer and its codes.
+ *
+ * @param sq Quantizer to free.
+ */
+void scalar_quantizer_free(ScalarQuantizer* sq) {
+    if (sq) {
+        free(sq->offset);
+        free(sq->scale);
+        free(sq->codes);
+        free(sq->norms);
+        free(sq->scratch);
+        free(sq);
+    }
+}
+
+/**
+ * @brief Make sure codes can be stored for at least `slots` slots.
+ *
+ * @param sq Quantizer to grow.
+ * @param slots Required number of slots.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int scalar_quantizer_reserve(ScalarQuantizer* sq, size_t slots) {
+    if (slots <= sq->capacity) {
+        return 0;
+    }
+    size_t capacity = sq->capacity > 0 ? sq->capacity : SCALAR_QUANTIZER_MIN_CAPACITY;
+    while (capacity < slots) {
+        capacity *= 2;
+    }
+    int8_t* codes = (int8_t*)realloc(sq->codes, capacity * sq->code_stride);
+    if (!codes) {
+        fprintf(stderr, "Failed to allocate quantized codes\n");
+        return -1;
+    }
+    sq->codes = codes;
+    float* norms = (float*)realloc(sq->norms, capacity * sizeof(float));
+    if (!norms) {
+        fprintf(stderr, "Failed to allocate quantized codes\n");
+        return -1;
+    }
+    sq->norms = norms;
+    sq->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Encode components already decoded to doubles.
+ *
+ * @param sq Trained quantizer with room for the slot.
+ * @param slot Storage slot of the vector.
+ * @param values `dimension` components.
+ */
+static void scalar_quantizer_encode_values(ScalarQuantizer* sq, size_t slot, const double* values) {
+    int8_t* code = sq->codes + slot * sq->code_stride;
+    double norm = 0.0;
+    for (size_t d = 0; d < sq->dimension; d++) {
+        long q = 0;
+        if (sq->scale[d] > 0.0f) {
+            q = lround((values[d] - sq->offset[d]) / sq->scale[d]);
+            if (q > SCALAR_QUANTIZER_MAX_CODE) {
+                q = SCALAR_QUANTIZER_MAX_CODE;
+            } else if (q < -SCALAR_QUANTIZER_MAX_CODE) {
+                q = -SCALAR_QUANTIZER_MAX_CODE;
+            }
+        }
+        code[d] = (int8_t)q;
+        double decoded = (double)sq->offset[d] + (double)sq->scale[d] * (double)q;
+        norm += decoded * decoded;
+    }
+    memset(code + sq->dimension, 0, sq->code_stride - sq->dimension);
+    sq->norms[slot] = (float)norm;
+}
+
+/**
+ * @brief Train the per-dimension ranges on the live slots of a storage and encode all of them.
+ *
+ * @param sq Quantizer to train.
+ * @param storage Storage holding the vectors.
+ * @param size Number of slots in use, tombstones included.
+ * @return int 0 on success, -1 on failure (the quantizer is left untrained).
+ */
+int scalar_quantizer_train(ScalarQuantizer* sq, const VectorStorage* storage, size_t size) {
+    sq->trained_count = 0;
+    if (storage->stride != sq->dimension || scalar_quantizer_reserve(sq, size) != 0) {
+        return -1;
+    }
+
+    // Cold vectors of tiered storage are read through a buffer without promoting them
+    void* buffer = storage->tier ? malloc(storage->vector_bytes) : NULL;
+    if (storage->tier && !buffer) {
+        return -1;
+    }
+
+    // Per-dimension range, kept in the offset (minimum) and scale (maximum) arrays until the end
+    size_t live = 0;
+    for (size_t i = 0; i < size; i++) {
+        const void* data = vector_storage_is_deleted(storage, i) ? NULL : vector_storage_read(storage, i, 0, buffer);
+        if (!data) {
+            continue;
+        }
+        vector_element_convert(VECTOR_ELEMENT_FLOAT64, sq->scratch, storage->element_type, data, sq->dimension);
+        for (size_t d = 0; d < sq->dimension; d++) {
+            float value = (float)sq->scratch[d];
+            if (live == 0 || value < sq->offset[d]) {
+                sq->offset[d] = value;
+            }
+            if (live == 0 || value > sq->scale[d]) {
+                sq->scale[d] = value;
+            }
+        }
+        live++;
+    }
+    if (live == 0) {
+        free(buffer);
+        return -1;
+    }
+    for (size_t d = 0; d < sq->dimension; d++) {
+        float min = sq->offset[d];
+        float max = sq->scale[d];
+        sq->offset[d] = min + (max - min) * 0.5f;
+        sq->scale[d] = (max - min) / (2.0f * SCALAR_QUANTIZER_MAX_CODE);
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        const void* data = vector_storage_is_deleted(storage, i) ? NULL : vector_storage_read(storage, i, 0, buffer);
+        if (data) {
+            vector_element_convert(VECTOR_ELEMENT_FLOAT64, sq->scratch, storage->element_type, data, sq->dimension);
+            scalar_quantizer_encode_values(sq, i, sq->scratch);
+        }
+    }
+    free(buffer);
+    sq->trained_count = live;
+    printf("Scalar quantizer trained on %zu vectors\n", live);
+    return 0;
+}
+
+/**
+ * @brief Load trained ranges and codes, e.g. from a database file.
+ *
+ * @param sq Quantizer to fill.
+ * @param offset Per-dimension midpoints.
+ * @param scale Per-dimension steps.
+ * @param codes code_stride bytes per slot.
+ * @param norms Squared norm of every code.
+ * @param count Number of slots.
+ * @return int 0 on success, -1 on failure.
+ */
+int scalar_quantizer_restore(ScalarQuantizer* sq, const float* offset, const float* scale,
+                             const int8_t* codes, const float* norms, size_t count) {
+    if (count == 0 || scalar_quantizer_reserve(sq, count) != 0) {
+        return -1;
+    }
+    memcpy(sq->offset, offset, sq->dimension * sizeof(float));
+    memcpy(sq->scale, scale, sq->dimension * sizeof(float));
+    memcpy(sq->codes, codes, count * sq->code_stride);
+    memcpy(sq->norms, norms, count * sizeof(float));
+    sq->trained_count = count;
+    return 0;
+}
+
+/**
+ * @brief Encode the components of a slot. Does nothing while the quantizer is untrained.
+ *
+ * @param sq Quantizer to update.
+ * @param slot Storage slot of the vector.
+ * @param type Element type of data.
+ * @param data `dimension` components.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int scalar_quantizer_encode(ScalarQuantizer* sq, size_t slot, VectorElementType type, const void* data) {
+    if (sq->trained_count == 0) {
+        return 0;
+    }
+    if (scalar_quantizer_reserve(sq, slot + 1) != 0) {
+        sq->trained_count = 0; // The slot has no code, retrain before the next scan
+        return -1;
+    }
+    vector_element_convert(VECTOR_ELEMENT_FLOAT64, sq->scratch, type, data, sq->dimension);
+    scalar_quantizer_encode_values(sq, slot, sq->scratch);
+    return 0;
+}
+
+/**
+ * @brief Copy the code of one slot to another, after the vector was moved.
+ *
+ * @param sq Quantizer to update.
+ * @param dst Destination slot.
+ * @param src Source slot.
+ */
+void scalar_quantizer_move(ScalarQuantizer* sq, size_t dst, size_t src) {
+    if (sq->trained_count == 0 || dst >= sq->capacity || src >= sq->capacity) {
+        return;
+    }
+    memcpy(sq->codes + dst * sq->code_stride, sq->codes + src * sq->code_stride, sq->code_stride);
+    sq->norms[dst] = sq->norms[src];
+}
+
+/**
+ * @brief Prepare a query for scalar_quantizer_distance.
+ *
+ * The query is folded into the scale of every dimension, so that its product with a code
+ * reduces to one integer dot product plus constants.
+ *
+ * @param sq Trained quantizer.
+ * @param query `dimension` components.
+ * @param prepared Filled on success; release with scalar_quantizer_query_free.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int scalar_quantizer_query_init(const ScalarQuantizer* sq, const double* query, ScalarQuantizerQuery* prepared) {
+    prepared->weights = (int8_t*)calloc(sq->code_stride, sizeof(int8_t));
+    if (!prepared->weights) {
+        fprintf(stderr, "Failed to allocate quantized query\n");
+        return -1;
+    }
+
+    double max_weight = 0.0;
+    prepared->bias = 0.0;
+    prepared->norm = 0.0;
+    for (size_t d = 0; d < sq->dimension; d++) {
+        double weight = fabs(query[d] * sq->scale[d]);
+        if (weight > max_weight) {
+            max_weight = weight;
+        }
+        prepared->bias += query[d] * sq->offset[d];
+        prepared->norm += query[d] * query[d];
+    }
+    prepared->weight_scale = max_weight > 0.0 ? max_weight / SCALAR_QUANTIZER_MAX_CODE : 0.0;
+    for (size_t d = 0; d < sq->dimension && max_weight > 0.0; d++) {
+        prepared->weights[d] = (int8_t)lround(query[d] * sq->scale[d] / prepared->weight_scale);
+    }
+    return 0;
+}
+
+/**
+ * @brief Release a prepared query.
+ *
+ * @param prepared Query to release.
+ */
+void scalar_quantizer_query_free(ScalarQuantizerQuery* prepared) {
+    free(prepared->weights);
+    prepared->weights = NULL;
+}
+
+/**
+ * @brief Approximate squared Euclidean distance between a query and the code of a slot.
+ *
+ * |q - x|^2 = |q|^2 - 2 q.x + |x|^2, where q.x is the bias plus the scaled integer dot product.
+ *
+ * @param sq Trained quantizer.
+ * @param prepared Prepared query.
+ * @param slot Encoded slot.
+ * @return double Approximate squared distance.
+ */
+double scalar_quantizer_distance(const ScalarQuantizer* sq, const ScalarQuantizerQuery* prepared, size_t slot) {
+    int32_t dot = scalar_quantizer_dot(prepared->weights, sq->codes + slot * sq->code_stride, sq->code_stride);
+    double product = prepared->bias + prepared->weight_scale * (double)dot;
+    return prepared->norm - 2.0 * product + (double)sq->norms[slot];
+}
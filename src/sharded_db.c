@@ -0,0 +1,1357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "../include/sharded_db.h"
+#include "../include/vector_database.h"
+#include "../include/compactor.h"
+#include "../include/snapshotter.h"
+#include "../include/wal.h"
+
+#define SHARDED_DB_STAGING_SUFFIX ".resharded"  // New layout written during a shard count change
+#define SHARDED_DB_MARKER_SUFFIX ".resharding"  // Present once the new layout is complete, holds its shard count
+#define SHARDED_DB_MIGRATED_SUFFIX ".migrated"  // Files of the previous layout, set aside
+
+/**
+ * @struct ShardedDBSearch
+ * @brief Search of one shard, run on its own thread.
+ */
+typedef struct ShardedDBSearch {
+    VectorDatabase* shard;        /**< Shard to search */
+    VectorDBSearchMethod method;  /**< Search method */
+    const double* query;          /**< Query vector */
+    size_t k;                     /**< Maximum number of results */
+    VectorDBSearchParams params;  /**< Per-query knobs */
+    size_t* indices;              /**< k local indices */
+    double* distances;            /**< k distances */
+    char* uuids;                  /**< k UUIDs of UUID_SIZE bytes, or NULL */
+    size_t found;                 /**< Number of results, or (size_t)-1 on failure */
+} ShardedDBSearch;
+
+/**
+ * @struct ShardedDBResult
+ * @brief Result of a shard search, ordered by distance when merging.
+ */
+typedef struct ShardedDBResult {
+    double distance; /**< Euclidean distance to the query */
+    size_t index;    /**< Global index */
+    const char* uuid; /**< UUID copied by the shard search, NULL if none was asked for */
+} ShardedDBResult;
+
+/**
+ * @brief Pick the shard of a UUID.
+ *
+ * The 64-bit FNV-1a hash is passed through a finalizer first: the UUID index of every shard
+ * buckets on the raw hash, and similar UUIDs differ in few of its bits.
+ *
+ * @param db Pointer to the sharded database.
+ * @param uuid UUID to route.
+ * @return size_t The shard number.
+ */
+static size_t sharded_db_route(const ShardedDatabase* db, const char* uuid) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; uuid[i] != '\0'; ++i) {
+        hash ^= (unsigned char)uuid[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return (size_t)(hash % db->shard_count);
+}
+
+/**
+ * @brief Split a global index into a shard and a local index.
+ *
+ * @param db Pointer to the sharded database.
+ * @param index Global index.
+ * @param local Set to the index inside the shard.
+ * @return VectorDatabase* The shard holding the index.
+ */
+static VectorDatabase* sharded_db_locate(const ShardedDatabase* db, size_t index, size_t* local) {
+    *local = index / db->shard_count;
+    return db->shards[index % db->shard_count];
+}
+
+/**
+ * @brief Build the file name of a shard.
+ *
+ * @param base Base file name.
+ * @param shard_count Number of shards.
+ * @param shard Shard number.
+ * @return char* Newly allocated file name, or NULL on allocation failure.
+ */
+char* sharded_db_filename(const char* base, size_t shard_count, size_t shard) {
+    size_t length = strlen(base) + sizeof(".shard") + 20;
+    char* filename = (char*)malloc(length);
+    if (!filename) {
+        fprintf(stderr, "Failed to allocate memory for file name\n");
+        return NULL;
+    }
+    if (shard_count == 1) {
+        snprintf(filename, length, "%s", base);
+    } else {
+        snprintf(filename, length, "%s.shard%zu", base, shard);
+    }
+    return filename;
+}
+
+/**
+ * @brief Build a file name from a base name and a suffix.
+ *
+ * @param base Base file name.
+ * @param suffix Suffix to append.
+ * @return char* Newly allocated file name, or NULL on allocation failure.
+ */
+static char* sharded_db_suffixed(const char* base, const char* suffix) {
+    size_t length = strlen(base) + strlen(suffix) + 1;
+    char* filename = (char*)malloc(length);
+    if (!filename) {
+        fprintf(stderr, "Failed to allocate memory for file name\n");
+        return NULL;
+    }
+    snprintf(filename, length, "%s%s", base, suffix);
+    return filename;
+}
+
+/**
+ * @brief Directory holding a file.
+ *
+ * @param path Path of the file.
+ * @return char* Newly allocated directory name, or NULL on allocation failure.
+ */
+static char* sharded_db_directory(const char* path) {
+    const char* slash = strrchr(path, '/');
+    size_t length = slash == path ? 1 : slash ? (size_t)(slash - path) : 0;
+    char* directory = (char*)malloc(length + 2);
+    if (!directory) {
+        fprintf(stderr, "Failed to allocate memory for file name\n");
+        return NULL;
+    }
+    if (slash) {
+        memcpy(directory, path, length);
+        directory[length] = '\0';
+    } else {
+        strcpy(directory, ".");
+    }
+    return directory;
+}
+
+/**
+ * @brief Make the renames and creations of files next to a path durable.
+ *
+ * @param path Path of a file in the directory.
+ * @return int 0 on success, -1 on failure.
+ */
+static int sharded_db_sync_directory(const char* path) {
+    char* directory = sharded_db_directory(path);
+    int fd = directory ? open(directory, O_RDONLY) : -1;
+    free(directory);
+    if (fd < 0) {
+        perror("Failed to open directory");
+        return -1;
+    }
+    int status = fsync(fd);
+    close(fd);
+    return status == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Compare two shard numbers, for qsort.
+ *
+ * @param a First shard number.
+ * @param b Second shard number.
+ * @return int Negative, zero or positive as a is below, equal to or above b.
+ */
+static int sharded_db_compare_shards(const void* a, const void* b) {
+    size_t x = *(const size_t*)a;
+    size_t y = *(const size_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief List the shard numbers of the "<base>.shard<i>" files present on disk.
+ *
+ * The directory is scanned rather than probed from shard 0, so a layout with holes is still
+ * seen whole.
+ *
+ * @param base Base file name.
+ * @param shards Set to a newly allocated array of shard numbers in increasing order, NULL if none.
+ * @param count Set to the number of entries of shards.
+ * @return int 0 on success, -1 on failure.
+ */
+static int sharded_db_list_files(const char* base, size_t** shards, size_t* count) {
+    *shards = NULL;
+    *count = 0;
+    char* directory = sharded_db_directory(base);
+    if (!directory) {
+        return -1;
+    }
+    DIR* dir = opendir(directory);
+    free(directory);
+    if (!dir) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    const char* slash = strrchr(base, '/');
+    const char* name = slash ? slash + 1 : base;
+    size_t name_length = strlen(name);
+    size_t capacity = 0;
+    int status = 0;
+    struct dirent* entry;
+    while (status == 0 && (entry = readdir(dir)) != NULL) {
+        const char* rest = entry->d_name;
+        if (strncmp(rest, name, name_length) != 0 || strncmp(rest + name_length, ".shard", 6) != 0) {
+            continue;
+        }
+        rest += name_length + 6;
+        char* end;
+        unsigned long long shard = strtoull(rest, &end, 10);
+        // Only the names sharded_db_filename builds, not the side files of a shard
+        if (*rest < '0' || *rest > '9' || (*rest == '0' && end != rest + 1) || *end != '\0') {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity > 0 ? 2 * capacity : 16;
+            size_t* grown = (size_t*)realloc(*shards, capacity * sizeof(size_t));
+            if (!grown) {
+                fprintf(stderr, "Failed to allocate memory for file names\n");
+                status = -1;
+                continue;
+            }
+            *shards = grown;
+        }
+        (*shards)[(*count)++] = (size_t)shard;
+    }
+    closedir(dir);
+    if (status != 0) {
+        free(*shards);
+        *shards = NULL;
+        *count = 0;
+        return -1;
+    }
+    if (*count > 0) {
+        qsort(*shards, *count, sizeof(size_t), sharded_db_compare_shards);
+    }
+    return 0;
+}
+
+/**
+ * @brief Set a file of a previous layout aside under "<name>.migrated", if it exists.
+ *
+ * @param filename File to set aside.
+ * @return int 0 on success or if the file is missing, -1 on failure.
+ */
+static int sharded_db_set_aside(const char* filename) {
+    if (access(filename, F_OK) != 0) {
+        return 0;
+    }
+    char* migrated = sharded_db_suffixed(filename, SHARDED_DB_MIGRATED_SUFFIX);
+    int status = migrated ? rename(filename, migrated) : -1;
+    if (migrated && status != 0) {
+        perror("Failed to rename migrated file");
+    }
+    free(migrated);
+    return status == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Swap a complete staged layout in place of the previous one.
+ *
+ * Runs once the marker is written, and again at startup if a swap was interrupted. Only the
+ * staged files are renamed over their targets, so a target whose staged file is gone already
+ * holds the new layout; every other file of a layout is from the previous one and is set aside.
+ * The marker is removed last.
+ *
+ * @param base Base file name of the database.
+ * @param shard_count Number of shards of the staged layout.
+ * @param marker Marker file name.
+ * @return int 0 on success, -1 on failure.
+ */
+static int sharded_db_swap_layout(const char* base, size_t shard_count, const char* marker) {
+    int status = 0;
+    for (size_t i = 0; i < shard_count && status == 0; ++i) {
+        char* target = sharded_db_filename(base, shard_count, i);
+        char* staged = target ? sharded_db_suffixed(target, SHARDED_DB_STAGING_SUFFIX) : NULL;
+        if (!staged) {
+            status = -1;
+        } else if (access(staged, F_OK) == 0) {
+            status = sharded_db_set_aside(target);
+            if (status == 0 && rename(staged, target) != 0) {
+                perror("Failed to rename staged shard file");
+                status = -1;
+            }
+        }
+        free(staged);
+        free(target);
+    }
+
+    size_t* shards = NULL;
+    size_t count = 0;
+    if (status == 0) {
+        status = sharded_db_list_files(base, &shards, &count);
+    }
+    for (size_t i = 0; i < count && status == 0; ++i) {
+        if (shard_count == 1 || shards[i] >= shard_count) {
+            char* filename = sharded_db_filename(base, 2, shards[i]);
+            status = filename ? sharded_db_set_aside(filename) : -1;
+            free(filename);
+        }
+    }
+    free(shards);
+    if (status == 0 && shard_count > 1) {
+        status = sharded_db_set_aside(base);
+    }
+
+    if (status == 0 && (sharded_db_sync_directory(base) != 0 || unlink(marker) != 0)) {
+        perror("Failed to finish the shard layout change");
+        status = -1;
+    }
+    return status;
+}
+
+/**
+ * @brief Finish a shard count change interrupted after its new layout was complete.
+ *
+ * @param base Base file name of the database.
+ * @return int 0 on success or if no change was interrupted, -1 on failure.
+ */
+static int sharded_db_recover_layout(const char* base) {
+    char* marker = sharded_db_suffixed(base, SHARDED_DB_MARKER_SUFFIX);
+    if (!marker) {
+        return -1;
+    }
+    FILE* file = fopen(marker, "r");
+    if (!file) {
+        free(marker);
+        return 0;
+    }
+    size_t shard_count = 0;
+    int parsed = fscanf(file, "%zu", &shard_count) == 1 && shard_count > 0;
+    fclose(file);
+    int status = -1;
+    if (!parsed) {
+        fprintf(stderr, "Invalid shard layout marker %s\n", marker);
+    } else {
+        printf("Finishing the interrupted change to %zu shards\n", shard_count);
+        status = sharded_db_swap_layout(base, shard_count, marker);
+    }
+    free(marker);
+    return status;
+}
+
+/**
+ * @brief Write the shards to staged files, then swap them in place of the previous layout.
+ *
+ * The previous files stay untouched until every staged file is fsynced and a marker holding the
+ * shard count is written, so a crash before the marker restarts the change from the previous
+ * layout and a crash after it is finished by sharded_db_recover_layout.
+ *
+ * @param db Pointer to the sharded database, holding the redistributed vectors.
+ * @param base Base file name of the database.
+ * @return int 0 on success, -1 on failure.
+ */
+static int sharded_db_stage_layout(ShardedDatabase* db, const char* base) {
+    int status = 0;
+    for (size_t i = 0; i < db->shard_count && status == 0; ++i) {
+        char* staged = sharded_db_suffixed(db->filenames[i], SHARDED_DB_STAGING_SUFFIX);
+        if (!staged) {
+            status = -1;
+        } else {
+            // A staged file left by an interrupted change would pass for this one
+            unlink(staged);
+            vector_db_save(db->shards[i], staged);
+            status = access(staged, F_OK) == 0 ? 0 : -1;
+        }
+        free(staged);
+    }
+
+    char* marker = sharded_db_suffixed(base, SHARDED_DB_MARKER_SUFFIX);
+    FILE* file = status == 0 && marker && sharded_db_sync_directory(base) == 0 ? fopen(marker, "w") : NULL;
+    if (!file) {
+        fprintf(stderr, "Failed to stage the new shard layout\n");
+        free(marker);
+        return -1;
+    }
+    int written = fprintf(file, "%zu\n", db->shard_count) > 0 && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    written = fclose(file) == 0 && written;
+    status = written && sharded_db_sync_directory(base) == 0 ? sharded_db_swap_layout(base, db->shard_count, marker) : -1;
+    free(marker);
+    return status;
+}
+
+/**
+ * @brief Move the vectors of a database file written with another shard count into the shards.
+ *
+ * @param db Pointer to the sharded database, with empty shards.
+ * @param filename File to read.
+ * @param dimension Dimension of the KD-Tree.
+ * @param element_type Storage type of every component.
+ * @return int 0 on success, -1 on failure.
+ */
+static int sharded_db_redistribute(ShardedDatabase* db, const char* filename, size_t dimension,
+                                   VectorElementType element_type) {
+    VectorDatabase* source = vector_db_load(filename, dimension, db->vector_size, element_type, VECTOR_DB_WARMUP_NONE);
+    if (!source) {
+        return -1;
+    }
+    size_t moved = 0;
+    for (size_t i = 0; i < source->size; ++i) {
+        Vector* vec = vector_db_read(source, i);
+        if (vec && vector_db_insert(db->shards[sharded_db_route(db, vec->uuid)], *vec) != (size_t)-1) {
+            moved++;
+        }
+    }
+    vector_db_free(source);
+    printf("Redistributed %zu vectors from %s into %zu shards\n", moved, filename, db->shard_count);
+    return 0;
+}
+
+/**
+ * @brief Load every shard from its file, or create empty shards.
+ *
+ * @param filename Base file name of the database.
+ * @param shard_count Number of shards, at least 1.
+ * @param dimension Dimension of the KD-Tree.
+ * @param vector_size Number of components of every stored vector.
+ * @param element_type Storage type of every component.
+ * @param warmup How the mapped files are pre-faulted.
+ * @return ShardedDatabase* Pointer to the database, or NULL on failure.
+ */
+ShardedDatabase* sharded_db_open(const char* filename, size_t shard_count, size_t dimension, size_t vector_size,
+                                 VectorElementType element_type, VectorDBWarmup warmup) {
+    if (shard_count == 0) {
+        fprintf(stderr, "Shard count must be at least 1\n");
+        return NULL;
+    }
+    ShardedDatabase* db = (ShardedDatabase*)calloc(1, sizeof(ShardedDatabase));
+    if (!db) {
+        fprintf(stderr, "Failed to allocate memory for sharded database\n");
+        return NULL;
+    }
+    db->shard_count = shard_count;
+    db->vector_size = vector_size;
+    db->search_method = VECTOR_DB_SEARCH_KDTREE;
+    db->shards = (VectorDatabase**)calloc(shard_count, sizeof(VectorDatabase*));
+    db->filenames = (char**)calloc(shard_count, sizeof(char*));
+    db->wals = (WAL**)calloc(shard_count, sizeof(WAL*));
+    db->compactors = (Compactor**)calloc(shard_count, sizeof(Compactor*));
+    db->snapshotters = (Snapshotter**)calloc(shard_count, sizeof(Snapshotter*));
+    if (!db->shards || !db->filenames || !db->wals || !db->compactors || !db->snapshotters) {
+        fprintf(stderr, "Failed to allocate memory for sharded database\n");
+        sharded_db_free(db);
+        return NULL;
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        db->filenames[i] = sharded_db_filename(filename, shard_count, i);
+        if (!db->filenames[i]) {
+            sharded_db_free(db);
+            return NULL;
+        }
+    }
+
+    // Files of another shard count are redistributed; the unsharded file counts as one shard
+    size_t* on_disk = NULL;
+    size_t on_disk_count = 0;
+    if (sharded_db_recover_layout(filename) != 0 || sharded_db_list_files(filename, &on_disk, &on_disk_count) != 0) {
+        fprintf(stderr, "Failed to read the shard layout of %s\n", filename);
+        sharded_db_free(db);
+        return NULL;
+    }
+    int base_exists = access(filename, F_OK) == 0;
+    int complete = on_disk_count == shard_count && on_disk[shard_count - 1] == shard_count - 1;
+    int migrate = shard_count == 1 ? !base_exists && on_disk_count > 0
+                                   : !complete && (on_disk_count > 0 || base_exists);
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        if (!migrate && access(db->filenames[i], F_OK) == 0) {
+            db->shards[i] = vector_db_load(db->filenames[i], dimension, vector_size, element_type, warmup);
+        }
+        if (!db->shards[i]) {
+            db->shards[i] = vector_db_init(0, dimension, vector_size, element_type);
+        }
+        if (!db->shards[i]) {
+            fprintf(stderr, "Failed to initialize shard %zu\n", i);
+            free(on_disk);
+            sharded_db_free(db);
+            return NULL;
+        }
+    }
+    if (!migrate) {
+        free(on_disk);
+        return db;
+    }
+
+    // The previous files are only set aside once the new layout is complete on disk
+    int status = 0;
+    size_t sources = on_disk_count > 0 ? on_disk_count : 1;
+    for (size_t i = 0; i < sources && status == 0; ++i) {
+        char* source = on_disk_count > 0 ? sharded_db_filename(filename, 2, on_disk[i]) : sharded_db_filename(filename, 1, 0);
+        status = source ? sharded_db_redistribute(db, source, dimension, element_type) : -1;
+        free(source);
+    }
+    free(on_disk);
+    if (status == 0) {
+        status = sharded_db_stage_layout(db, filename);
+    }
+    if (status != 0) {
+        fprintf(stderr, "Failed to redistribute database files into %zu shards\n", shard_count);
+        sharded_db_free(db);
+        return NULL;
+    }
+    return db;
+}
+
+/**
+ * @brief Replay callback applying a record to the shard its UUID routes to.
+ *
+ * @param ctx Pointer to the sharded database.
+ * @param type Kind of mutation.
+ * @param uuid UUID of the vector.
+ * @param data Components (NULL for deletes).
+ * @param element_type Element type of data.
+ * @param dimension Number of components (0 for deletes).
+ */
+static void sharded_db_replay_record(void* ctx, WALRecordType type, const char* uuid, const void* data,
+                                     VectorElementType element_type, size_t dimension) {
+    ShardedDatabase* db = (ShardedDatabase*)ctx;
+    vector_db_apply_wal_record(db->shards[sharded_db_route(db, uuid)], type, uuid, data, element_type, dimension);
+}
+
+/**
+ * @brief Replay every write-ahead log on disk into the shards.
+ *
+ * Logs written under any shard count are found, the unsharded one included, and each record is
+ * applied to the shard its UUID routes to now. Once the shards holding replayed records are saved,
+ * every log is obsolete and is removed; so are empty logs of another shard count. A crash before
+ * the removal replays the logs again, which is harmless since records are applied by UUID.
+ *
+ * @param db Pointer to the sharded database.
+ * @param filename Base file name of the logs.
+ * @return int 0 on success, -1 on failure.
+ */
+static int sharded_db_replay_logs(ShardedDatabase* db, const char* filename) {
+    size_t* shards = NULL;
+    size_t count = 0;
+    if (sharded_db_list_files(filename, &shards, &count) != 0) {
+        fprintf(stderr, "Failed to list the write-ahead logs of %s\n", filename);
+        return -1;
+    }
+
+    // The unsharded log first: a sharded one is never older than it
+    size_t replayed = 0;
+    int status = 0;
+    for (size_t i = 0; i <= count && status == 0; ++i) {
+        char* log = i == 0 ? sharded_db_filename(filename, 1, 0) : sharded_db_filename(filename, 2, shards[i - 1]);
+        size_t records = log ? wal_replay(log, sharded_db_replay_record, db) : (size_t)-1;
+        if (records == (size_t)-1) {
+            status = -1;
+        } else {
+            replayed += records;
+        }
+        free(log);
+    }
+
+    // Logs may only go once every record they hold is in a saved file
+    for (size_t i = 0; i < db->shard_count && status == 0 && replayed > 0; ++i) {
+        if (vector_db_dirty_writes(db->shards[i]) > 0) {
+            vector_db_save(db->shards[i], db->filenames[i]);
+            status = vector_db_dirty_writes(db->shards[i]) == 0 && sharded_db_sync_directory(db->filenames[i]) == 0 ? 0 : -1;
+        }
+    }
+    for (size_t i = 0; i <= count && status == 0; ++i) {
+        int in_layout = i == 0 ? db->shard_count == 1 : db->shard_count > 1 && shards[i - 1] < db->shard_count;
+        char* log = i == 0 ? sharded_db_filename(filename, 1, 0) : sharded_db_filename(filename, 2, shards[i - 1]);
+        if (!log) {
+            status = -1;
+        } else if ((replayed > 0 || !in_layout) && unlink(log) != 0 && errno != ENOENT) {
+            perror("Failed to remove replayed write-ahead log");
+            status = -1;
+        }
+        free(log);
+    }
+    free(shards);
+    if (status == 0 && (replayed > 0 || count > 0)) {
+        status = sharded_db_sync_directory(filename);
+    }
+    if (status != 0) {
+        fprintf(stderr, "Failed to replay the write-ahead logs of %s\n", filename);
+    } else if (replayed > 0) {
+        printf("Replayed %zu write-ahead log records into %zu shards\n", replayed, db->shard_count);
+    }
+    return status;
+}
+
+/**
+ * @brief Replay the write-ahead logs, then attach one log per shard.
+ *
+ * @param db Pointer to the sharded database.
+ * @param filename Base file name of the logs.
+ * @param durability When appended records are fsynced.
+ * @param sync_interval_ms fsync period in asynchronous mode.
+ * @return int 0 on success, -1 on failure.
+ */
+int sharded_db_open_wal(ShardedDatabase* db, const char* filename, WALDurability durability,
+                        unsigned int sync_interval_ms) {
+    if (sharded_db_replay_logs(db, filename) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        char* wal_filename = sharded_db_filename(filename, db->shard_count, i);
+        if (!wal_filename) {
+            return -1;
+        }
+        db->wals[i] = wal_open(wal_filename, durability, sync_interval_ms);
+        free(wal_filename);
+        if (!db->wals[i]) {
+            return -1;
+        }
+        vector_db_set_wal(db->shards[i], db->wals[i]);
+    }
+    return 0;
+}
+
+/**
+ * @brief Move the components of every shard to a cold file next to its database file.
+ *
+ * The hot set is divided evenly between the shards; shard i uses "<shard file>.cold".
+ *
+ * @param db Pointer to the sharded database.
+ * @param hot_set_size Number of vectors kept in memory across all shards.
+ * @return int 0 on success, -1 on failure.
+ */
+int sharded_db_enable_tiering(ShardedDatabase* db, size_t hot_set_size) {
+    size_t hot_limit = (hot_set_size + db->shard_count - 1) / db->shard_count;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        size_t length = strlen(db->filenames[i]) + sizeof(".cold");
+        char* cold_filename = (char*)malloc(length);
+        if (!cold_filename) {
+            fprintf(stderr, "Failed to allocate memory for file name\n");
+            return -1;
+        }
+        snprintf(cold_filename, length, "%s.cold", db->filenames[i]);
+        int status = vector_db_enable_tiering(db->shards[i], cold_filename, hot_limit);
+        free(cold_filename);
+        if (status != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Start the compactor and the snapshotter of every shard.
+ *
+ * @param db Pointer to the sharded database.
+ * @param compaction_batch_size Maximum number of vectors moved per compaction step.
+ * @param compaction_interval_ms Idle sleep of the compactors, in milliseconds.
+ * @param snapshot_interval_ms Time trigger of the snapshotters, in milliseconds (0 to disable).
+ * @param snapshot_dirty_writes Write-count trigger of the snapshotters (0 to disable).
+ * @return int 0 on success, -1 on failure.
+ */
+int sharded_db_start(ShardedDatabase* db, size_t compaction_batch_size, unsigned int compaction_interval_ms,
+                     unsigned int snapshot_interval_ms, size_t snapshot_dirty_writes) {
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        db->compactors[i] = compactor_start(db->shards[i], compaction_batch_size, compaction_interval_ms);
+        if (!db->compactors[i]) {
+            fprintf(stderr, "Failed to start compactor of shard %zu\n", i);
+            return -1;
+        }
+        db->snapshotters[i] = snapshotter_start(db->shards[i], db->filenames[i], snapshot_interval_ms, snapshot_dirty_writes);
+        if (!db->snapshotters[i]) {
+            fprintf(stderr, "Failed to start snapshotter of shard %zu\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Stop the background threads, close the logs and free every shard.
+ *
+ * @param db Pointer to the sharded database.
+ */
+void sharded_db_free(ShardedDatabase* db) {
+    if (!db) {
+        return;
+    }
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        if (db->snapshotters && db->snapshotters[i]) {
+            snapshotter_stop(db->snapshotters[i]);
+        }
+        if (db->compactors && db->compactors[i]) {
+            compactor_stop(db->compactors[i]);
+        }
+        if (db->shards && db->shards[i]) {
+            vector_db_set_wal(db->shards[i], NULL);
+            vector_db_free(db->shards[i]);
+        }
+        if (db->wals && db->wals[i]) {
+            wal_close(db->wals[i]);
+        }
+        if (db->filenames) {
+            free(db->filenames[i]);
+        }
+    }
+    free(db->snapshotters);
+    free(db->compactors);
+    free(db->wals);
+    free(db->filenames);
+    free(db->shards);
+    free(db);
+}
+
+/**
+ * @brief Save every shard to its file.
+ *
+ * @param db Pointer to the sharded database.
+ */
+void sharded_db_save(ShardedDatabase* db) {
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        vector_db_save(db->shards[i], db->filenames[i]);
+    }
+}
+
+/**
+ * @brief Upper bound of the global indices in use.
+ *
+ * @param db Pointer to the sharded database.
+ * @return size_t Every stored vector has a global index below this value.
+ */
+size_t sharded_db_index_bound(ShardedDatabase* db) {
+    size_t max_size = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        VectorDatabase* shard = db->shards[i];
+        pthread_rwlock_rdlock(&shard->lock);  // Lock for reading
+        if (shard->size > max_size) {
+            max_size = shard->size;
+        }
+        pthread_rwlock_unlock(&shard->lock);  // Unlock
+    }
+    return max_size * db->shard_count;
+}
+
+/**
+ * @brief Insert a vector into the shard its UUID hashes to.
+ *
+ * @param db Pointer to the sharded database.
+ * @param vec Vector to be inserted.
+ * @return size_t The global index of the inserted vector, or (size_t)-1 on failure.
+ */
+size_t sharded_db_insert(ShardedDatabase* db, Vector vec) {
+    size_t shard = sharded_db_route(db, vec.uuid);
+    size_t local = vector_db_insert(db->shards[shard], vec);
+    return local == (size_t)-1 ? (size_t)-1 : local * db->shard_count + shard;
+}
+
+/**
+ * @brief Check whether a global index holds a live vector.
+ *
+ * @param db Pointer to the sharded database.
+ * @param index Global index.
+ * @return int Non-zero if the vector exists.
+ */
+int sharded_db_contains(ShardedDatabase* db, size_t index) {
+    size_t local;
+    VectorDatabase* shard = sharded_db_locate(db, index, &local);
+    return vector_db_contains(shard, local);
+}
+
+/**
+ * @brief Copy a vector out of the database.
+ *
+ * @param db Pointer to the sharded database.
+ * @param index Global index of the vector.
+ * @return Vector* The copy, or NULL if not found.
+ */
+Vector* sharded_db_get(ShardedDatabase* db, size_t index) {
+    size_t local;
+    VectorDatabase* shard = sharded_db_locate(db, index, &local);
+    return vector_db_get(shard, local);
+}
+
+/**
+ * @brief Copy a vector out of the database, by UUID.
+ *
+ * @param db Pointer to the sharded database.
+ * @param uuid UUID of the vector.
+ * @return Vector* The copy, or NULL if not found.
+ */
+Vector* sharded_db_get_by_uuid(ShardedDatabase* db, const char* uuid) {
+    return vector_db_get_by_uuid(db->shards[sharded_db_route(db, uuid)], uuid);
+}
+
+/**
+ * @brief Find the global index of a vector by UUID.
+ *
+ * @param db Pointer to the sharded database.
+ * @param uuid UUID of the vector.
+ * @return size_t The global index, or (size_t)-1 if the UUID is unknown.
+ */
+size_t sharded_db_find_index(ShardedDatabase* db, const char* uuid) {
+    size_t shard = sharded_db_route(db, uuid);
+    size_t local = vector_db_find_index(db->shards[shard], uuid);
+    return local == (size_t)-1 ? (size_t)-1 : local * db->shard_count + shard;
+}
+
+/**
+ * @brief Update a vector.
+ *
+ * @param db Pointer to the sharded database.
+ * @param index Global index of the vector.
+ * @param vec New components.
+ */
+void sharded_db_update(ShardedDatabase* db, size_t index, Vector vec) {
+    size_t local;
+    VectorDatabase* shard = sharded_db_locate(db, index, &local);
+    vector_db_update(shard, local, vec);
+}
+
+/**
+ * @brief Delete a vector.
+ *
+ * @param db Pointer to the sharded database.
+ * @param index Global index of the vector.
+ */
+void sharded_db_delete(ShardedDatabase* db, size_t index) {
+    size_t local;
+    VectorDatabase* shard = sharded_db_locate(db, index, &local);
+    vector_db_delete(shard, local);
+}
+
+/**
+ * @brief Enable or disable int8 quantization on every shard.
+ *
+ * @param db Pointer to the sharded database.
+ * @param enabled Non-zero to keep int8 codes.
+ * @param rescore_factor Number of quantized candidates rescored per result.
+ * @return int 0 on success, -1 on failure.
+ */
+int sharded_db_set_quantization(ShardedDatabase* db, int enabled, size_t rescore_factor) {
+    int status = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        if (vector_db_set_quantization(db->shards[i], enabled, rescore_factor) != 0) {
+            status = -1;
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Set the number of live vectors up to which every shard is scanned exactly.
+ *
+ * @param db Pointer to the sharded database.
+ * @param threshold Largest number of live vectors of a shard scanned instead of searching an index, 0 to never scan.
+ */
+void sharded_db_set_flat_threshold(ShardedDatabase* db, size_t threshold) {
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        vector_db_set_flat_threshold(db->shards[i], threshold);
+    }
+}
+
+/**
+ * @brief Train the product quantization index of every non-empty shard.
+ *
+ * @param db Pointer to the sharded database.
+ * @param subspaces Number of subspaces, or 0 for one per 8 components.
+ * @param code_bytes Set to the code size in bytes on success.
+ * @return size_t The total number of training vectors, or (size_t)-1 on failure.
+ */
+size_t sharded_db_train_pq(ShardedDatabase* db, size_t subspaces, size_t* code_bytes) {
+    size_t trained = 0;
+    *code_bytes = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        VectorDatabase* shard = db->shards[i];
+        if (vector_db_count(shard) == 0) {
+            continue;
+        }
+        size_t shard_trained = vector_db_train_pq(shard, subspaces);
+        if (shard_trained == (size_t)-1) {
+            return (size_t)-1;
+        }
+        trained += shard_trained;
+        pthread_rwlock_rdlock(&shard->lock);  // Lock for reading
+        if (shard->pq) {
+            *code_bytes = shard->pq->subspaces;
+        }
+        pthread_rwlock_unlock(&shard->lock);  // Unlock
+    }
+    if (trained == 0) {
+        fprintf(stderr, "Cannot train a PQ index on an empty database\n");
+        return (size_t)-1;
+    }
+    return trained;
+}
+
+/**
+ * @brief Rebuilds the balanced KD-Tree of every shard.
+ *
+ * Shards are rebuilt one at a time, since each build already uses every core.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_rebuild_kdtree(ShardedDatabase* db) {
+    size_t indexed = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        size_t shard_indexed = vector_db_rebuild_kdtree(db->shards[i]);
+        if (shard_indexed == (size_t)-1) {
+            return (size_t)-1;
+        }
+        indexed += shard_indexed;
+    }
+    return indexed;
+}
+
+/**
+ * @brief Builds the randomized KD-forest of every shard.
+ *
+ * Shards are built one at a time, since each build already runs one thread per tree.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param tree_count Number of trees per shard, or 0 for KD_FOREST_DEFAULT_TREES.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_build_forest(ShardedDatabase* db, size_t tree_count) {
+    size_t indexed = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        size_t shard_indexed = vector_db_build_forest(db->shards[i], tree_count);
+        if (shard_indexed == (size_t)-1) {
+            return (size_t)-1;
+        }
+        indexed += shard_indexed;
+    }
+    return indexed;
+}
+
+/**
+ * @brief Builds the HNSW graph of every shard.
+ *
+ * Shards are built one at a time, since each build already inserts on every core.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param m Links per node and layer, or 0 for HNSW_DEFAULT_M.
+ * @param ef_construction Candidates kept while linking a vector, or 0 for HNSW_DEFAULT_EF_CONSTRUCTION.
+ * @param metric Metric the graphs are built and searched with.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_build_hnsw(ShardedDatabase* db, size_t m, size_t ef_construction, HNSWMetric metric) {
+    size_t indexed = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        size_t shard_indexed = vector_db_build_hnsw(db->shards[i], m, ef_construction, metric);
+        if (shard_indexed == (size_t)-1) {
+            return (size_t)-1;
+        }
+        indexed += shard_indexed;
+    }
+    return indexed;
+}
+
+/**
+ * @brief Keeps the HNSW graph loaded with every shard if it matches, or builds it.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param m Links per node and layer, or 0 for HNSW_DEFAULT_M.
+ * @param ef_construction Candidates kept while linking a vector, or 0 for HNSW_DEFAULT_EF_CONSTRUCTION.
+ * @param metric Metric the graphs are built and searched with.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_enable_hnsw(ShardedDatabase* db, size_t m, size_t ef_construction, HNSWMetric metric) {
+    size_t indexed = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        size_t shard_indexed = vector_db_enable_hnsw(db->shards[i], m, ef_construction, metric);
+        if (shard_indexed == (size_t)-1) {
+            return (size_t)-1;
+        }
+        indexed += shard_indexed;
+    }
+    return indexed;
+}
+
+/**
+ * @brief Builds the inverted file index of every shard.
+ *
+ * Shards are built one at a time, since each build already trains and assigns on every core.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param list_count Number of lists per shard, or 0 for the square root of its live vectors.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_build_ivf(ShardedDatabase* db, size_t list_count) {
+    size_t indexed = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        size_t shard_indexed = vector_db_build_ivf(db->shards[i], list_count);
+        if (shard_indexed == (size_t)-1) {
+            return (size_t)-1;
+        }
+        indexed += shard_indexed;
+    }
+    return indexed;
+}
+
+/**
+ * @brief Builds the on-disk Vamana graph of every shard, next to its database file.
+ *
+ * Shards are built one at a time, since each build already links on every core.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param degree Largest number of neighbors per node, or 0 for DISKANN_DEFAULT_DEGREE.
+ * @param build_list Candidates kept while linking a vector, or 0 for DISKANN_DEFAULT_BUILD_LIST.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_build_diskann(ShardedDatabase* db, size_t degree, size_t build_list) {
+    size_t indexed = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        size_t shard_indexed = vector_db_build_diskann(db->shards[i], db->filenames[i], degree, build_list);
+        if (shard_indexed == (size_t)-1) {
+            return (size_t)-1;
+        }
+        indexed += shard_indexed;
+    }
+    return indexed;
+}
+
+/**
+ * @brief Keeps the Vamana graph loaded with every shard if it matches, or builds it.
+ *
+ * @param db Pointer to the ShardedDatabase structure.
+ * @param degree Largest number of neighbors per node, or 0 for DISKANN_DEFAULT_DEGREE.
+ * @param build_list Candidates kept while linking a vector, or 0 for DISKANN_DEFAULT_BUILD_LIST.
+ * @return Total number of vectors indexed, or -1 on failure.
+ */
+size_t sharded_db_enable_diskann(ShardedDatabase* db, size_t degree, size_t build_list) {
+    size_t indexed = 0;
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        size_t shard_indexed = vector_db_enable_diskann(db->shards[i], db->filenames[i], degree, build_list);
+        if (shard_indexed == (size_t)-1) {
+            return (size_t)-1;
+        }
+        indexed += shard_indexed;
+    }
+    return indexed;
+}
+
+/**
+ * @brief Search one shard.
+ *
+ * @param arg Pointer to the ShardedDBSearch.
+ * @return Always NULL.
+ */
+static void* sharded_db_search_thread(void* arg) {
+    ShardedDBSearch* search = (ShardedDBSearch*)arg;
+    search->found = vector_db_nearest(search->shard, search->method, search->query, search->k,
+                                      &search->params, search->indices, search->distances, search->uuids);
+    return NULL;
+}
+
+/**
+ * @brief Order shard results by increasing distance.
+ *
+ * @param a First ShardedDBResult.
+ * @param b Second ShardedDBResult.
+ * @return int Negative, zero or positive as a is nearer, as near or farther than b.
+ */
+static int sharded_db_compare_results(const void* a, const void* b) {
+    double da = ((const ShardedDBResult*)a)->distance;
+    double db = ((const ShardedDBResult*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+/**
+ * @brief Find the nearest vectors by searching every shard in parallel and merging the results.
+ *
+ * Every shard returns its own k nearest, so the k nearest overall are among them. Each shard
+ * re-ranks its own pool of KD-Tree candidates.
+ *
+ * @param db Pointer to the sharded database.
+ * @param method Search method.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param params Per-query knobs of every shard, or NULL; fields left at 0 take search_params.
+ * @param indices Set to the global indices of the results, nearest first.
+ * @param distances Set to the Euclidean distances of the results.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL.
+ * @return size_t The number of results, or (size_t)-1 if the method is unavailable or failed.
+ */
+size_t sharded_db_nearest(ShardedDatabase* db, VectorDBSearchMethod method, const double* query, size_t k,
+                          const VectorDBSearchParams* params, size_t* indices, double* distances, char* uuids) {
+    VectorDBSearchParams shard_params = db->search_params;
+    if (params && params->candidates > 0) {
+        shard_params.candidates = params->candidates;
+    }
+    if (params && params->max_checks > 0) {
+        shard_params.max_checks = params->max_checks;
+    }
+    if (params && params->ef_search > 0) {
+        shard_params.ef_search = params->ef_search;
+    }
+    if (params && params->nprobe > 0) {
+        shard_params.nprobe = params->nprobe;
+    }
+    if (params && params->search_list > 0) {
+        shard_params.search_list = params->search_list;
+    }
+    if (params && params->beam_width > 0) {
+        shard_params.beam_width = params->beam_width;
+    }
+    if (db->shard_count == 1) {
+        return vector_db_nearest(db->shards[0], method, query, k, &shard_params, indices, distances, uuids);
+    }
+    if (k == 0) {
+        return 0;
+    }
+
+    size_t count = db->shard_count;
+    ShardedDBSearch* searches = (ShardedDBSearch*)calloc(count, sizeof(ShardedDBSearch));
+    pthread_t* threads = (pthread_t*)calloc(count, sizeof(pthread_t));
+    int* started = (int*)calloc(count, sizeof(int));
+    size_t* local_indices = (size_t*)malloc(count * k * sizeof(size_t));
+    double* local_distances = (double*)malloc(count * k * sizeof(double));
+    char* local_uuids = uuids ? (char*)malloc(count * k * UUID_SIZE) : NULL;
+    ShardedDBResult* results = (ShardedDBResult*)malloc(count * k * sizeof(ShardedDBResult));
+    if (!searches || !threads || !started || !local_indices || !local_distances || (uuids && !local_uuids) || !results) {
+        fprintf(stderr, "Failed to allocate memory for sharded search\n");
+        free(results);
+        free(local_uuids);
+        free(local_distances);
+        free(local_indices);
+        free(started);
+        free(threads);
+        free(searches);
+        return (size_t)-1;
+    }
+
+    // Fan out: every shard but the first on its own thread, the first on this one
+    for (size_t i = 0; i < count; ++i) {
+        ShardedDBSearch* search = &searches[i];
+        search->shard = db->shards[i];
+        search->method = method;
+        search->query = query;
+        search->k = k;
+        search->params = shard_params;
+        search->indices = local_indices + i * k;
+        search->distances = local_distances + i * k;
+        search->uuids = local_uuids ? local_uuids + i * k * UUID_SIZE : NULL;
+        if (vector_db_count(search->shard) == 0) {
+            continue; // Nothing to find, and its indexes may never have been trained
+        }
+        if (i > 0 && pthread_create(&threads[i], NULL, sharded_db_search_thread, search) == 0) {
+            started[i] = 1;
+        } else {
+            sharded_db_search_thread(search);
+        }
+    }
+    for (size_t i = 1; i < count; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    // Merge the per-shard results
+    size_t merged = 0;
+    int failed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (searches[i].found == (size_t)-1) {
+            failed = 1;
+            continue;
+        }
+        for (size_t j = 0; j < searches[i].found; ++j) {
+            results[merged].distance = searches[i].distances[j];
+            results[merged].index = searches[i].indices[j] * count + i;
+            results[merged].uuid = searches[i].uuids ? searches[i].uuids + j * UUID_SIZE : NULL;
+            merged++;
+        }
+    }
+    size_t found = (size_t)-1;
+    if (!failed) {
+        qsort(results, merged, sizeof(ShardedDBResult), sharded_db_compare_results);
+        found = merged < k ? merged : k;
+        for (size_t i = 0; i < found; ++i) {
+            indices[i] = results[i].index;
+            distances[i] = results[i].distance;
+            if (uuids) {
+                memcpy(uuids + i * UUID_SIZE, results[i].uuid, UUID_SIZE);
+            }
+        }
+    }
+
+    free(results);
+    free(local_uuids);
+    free(local_distances);
+    free(local_indices);
+    free(started);
+    free(threads);
+    free(searches);
+    return found;
+}
+
+/**
+ * @brief Distance between a query and a vector, as sharded_db_nearest reports it for a method.
+ *
+ * @param db Pointer to the sharded database.
+ * @param method Search method the distance is reported for.
+ * @param query Query vector of vector_size components.
+ * @param vec Copy of a stored vector.
+ * @return double The distance.
+ */
+double sharded_db_distance(ShardedDatabase* db, VectorDBSearchMethod method, const double* query, const Vector* vec) {
+    return vector_db_distance(db->shards[sharded_db_route(db, vec->uuid)], method, query, vec);
+}
+
+/**
+ * @brief Measure the recall of a search method against the exact flat scan.
+ *
+ * Both searches see the same database, so writes running meanwhile only blur the measure. A
+ * query is a stored vector, which is then among its own nearest neighbors.
+ *
+ * @param db Pointer to the sharded database.
+ * @param method Search method to measure.
+ * @param k Number of neighbors per query.
+ * @param query_count Number of queries to run.
+ * @param params Per-query knobs of the method, or NULL; fields left at 0 take search_params.
+ * @param recall Set to the recall, from 0 to 1.
+ * @return size_t The number of queries run, or (size_t)-1 if the method is unavailable or failed.
+ */
+size_t sharded_db_measure_recall(ShardedDatabase* db, VectorDBSearchMethod method, size_t k, size_t query_count,
+                                 const VectorDBSearchParams* params, double* recall) {
+    *recall = 1.0;
+    double* query = (double*)malloc(db->vector_size * sizeof(double));
+    size_t* truth = (size_t*)malloc(2 * (k > 0 ? k : 1) * sizeof(size_t));
+    double* distances = (double*)malloc((k > 0 ? k : 1) * sizeof(double));
+    if (!query || !truth || !distances) {
+        fprintf(stderr, "Failed to allocate memory for recall measure\n");
+        free(query);
+        free(truth);
+        free(distances);
+        return (size_t)-1;
+    }
+    size_t* found = truth + k;
+
+    size_t bound = sharded_db_index_bound(db);
+    size_t queries = 0, expected = 0, hits = 0;
+    for (size_t q = 0; q < query_count && bound > 0 && k > 0; ++q) {
+        Vector* vec = sharded_db_get(db, q * bound / query_count);
+        if (!vec) {
+            continue; // Deleted slot
+        }
+        vector_element_convert(VECTOR_ELEMENT_FLOAT64, query, vec->type, vec->data, db->vector_size);
+        vector_db_release(vec);
+
+        size_t truth_count = sharded_db_nearest(db, VECTOR_DB_SEARCH_FLAT, query, k, NULL, truth, distances, NULL);
+        size_t found_count = sharded_db_nearest(db, method, query, k, params, found, distances, NULL);
+        if (truth_count == (size_t)-1 || found_count == (size_t)-1) {
+            queries = (size_t)-1;
+            break;
+        }
+        for (size_t i = 0; i < found_count; ++i) {
+            for (size_t j = 0; j < truth_count; ++j) {
+                if (found[i] == truth[j]) {
+                    hits++;
+                    break;
+                }
+            }
+        }
+        expected += truth_count;
+        queries++;
+    }
+    if (queries != (size_t)-1 && expected > 0) {
+        *recall = (double)hits / (double)expected;
+    }
+    free(query);
+    free(truth);
+    free(distances);
+    return queries;
+}
+
+/**
+ * @brief Find every vector within a radius of a query in every shard and merge the results.
+ *
+ * Every shard keeps its own max_results nearest, so the nearest overall are among them.
+ *
+ * @param db Pointer to the sharded database.
+ * @param query Query vector of vector_size components.
+ * @param radius Largest Euclidean distance.
+ * @param max_results Keep only the nearest max_results vectors, or 0 to keep all of them.
+ * @param indices Set to a newly allocated array of the global indices of the results, nearest first.
+ * @param distances Set to a newly allocated array of the distances of the results.
+ * @param uuids Set to a newly allocated array of the UUIDs of the results, UUID_SIZE bytes each.
+ * @return size_t The number of results, or (size_t)-1 on failure.
+ */
+size_t sharded_db_range(ShardedDatabase* db, const double* query, double radius, size_t max_results,
+                        size_t** indices, double** distances, char** uuids) {
+    if (db->shard_count == 1) {
+        return vector_db_range(db->shards[0], query, radius, max_results, indices, distances, uuids);
+    }
+    *indices = NULL;
+    *distances = NULL;
+    *uuids = NULL;
+
+    // The UUIDs of every shard are kept until the merge is copied out
+    char** local_uuids = (char**)calloc(db->shard_count, sizeof(char*));
+    if (!local_uuids) {
+        fprintf(stderr, "Failed to allocate memory for sharded range search\n");
+        return (size_t)-1;
+    }
+    ShardedDBResult* results = NULL;
+    size_t merged = 0;
+    int failed = 0;
+    for (size_t i = 0; i < db->shard_count && !failed; ++i) {
+        size_t* local_indices = NULL;
+        double* local_distances = NULL;
+        size_t found = vector_db_range(db->shards[i], query, radius, max_results, &local_indices, &local_distances,
+                                       &local_uuids[i]);
+        ShardedDBResult* grown = found == (size_t)-1 ? NULL :
+            (ShardedDBResult*)realloc(results, (merged + found + 1) * sizeof(ShardedDBResult));
+        if (!grown) {
+            failed = 1;
+        } else {
+            results = grown;
+            for (size_t j = 0; j < found; ++j) {
+                results[merged].distance = local_distances[j];
+                results[merged].index = local_indices[j] * db->shard_count + i;
+                results[merged].uuid = local_uuids[i] + j * UUID_SIZE;
+                merged++;
+            }
+        }
+        free(local_indices);
+        free(local_distances);
+    }
+
+    size_t found = max_results > 0 && merged > max_results ? max_results : merged;
+    if (!failed && found > 0) {
+        qsort(results, merged, sizeof(ShardedDBResult), sharded_db_compare_results);
+        *indices = (size_t*)malloc(found * sizeof(size_t));
+        *distances = (double*)malloc(found * sizeof(double));
+        *uuids = (char*)malloc(found * UUID_SIZE);
+        if (!*indices || !*distances || !*uuids) {
+            fprintf(stderr, "Failed to allocate memory for sharded range search\n");
+            free(*indices);
+            free(*distances);
+            free(*uuids);
+            *indices = NULL;
+            *distances = NULL;
+            *uuids = NULL;
+            failed = 1;
+        } else {
+            for (size_t i = 0; i < found; ++i) {
+                (*indices)[i] = results[i].index;
+                (*distances)[i] = results[i].distance;
+                memcpy(*uuids + i * UUID_SIZE, results[i].uuid, UUID_SIZE);
+            }
+        }
+    }
+    for (size_t i = 0; i < db->shard_count; ++i) {
+        free(local_uuids[i]);
+    }
+    free(local_uuids);
+    free(results);
+    return failed ? (size_t)-1 : found;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../include/snapshotter.h"
+#include "../include/vector_database.h"
+
+#define SNAPSHOTTER_POLL_MS 100 // How often the dirty-write count is checked
+
+/**
+ * @brief Milliseconds elapsed on the monotonic clock.
+ * 
+ * @return unsigned long long Current time in milliseconds.
+ */
+static unsigned long long snapshotter_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000ULL + (unsigned long long)now.tv_nsec / 1000000ULL;
+}
+
+/**
+ * @brief Snapshotter thread body.
+ * 
+ * Polls the dirty-write count and saves the database when either trigger fires. Nothing is
+ * written while the database is clean.
+ *
+ * @param arg Pointer to the Snapshotter.
+ * @return Always NULL.
+ */
+static void* snapshotter_run(void* arg) {
+    Snapshotter* snapshotter = (Snapshotter*)arg;
+    unsigned long long last_save = snapshotter_now_ms();
+
+    pthread_mutex_lock(&snapshotter->lock);
+    while (snapshotter->running) {
+        pthread_mutex_unlock(&snapshotter->lock);
+        size_t dirty_writes = vector_db_dirty_writes(snapshotter->db);
+        unsigned long long now = snapshotter_now_ms();
+        int due = dirty_writes > 0 &&
+                  ((snapshotter->interval_ms > 0 && now - last_save >= snapshotter->interval_ms) ||
+                   (snapshotter->dirty_writes > 0 && dirty_writes >= snapshotter->dirty_writes));
+        if (due) {
+            printf("Snapshotter saving %zu pending writes\n", dirty_writes);
+            vector_db_save(snapshotter->db, snapshotter->filename);
+            last_save = snapshotter_now_ms();
+        } else if (dirty_writes == 0) {
+            last_save = now;
+        }
+        pthread_mutex_lock(&snapshotter->lock);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)SNAPSHOTTER_POLL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (snapshotter->running) {
+            pthread_cond_timedwait(&snapshotter->wakeup, &snapshotter->lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&snapshotter->lock);
+    return NULL;
+}
+
+/**
+ * @brief Start the background snapshotter.
+ * 
+ * @param db Database to save.
+ * @param filename File the database is saved to.
+ * @param interval_ms Save pending mutations at least this often, in milliseconds (0 to disable).
+ * @param dirty_writes Save as soon as this many mutations are pending (0 to disable).
+ * @return Snapshotter* Pointer to the running snapshotter, or NULL on failure.
+ */
+Snapshotter* snapshotter_start(VectorDatabase* db, const char* filename, unsigned int interval_ms, size_t dirty_writes) {
+    Snapshotter* snapshotter = (Snapshotter*)malloc(sizeof(Snapshotter));
+    if (!snapshotter) {
+        fprintf(stderr, "Failed to allocate memory for snapshotter\n");
+        return NULL;
+    }
+    snapshotter->filename = strdup(filename);
+    if (!snapshotter->filename) {
+        fprintf(stderr, "Failed to allocate memory for snapshotter\n");
+        free(snapshotter);
+        return NULL;
+    }
+    snapshotter->db = db;
+    snapshotter->interval_ms = interval_ms;
+    snapshotter->dirty_writes = dirty_writes;
+    snapshotter->running = 1;
+    pthread_mutex_init(&snapshotter->lock, NULL);
+    pthread_cond_init(&snapshotter->wakeup, NULL);
+
+    if (pthread_create(&snapshotter->thread, NULL, snapshotter_run, snapshotter) != 0) {
+        fprintf(stderr, "Failed to start snapshotter thread\n");
+        pthread_cond_destroy(&snapshotter->wakeup);
+        pthread_mutex_destroy(&snapshotter->lock);
+        free(snapshotter->filename);
+        free(snapshotter);
+        return NULL;
+    }
+    return snapshotter;
+}
+
+/**
+ * @brief Stop the snapshotter thread and free it.
+ * 
+ * @param snapshotter Snapshotter to stop.
+ */
+void snapshotter_stop(Snapshotter* snapshotter) {
+    if (snapshotter) {
+        pthread_mutex_lock(&snapshotter->lock);
+        snapshotter->running = 0;
+        pthread_cond_signal(&snapshotter->wakeup);
+        pthread_mutex_unlock(&snapshotter->lock);
+        pthread_join(snapshotter->thread, NULL);
+        pthread_cond_destroy(&snapshotter->wakeup);
+        pthread_mutex_destroy(&snapshotter->lock);
+        free(snapshotter->filename);
+        free(snapshotter);
+    }
+}
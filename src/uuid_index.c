@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/uuid_index.h"
+#include "../include/vector_database.h"
+
+#define UUID_INDEX_EMPTY ((size_t)-1)
+#define UUID_INDEX_TOMBSTONE ((size_t)-2)
+#define UUID_INDEX_MIN_CAPACITY 16
+
+/**
+ * @brief Hash a UUID string with 64-bit FNV-1a.
+ *
+ * @param uuid NUL-terminated UUID.
+ * @return uint64_t Hash value.
+ */
+static uint64_t uuid_hash(const char* uuid) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < UUID_SIZE && uuid[i] != '\0'; i++) {
+        hash ^= (unsigned char)uuid[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Smallest power-of-two capacity keeping `count` entries under a 0.7 load factor.
+ *
+ * @param count Number of entries.
+ * @return size_t Bucket count.
+ */
+static size_t uuid_index_capacity_for(size_t count) {
+    size_t capacity = UUID_INDEX_MIN_CAPACITY;
+    while (capacity * 7 < count * 10) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/**
+ * @brief Allocate a new bucket array and move every live entry into it.
+ *
+ * Hashes are stored in the buckets, so rehashing never touches the vector storage.
+ *
+ * @param index Index to rehash.
+ * @param capacity New bucket count (power of two).
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int uuid_index_rehash(UUIDIndex* index, size_t capacity) {
+    UUIDIndexEntry* entries = (UUIDIndexEntry*)malloc(capacity * sizeof(UUIDIndexEntry));
+    if (!entries) {
+        fprintf(stderr, "Failed to allocate UUID index\n");
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        entries[i].slot = UUID_INDEX_EMPTY;
+    }
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < index->capacity; i++) {
+        UUIDIndexEntry* entry = &index->entries[i];
+        if (entry->slot == UUID_INDEX_EMPTY || entry->slot == UUID_INDEX_TOMBSTONE) {
+            continue;
+        }
+        size_t pos = entry->hash & mask;
+        while (entries[pos].slot != UUID_INDEX_EMPTY) {
+            pos = (pos + 1) & mask;
+        }
+        entries[pos] = *entry;
+    }
+
+    free(index->entries);
+    index->entries = entries;
+    index->capacity = capacity;
+    index->tombstones = 0;
+    return 0;
+}
+
+/**
+ * @brief Find the bucket holding a UUID.
+ *
+ * @param index Index to search.
+ * @param uuid UUID to look up.
+ * @param hash Hash of the UUID.
+ * @return UUIDIndexEntry* Matching bucket, or NULL if the UUID is unknown.
+ */
+static UUIDIndexEntry* uuid_index_lookup(const UUIDIndex* index, const char* uuid, uint64_t hash) {
+    size_t mask = index->capacity - 1;
+    size_t pos = hash & mask;
+    while (index->entries[pos].slot != UUID_INDEX_EMPTY) {
+        UUIDIndexEntry* entry = &index->entries[pos];
+        if (entry->slot != UUID_INDEX_TOMBSTONE && entry->hash == hash &&
+            strncmp(vector_storage_slot(index->storage, entry->slot)->uuid, uuid, UUID_SIZE) == 0) {
+            return entry;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Create a new UUID index.
+ *
+ * @param storage Storage the slots refer to.
+ * @param initial_capacity Number of entries to size the table for.
+ * @return UUIDIndex* Pointer to the index, or NULL on failure.
+ */
+UUIDIndex* uuid_index_create(const VectorStorage* storage, size_t initial_capacity) {
+    UUIDIndex* index = (UUIDIndex*)malloc(sizeof(UUIDIndex));
+    if (!index) {
+        return NULL;
+    }
+    index->entries = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->tombstones = 0;
+    index->storage = storage;
+
+    if (uuid_index_rehash(index, uuid_index_capacity_for(initial_capacity)) != 0) {
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+/**
+ * @brief Free the index.
+ *
+ * @param index Index to free.
+ */
+void uuid_index_free(UUIDIndex* index) {
+    if (index) {
+        free(index->entries);
+        free(index);
+    }
+}
+
+/**
+ * @brief Grow the table so that `count` entries fit without rehashing.
+ *
+ * @param index Index to grow.
+ * @param count Number of entries to make room for.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int uuid_index_reserve(UUIDIndex* index, size_t count) {
+    size_t capacity = uuid_index_capacity_for(count);
+    if (capacity <= index->capacity) {
+        return 0;
+    }
+    return uuid_index_rehash(index, capacity);
+}
+
+/**
+ * @brief Map a UUID to a slot. The UUID must already be written to the slot.
+ *
+ * @param index Index to insert into.
+ * @param uuid UUID of the vector.
+ * @param slot Storage slot of the vector.
+ * @return int 0 on success, 1 if the UUID is already present, -1 on allocation failure.
+ */
+int uuid_index_insert(UUIDIndex* index, const char* uuid, size_t slot) {
+    uint64_t hash = uuid_hash(uuid);
+    if (uuid_index_lookup(index, uuid, hash)) {
+        return 1;
+    }
+
+    if ((index->count + index->tombstones + 1) * 10 > index->capacity * 7) {
+        if (uuid_index_rehash(index, uuid_index_capacity_for(index->count + 1)) != 0) {
+            return -1;
+        }
+    }
+
+    size_t mask = index->capacity - 1;
+    size_t pos = hash & mask;
+    while (index->entries[pos].slot != UUID_INDEX_EMPTY && index->entries[pos].slot != UUID_INDEX_TOMBSTONE) {
+        pos = (pos + 1) & mask;
+    }
+    if (index->entries[pos].slot == UUID_INDEX_TOMBSTONE) {
+        index->tombstones--;
+    }
+    index->entries[pos].hash = hash;
+    index->entries[pos].slot = slot;
+    index->count++;
+    return 0;
+}
+
+/**
+ * @brief Look up the slot of a UUID.
+ *
+ * @param index Index to search.
+ * @param uuid UUID to look up.
+ * @return size_t Storage slot, or (size_t)-1 if the UUID is unknown.
+ */
+size_t uuid_index_find(const UUIDIndex* index, const char* uuid) {
+    UUIDIndexEntry* entry = uuid_index_lookup(index, uuid, uuid_hash(uuid));
+    return entry ? entry->slot : (size_t)-1;
+}
+
+/**
+ * @brief Remove a UUID from the index.
+ *
+ * @param index Index to remove from.
+ * @param uuid UUID to remove.
+ * @return size_t Slot the UUID was mapped to, or (size_t)-1 if it was unknown.
+ */
+size_t uuid_index_remove(UUIDIndex* index, const char* uuid) {
+    UUIDIndexEntry* entry = uuid_index_lookup(index, uuid, uuid_hash(uuid));
+    if (!entry) {
+        return (size_t)-1;
+    }
+    size_t slot = entry->slot;
+    entry->slot = UUID_INDEX_TOMBSTONE;
+    index->count--;
+    index->tombstones++;
+    return slot;
+}
+
+/**
+ * @brief Point an existing entry at a new slot after the vector was moved.
+ *
+ * @param index Index to update.
+ * @param uuid UUID of the moved vector.
+ * @param old_slot Slot the vector was moved from.
+ * @param new_slot Slot the vector was moved to.
+ */
+void uuid_index_remap(UUIDIndex* index, const char* uuid, size_t old_slot, size_t new_slot) {
+    uint64_t hash = uuid_hash(uuid);
+    size_t mask = index->capacity - 1;
+    size_t pos = hash & mask;
+    while (index->entries[pos].slot != UUID_INDEX_EMPTY) {
+        UUIDIndexEntry* entry = &index->entries[pos];
+        if (entry->hash == hash && entry->slot == old_slot) {
+            entry->slot = new_slot;
+            return;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
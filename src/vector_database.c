@@ -1,55 +1,327 @@
+#define _GNU_SOURCE  // pthread_rwlockattr_setkind_np on glibc
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <math.h>
+#include <errno.h>
 #include <pthread.h>  // Include pthread library
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #include "../include/vector_database.h"
 #include "../include/kdtree.h"
+#include "../include/vector_storage.h"
+#include "../include/uuid_index.h"
+#include "../include/wal.h"
+#include "../include/vector_element.h"
+#include "../include/scalar_quantizer.h"
+#include "../include/pq_index.h"
+#include "../include/crc32c.h"
+#include "../include/flat_scan.h"
+
+#define VECTOR_DB_FILE_MAGIC "SVDBMAP"       // 7 chars + '\0'
+#define VECTOR_DB_FILE_VERSION 5               // 1: float64, 2: element type, 3: int8 codes, 4: PQ index, 5: checksums
+#define VECTOR_DB_FILE_BLOCK_RECORDS 1024    // Records covered by one block checksum
+#define VECTOR_DB_FILE_UUID_STRIDE 40        // UUID_SIZE rounded up to 8 bytes
+#define VECTOR_DB_FILE_MIN_ALIGNMENT 4096
+#define VECTOR_DB_FILE_WRITE_BUFFER 65536
+#define VECTOR_KERNEL_BLOCK 64               // Components decoded at a time by the mixed-type kernels
+#define VECTOR_DB_PQ_TRAIN_SAMPLES (PQ_INDEX_CENTROIDS * 40) // Vectors sampled to train the PQ codebooks
+#define VECTOR_DB_PQ_SUBSPACE_COMPONENTS 8   // Components per PQ subspace when none is requested
+#define VECTOR_DB_PQ_ENCODE_BATCH 1024       // Vectors encoded per lock hold after PQ training
+#define VECTOR_DB_IVF_TRAIN_SAMPLES_PER_LIST 64 // Vectors sampled per list to train the IVF centroids
+#define VECTOR_DB_SNAPSHOT_GRAPH_FAILED 2    // Snapshot writer status bit: the HNSW graph file failed
+#define VECTOR_DB_SNAPSHOT_MAP_FAILED 4      // Snapshot writer status bit: the Vamana map file failed
+
+// Serializes in-process snapshots of every database: the snapshot writers use static buffers
+static pthread_mutex_t vector_db_snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * @brief Initialize a vector database with a given initial capacity and dimension.
+ * @struct VectorDBFileHeader
+ * @brief First bytes of a database file in the mapped layout.
+ */
+typedef struct VectorDBFileHeader {
+    char magic[8];        /**< VECTOR_DB_FILE_MAGIC */
+    uint32_t version;     /**< VECTOR_DB_FILE_VERSION */
+    uint32_t header_size; /**< sizeof(VectorDBFileHeader) */
+    uint64_t count;       /**< Number of vectors */
+    uint64_t vector_size; /**< Number of components per vector */
+    uint64_t uuid_offset; /**< Page-aligned offset of the UUID section */
+    uint64_t uuid_stride; /**< Bytes per UUID */
+    uint64_t data_offset; /**< Page-aligned offset of the data section */
+    uint64_t data_stride; /**< Bytes per vector */
+    uint32_t element_type; /**< VectorElementType of the data section (version 2) */
+    uint32_t reserved;    /**< Zero */
+    uint64_t codes_offset; /**< Page-aligned offset of the quantized code section, or 0 (version 3) */
+    uint64_t code_stride; /**< Bytes per quantized code (version 3) */
+    uint64_t pq_offset;   /**< Page-aligned offset of the PQ index section, or 0 (version 4) */
+    uint64_t pq_subspaces; /**< Bytes per PQ code (version 4) */
+    uint64_t block_offset; /**< Offset of the block table (version 5) */
+    uint32_t block_records; /**< Records per block; the last block may hold fewer (version 5) */
+    uint32_t header_crc;  /**< CRC32C of the header with this field zeroed (version 5) */
+    uint32_t tables_crc;  /**< CRC32C of the quantizer ranges and the PQ codebooks (version 5) */
+    uint32_t reserved2;   /**< Zero */
+} VectorDBFileHeader;
+
+/**
+ * @struct VectorDBFileBlock
+ * @brief Block table entry of a database file.
+ *
+ * Block b covers the records b * block_records onwards. Its checksum runs over the bytes of those
+ * records in every section, in file order: UUIDs, data, quantized codes, their norms, PQ codes.
+ */
+typedef struct VectorDBFileBlock {
+    uint32_t count;       /**< Number of records in the block */
+    uint32_t crc;         /**< CRC32C of the records of the block */
+} VectorDBFileBlock;
+
+/**
+ * @struct VectorDBCandidate
+ * @brief Result of a search, ordered by distance with compare() (distance comes first).
+ */
+typedef struct VectorDBCandidate {
+    double distance; /**< Distance to the query */
+    size_t index;    /**< Index of the vector */
+} VectorDBCandidate;
+
+/**
+ * @brief Decode the KD-Tree coordinates of stored components.
  * 
- * @param initial_capacity The initial capacity of the database.
- * @param dimension The dimension of the vectors.
+ * The tree works on doubles; float64 components are returned in place and any other element type
+ * is decoded into the buffer. Dimensions beyond the vector size read as zero.
+ *
+ * @param db Pointer to the vector database.
+ * @param data Components in the database element type.
+ * @param buffer Scratch space of KD-Tree dimension doubles.
+ * @return const double* The first KD-Tree dimension components as doubles.
+ */
+static const double* vector_db_kd_decode(VectorDatabase* db, const void* data, double* buffer) {
+    size_t dimension = db->kdtree->dimension;
+    if (db->element_type == VECTOR_ELEMENT_FLOAT64 && dimension <= db->vector_size) {
+        return (const double*)data;
+    }
+    size_t count = dimension < db->vector_size ? dimension : db->vector_size;
+    vector_element_convert(VECTOR_ELEMENT_FLOAT64, buffer, db->element_type, data, count);
+    for (size_t i = count; i < dimension; i++) {
+        buffer[i] = 0.0;
+    }
+    return buffer;
+}
+
+/**
+ * @brief Get the KD-Tree coordinates of stored components.
+ * 
+ * The result may live in the scratch buffer, so it is only valid until the next call. The caller
+ * must hold the database lock for writing.
+ *
+ * @param db Pointer to the vector database.
+ * @param data Components in the database element type.
+ * @return const double* The first KD-Tree dimension components as doubles.
+ */
+static const double* vector_db_kd_point(VectorDatabase* db, const void* data) {
+    return vector_db_kd_decode(db, data, db->kd_point);
+}
+
+/**
+ * @brief Get the components of a slot for a callback that has no scratch space of its own.
+ * 
+ * Searches may promote a cold slot while the hot set has room; index builds, which read every
+ * vector, never do. A cold slot that is not promoted is read into a new allocation returned
+ * through scratch, which the caller frees once done with the components.
+ *
+ * @param db Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ * @param scratch Set to the allocation to free, or NULL.
+ * @return const void* The components, or NULL if the vector cannot be read.
+ */
+static const void* vector_db_slot_data(VectorDatabase* db, size_t index, void** scratch) {
+    *scratch = NULL;
+    if (db->storage->tier && !(*scratch = malloc(db->storage->vector_bytes))) {
+        fprintf(stderr, "Failed to allocate memory for a cold vector\n");
+        return NULL;
+    }
+    return vector_storage_read(db->storage, index, !db->building, *scratch);
+}
+
+/**
+ * @brief KD-Tree point function reading the coordinates of a storage slot.
+ * 
+ * The tree keeps no copy of the vectors, so searches read them back from storage through this
+ * function while the caller holds the database lock.
+ *
+ * @param context Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ * @param buffer Scratch space of KD-Tree dimension doubles.
+ * @return const double* The first KD-Tree dimension components as doubles.
+ */
+static const double* vector_db_kd_slot(void* context, size_t index, double* buffer) {
+    VectorDatabase* db = (VectorDatabase*)context;
+    void* scratch;
+    const void* data = vector_db_slot_data(db, index, &scratch);
+    const double* point = data ? vector_db_kd_decode(db, data, buffer) : NULL;
+    if (point && point == scratch) {
+        memcpy(buffer, point, db->kdtree->dimension * sizeof(double)); // Decoded in place
+        point = buffer;
+    }
+    free(scratch);
+    return point;
+}
+
+/**
+ * @brief KD-Tree prefetch function starting to load the components of a storage slot.
+ * 
+ * @param context Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ */
+static void vector_db_kd_prefetch(void* context, size_t index) {
+    vector_storage_prefetch(((VectorDatabase*)context)->storage, index);
+}
+
+/**
+ * @brief Replace the KD-Tree with a balanced tree over every live vector.
+ * 
+ * The caller must hold the database lock for writing, or own the database exclusively.
+ *
+ * @param db Pointer to the vector database.
+ * @return size_t The number of vectors indexed, or (size_t)-1 on failure.
+ */
+static size_t vector_db_build_kdtree(VectorDatabase* db) {
+    size_t live = db->size - db->deleted_count;
+    size_t* indices = (size_t*)malloc((live > 0 ? live : 1) * sizeof(size_t));
+    if (!indices) {
+        fprintf(stderr, "Failed to allocate memory for the KDTree build\n");
+        return (size_t)-1;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < db->size && count < live; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            indices[count++] = i;
+        }
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    db->building = 1;
+    int status = kdtree_build(db->kdtree, indices, count, cpus > 1 ? (size_t)cpus : 1);
+    db->building = 0;
+    free(indices);
+    if (status != 0) {
+        fprintf(stderr, "Failed to build KDTree\n");
+        return (size_t)-1;
+    }
+    return count;
+}
+
+/**
+ * @brief Build a vector database around an existing storage.
+ * 
+ * @param storage The storage holding the vectors. Ownership is taken, even on failure.
+ * @param index_capacity The number of UUIDs to size the hash index for.
+ * @param dimension The dimension of the KD-tree.
  * @return VectorDatabase* Pointer to the initialized vector database, or NULL on failure.
  */
-VectorDatabase* vector_db_init(size_t initial_capacity, size_t dimension) {
+static VectorDatabase* vector_db_create(VectorStorage* storage, size_t index_capacity, size_t dimension) {
     VectorDatabase* db = (VectorDatabase*)malloc(sizeof(VectorDatabase));
     if (!db) {
         fprintf(stderr, "Failed to allocate memory for database\n");
+        vector_storage_free(storage);
         return NULL;
     }
 
     db->size = 0;
-    db->capacity = initial_capacity > 0 ? initial_capacity : 10;
-    db->vectors = (Vector*)malloc(db->capacity * sizeof(Vector));
-    if (!db->vectors) {
-        fprintf(stderr, "Failed to allocate memory for vectors\n");
+    db->deleted_count = 0;
+    db->dirty_writes = 0;
+    db->compact_cursor = 0;
+    db->vector_size = storage->stride;
+    db->element_type = storage->element_type;
+    db->storage = storage;
+    db->wal = NULL;
+    db->quantizer = NULL;
+    db->rescore_factor = 1;
+    db->pq = NULL;
+    db->forest = NULL;
+    db->hnsw = NULL;
+    db->ivf = NULL;
+    db->diskann = NULL;
+    db->search_method = VECTOR_DB_SEARCH_KDTREE;
+    db->flat_threshold = VECTOR_DB_DEFAULT_FLAT_THRESHOLD;
+    db->building = 0;
+    db->capacity = vector_storage_capacity(db->storage);
+
+    db->uuid_index = uuid_index_create(db->storage, index_capacity);
+    if (!db->uuid_index) {
+        fprintf(stderr, "Failed to create UUID index\n");
+        vector_storage_free(db->storage);
         free(db);
         return NULL;
     }
 
-    db->kdtree = kdtree_create(dimension);
+    db->kd_point = (double*)calloc(dimension > 0 ? 2 * dimension : 1, sizeof(double));
+    db->kdtree = db->kd_point ? kdtree_create(dimension, vector_db_kd_slot, vector_db_kd_prefetch, db) : NULL;
     if (!db->kdtree) {
         fprintf(stderr, "Failed to create KDTree\n");
-        free(db->vectors);
+        free(db->kd_point);
+        uuid_index_free(db->uuid_index);
+        vector_storage_free(db->storage);
         free(db);
         return NULL;
     } else {
         printf("KDTree initialized\n");
     }
 
-    // Initialize the mutex
-    if (pthread_mutex_init(&db->mutex, NULL) != 0) {
-        fprintf(stderr, "Failed to initialize mutex\n");
+    // Initialize the locks; writers are short, so they go first and a stream of searches cannot starve them
+    pthread_rwlockattr_t lock_attr;
+    pthread_rwlockattr_init(&lock_attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int lock_status = pthread_rwlock_init(&db->lock, &lock_attr);
+    pthread_rwlockattr_destroy(&lock_attr);
+    if (lock_status != 0 || pthread_mutex_init(&db->save_mutex, NULL) != 0) {
+        fprintf(stderr, "Failed to initialize locks\n");
         kdtree_free(db->kdtree);
-        free(db->vectors);
+        free(db->kd_point);
+        uuid_index_free(db->uuid_index);
+        vector_storage_free(db->storage);
         free(db);
         return NULL;
     }
 
-    printf("Database initialized with capacity: %zu\n", db->capacity);
+    return db;
+}
+
+/**
+ * @brief Initialize a vector database with a given initial capacity and dimension.
+ * 
+ * @param initial_capacity The initial capacity of the database.
+ * @param dimension The dimension of the KD-tree.
+ * @param vector_size The number of components of every stored vector.
+ * @param element_type The storage type of every component.
+ * @return VectorDatabase* Pointer to the initialized vector database, or NULL on failure.
+ */
+VectorDatabase* vector_db_init(size_t initial_capacity, size_t dimension, size_t vector_size, VectorElementType element_type) {
+    VectorStorage* storage = vector_storage_create(vector_size, element_type, initial_capacity > 0 ? initial_capacity : 10);
+    if (!storage) {
+        fprintf(stderr, "Failed to allocate memory for vectors\n");
+        return NULL;
+    }
+
+    VectorDatabase* db = vector_db_create(storage, initial_capacity, dimension);
+    if (db) {
+        printf("Database initialized with capacity: %zu\n", db->capacity);
+    }
     return db;
 }
 
@@ -60,13 +332,19 @@ VectorDatabase* vector_db_init(size_t initial_capacity, size_t dimension) {
  */
 void vector_db_free(VectorDatabase* db) {
     if (db) {
-        for (size_t i = 0; i < db->size; ++i) {
-            free(db->vectors[i].data);
-        }
         kdtree_free(db->kdtree);
-        free(db->vectors);
-        // Destroy the mutex
-        pthread_mutex_destroy(&db->mutex);
+        kd_forest_free(db->forest);
+        hnsw_free(db->hnsw);
+        ivf_index_free(db->ivf);
+        diskann_free(db->diskann);
+        free(db->kd_point);
+        uuid_index_free(db->uuid_index);
+        scalar_quantizer_free(db->quantizer);
+        pq_index_free(db->pq);
+        vector_storage_free(db->storage);
+        // Destroy the locks
+        pthread_rwlock_destroy(&db->lock);
+        pthread_mutex_destroy(&db->save_mutex);
         free(db);
     }
 }
@@ -74,64 +352,122 @@ void vector_db_free(VectorDatabase* db) {
 /**
  * @brief Insert a vector into the vector database.
  * 
+ * The components are converted to the database element type and copied into the next free
+ * storage slot. Growing the storage appends
+ * a new chunk and never moves the vectors already stored.
+ *
  * @param db Pointer to the vector database.
- * @param vec The vector to insert.
+ * @param vec The vector to insert. The caller keeps ownership of vec.data.
  * @return size_t The index of the inserted vector, or (size_t)-1 on failure.
  */
 size_t vector_db_insert(VectorDatabase* db, Vector vec) {
-    pthread_mutex_lock(&db->mutex);  // Lock the mutex
+    if (vec.dimension != db->vector_size || !vec.data || vector_element_size(vec.type) == 0) {
+        fprintf(stderr, "Vector dimension %zu does not match database vector size %zu\n", vec.dimension, db->vector_size);
+        return (size_t)-1;
+    }
+
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+
+    if (!db->kdtree) {
+        fprintf(stderr, "KDTree is NULL before inserting\n");
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return (size_t)-1;
+    }
 
-    printf("Inserting vector, current size: %zu, current capacity: %zu\n", db->size, db->capacity);
     if (db->size >= db->capacity) {
-        size_t new_capacity = db->capacity > SIZE_MAX / 2 ? SIZE_MAX : db->capacity * 2;
-        printf("Current capacity: %zu\n", db->capacity);
-        printf("Requested new capacity: %zu\n", new_capacity);
-        printf("Maximum size_t value: %zu\n", SIZE_MAX);
-        if (new_capacity <= db->capacity || new_capacity > SIZE_MAX / sizeof(Vector)) {
-            fprintf(stderr, "Capacity overflow detected, unable to allocate more memory for vectors\n");
-            pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
-            return (size_t)-1;
-        }
-        Vector* new_vectors = (Vector*)realloc(db->vectors, new_capacity * sizeof(Vector));
-        if (!new_vectors) {
+        if (db->size == SIZE_MAX || vector_storage_reserve(db->storage, db->size + 1) != 0) {
             fprintf(stderr, "Failed to allocate more memory for vectors\n");
-            pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
+            pthread_rwlock_unlock(&db->lock);  // Unlock
             return (size_t)-1;
         }
-        db->vectors = new_vectors;
-        db->capacity = new_capacity;
+        db->capacity = vector_storage_capacity(db->storage);
     }
 
-    strncpy(db->vectors[db->size].uuid, vec.uuid, UUID_SIZE - 1);
-    db->vectors[db->size].uuid[UUID_SIZE - 1] = '\0';
-
-    if (!db->kdtree) {
-        fprintf(stderr, "KDTree is NULL before inserting\n");
-        pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
+    Vector* slot = vector_storage_slot(db->storage, db->size);
+    void* data = vector_storage_data_for_write(db->storage, db->size);
+    if (!data) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return (size_t)-1;
+    }
+    vector_storage_set_deleted(db->storage, db->size, 0);
+    strncpy(slot->uuid, vec.uuid, UUID_SIZE - 1);
+    slot->uuid[UUID_SIZE - 1] = '\0';
+    int status = uuid_index_insert(db->uuid_index, slot->uuid, db->size);
+    if (status != 0) {
+        fprintf(stderr, status > 0 ? "UUID %s is already stored\n" : "Failed to index UUID %s\n", slot->uuid);
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return (size_t)-1;
+    }
+    uint64_t lsn = 0;
+    if (db->wal && (lsn = wal_append(db->wal, WAL_RECORD_INSERT, slot->uuid, vec.data, vec.type, db->vector_size)) == 0) {
+        uuid_index_remove(db->uuid_index, slot->uuid);
+        pthread_rwlock_unlock(&db->lock);  // Unlock
         return (size_t)-1;
     }
-    db->vectors[db->size] = vec;
-    kdtree_insert(db->kdtree, vec.data, db->size);
+    vector_element_convert(db->element_type, data, vec.type, vec.data, db->vector_size);
+    if (db->quantizer) {
+        scalar_quantizer_encode(db->quantizer, db->size, db->element_type, data);
+    }
+    if (db->pq) {
+        pq_index_encode(db->pq, db->size, db->element_type, data);
+    }
+
+    kdtree_insert(db->kdtree, vector_db_kd_point(db, data), db->size);
+    if (db->forest && kd_forest_insert(db->forest, db->size) != 0) {
+        fprintf(stderr, "Failed to add vector %zu to the KD-forest\n", db->size);
+    }
+    if (db->hnsw && hnsw_insert(db->hnsw, db->size) != 0) {
+        fprintf(stderr, "Failed to add vector %zu to the HNSW graph\n", db->size);
+    }
+    if (db->ivf && ivf_index_insert(db->ivf, db->size) != 0) {
+        fprintf(stderr, "Failed to add vector %zu to the IVF index\n", db->size);
+    }
+    if (db->diskann && diskann_insert(db->diskann, db->size) != 0) {
+        fprintf(stderr, "Failed to add vector %zu to the Vamana graph\n", db->size);
+    }
     size_t index = db->size++;
+    db->dirty_writes++;
+    WAL* wal = db->wal;
     
-    pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+
+    // Wait for the log outside the lock so that concurrent writers share one fsync
+    if (wal && wal_wait(wal, lsn) != 0) {
+        fprintf(stderr, "Insert of %s at index %zu may not be durable\n", vec.uuid, index);
+    }
     return index;
 }
 
+/**
+ * @brief Check whether an index holds a live vector.
+ * 
+ * Only the size and the slot flags are read, so a cold slot of tiered storage stays on disk.
+ *
+ * @param db Pointer to the vector database.
+ * @param index The index to check.
+ * @return int Non-zero if the index is in range and not deleted.
+ */
+int vector_db_contains(VectorDatabase* db, size_t index) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    int found = index < db->size && !vector_storage_is_deleted(db->storage, index);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return found;
+}
+
 /**
  * @brief Read a vector from the vector database at a given index.
  * 
  * @param db Pointer to the vector database.
  * @param index The index of the vector to read.
- * @return Vector* Pointer to the vector, or NULL if the index is out of range.
+ * @return Vector* Pointer to the vector, or NULL if the index is out of range or deleted.
  */
 Vector* vector_db_read(VectorDatabase* db, size_t index) {
-    pthread_mutex_lock(&db->mutex);  // Lock the mutex
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
     Vector* vec = NULL;
-    if (index < db->size) {
-        vec = &db->vectors[index];
+    if (index < db->size && !vector_storage_is_deleted(db->storage, index)) {
+        vec = vector_storage_slot(db->storage, index);
     }
-    pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
+    pthread_rwlock_unlock(&db->lock);  // Unlock
     return vec;
 }
 
@@ -143,225 +479,3277 @@ Vector* vector_db_read(VectorDatabase* db, size_t index) {
  * @return Vector* Pointer to the vector, or NULL if the index is out of range.
  */
 Vector* vector_db_read_by_uuid(VectorDatabase* db, const char* uuid) {
-    pthread_mutex_lock(&db->mutex);  // Lock the mutex
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
 
     Vector* vec = NULL;
-    for (size_t i = 0; i < db->size; ++i) {
-        if (strncmp(db->vectors[i].uuid, uuid, UUID_SIZE) == 0) {
-            vec = &db->vectors[i];
-            break;
-        }
+    size_t index = uuid_index_find(db->uuid_index, uuid);
+    if (index != (size_t)-1) {
+        vec = vector_storage_slot(db->storage, index);
     }
 
-    pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
+    pthread_rwlock_unlock(&db->lock);  // Unlock
     return vec;
 }
 
+/**
+ * @brief Find the index of a vector by UUID.
+ * 
+ * @param db Pointer to the vector database.
+ * @param uuid The UUID of the vector to look up.
+ * @return size_t The index of the vector, or (size_t)-1 if the UUID is unknown.
+ */
+size_t vector_db_find_index(VectorDatabase* db, const char* uuid) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t index = uuid_index_find(db->uuid_index, uuid);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return index;
+}
+
+/**
+ * @brief Copy a slot into a single allocation holding the header and the components.
+ * 
+ * The caller must hold the database lock.
+ *
+ * @param db Pointer to the vector database.
+ * @param index The index of a live slot.
+ * @return Vector* The copy, or NULL if the allocation failed.
+ */
+static Vector* vector_db_copy_slot(VectorDatabase* db, size_t index) {
+    const Vector* slot = vector_storage_slot(db->storage, index);
+    size_t header_bytes = (sizeof(Vector) + VECTOR_STORAGE_ALIGNMENT - 1) & ~(size_t)(VECTOR_STORAGE_ALIGNMENT - 1);
+    size_t data_bytes = db->vector_size * vector_element_size(db->element_type);
+    Vector* vec = (Vector*)malloc(header_bytes + data_bytes);
+    if (!vec) {
+        fprintf(stderr, "Failed to allocate memory for vector copy\n");
+        return NULL;
+    }
+    vec->data = (unsigned char*)vec + header_bytes;
 
+    // A cold slot is read straight into the copy once the hot set is full
+    const void* data = vector_storage_read(db->storage, index, 1, vec->data);
+    if (!data) {
+        free(vec);
+        return NULL;
+    }
+    memcpy(vec->uuid, slot->uuid, UUID_SIZE);
+    vec->dimension = db->vector_size;
+    vec->type = db->element_type;
+    if (data != vec->data) {
+        memcpy(vec->data, data, data_bytes);
+    }
+    return vec;
+}
 
 /**
- * @brief Update a vector in the vector database at a given index.
+ * @brief Copy a vector out of the vector database at a given index.
  * 
  * @param db Pointer to the vector database.
- * @param index The index of the vector to update.
- * @param vec The new vector data.
+ * @param index The index of the vector to copy.
+ * @return Vector* The copy, or NULL if the index is out of range, deleted or the allocation failed.
  */
-void vector_db_update(VectorDatabase* db, size_t index, Vector vec) {
-    pthread_mutex_lock(&db->mutex);  // Lock the mutex
-    if (index < db->size) {
-        free(db->vectors[index].data);
-        db->vectors[index] = vec;
-        kdtree_insert(db->kdtree, vec.data, index);
+Vector* vector_db_get(VectorDatabase* db, size_t index) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    Vector* vec = NULL;
+    if (index < db->size && !vector_storage_is_deleted(db->storage, index)) {
+        vec = vector_db_copy_slot(db, index);
     }
-    pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return vec;
 }
 
 /**
- * @brief Delete a vector from the vector database at a given index.
+ * @brief Copy a vector out of the vector database by UUID.
  * 
  * @param db Pointer to the vector database.
- * @param index The index of the vector to delete.
+ * @param uuid The UUID of the vector to copy.
+ * @return Vector* The copy, or NULL if the UUID is unknown or the allocation failed.
  */
-void vector_db_delete(VectorDatabase* db, size_t index) {
-    pthread_mutex_lock(&db->mutex);  // Lock the mutex
-    if (index < db->size) {
-        free(db->vectors[index].data);
-        for (size_t i = index; i < db->size - 1; ++i) {
-            db->vectors[i] = db->vectors[i + 1];
-        }
-        db->size--;
+Vector* vector_db_get_by_uuid(VectorDatabase* db, const char* uuid) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    Vector* vec = NULL;
+    size_t index = uuid_index_find(db->uuid_index, uuid);
+    if (index != (size_t)-1) {
+        vec = vector_db_copy_slot(db, index);
     }
-    pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return vec;
 }
 
 /**
- * @brief Save the vector database to a file.
+ * @brief Release a copy returned by vector_db_get.
+ * 
+ * @param vec The copy to release, may be NULL.
+ */
+void vector_db_release(Vector* vec) {
+    free(vec);
+}
+
+
+/**
+ * @brief Update a vector in the vector database at a given index.
  * 
  * @param db Pointer to the vector database.
- * @param filename The name of the file to save the database to.
+ * @param index The index of the vector to update.
+ * @param vec The new vector data. The caller keeps ownership of vec.data.
  */
-void vector_db_save(VectorDatabase* db, const char* filename) {
-    pthread_mutex_lock(&db->mutex);  // Lock the mutex
-    FILE* file = fopen(filename, "wb");
-    if (!file) {
-        perror("Failed to open file for writing");
-        pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
+void vector_db_update(VectorDatabase* db, size_t index, Vector vec) {
+    if (vec.dimension != db->vector_size || !vec.data || vector_element_size(vec.type) == 0) {
+        fprintf(stderr, "Vector dimension %zu does not match database vector size %zu\n", vec.dimension, db->vector_size);
         return;
     }
 
-    printf("Saving database of size %zu\n", db->size);
-    fwrite(&db->size, sizeof(size_t), 1, file);
-    for (size_t i = 0; i < db->size; ++i) {
-        if (db->vectors[i].dimension == 0 || db->vectors[i].data == NULL) {
-            fprintf(stderr, "Invalid vector at index %zu, skipping\n", i);
-            continue;
+    uint64_t lsn = 0;
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    WAL* wal = db->wal;
+    if (index < db->size && !vector_storage_is_deleted(db->storage, index)) {
+        Vector* slot = vector_storage_slot(db->storage, index);
+        void* data = vector_storage_data(db->storage, index);
+        if (data && (!wal || (lsn = wal_append(wal, WAL_RECORD_UPDATE, slot->uuid, vec.data, vec.type, db->vector_size)) != 0)) {
+            // Keep the old coordinates, the components are overwritten in place
+            double* previous = db->kd_point + db->kdtree->dimension;
+            memcpy(previous, vector_db_kd_point(db, data), db->kdtree->dimension * sizeof(double));
+            if (db->forest) {
+                kd_forest_remove(db->forest, index); // The forest reads the old components back from storage
+            }
+            if (db->hnsw) {
+                hnsw_remove(db->hnsw, index);
+            }
+            if (db->ivf) {
+                ivf_index_remove(db->ivf, index);
+            }
+            if (db->diskann) {
+                diskann_remove(db->diskann, index); // The node on disk keeps the old components
+            }
+            data = vector_storage_data_for_write(db->storage, index); // Resident already, now dirty
+            vector_element_convert(db->element_type, data, vec.type, vec.data, db->vector_size);
+            if (db->quantizer) {
+                scalar_quantizer_encode(db->quantizer, index, db->element_type, data);
+            }
+            if (db->pq) {
+                pq_index_encode(db->pq, index, db->element_type, data);
+            }
+            kdtree_update(db->kdtree, previous, vector_db_kd_point(db, data), index);
+            if (db->forest && kd_forest_insert(db->forest, index) != 0) {
+                fprintf(stderr, "Failed to add vector %zu to the KD-forest\n", index);
+            }
+            if (db->hnsw && hnsw_insert(db->hnsw, index) != 0) {
+                fprintf(stderr, "Failed to add vector %zu to the HNSW graph\n", index);
+            }
+            if (db->ivf && ivf_index_insert(db->ivf, index) != 0) {
+                fprintf(stderr, "Failed to add vector %zu to the IVF index\n", index);
+            }
+            if (db->diskann && diskann_insert(db->diskann, index) != 0) {
+                fprintf(stderr, "Failed to add vector %zu to the Vamana graph\n", index);
+            }
+            db->dirty_writes++;
         }
-        printf("Saving vector at index %zu with dimension %zu\n", i, db->vectors[i].dimension);
-        fwrite(db->vectors[i].uuid, sizeof(char), 37, file); // Assuming UUID is stored as a 36-char string + NULL terminator
-        fwrite(&db->vectors[i].dimension, sizeof(size_t), 1, file);
-        fwrite(db->vectors[i].data, sizeof(double), db->vectors[i].dimension, file);
     }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
 
-    fclose(file);
-    pthread_mutex_unlock(&db->mutex);  // Unlock the mutex
-    printf("Database saved to %s\n", filename);
+    if (lsn != 0 && wal_wait(wal, lsn) != 0) {
+        fprintf(stderr, "Update at index %zu may not be durable\n", index);
+    }
 }
 
 /**
- * @brief Load a vector database from a file.
+ * @brief Delete a vector from the vector database at a given index.
  * 
- * @param filename The name of the file to load the database from.
- * @param dimension The dimension of the vectors.
- * @return VectorDatabase* Pointer to the loaded vector database, or NULL on failure.
+ * The slot becomes a tombstone: it is dropped from the UUID index and removed from the KD-tree,
+ * and every other vector keeps its index until the compactor runs.
+ *
+ * @param db Pointer to the vector database.
+ * @param index The index of the vector to delete.
  */
-VectorDatabase* vector_db_load(const char* filename, size_t dimension) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        perror("Failed to open file for reading");
-        return NULL;
-    }
-    VectorDatabase* db = (VectorDatabase*)malloc(sizeof(VectorDatabase));
-    if (!db) {
-        fprintf(stderr, "Failed to allocate memory for database\n");
-        fclose(file);
-        return NULL;
-    }
-    fread(&db->size, sizeof(size_t), 1, file);
-    db->capacity = db->size > 0 ? db->size : 10;
-    db->vectors = (Vector*)malloc(db->capacity * sizeof(Vector));
-    if (!db->vectors) {
-        fprintf(stderr, "Failed to allocate memory for vectors\n");
-        free(db);
-        fclose(file);
-        return NULL;
-    }
-    for (size_t i = 0; i < db->size; ++i) {
-        fread(db->vectors[i].uuid, sizeof(char), 37, file); // Assuming UUID is stored as a 36-char string + NULL terminator
-        fread(&db->vectors[i].dimension, sizeof(size_t), 1, file);
-        db->vectors[i].data = (double*)malloc(db->vectors[i].dimension * sizeof(double));
-        if (!db->vectors[i].data) {
-            fprintf(stderr, "Failed to allocate memory for vector data\n");
-            vector_db_free(db);
-            fclose(file);
-            return NULL;
+void vector_db_delete(VectorDatabase* db, size_t index) {
+    uint64_t lsn = 0;
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    WAL* wal = db->wal;
+    if (index < db->size && !vector_storage_is_deleted(db->storage, index)) {
+        Vector* vec = vector_storage_slot(db->storage, index);
+        // A cold slot about to become a tombstone is read without promoting it
+        void* scratch = db->storage->tier ? malloc(db->storage->vector_bytes) : NULL;
+        const void* data = db->storage->tier && !scratch ? NULL : vector_storage_read(db->storage, index, 0, scratch);
+        if (!data || (wal && (lsn = wal_append(wal, WAL_RECORD_DELETE, vec->uuid, NULL, db->element_type, 0)) == 0)) {
+            pthread_rwlock_unlock(&db->lock);  // Unlock
+            free(scratch);
+            return;
+        }
+        uuid_index_remove(db->uuid_index, vec->uuid);
+        kdtree_remove(db->kdtree, vector_db_kd_point(db, data), index);
+        free(scratch);
+        if (db->forest) {
+            kd_forest_remove(db->forest, index);
+        }
+        if (db->hnsw) {
+            hnsw_remove(db->hnsw, index);
+        }
+        if (db->ivf) {
+            ivf_index_remove(db->ivf, index);
+        }
+        if (db->diskann) {
+            diskann_remove(db->diskann, index);
+        }
+        vector_storage_set_deleted(db->storage, index, 1);
+        db->deleted_count++;
+        db->dirty_writes++;
+        if (index < db->compact_cursor) {
+            db->compact_cursor = index;
         }
-        fread(db->vectors[i].data, sizeof(double), db->vectors[i].dimension, file);
-    }
-    db->kdtree = kdtree_create(dimension);
-    if (!db->kdtree) {
-        fprintf(stderr, "Failed to create KDTree\n");
-        vector_db_free(db);
-        fclose(file);
-        return NULL;
-    }
-    for (size_t i = 0; i < db->size; ++i) {
-        kdtree_insert(db->kdtree, db->vectors[i].data, i);
     }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
 
-    // Initialize the mutex
-    if (pthread_mutex_init(&db->mutex, NULL) != 0) {
-        fprintf(stderr, "Failed to initialize mutex\n");
-        vector_db_free(db);
-        fclose(file);
-        return NULL;
+    if (lsn != 0 && wal_wait(wal, lsn) != 0) {
+        fprintf(stderr, "Delete at index %zu may not be durable\n", index);
     }
-
-    fclose(file);
-    printf("Database loaded with size: %zu, capacity: %zu\n", db->size, db->capacity);
-    return db;
 }
 
 /**
- * @brief Calculate the cosine similarity between two vectors.
+ * @brief Attach a write-ahead log to the database.
  * 
- * @param vec1 The first vector.
- * @param vec2 The second vector.
- * @return float The cosine similarity, or -1.0 if the dimensions do not match.
+ * @param db Pointer to the vector database.
+ * @param wal Log to append to, or NULL to stop logging.
  */
-float cosine_similarity(Vector vec1, Vector vec2) {
-    if (vec1.dimension != vec2.dimension) {
-        fprintf(stderr, "Vectors have different dimensions\n");
-        return -1.0;
-    }
-    float dot_product = 0.0, norm_a = 0.0, norm_b = 0.0;
-    for (size_t i = 0; i < vec1.dimension; i++) {
-        dot_product += vec1.data[i] * vec2.data[i];
-        norm_a += vec1.data[i] * vec1.data[i];
-        norm_b += vec2.data[i] * vec2.data[i];
-    }
-    return dot_product / (sqrt(norm_a) * sqrt(norm_b));
+void vector_db_set_wal(VectorDatabase* db, WAL* wal) {
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    db->wal = wal;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
 }
 
 /**
- * @brief Calculate the Euclidean distance between two vectors.
+ * @brief Apply one write-ahead log record to the database.
  * 
- * @param vec1 The first vector.
- * @param vec2 The second vector.
- * @return float The Euclidean distance, or -1.0 if the dimensions do not match.
+ * Inserts of a UUID that is already stored become updates, and updates or deletes of an unknown
+ * UUID are skipped, so a record that already made it into the snapshot is applied harmlessly.
+ *
+ * @param db Pointer to the vector database.
+ * @param type Kind of mutation.
+ * @param uuid UUID of the vector.
+ * @param data Components (NULL for deletes).
+ * @param element_type Element type of data.
+ * @param dimension Number of components (0 for deletes).
  */
-float euclidean_distance(Vector vec1, Vector vec2) {
-    if (vec1.dimension != vec2.dimension) {
-        fprintf(stderr, "Vectors have different dimensions\n");
-        return -1.0;
+void vector_db_apply_wal_record(VectorDatabase* db, WALRecordType type, const char* uuid, const void* data,
+                                VectorElementType element_type, size_t dimension) {
+    size_t index = vector_db_find_index(db, uuid);
+
+    if (type == WAL_RECORD_DELETE) {
+        if (index != (size_t)-1) {
+            vector_db_delete(db, index);
+        }
+        return;
     }
-    float sum = 0.0;
-    for (size_t i = 0; i < vec1.dimension; i++) {
-        float diff = vec1.data[i] - vec2.data[i];
-        sum += diff * diff;
+
+    Vector vec;
+    strncpy(vec.uuid, uuid, UUID_SIZE - 1);
+    vec.uuid[UUID_SIZE - 1] = '\0';
+    vec.dimension = dimension;
+    vec.type = element_type;
+    vec.data = (void*)data;
+    if (index != (size_t)-1) {
+        vector_db_update(db, index, vec);
+    } else if (type == WAL_RECORD_INSERT) {
+        vector_db_insert(db, vec);
     }
-    return sqrt(sum);
 }
 
 /**
- * @brief Calculate the dot product of two vectors.
+ * @brief Replay callback applying a record to the database passed as context.
+ *
+ * @param ctx Pointer to the vector database.
+ * @param type Kind of mutation.
+ * @param uuid UUID of the vector.
+ * @param data Components (NULL for deletes).
+ * @param element_type Element type of data.
+ * @param dimension Number of components (0 for deletes).
+ */
+static void vector_db_replay_record(void* ctx, WALRecordType type, const char* uuid, const void* data,
+                                    VectorElementType element_type, size_t dimension) {
+    vector_db_apply_wal_record((VectorDatabase*)ctx, type, uuid, data, element_type, dimension);
+}
+
+/**
+ * @brief Apply the records of a write-ahead log file to the database.
  * 
- * @param vec1 The first vector.
- * @param vec2 The second vector.
- * @return float The dot product, or -1.0 if the dimensions do not match.
+ * @param db Pointer to the vector database.
+ * @param filename The name of the log file.
+ * @return size_t The number of records replayed, or (size_t)-1 on failure.
  */
-float dot_product(Vector vec1, Vector vec2) {
-    if (vec1.dimension != vec2.dimension) {
-        fprintf(stderr, "Vectors have different dimensions\n");
-        return -1.0;
-    }
-    float result = 0.0;
-    for (size_t i = 0; i < vec1.dimension; i++) {
-        result += vec1.data[i] * vec2.data[i];
+size_t vector_db_replay_wal(VectorDatabase* db, const char* filename) {
+    if (db->wal) {
+        fprintf(stderr, "Cannot replay a write-ahead log while logging\n");
+        return (size_t)-1;
     }
-    return result;
+    return wal_replay(filename, vector_db_replay_record, db);
 }
 
 /**
- * @brief Compare two double values (for use with qsort).
+ * @brief Reclaim tombstoned slots by moving the last live vectors into them.
  * 
- * @param a Pointer to the first double value.
- * @param b Pointer to the second double value.
- * @return int -1 if the first value is less, 1 if the first value is greater, 0 if they are equal.
+ * Trailing tombstones are dropped first; each remaining hole is then filled with the vector
+ * stored in the last slot. The UUID index and the KD-tree are remapped while the lock is held,
+ * so readers never observe a half-moved vector.
+ *
+ * @param db Pointer to the vector database.
+ * @param max_moves The maximum number of vectors to move in this step.
+ * @return size_t The number of tombstones reclaimed.
  */
-int compare(const void* a, const void* b) {
+size_t vector_db_compact_step(VectorDatabase* db, size_t max_moves) {
+    size_t reclaimed = 0;
+    size_t moves = 0;
+
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    while (db->deleted_count > 0) {
+        // Drop tombstones at the end of the array, they need no move
+        while (db->size > 0 && vector_storage_is_deleted(db->storage, db->size - 1)) {
+            vector_storage_set_deleted(db->storage, db->size - 1, 0);
+            db->size--;
+            db->deleted_count--;
+            reclaimed++;
+        }
+        if (db->deleted_count == 0 || moves >= max_moves) {
+            break;
+        }
+
+        // The last slot is live here, so a hole exists below it
+        size_t hole = db->compact_cursor;
+        while (!vector_storage_is_deleted(db->storage, hole)) {
+            hole++;
+        }
+        size_t last = db->size - 1;
+        Vector* dst = vector_storage_slot(db->storage, hole);
+        Vector* src = vector_storage_slot(db->storage, last);
+        // The last slot is copied without promoting it, since it becomes a tombstone
+        void* dst_data = vector_storage_data_for_write(db->storage, hole);
+        if (!dst_data || vector_storage_copy_out(db->storage, last, 0, dst_data, db->storage->vector_bytes) != 0) {
+            break;
+        }
+        memcpy(dst->uuid, src->uuid, UUID_SIZE);
+        if (db->quantizer) {
+            scalar_quantizer_move(db->quantizer, hole, last);
+        }
+        if (db->pq && last < db->pq->encoded) {
+            pq_index_move(db->pq, hole, last);
+        } else if (db->pq && hole < db->pq->encoded) {
+            pq_index_encode(db->pq, hole, db->element_type, dst_data); // Not reached by the encoder yet
+        }
+        uuid_index_remap(db->uuid_index, dst->uuid, last, hole);
+        kdtree_remap(db->kdtree, vector_db_kd_point(db, dst_data), last, hole);
+        if (db->forest) {
+            kd_forest_remap(db->forest, last, hole);
+        }
+        if (db->hnsw) {
+            hnsw_remap(db->hnsw, last, hole);
+        }
+        if (db->ivf) {
+            ivf_index_remap(db->ivf, last, hole);
+        }
+        if (db->diskann) {
+            diskann_remap(db->diskann, last, hole);
+        }
+        vector_storage_set_deleted(db->storage, hole, 0);
+        vector_storage_set_deleted(db->storage, last, 1);
+
+        // The tombstone now sits at the end and is dropped on the next iteration
+        db->compact_cursor = hole + 1;
+        moves++;
+    }
+    if (db->deleted_count == 0) {
+        db->compact_cursor = db->size;
+    }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return reclaimed;
+}
+
+/**
+ * @brief Round a file offset up to a multiple of the alignment.
+ * 
+ * @param value The offset to round.
+ * @param alignment The alignment, in bytes.
+ * @return size_t The aligned offset.
+ */
+static size_t vector_db_align(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * @struct VectorDBFileWriter
+ * @brief Buffered writer over a raw file descriptor.
+ *
+ * Used by the snapshot child process, where only async-signal-safe calls are allowed, so it
+ * neither allocates nor goes through stdio.
+ */
+typedef struct VectorDBFileWriter {
+    int fd;                             /**< Destination file */
+    size_t used;                        /**< Bytes pending in buffer */
+    size_t offset;                      /**< File offset reached once buffer is written */
+    int failed;                         /**< Set once a write failed */
+    char buffer[VECTOR_DB_FILE_WRITE_BUFFER];
+} VectorDBFileWriter;
+
+/**
+ * @brief Write the pending bytes of a writer.
+ * 
+ * @param writer Writer to flush.
+ */
+static void vector_db_writer_flush(VectorDBFileWriter* writer) {
+    size_t done = 0;
+    while (!writer->failed && done < writer->used) {
+        ssize_t written = write(writer->fd, writer->buffer + done, writer->used - done);
+        if (written < 0 && errno != EINTR) {
+            writer->failed = 1;
+        } else if (written > 0) {
+            done += (size_t)written;
+        }
+    }
+    writer->used = 0;
+}
+
+/**
+ * @brief Append bytes to a writer, or zeros if data is NULL.
+ * 
+ * @param writer Writer to append to.
+ * @param data Bytes to append, or NULL for padding.
+ * @param length Number of bytes.
+ */
+static void vector_db_writer_put(VectorDBFileWriter* writer, const void* data, size_t length) {
+    const char* bytes = (const char*)data;
+    while (length > 0 && !writer->failed) {
+        size_t room = sizeof(writer->buffer) - writer->used;
+        size_t n = length < room ? length : room;
+        if (bytes) {
+            memcpy(writer->buffer + writer->used, bytes, n);
+            bytes += n;
+        } else {
+            memset(writer->buffer + writer->used, 0, n);
+        }
+        writer->used += n;
+        writer->offset += n;
+        length -= n;
+        if (writer->used == sizeof(writer->buffer)) {
+            vector_db_writer_flush(writer);
+        }
+    }
+}
+
+/**
+ * @brief Append the components of a slot to a writer.
+ * 
+ * Cold slots of tiered storage are copied straight into the write buffer without promoting them.
+ *
+ * @param writer Writer to append to.
+ * @param db Pointer to the vector database.
+ * @param slot Slot of the vector.
+ */
+static void vector_db_writer_put_slot(VectorDBFileWriter* writer, const VectorDatabase* db, size_t slot) {
+    size_t length = db->storage->vector_bytes;
+    if (!db->storage->tier) {
+        vector_db_writer_put(writer, vector_storage_data(db->storage, slot), length);
+        return;
+    }
+    size_t offset = 0;
+    while (offset < length && !writer->failed) {
+        size_t room = sizeof(writer->buffer) - writer->used;
+        size_t n = length - offset < room ? length - offset : room;
+        if (vector_storage_copy_out(db->storage, slot, offset, writer->buffer + writer->used, n) != 0) {
+            writer->failed = 1;
+        }
+        writer->used += n;
+        writer->offset += n;
+        offset += n;
+        if (writer->used == sizeof(writer->buffer)) {
+            vector_db_writer_flush(writer);
+        }
+    }
+}
+
+/**
+ * @brief Extend a checksum with the components of a slot.
+ * 
+ * Cold slots of tiered storage are read in pieces through a static buffer, without promoting
+ * them, so this can run in a forked child. In-process saves hold vector_db_snapshot_mutex, so the
+ * buffer is never shared.
+ *
+ * @param db Pointer to the vector database.
+ * @param slot Slot of the vector.
+ * @param crc Checksum of the data seen so far.
+ * @param failed Set to non-zero if a cold slot could not be read.
+ * @return uint32_t The updated checksum.
+ */
+static uint32_t vector_db_crc_slot(const VectorDatabase* db, size_t slot, uint32_t crc, int* failed) {
+    static unsigned char scratch[VECTOR_DB_FILE_WRITE_BUFFER];
+    size_t length = db->storage->vector_bytes;
+    if (!db->storage->tier) {
+        return crc32c_update(crc, vector_storage_data(db->storage, slot), length);
+    }
+    for (size_t offset = 0; offset < length; offset += sizeof(scratch)) {
+        size_t n = length - offset < sizeof(scratch) ? length - offset : sizeof(scratch);
+        if (vector_storage_copy_out(db->storage, slot, offset, scratch, n) != 0) {
+            *failed = 1;
+        }
+        crc = crc32c_update(crc, scratch, n);
+    }
+    return crc;
+}
+
+/**
+ * @brief Checksum the records of one file block from memory.
+ * 
+ * Produces the same value as vector_db_file_block_crc on the written file.
+ *
+ * @param db Pointer to the vector database.
+ * @param header The header being written.
+ * @param first Slot of the first record of the block.
+ * @param end One past the slot of the last record of the block.
+ * @param failed Set to non-zero if a cold slot could not be read.
+ * @return uint32_t The block checksum.
+ */
+static uint32_t vector_db_block_crc(const VectorDatabase* db, const VectorDBFileHeader* header, size_t first, size_t end,
+                                    int* failed) {
+    char uuid[VECTOR_DB_FILE_UUID_STRIDE];
+    uint32_t crc = 0;
+    for (size_t i = first; i < end; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            memset(uuid, 0, sizeof(uuid));
+            memcpy(uuid, vector_storage_slot(db->storage, i)->uuid, UUID_SIZE);
+            crc = crc32c_update(crc, uuid, sizeof(uuid));
+        }
+    }
+    for (size_t i = first; i < end; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            crc = vector_db_crc_slot(db, i, crc, failed);
+        }
+    }
+    if (header->codes_offset != 0) {
+        for (size_t i = first; i < end; ++i) {
+            if (!vector_storage_is_deleted(db->storage, i)) {
+                crc = crc32c_update(crc, db->quantizer->codes + i * header->code_stride, header->code_stride);
+            }
+        }
+        for (size_t i = first; i < end; ++i) {
+            if (!vector_storage_is_deleted(db->storage, i)) {
+                crc = crc32c_update(crc, &db->quantizer->norms[i], sizeof(float));
+            }
+        }
+    }
+    if (header->pq_offset != 0) {
+        for (size_t i = first; i < end; ++i) {
+            if (!vector_storage_is_deleted(db->storage, i)) {
+                crc = crc32c_update(crc, db->pq->codes + i * header->pq_subspaces, header->pq_subspaces);
+            }
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Identify a saved file by its checksums.
+ * 
+ * The header checksum covers the record count and layout, and the checksum of the block table
+ * covers every record, so a file saved from other contents gets another tag. Indexes saved next
+ * to the file carry it and are only loaded with the file they were written with.
+ *
+ * @param header_crc The header checksum of the file.
+ * @param blocks_crc The CRC32C of its block table.
+ * @return uint64_t The tag.
+ */
+static uint64_t vector_db_file_tag(uint32_t header_crc, uint32_t blocks_crc) {
+    return (uint64_t)header_crc << 32 | blocks_crc;
+}
+
+/**
+ * @brief Serialize the database in the mapped layout.
+ * 
+ * Layout: a header and the block table, then every UUID at a fixed stride, then every
+ * vector at a fixed stride, then the quantized codes and the PQ index if the database has trained
+ * ones, each section starting on a page boundary. Tombstones are not written. The header, the
+ * trained tables and every block of VECTOR_DB_FILE_BLOCK_RECORDS records carry a CRC32C, so a torn
+ * or corrupted file is detected on load. Takes no lock and makes no allocation, so it can run in
+ * a forked child.
+ *
+ * @param db Pointer to the vector database.
+ * @param fd The file to write to, positioned at offset 0.
+ * @param alignment The section alignment, in bytes.
+ * @param tag Set to the identifier of the written file, see vector_db_file_tag.
+ * @return int 0 on success, -1 on failure.
+ */
+static int vector_db_write_file(const VectorDatabase* db, int fd, size_t alignment, uint64_t* tag) {
+    static VectorDBFileWriter writer;
+    writer.fd = fd;
+    writer.used = 0;
+    writer.offset = 0;
+    writer.failed = 0;
+
+    size_t count = db->size - db->deleted_count;
+    VectorDBFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VECTOR_DB_FILE_MAGIC, sizeof(header.magic));
+    header.version = VECTOR_DB_FILE_VERSION;
+    header.header_size = sizeof(VectorDBFileHeader);
+    header.count = count;
+    header.vector_size = db->vector_size;
+    header.block_offset = vector_db_align(sizeof(header), sizeof(uint64_t));
+    header.block_records = VECTOR_DB_FILE_BLOCK_RECORDS;
+    size_t block_count = (count + VECTOR_DB_FILE_BLOCK_RECORDS - 1) / VECTOR_DB_FILE_BLOCK_RECORDS;
+    header.uuid_offset = vector_db_align(header.block_offset + block_count * sizeof(VectorDBFileBlock), alignment);
+    header.uuid_stride = VECTOR_DB_FILE_UUID_STRIDE;
+    header.data_offset = vector_db_align(header.uuid_offset + count * VECTOR_DB_FILE_UUID_STRIDE, alignment);
+    header.data_stride = db->storage->vector_bytes;
+    header.element_type = (uint32_t)db->element_type;
+    const ScalarQuantizer* sq = db->quantizer;
+    if (sq && sq->trained_count > 0) {
+        header.codes_offset = vector_db_align(header.data_offset + count * header.data_stride, alignment);
+        header.code_stride = sq->code_stride;
+    }
+    const PQIndex* pq = db->pq;
+    if (pq && pq->trained && pq->encoded >= db->size) {
+        size_t previous_end = header.codes_offset != 0
+            ? header.codes_offset + count * (header.code_stride + sizeof(float)) + 2 * sq->dimension * sizeof(float)
+            : header.data_offset + count * header.data_stride;
+        header.pq_offset = vector_db_align(previous_end, alignment);
+        header.pq_subspaces = pq->subspaces;
+    }
+    if (header.codes_offset != 0) {
+        header.tables_crc = crc32c_update(header.tables_crc, sq->offset, sq->dimension * sizeof(float));
+        header.tables_crc = crc32c_update(header.tables_crc, sq->scale, sq->dimension * sizeof(float));
+    }
+    if (header.pq_offset != 0) {
+        header.tables_crc = crc32c_update(header.tables_crc, pq->centroids, PQ_INDEX_CENTROIDS * pq->dimension * sizeof(float));
+    }
+    header.header_crc = crc32c_update(0, &header, sizeof(header));
+    vector_db_writer_put(&writer, &header, sizeof(header));
+
+    // Block table, checksummed from memory ahead of the sections
+    vector_db_writer_put(&writer, NULL, header.block_offset - writer.offset);
+    size_t slot = 0;
+    uint32_t blocks_crc = 0;
+    for (size_t b = 0; b < block_count; ++b) {
+        VectorDBFileBlock block;
+        block.count = 0;
+        size_t first = slot;
+        while (block.count < VECTOR_DB_FILE_BLOCK_RECORDS && slot < db->size) {
+            if (!vector_storage_is_deleted(db->storage, slot)) {
+                block.count++;
+            }
+            slot++;
+        }
+        block.crc = vector_db_block_crc(db, &header, first, slot, &writer.failed);
+        blocks_crc = crc32c_update(blocks_crc, &block, sizeof(block));
+        vector_db_writer_put(&writer, &block, sizeof(block));
+    }
+    *tag = vector_db_file_tag(header.header_crc, blocks_crc);
+
+    // UUID section
+    char uuid[VECTOR_DB_FILE_UUID_STRIDE];
+    vector_db_writer_put(&writer, NULL, header.uuid_offset - writer.offset);
+    for (size_t i = 0; i < db->size; ++i) {
+        if (vector_storage_is_deleted(db->storage, i)) {
+            continue;
+        }
+        memset(uuid, 0, sizeof(uuid));
+        memcpy(uuid, vector_storage_slot(db->storage, i)->uuid, UUID_SIZE);
+        vector_db_writer_put(&writer, uuid, sizeof(uuid));
+    }
+
+    // Data section
+    vector_db_writer_put(&writer, NULL, header.data_offset - writer.offset);
+    for (size_t i = 0; i < db->size; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            vector_db_writer_put_slot(&writer, db, i);
+        }
+    }
+
+    // Quantized code section: codes, their norms, then the per-dimension offsets and scales
+    if (header.codes_offset != 0) {
+        vector_db_writer_put(&writer, NULL, header.codes_offset - writer.offset);
+        for (size_t i = 0; i < db->size; ++i) {
+            if (!vector_storage_is_deleted(db->storage, i)) {
+                vector_db_writer_put(&writer, sq->codes + i * sq->code_stride, sq->code_stride);
+            }
+        }
+        for (size_t i = 0; i < db->size; ++i) {
+            if (!vector_storage_is_deleted(db->storage, i)) {
+                vector_db_writer_put(&writer, &sq->norms[i], sizeof(float));
+            }
+        }
+        vector_db_writer_put(&writer, sq->offset, sq->dimension * sizeof(float));
+        vector_db_writer_put(&writer, sq->scale, sq->dimension * sizeof(float));
+    }
+
+    // PQ index section: the codebooks, then the codes
+    if (header.pq_offset != 0) {
+        vector_db_writer_put(&writer, NULL, header.pq_offset - writer.offset);
+        vector_db_writer_put(&writer, pq->centroids, PQ_INDEX_CENTROIDS * pq->dimension * sizeof(float));
+        for (size_t i = 0; i < db->size; ++i) {
+            if (!vector_storage_is_deleted(db->storage, i)) {
+                vector_db_writer_put(&writer, pq->codes + i * pq->subspaces, pq->subspaces);
+            }
+        }
+    }
+    vector_db_writer_flush(&writer);
+    return writer.failed ? -1 : 0;
+}
+
+/**
+ * @brief Rebuild the KD-Tree as a balanced tree over the live vectors.
+ * 
+ * Writes keep the tree weight-balanced, within about log2(n) / log2(1 / KDTREE_BALANCE_ALPHA) levels;
+ * a rebuild brings it back to a complete tree of depth log2(n). Searches wait for the rebuild.
+ *
+ * @param db Pointer to the vector database.
+ * @return size_t The number of vectors indexed, or (size_t)-1 on failure.
+ */
+size_t vector_db_rebuild_kdtree(VectorDatabase* db) {
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    size_t count = vector_db_build_kdtree(db);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return count;
+}
+
+/**
+ * @brief Move the components to a cold file and keep a bounded hot set in memory.
+ * 
+ * @param db Pointer to the vector database.
+ * @param cold_filename Path of the cold file.
+ * @param hot_limit Number of vectors kept in memory.
+ * @return int 0 on success, -1 on failure.
+ */
+int vector_db_enable_tiering(VectorDatabase* db, const char* cold_filename, size_t hot_limit) {
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    int status = vector_storage_enable_tier(db->storage, cold_filename, db->size, hot_limit);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return status;
+}
+
+/**
+ * @brief Evict vectors not referenced recently once the hot set is full.
+ * 
+ * A snapshot child reads cold vectors from the shared cold file, which is not copy-on-write, so
+ * write-backs wait until no save is running.
+ *
+ * @param db Pointer to the vector database.
+ * @param max_demotions Maximum number of vectors evicted in this pass.
+ * @return size_t Number of vectors evicted.
+ */
+size_t vector_db_demote(VectorDatabase* db, size_t max_demotions) {
+    if (!db->storage->tier || pthread_mutex_trylock(&db->save_mutex) != 0) {
+        return 0;
+    }
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    size_t demoted = vector_storage_demote(db->storage, max_demotions);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    pthread_mutex_unlock(&db->save_mutex);
+
+    if (demoted == (size_t)-1) {
+        fprintf(stderr, "Failed to write back vectors to the cold tier\n");
+        return 0;
+    }
+    return demoted;
+}
+
+/**
+ * @brief Write the database file and, if the database has them, its HNSW graph and Vamana map files.
+ * 
+ * Makes no allocation, so it can run in a forked child. Writes through static buffers, so calls
+ * from the same process must hold vector_db_snapshot_mutex.
+ *
+ * @param db Pointer to the vector database.
+ * @param fd The database file, positioned at offset 0.
+ * @param graph_fd The graph file, positioned at offset 0, or -1 to skip the graph.
+ * @param map_fd The Vamana map file, positioned at offset 0, or -1 to skip the map.
+ * @param index_map Index of every slot in the saved file, SIZE_MAX for tombstones (size entries).
+ * @param alignment The section alignment, in bytes.
+ * @return int 0 on success, 1 if the database file failed, otherwise VECTOR_DB_SNAPSHOT_GRAPH_FAILED
+ *             and VECTOR_DB_SNAPSHOT_MAP_FAILED for the side files that failed.
+ */
+static int vector_db_write_snapshot(const VectorDatabase* db, int fd, int graph_fd, int map_fd, const size_t* index_map,
+                                    size_t alignment) {
+    uint64_t tag;
+    if (vector_db_write_file(db, fd, alignment, &tag) != 0) {
+        return 1;
+    }
+    int result = 0;
+    if (graph_fd >= 0 && hnsw_write(db->hnsw, graph_fd, index_map, db->size, tag) != 0) {
+        result |= VECTOR_DB_SNAPSHOT_GRAPH_FAILED;
+    }
+    if (map_fd >= 0 && diskann_write_map(db->diskann, map_fd, index_map, db->size, tag) != 0) {
+        result |= VECTOR_DB_SNAPSHOT_MAP_FAILED;
+    }
+    return result;
+}
+
+/**
+ * @brief Open the temporary file of an index saved next to the database.
+ * 
+ * @param tmp_filename Name of the temporary file.
+ * @param what Name of the index, for the error message.
+ * @return int The file descriptor, or -1 if the index is not saved.
+ */
+static int vector_db_open_side_file(const char* tmp_filename, const char* what) {
+    int fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s, the %s is not saved\n", tmp_filename, what);
+    }
+    return fd;
+}
+
+/**
+ * @brief Sync, close and rename into place the temporary file of an index saved next to the database.
+ * 
+ * @param fd The temporary file, or -1 if the index was not saved.
+ * @param db_saved Non-zero if the database file was written.
+ * @param written Non-zero if the index was written.
+ * @param tmp_filename Name of the temporary file, unlinked in any case.
+ * @param filename Name of the index file.
+ * @param what Name of the index, for the error message.
+ * @return int 0 if the index file is in place, -1 otherwise.
+ */
+static int vector_db_finish_side_file(int fd, int db_saved, int written, const char* tmp_filename,
+                                      const char* filename, const char* what) {
+    if (fd < 0) {
+        return -1;
+    }
+    int ok = written && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (db_saved && (!ok || rename(tmp_filename, filename) != 0)) {
+        fprintf(stderr, "Failed to write %s file %s\n", what, filename);
+        ok = 0;
+    }
+    unlink(tmp_filename);
+    return db_saved && ok ? 0 : -1;
+}
+
+/**
+ * @brief Save the vector database to a file.
+ * 
+ * The database lock is only held while the process forks: the child inherits a copy-on-write
+ * image of the database as of that instant and serializes it, while the parent keeps serving
+ * reads and writes. Pages modified in the meantime are copied by the kernel, so the extra memory
+ * is bounded by what the writers touch during the snapshot. If fork fails the file is written
+ * in-process under the lock instead.
+ *
+ * The file is written next to the target and renamed over it, so a mapping of the previous file
+ * stays valid. The write-ahead log is then cut at the sequence number captured with the image, so
+ * mutations logged during the snapshot are kept. Concurrent saves are serialized. The HNSW graph,
+ * if any, is written from the same image to "<filename>.hnsw" and the dataset index of every
+ * Vamana graph node to "<filename>.diskann.map"; both are renamed into place first, and one that
+ * fails to save is dropped without failing the save.
+ *
+ * @param db Pointer to the vector database.
+ * @param filename The name of the file to save the database to.
+ */
+void vector_db_save(VectorDatabase* db, const char* filename) {
+    size_t tmp_length = strlen(filename) + sizeof(".diskann.map.tmp");
+    char* tmp_filename = (char*)malloc(5 * tmp_length);
+    if (!tmp_filename) {
+        fprintf(stderr, "Failed to allocate memory for file name\n");
+        return;
+    }
+    char* graph_filename = tmp_filename + tmp_length;
+    char* graph_tmp_filename = graph_filename + tmp_length;
+    char* map_filename = graph_tmp_filename + tmp_length;
+    char* map_tmp_filename = map_filename + tmp_length;
+    snprintf(tmp_filename, tmp_length, "%s.tmp", filename);
+    snprintf(graph_filename, tmp_length, "%s.hnsw", filename);
+    snprintf(graph_tmp_filename, tmp_length, "%s.hnsw.tmp", filename);
+    snprintf(map_filename, tmp_length, "%s.diskann.map", filename);
+    snprintf(map_tmp_filename, tmp_length, "%s.diskann.map.tmp", filename);
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t alignment = page_size > VECTOR_DB_FILE_MIN_ALIGNMENT ? (size_t)page_size : VECTOR_DB_FILE_MIN_ALIGNMENT;
+
+    pthread_mutex_lock(&db->save_mutex);
+    int fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Failed to open file for writing");
+        pthread_mutex_unlock(&db->save_mutex);
+        free(tmp_filename);
+        return;
+    }
+
+    crc32c_update(0, NULL, 0);  // Build the checksum tables before the child needs them
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t count = db->size - db->deleted_count;
+    size_t dirty_writes = db->dirty_writes;
+    uint64_t wal_lsn = db->wal ? wal_next_lsn(db->wal) : 0;
+
+    // The saved file is compacted, so the indexes are written with the rank of every live slot
+    size_t* index_map = NULL;
+    int graph_fd = -1;
+    int map_fd = -1;
+    if (db->hnsw || db->diskann) {
+        index_map = (size_t*)malloc((db->size > 0 ? db->size : 1) * sizeof(size_t));
+        for (size_t i = 0, rank = 0; index_map && i < db->size; ++i) {
+            index_map[i] = vector_storage_is_deleted(db->storage, i) ? SIZE_MAX : rank++;
+        }
+        if (index_map && db->hnsw) {
+            graph_fd = vector_db_open_side_file(graph_tmp_filename, "HNSW graph");
+        }
+        if (index_map && db->diskann) {
+            map_fd = vector_db_open_side_file(map_tmp_filename, "Vamana map");
+        }
+    }
+    int result;
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(vector_db_write_snapshot(db, fd, graph_fd, map_fd, index_map, alignment));
+    } else if (pid < 0) {
+        perror("Failed to fork snapshot writer, saving in-process");
+        // Every shard saves on its own, and the writer buffers are shared by the whole process
+        pthread_mutex_lock(&vector_db_snapshot_mutex);
+        result = vector_db_write_snapshot(db, fd, graph_fd, map_fd, index_map, alignment);
+        pthread_mutex_unlock(&vector_db_snapshot_mutex);
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+    } else {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        int status = 0;
+        pid_t waited;
+        do {
+            waited = waitpid(pid, &status, 0);
+        } while (waited < 0 && errno == EINTR);
+        result = waited == pid && WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+    free(index_map);
+
+    int ok = result != 1 && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    int graph_saved = vector_db_finish_side_file(graph_fd, ok, !(result & VECTOR_DB_SNAPSHOT_GRAPH_FAILED),
+                                                 graph_tmp_filename, graph_filename, "HNSW graph") == 0;
+    int map_saved = vector_db_finish_side_file(map_fd, ok, !(result & VECTOR_DB_SNAPSHOT_MAP_FAILED),
+                                               map_tmp_filename, map_filename, "Vamana map") == 0;
+    if (!ok || rename(tmp_filename, filename) != 0) {
+        perror("Failed to write database file");
+        unlink(tmp_filename);
+        pthread_mutex_unlock(&db->save_mutex);
+        free(tmp_filename);
+        return;
+    }
+    // Side files left from an earlier save no longer match the file
+    if (!graph_saved) {
+        unlink(graph_filename);
+    }
+    if (!map_saved) {
+        unlink(map_filename);
+    }
+    if (db->wal) {
+        wal_checkpoint(db->wal, wal_lsn);
+    }
+
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    db->dirty_writes -= dirty_writes;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    pthread_mutex_unlock(&db->save_mutex);
+    free(tmp_filename);
+    printf("Database of size %zu saved to %s\n", count, filename);
+}
+
+/**
+ * @brief Number of mutations not yet captured by a saved file.
+ * 
+ * @param db Pointer to the vector database.
+ * @return size_t The number of inserts, updates and deletes since the last save.
+ */
+size_t vector_db_dirty_writes(VectorDatabase* db) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t dirty_writes = db->dirty_writes;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return dirty_writes;
+}
+
+/**
+ * @brief Number of live vectors in the database.
+ * 
+ * @param db Pointer to the vector database.
+ * @return size_t The number of stored vectors, tombstones excluded.
+ */
+size_t vector_db_count(VectorDatabase* db) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t count = db->size - db->deleted_count;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return count;
+}
+
+/**
+ * @brief Load a database file written before the mapped layout existed.
+ * 
+ * Every record is read and converted into its storage slot and the UUID index is rebuilt
+ * in a single pass over a table sized for the whole file. Records always hold float64 components.
+ *
+ * @param filename The name of the file to load the database from.
+ * @param dimension The dimension of the KD-tree.
+ * @param vector_size The number of components of every stored vector.
+ * @param element_type The storage type of every component.
+ * @return VectorDatabase* Pointer to the loaded vector database, or NULL on failure.
+ */
+static VectorDatabase* vector_db_load_legacy(const char* filename, size_t dimension, size_t vector_size,
+                                             VectorElementType element_type) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        perror("Failed to open file for reading");
+        return NULL;
+    }
+    size_t count = 0;
+    if (fread(&count, sizeof(size_t), 1, file) != 1) {
+        fprintf(stderr, "Failed to read database header\n");
+        fclose(file);
+        return NULL;
+    }
+
+    VectorDatabase* db = vector_db_init(count, dimension, vector_size, element_type);
+    if (!db) {
+        fclose(file);
+        return NULL;
+    }
+
+    double* record = (double*)malloc(vector_size * sizeof(double));
+    if (!record || uuid_index_reserve(db->uuid_index, count) != 0) {
+        free(record);
+        vector_db_free(db);
+        fclose(file);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        Vector* vec = vector_storage_slot(db->storage, db->size);
+        size_t record_dimension = 0;
+        if (fread(vec->uuid, sizeof(char), UUID_SIZE, file) != UUID_SIZE ||
+            fread(&record_dimension, sizeof(size_t), 1, file) != 1) {
+            fprintf(stderr, "Truncated record at index %zu\n", i);
+            free(record);
+            vector_db_free(db);
+            fclose(file);
+            return NULL;
+        }
+        vec->uuid[UUID_SIZE - 1] = '\0';
+        if (record_dimension != vector_size) {
+            fprintf(stderr, "Vector at index %zu has dimension %zu, expected %zu\n", i, record_dimension, vector_size);
+            free(record);
+            vector_db_free(db);
+            fclose(file);
+            return NULL;
+        }
+        if (fread(record, sizeof(double), vector_size, file) != vector_size) {
+            fprintf(stderr, "Truncated record at index %zu\n", i);
+            free(record);
+            vector_db_free(db);
+            fclose(file);
+            return NULL;
+        }
+        if (uuid_index_insert(db->uuid_index, vec->uuid, db->size) != 0) {
+            fprintf(stderr, "Skipping duplicate UUID %s at index %zu\n", vec->uuid, i);
+            continue;
+        }
+        vector_element_convert(element_type, vec->data, VECTOR_ELEMENT_FLOAT64, record, vector_size);
+        db->size++;
+    }
+
+    free(record);
+    fclose(file);
+    if (vector_db_build_kdtree(db) == (size_t)-1) {
+        vector_db_free(db);
+        return NULL;
+    }
+    printf("Database loaded with size: %zu, capacity: %zu\n", db->size, db->capacity);
+    return db;
+}
+
+/**
+ * @brief Check that a section of a file ends within a limit, without overflowing on hostile values.
+ *
+ * @param offset Offset of the section.
+ * @param count Number of records in the section.
+ * @param stride Bytes per record.
+ * @param extra Bytes after the records.
+ * @param limit Offset the section must end at or before.
+ * @return int 1 if offset + count * stride + extra <= limit, 0 otherwise.
+ */
+static int vector_db_section_fits(uint64_t offset, uint64_t count, uint64_t stride, uint64_t extra, uint64_t limit) {
+    if (offset > limit || extra > limit - offset) {
+        return 0;
+    }
+    return stride == 0 || count <= (limit - offset - extra) / stride;
+}
+
+/**
+ * @brief Read the quantized code section of a mapped database file.
+ * 
+ * The codes are copied to the heap so that they can grow with the database. A missing or invalid
+ * section is not an error: the quantizer is retrained when quantization is enabled.
+ *
+ * @param header The validated file header.
+ * @param base Base of the file mapping.
+ * @param file_size Size of the file in bytes.
+ * @return ScalarQuantizer* The restored quantizer, or NULL if the file holds no usable codes.
+ */
+static ScalarQuantizer* vector_db_load_codes(const VectorDBFileHeader* header, const char* base, size_t file_size) {
+    if (header->version < 3 || header->header_size < offsetof(VectorDBFileHeader, code_stride) + sizeof(uint64_t) ||
+        header->codes_offset == 0 || header->count == 0) {
+        return NULL;
+    }
+    ScalarQuantizer* sq = scalar_quantizer_create((size_t)header->vector_size);
+    if (!sq) {
+        return NULL;
+    }
+    size_t count = (size_t)header->count;
+    size_t codes_length = count * sq->code_stride;
+    size_t ranges_length = 2 * sq->dimension * sizeof(float);
+    if (header->code_stride != sq->code_stride || header->codes_offset % sizeof(float) != 0 ||
+        !vector_db_section_fits(header->codes_offset, count, sq->code_stride + sizeof(float), ranges_length, file_size)) {
+        fprintf(stderr, "Ignoring invalid quantized code section\n");
+        scalar_quantizer_free(sq);
+        return NULL;
+    }
+
+    const char* codes = base + header->codes_offset;
+    const float* norms = (const float*)(codes + codes_length);
+    const float* offset = norms + count;
+    const float* scale = offset + sq->dimension;
+    if (scalar_quantizer_restore(sq, offset, scale, (const int8_t*)codes, norms, count) != 0) {
+        scalar_quantizer_free(sq);
+        return NULL;
+    }
+    return sq;
+}
+
+/**
+ * @brief Read the PQ index section of a mapped database file.
+ * 
+ * @param header The validated file header.
+ * @param base Base of the file mapping.
+ * @param file_size Size of the file in bytes.
+ * @return PQIndex* The restored index, or NULL if the file holds no usable index.
+ */
+static PQIndex* vector_db_load_pq(const VectorDBFileHeader* header, const char* base, size_t file_size) {
+    if (header->version < 4 || header->header_size < offsetof(VectorDBFileHeader, pq_subspaces) + sizeof(uint64_t) ||
+        header->pq_offset == 0) {
+        return NULL;
+    }
+    size_t centroids_length = PQ_INDEX_CENTROIDS * (size_t)header->vector_size * sizeof(float);
+    if (header->pq_subspaces == 0 || header->pq_subspaces > header->vector_size || header->pq_offset % sizeof(float) != 0 ||
+        !vector_db_section_fits(header->pq_offset, header->count, header->pq_subspaces, centroids_length, file_size)) {
+        fprintf(stderr, "Ignoring invalid PQ index section\n");
+        return NULL;
+    }
+    PQIndex* pq = pq_index_create((size_t)header->vector_size, (size_t)header->pq_subspaces);
+    if (pq && pq_index_restore(pq, (const float*)(base + header->pq_offset),
+                               (const uint8_t*)(base + header->pq_offset + centroids_length), (size_t)header->count) != 0) {
+        pq_index_free(pq);
+        return NULL;
+    }
+    return pq;
+}
+
+/**
+ * @struct VectorDBLoadJob
+ * @brief Work shared by the load threads; each thread takes the next unchecked block.
+ */
+typedef struct VectorDBLoadJob {
+    const VectorDBFileHeader* header; /**< Validated file header */
+    const char* base;                 /**< Base of the file mapping */
+    const VectorDBFileBlock* blocks;  /**< Block table, or NULL if the file has no checksums */
+    size_t block_records;             /**< Records per block */
+    size_t block_count;               /**< Number of blocks */
+    VectorStorage* storage;           /**< Heap storage to convert the records into, or NULL if mapped in place */
+    VectorElementType file_type;      /**< Element type of the data section */
+    size_t next_block;                /**< Next block to process, guarded by lock */
+    size_t corrupt_block;             /**< First block whose checksum failed, or SIZE_MAX */
+    pthread_mutex_t lock;             /**< Protects next_block and corrupt_block */
+} VectorDBLoadJob;
+
+/**
+ * @brief Checksum the records of one block of a mapped database file.
+ * 
+ * @param header The validated file header.
+ * @param base Base of the file mapping.
+ * @param first Index of the first record of the block.
+ * @param count Number of records in the block.
+ * @return uint32_t The block checksum.
+ */
+static uint32_t vector_db_file_block_crc(const VectorDBFileHeader* header, const char* base, size_t first, size_t count) {
+    uint32_t crc = crc32c_update(0, base + header->uuid_offset + first * header->uuid_stride, count * header->uuid_stride);
+    crc = crc32c_update(crc, base + header->data_offset + first * header->data_stride, count * header->data_stride);
+    if (header->codes_offset != 0) {
+        const char* norms = base + header->codes_offset + header->count * header->code_stride;
+        crc = crc32c_update(crc, base + header->codes_offset + first * header->code_stride, count * header->code_stride);
+        crc = crc32c_update(crc, norms + first * sizeof(float), count * sizeof(float));
+    }
+    if (header->pq_offset != 0) {
+        const char* codes = base + header->pq_offset + PQ_INDEX_CENTROIDS * header->vector_size * sizeof(float);
+        crc = crc32c_update(crc, codes + first * header->pq_subspaces, count * header->pq_subspaces);
+    }
+    return crc;
+}
+
+/**
+ * @brief Thread body verifying and converting blocks until none is left.
+ * 
+ * @param arg Pointer to the VectorDBLoadJob.
+ * @return void* NULL.
+ */
+static void* vector_db_load_thread(void* arg) {
+    VectorDBLoadJob* job = (VectorDBLoadJob*)arg;
+    const VectorDBFileHeader* header = job->header;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t b = job->next_block++;
+        pthread_mutex_unlock(&job->lock);
+        if (b >= job->block_count) {
+            break;
+        }
+
+        size_t first = b * job->block_records;
+        size_t count = (size_t)header->count - first < job->block_records ? (size_t)header->count - first : job->block_records;
+        if (job->blocks && vector_db_file_block_crc(header, job->base, first, count) != job->blocks[b].crc) {
+            pthread_mutex_lock(&job->lock);
+            if (b < job->corrupt_block) {
+                job->corrupt_block = b;
+            }
+            pthread_mutex_unlock(&job->lock);
+            continue;
+        }
+        for (size_t i = first; job->storage && i < first + count; ++i) {
+            Vector* vec = vector_storage_slot(job->storage, i);
+            memcpy(vec->uuid, job->base + header->uuid_offset + i * header->uuid_stride, UUID_SIZE);
+            vec->uuid[UUID_SIZE - 1] = '\0';
+            vector_element_convert(job->storage->element_type, vec->data, job->file_type,
+                                   job->base + header->data_offset + i * header->data_stride, (size_t)header->vector_size);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Verify the block checksums of a mapped file and convert its records, on every core.
+ * 
+ * @param job The load job, with its block range and destination set.
+ * @return int 0 on success, -1 if a block is corrupt or no thread could run.
+ */
+static int vector_db_load_blocks(VectorDBLoadJob* job) {
+    job->next_block = 0;
+    job->corrupt_block = SIZE_MAX;
+    if (pthread_mutex_init(&job->lock, NULL) != 0) {
+        return -1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = cpus > 1 ? (size_t)cpus : 1;
+    if (thread_count > job->block_count) {
+        thread_count = job->block_count;
+    }
+    pthread_t* threads = (pthread_t*)malloc((thread_count > 0 ? thread_count : 1) * sizeof(pthread_t));
+    size_t started = 0;
+    while (threads && started + 1 < thread_count &&
+           pthread_create(&threads[started], NULL, vector_db_load_thread, job) == 0) {
+        started++;
+    }
+    vector_db_load_thread(job); // The caller takes blocks too
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job->lock);
+    return job->corrupt_block == SIZE_MAX ? 0 : -1;
+}
+
+/**
+ * @brief Validate the checksums of a version 5 header, its block table and its trained tables.
+ * 
+ * @param header The file header, with offsets already checked against the file size.
+ * @param base Base of the file mapping.
+ * @param file_size Size of the file in bytes.
+ * @return const VectorDBFileBlock* The block table, or NULL if the file is invalid.
+ */
+static const VectorDBFileBlock* vector_db_check_file(const VectorDBFileHeader* header, const char* base, size_t file_size) {
+    VectorDBFileHeader copy = *header;
+    copy.header_crc = 0;
+    if (header->header_size != sizeof(VectorDBFileHeader) || crc32c_update(0, &copy, sizeof(copy)) != header->header_crc) {
+        fprintf(stderr, "Corrupt database file header\n");
+        return NULL;
+    }
+
+    size_t count = (size_t)header->count;
+    size_t block_records = header->block_records;
+    size_t block_count = block_records > 0 ? (count + block_records - 1) / block_records : 0;
+    size_t ranges_length = 2 * (size_t)header->vector_size * sizeof(float);
+    size_t centroids_length = PQ_INDEX_CENTROIDS * (size_t)header->vector_size * sizeof(float);
+    if (block_records == 0 || header->block_offset % sizeof(uint64_t) != 0 ||
+        !vector_db_section_fits(header->block_offset, block_count, sizeof(VectorDBFileBlock), 0, header->uuid_offset) ||
+        (header->codes_offset != 0 && (header->code_stride > file_size ||
+         !vector_db_section_fits(header->codes_offset, count, header->code_stride + sizeof(float), ranges_length, file_size))) ||
+        (header->pq_offset != 0 &&
+         !vector_db_section_fits(header->pq_offset, count, header->pq_subspaces, centroids_length, file_size))) {
+        fprintf(stderr, "Invalid database file layout\n");
+        return NULL;
+    }
+    size_t codes_end = header->codes_offset + count * (header->code_stride + sizeof(float)) + ranges_length;
+    const VectorDBFileBlock* blocks = (const VectorDBFileBlock*)(base + header->block_offset);
+    for (size_t b = 0; b < block_count; ++b) {
+        size_t expected = count - b * block_records < block_records ? count - b * block_records : block_records;
+        if (blocks[b].count != expected) {
+            fprintf(stderr, "Invalid record count in database file block %zu\n", b);
+            return NULL;
+        }
+    }
+
+    uint32_t tables_crc = 0;
+    if (header->codes_offset != 0) {
+        tables_crc = crc32c_update(tables_crc, base + codes_end - 2 * header->vector_size * sizeof(float),
+                                   2 * header->vector_size * sizeof(float));
+    }
+    if (header->pq_offset != 0) {
+        tables_crc = crc32c_update(tables_crc, base + header->pq_offset, centroids_length);
+    }
+    if (tables_crc != header->tables_crc) {
+        fprintf(stderr, "Corrupt quantizer tables in database file\n");
+        return NULL;
+    }
+    return blocks;
+}
+
+// Defined with the other HNSW and Vamana functions, after the distance kernels they use
+static void vector_db_load_hnsw(VectorDatabase* db, const char* filename, uint64_t tag);
+static void vector_db_load_diskann(VectorDatabase* db, const char* filename, uint64_t tag);
+
+/**
+ * @brief Load a vector database from a file.
+ * 
+ * Files in the mapped layout are mmap'ed copy-on-write and served in place: vector components
+ * are never copied, and pages stay shared with the page cache until a vector is modified.
+ * A file stored with another element type is converted into heap chunks instead, and is
+ * written back in the new type on the next save. Quantized codes and the PQ index saved with
+ * the file are restored. The block checksums of version 5 files are verified, and records are
+ * converted, by one thread per core; a file that fails verification is not loaded. Files from
+ * before the block format are loaded unverified, and files from before the mapped layout are read
+ * record by record. An HNSW graph or a Vamana graph map saved with a version 5 file is loaded with it.
+ *
+ * @param filename The name of the file to load the database from.
+ * @param dimension The dimension of the KD-tree.
+ * @param vector_size The number of components of every stored vector.
+ * @param element_type The storage type of every component.
+ * @param warmup How to pre-fault the mapping.
+ * @return VectorDatabase* Pointer to the loaded vector database, or NULL on failure.
+ */
+VectorDatabase* vector_db_load(const char* filename, size_t dimension, size_t vector_size,
+                               VectorElementType element_type, VectorDBWarmup warmup) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open file for reading");
+        return NULL;
+    }
+
+    struct stat st;
+    VectorDBFileHeader header;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header) ||
+        pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, VECTOR_DB_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        close(fd);
+        return vector_db_load_legacy(filename, dimension, vector_size, element_type);
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    VectorElementType file_type = header.version >= 2 ? (VectorElementType)header.element_type : VECTOR_ELEMENT_FLOAT64;
+    size_t file_element_size = header.element_type < VECTOR_ELEMENT_TYPE_COUNT ? vector_element_size(file_type) : 0;
+    if (header.version < 1 || header.version > VECTOR_DB_FILE_VERSION || file_element_size == 0 ||
+        header.vector_size != vector_size || header.data_stride != vector_size * file_element_size ||
+        header.uuid_stride < UUID_SIZE || header.data_stride == 0 || header.data_offset % sizeof(double) != 0 ||
+        !vector_db_section_fits(header.uuid_offset, header.count, header.uuid_stride, 0, file_size) ||
+        !vector_db_section_fits(header.data_offset, header.count, header.data_stride, 0, file_size)) {
+        fprintf(stderr, "Invalid or incompatible database file %s (vector size %zu, expected %zu)\n",
+                filename, (size_t)header.vector_size, vector_size);
+        close(fd);
+        return NULL;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (warmup == VECTOR_DB_WARMUP_POPULATE) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* base = mmap(NULL, file_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("Failed to map database file");
+        return NULL;
+    }
+#ifndef MAP_POPULATE
+    if (warmup == VECTOR_DB_WARMUP_POPULATE) {
+        warmup = VECTOR_DB_WARMUP_WILLNEED;
+    }
+#endif
+    if (warmup == VECTOR_DB_WARMUP_WILLNEED) {
+        madvise(base, file_size, MADV_WILLNEED);
+    }
+
+    size_t count = (size_t)header.count;
+    VectorDBLoadJob job;
+    job.header = &header;
+    job.base = (const char*)base;
+    job.blocks = NULL;
+    job.block_records = VECTOR_DB_FILE_BLOCK_RECORDS;
+    job.storage = NULL;
+    job.file_type = file_type;
+    if (header.version >= 5) {
+        job.blocks = vector_db_check_file(&header, (const char*)base, file_size);
+        if (!job.blocks) {
+            fprintf(stderr, "Refusing to load %s\n", filename);
+            munmap(base, file_size);
+            return NULL;
+        }
+        job.block_records = header.block_records;
+    }
+    job.block_count = (count + job.block_records - 1) / job.block_records;
+    uint64_t tag = job.blocks ? vector_db_file_tag(header.header_crc,
+                                                   crc32c_update(0, job.blocks, job.block_count * sizeof(VectorDBFileBlock)))
+                              : 0;
+
+    ScalarQuantizer* quantizer = vector_db_load_codes(&header, (const char*)base, file_size);
+    PQIndex* pq = vector_db_load_pq(&header, (const char*)base, file_size);
+    VectorStorage* storage = vector_storage_create(vector_size, element_type, file_type == element_type ? 0 : count);
+    if (!storage) {
+        scalar_quantizer_free(quantizer);
+        pq_index_free(pq);
+        munmap(base, file_size);
+        return NULL;
+    }
+    if (file_type != element_type) {
+        printf("Converting %s from %s to %s\n", filename, vector_element_name(file_type), vector_element_name(element_type));
+        job.storage = storage;
+    }
+    if ((job.blocks || job.storage) && vector_db_load_blocks(&job) != 0) {
+        if (job.corrupt_block != SIZE_MAX) {
+            fprintf(stderr, "Checksum mismatch in block %zu of %s, refusing to load a torn or corrupted file\n",
+                    job.corrupt_block, filename);
+        }
+        scalar_quantizer_free(quantizer);
+        pq_index_free(pq);
+        vector_storage_free(storage);
+        munmap(base, file_size);
+        return NULL;
+    }
+    if (file_type == element_type) {
+        if (vector_storage_map_region(storage, base, file_size, (char*)base + header.data_offset,
+                                      (const char*)base + header.uuid_offset, (size_t)header.uuid_stride, count) != 0) {
+            scalar_quantizer_free(quantizer);
+            pq_index_free(pq);
+            vector_storage_free(storage);
+            return NULL;
+        }
+    } else {
+        munmap(base, file_size);
+    }
+
+    VectorDatabase* db = vector_db_create(storage, count, dimension);
+    if (!db) {
+        scalar_quantizer_free(quantizer);
+        pq_index_free(pq);
+        return NULL;
+    }
+    db->quantizer = quantizer;
+    db->pq = pq;
+
+    for (size_t i = 0; i < count; ++i) {
+        Vector* vec = vector_storage_slot(db->storage, i);
+        if (uuid_index_insert(db->uuid_index, vec->uuid, i) != 0) {
+            fprintf(stderr, "Skipping duplicate UUID %s at index %zu\n", vec->uuid, i);
+            vector_storage_set_deleted(db->storage, i, 1);
+            db->deleted_count++;
+        }
+    }
+    db->size = count;
+    if (vector_db_build_kdtree(db) == (size_t)-1) {
+        vector_db_free(db);
+        return NULL;
+    }
+    if (job.blocks) {
+        vector_db_load_hnsw(db, filename, tag);
+        vector_db_load_diskann(db, filename, tag);
+    }
+
+    printf("Database mapped with size: %zu, capacity: %zu\n", db->size, db->capacity);
+    return db;
+}
+
+/**
+ * @brief Accumulate the dot product and squared norms of two vectors in one pass.
+ * 
+ * Vectors of the same float64 or float32 type are read in place; any other combination is
+ * decoded to doubles in small blocks that stay in L1. Sums are kept in double precision.
+ *
+ * @param vec1 The first vector.
+ * @param vec2 The second vector, of the same dimension.
+ * @param sums Set to {dot product, |vec1|^2, |vec2|^2, |vec1 - vec2|^2}.
+ */
+static void vector_kernel_sums(const Vector* vec1, const Vector* vec2, double sums[4]) {
+    double dot = 0.0, norm_a = 0.0, norm_b = 0.0, l2 = 0.0;
+    size_t n = vec1->dimension;
+
+    if (vec1->type == VECTOR_ELEMENT_FLOAT32 && vec2->type == VECTOR_ELEMENT_FLOAT32) {
+        const float* a = (const float*)vec1->data;
+        const float* b = (const float*)vec2->data;
+        for (size_t i = 0; i < n; i++) {
+            double diff = (double)a[i] - b[i];
+            dot += (double)a[i] * b[i];
+            norm_a += (double)a[i] * a[i];
+            norm_b += (double)b[i] * b[i];
+            l2 += diff * diff;
+        }
+    } else if (vec1->type == VECTOR_ELEMENT_FLOAT64 && vec2->type == VECTOR_ELEMENT_FLOAT64) {
+        const double* a = (const double*)vec1->data;
+        const double* b = (const double*)vec2->data;
+        for (size_t i = 0; i < n; i++) {
+            double diff = a[i] - b[i];
+            dot += a[i] * b[i];
+            norm_a += a[i] * a[i];
+            norm_b += b[i] * b[i];
+            l2 += diff * diff;
+        }
+    } else {
+        double a[VECTOR_KERNEL_BLOCK], b[VECTOR_KERNEL_BLOCK];
+        size_t size1 = vector_element_size(vec1->type), size2 = vector_element_size(vec2->type);
+        for (size_t start = 0; start < n; start += VECTOR_KERNEL_BLOCK) {
+            size_t count = n - start < VECTOR_KERNEL_BLOCK ? n - start : VECTOR_KERNEL_BLOCK;
+            vector_element_convert(VECTOR_ELEMENT_FLOAT64, a, vec1->type, (const char*)vec1->data + start * size1, count);
+            vector_element_convert(VECTOR_ELEMENT_FLOAT64, b, vec2->type, (const char*)vec2->data + start * size2, count);
+            for (size_t i = 0; i < count; i++) {
+                double diff = a[i] - b[i];
+                dot += a[i] * b[i];
+                norm_a += a[i] * a[i];
+                norm_b += b[i] * b[i];
+                l2 += diff * diff;
+            }
+        }
+    }
+    sums[0] = dot;
+    sums[1] = norm_a;
+    sums[2] = norm_b;
+    sums[3] = l2;
+}
+
+/**
+ * @brief Squared Euclidean distance between two arrays of doubles.
+ * 
+ * Uses the widest double-precision SIMD lanes enabled at compile time (AVX, SSE2 or NEON) with
+ * two independent accumulators, so consecutive additions do not wait on each other.
+ *
+ * @param a First array.
+ * @param b Second array.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double vector_kernel_l2_f64(const double* a, const double* b, size_t n) {
+    double sum = 0.0;
+    size_t i = 0;
+#if defined(__AVX__)
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    for (; i + 8 <= n; i += 8) {
+        __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4));
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+    }
+    acc0 = _mm256_add_pd(acc0, acc1);
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+    sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+#elif defined(__SSE2__)
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        __m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+        __m128d d1 = _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+    }
+    acc0 = _mm_add_pd(acc0, acc1);
+    sum = _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    float64x2_t acc0 = vdupq_n_f64(0.0), acc1 = vdupq_n_f64(0.0);
+    for (; i + 4 <= n; i += 4) {
+        float64x2_t d0 = vsubq_f64(vld1q_f64(a + i), vld1q_f64(b + i));
+        float64x2_t d1 = vsubq_f64(vld1q_f64(a + i + 2), vld1q_f64(b + i + 2));
+        acc0 = vfmaq_f64(acc0, d0, d0);
+        acc1 = vfmaq_f64(acc1, d1, d1);
+    }
+    sum = vaddvq_f64(vaddq_f64(acc0, acc1));
+#endif
+    for (; i < n; i++) {
+        double diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/**
+ * @brief Squared Euclidean distance between doubles and floats, the floats widened in the lanes.
+ * 
+ * @param a Array of doubles.
+ * @param b Array of floats.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double vector_kernel_l2_f32(const double* a, const float* b, size_t n) {
+    double sum = 0.0;
+    size_t i = 0;
+#if defined(__AVX__)
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    for (; i + 8 <= n; i += 8) {
+        __m256 wide = _mm256_loadu_ps(b + i);
+        __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_cvtps_pd(_mm256_castps256_ps128(wide)));
+        __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_cvtps_pd(_mm256_extractf128_ps(wide, 1)));
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+    }
+    acc0 = _mm256_add_pd(acc0, acc1);
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+    sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+#elif defined(__SSE2__)
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        __m128 narrow = _mm_loadu_ps(b + i);
+        __m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_cvtps_pd(narrow));
+        __m128d d1 = _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_cvtps_pd(_mm_movehl_ps(narrow, narrow)));
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+    }
+    acc0 = _mm_add_pd(acc0, acc1);
+    sum = _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    float64x2_t acc0 = vdupq_n_f64(0.0), acc1 = vdupq_n_f64(0.0);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t narrow = vld1q_f32(b + i);
+        float64x2_t d0 = vsubq_f64(vld1q_f64(a + i), vcvt_f64_f32(vget_low_f32(narrow)));
+        float64x2_t d1 = vsubq_f64(vld1q_f64(a + i + 2), vcvt_high_f64_f32(narrow));
+        acc0 = vfmaq_f64(acc0, d0, d0);
+        acc1 = vfmaq_f64(acc1, d1, d1);
+    }
+    sum = vaddvq_f64(vaddq_f64(acc0, acc1));
+#endif
+    for (; i < n; i++) {
+        double diff = a[i] - (double)b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/**
+ * @brief Squared Euclidean distance between a float64 query and stored components.
+ * 
+ * float64 and float32 components are read in place by the SIMD kernels; any other element type
+ * is decoded to doubles in small blocks that stay in L1.
+ *
+ * @param query Query of n doubles.
+ * @param type Element type of the stored components.
+ * @param data Stored components.
+ * @param n Number of components.
+ * @return double The squared distance.
+ */
+static double vector_kernel_l2(const double* query, VectorElementType type, const void* data, size_t n) {
+    if (type == VECTOR_ELEMENT_FLOAT64) {
+        return vector_kernel_l2_f64(query, (const double*)data, n);
+    } else if (type == VECTOR_ELEMENT_FLOAT32) {
+        return vector_kernel_l2_f32(query, (const float*)data, n);
+    }
+    double decoded[VECTOR_KERNEL_BLOCK];
+    size_t size = vector_element_size(type);
+    double sum = 0.0;
+    for (size_t start = 0; start < n; start += VECTOR_KERNEL_BLOCK) {
+        size_t count = n - start < VECTOR_KERNEL_BLOCK ? n - start : VECTOR_KERNEL_BLOCK;
+        vector_element_convert(VECTOR_ELEMENT_FLOAT64, decoded, type, (const char*)data + start * size, count);
+        sum += vector_kernel_l2_f64(query + start, decoded, count);
+    }
+    return sum;
+}
+
+/**
+ * @brief Dot product of two arrays of doubles, with the squared norm of the second.
+ * 
+ * Uses the same SIMD lanes as vector_kernel_l2_f64, one accumulator per sum.
+ *
+ * @param a First array.
+ * @param b Second array.
+ * @param n Number of components.
+ * @param norm Incremented by the squared norm of b.
+ * @return double The dot product.
+ */
+static double vector_kernel_dot_f64(const double* a, const double* b, size_t n, double* norm) {
+    double dot = 0.0, squares = 0.0;
+    size_t i = 0;
+#if defined(__AVX__)
+    __m256d acc_dot = _mm256_setzero_pd(), acc_norm = _mm256_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        __m256d vb = _mm256_loadu_pd(b + i);
+        acc_dot = _mm256_add_pd(acc_dot, _mm256_mul_pd(_mm256_loadu_pd(a + i), vb));
+        acc_norm = _mm256_add_pd(acc_norm, _mm256_mul_pd(vb, vb));
+    }
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc_dot), _mm256_extractf128_pd(acc_dot, 1));
+    dot = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    half = _mm_add_pd(_mm256_castpd256_pd128(acc_norm), _mm256_extractf128_pd(acc_norm, 1));
+    squares = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+#elif defined(__SSE2__)
+    __m128d acc_dot = _mm_setzero_pd(), acc_norm = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2) {
+        __m128d vb = _mm_loadu_pd(b + i);
+        acc_dot = _mm_add_pd(acc_dot, _mm_mul_pd(_mm_loadu_pd(a + i), vb));
+        acc_norm = _mm_add_pd(acc_norm, _mm_mul_pd(vb, vb));
+    }
+    dot = _mm_cvtsd_f64(_mm_add_sd(acc_dot, _mm_unpackhi_pd(acc_dot, acc_dot)));
+    squares = _mm_cvtsd_f64(_mm_add_sd(acc_norm, _mm_unpackhi_pd(acc_norm, acc_norm)));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    float64x2_t acc_dot = vdupq_n_f64(0.0), acc_norm = vdupq_n_f64(0.0);
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t vb = vld1q_f64(b + i);
+        acc_dot = vfmaq_f64(acc_dot, vld1q_f64(a + i), vb);
+        acc_norm = vfmaq_f64(acc_norm, vb, vb);
+    }
+    dot = vaddvq_f64(acc_dot);
+    squares = vaddvq_f64(acc_norm);
+#endif
+    for (; i < n; i++) {
+        dot += a[i] * b[i];
+        squares += b[i] * b[i];
+    }
+    *norm += squares;
+    return dot;
+}
+
+/**
+ * @brief Dot product of a float64 query with stored components, with the squared norm of the components.
+ * 
+ * float64 components are read in place; any other element type is decoded to doubles in small
+ * blocks that stay in L1.
+ *
+ * @param query Query of n doubles.
+ * @param type Element type of the stored components.
+ * @param data Stored components.
+ * @param n Number of components.
+ * @param norm Set to the squared norm of the stored components.
+ * @return double The dot product.
+ */
+static double vector_kernel_dot(const double* query, VectorElementType type, const void* data, size_t n, double* norm) {
+    *norm = 0.0;
+    if (type == VECTOR_ELEMENT_FLOAT64) {
+        return vector_kernel_dot_f64(query, (const double*)data, n, norm);
+    }
+    double decoded[VECTOR_KERNEL_BLOCK];
+    size_t size = vector_element_size(type);
+    double sum = 0.0;
+    for (size_t start = 0; start < n; start += VECTOR_KERNEL_BLOCK) {
+        size_t count = n - start < VECTOR_KERNEL_BLOCK ? n - start : VECTOR_KERNEL_BLOCK;
+        vector_element_convert(VECTOR_ELEMENT_FLOAT64, decoded, type, (const char*)data + start * size, count);
+        sum += vector_kernel_dot_f64(query + start, decoded, count, norm);
+    }
+    return sum;
+}
+
+/**
+ * @brief Calculate the cosine similarity between two vectors.
+ * 
+ * @param vec1 The first vector.
+ * @param vec2 The second vector.
+ * @return float The cosine similarity, or -1.0 if the dimensions do not match.
+ */
+float cosine_similarity(Vector vec1, Vector vec2) {
+    if (vec1.dimension != vec2.dimension) {
+        fprintf(stderr, "Vectors have different dimensions\n");
+        return -1.0;
+    }
+    double sums[4];
+    vector_kernel_sums(&vec1, &vec2, sums);
+    return (float)(sums[0] / (sqrt(sums[1]) * sqrt(sums[2])));
+}
+
+/**
+ * @brief Calculate the Euclidean distance between two vectors.
+ * 
+ * @param vec1 The first vector.
+ * @param vec2 The second vector.
+ * @return float The Euclidean distance, or -1.0 if the dimensions do not match.
+ */
+float euclidean_distance(Vector vec1, Vector vec2) {
+    if (vec1.dimension != vec2.dimension) {
+        fprintf(stderr, "Vectors have different dimensions\n");
+        return -1.0;
+    }
+    double sums[4];
+    vector_kernel_sums(&vec1, &vec2, sums);
+    return (float)sqrt(sums[3]);
+}
+
+/**
+ * @brief Calculate the dot product of two vectors.
+ * 
+ * @param vec1 The first vector.
+ * @param vec2 The second vector.
+ * @return float The dot product, or -1.0 if the dimensions do not match.
+ */
+float dot_product(Vector vec1, Vector vec2) {
+    if (vec1.dimension != vec2.dimension) {
+        fprintf(stderr, "Vectors have different dimensions\n");
+        return -1.0;
+    }
+    double sums[4];
+    vector_kernel_sums(&vec1, &vec2, sums);
+    return (float)sums[0];
+}
+
+/**
+ * @brief Compare two double values (for use with qsort).
+ * 
+ * @param a Pointer to the first double value.
+ * @param b Pointer to the second double value.
+ * @return int -1 if the first value is less, 1 if the first value is greater, 0 if they are equal.
+ */
+int compare(const void* a, const void* b) {
     double arg1 = *(const double*)a;
     double arg2 = *(const double*)b;
     if (arg1 < arg2) return -1;
     if (arg1 > arg2) return 1;
     return 0;
 }
+
+/**
+ * @brief Enable or disable the int8 scalar quantization of every vector.
+ * 
+ * @param db Pointer to the vector database.
+ * @param enabled Non-zero to keep quantized codes, zero to drop them.
+ * @param rescore_factor Number of quantized candidates rescored in full precision per result.
+ * @return int 0 on success, -1 on failure.
+ */
+int vector_db_set_quantization(VectorDatabase* db, int enabled, size_t rescore_factor) {
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    db->rescore_factor = rescore_factor > 0 ? rescore_factor : 1;
+    if (!enabled) {
+        scalar_quantizer_free(db->quantizer);
+        db->quantizer = NULL;
+    } else if (!db->quantizer) {
+        db->quantizer = scalar_quantizer_create(db->vector_size);
+        if (!db->quantizer) {
+            pthread_rwlock_unlock(&db->lock);  // Unlock
+            return -1;
+        }
+        if (db->size > db->deleted_count) {
+            scalar_quantizer_train(db->quantizer, db->storage, db->size);
+        }
+    }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return 0;
+}
+
+/**
+ * @brief Push a candidate into a bounded max-heap keeping the smallest distances.
+ * 
+ * @param heap Heap array of `capacity` entries, largest distance at the root.
+ * @param count Number of entries in the heap, updated.
+ * @param capacity Maximum number of entries.
+ * @param distance Distance of the candidate.
+ * @param index Index of the candidate.
+ */
+static void vector_db_candidate_push(VectorDBCandidate* heap, size_t* count, size_t capacity, double distance, size_t index) {
+    size_t pos;
+    if (*count < capacity) {
+        // Sift the new entry up from the end
+        pos = (*count)++;
+        while (pos > 0 && heap[(pos - 1) / 2].distance < distance) {
+            heap[pos] = heap[(pos - 1) / 2];
+            pos = (pos - 1) / 2;
+        }
+    } else if (distance < heap[0].distance) {
+        // Replace the farthest candidate and sift down from the root
+        pos = 0;
+        for (;;) {
+            size_t child = 2 * pos + 1;
+            if (child >= *count) {
+                break;
+            }
+            if (child + 1 < *count && heap[child + 1].distance > heap[child].distance) {
+                child++;
+            }
+            if (heap[child].distance <= distance) {
+                break;
+            }
+            heap[pos] = heap[child];
+            pos = child;
+        }
+    } else {
+        return;
+    }
+    heap[pos].distance = distance;
+    heap[pos].index = index;
+}
+
+/**
+ * @brief Exact Euclidean distance between a query and a stored vector, over all components.
+ * 
+ * The caller must hold the database lock.
+ *
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param index Slot of the stored vector.
+ * @return double The distance, or INFINITY if the vector cannot be read.
+ */
+static double vector_db_query_distance(VectorDatabase* db, const double* query, size_t index) {
+    void* scratch;
+    const void* data = vector_db_slot_data(db, index, &scratch);
+    double distance = data ? sqrt(vector_kernel_l2(query, db->element_type, data, db->vector_size)) : INFINITY;
+    free(scratch);
+    return distance;
+}
+
+/**
+ * @brief Copy the UUIDs of search results while the lock is still held.
+ * 
+ * The compactor may move the vectors once the lock is released; the UUIDs keep naming them.
+ *
+ * @param db Pointer to the vector database.
+ * @param indices Indices of the results.
+ * @param count Number of results, or (size_t)-1 after a failed search.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL to copy nothing.
+ */
+static void vector_db_copy_uuids(const VectorDatabase* db, const size_t* indices, size_t count, char* uuids) {
+    if (!uuids || count == (size_t)-1) {
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(uuids + i * UUID_SIZE, vector_storage_slot(db->storage, indices[i])->uuid, UUID_SIZE);
+    }
+}
+
+/**
+ * @brief Rank candidates by their exact Euclidean distance to a query.
+ * 
+ * The caller must hold the database lock. The candidates are reordered.
+ *
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param candidates Candidates to rescore.
+ * @param count Number of candidates.
+ * @param k Maximum number of results.
+ * @param indices Set to the indices of the results, nearest first.
+ * @param distances Set to the Euclidean distances of the results.
+ * @return size_t The number of results.
+ */
+static size_t vector_db_rescore(VectorDatabase* db, const double* query, VectorDBCandidate* candidates, size_t count,
+                                size_t k, size_t* indices, double* distances) {
+    // Candidates are scattered over the storage, so the next one is loaded while this one is compared
+    for (size_t i = 0; i < count; ++i) {
+        if (i + 1 < count) {
+            vector_storage_prefetch(db->storage, candidates[i + 1].index);
+        }
+        candidates[i].distance = vector_db_query_distance(db, query, candidates[i].index);
+    }
+
+    qsort(candidates, count, sizeof(VectorDBCandidate), compare);
+    size_t results = count < k ? count : k;
+    for (size_t i = 0; i < results; ++i) {
+        indices[i] = candidates[i].index;
+        distances[i] = candidates[i].distance;
+    }
+    return results;
+}
+
+/**
+ * @brief Find the nearest vectors over all components using the quantized codes.
+ * 
+ * The codes are retrained first if the quantizer was never trained, or if the number of live
+ * vectors doubled since the last training, so that the ranges follow the data. Candidates are
+ * rescored against the stored components, which removes the quantization error from the results.
+ *
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param indices Set to the indices of the results, nearest first.
+ * @param distances Set to the Euclidean distances of the results.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL.
+ * @return size_t The number of results, or (size_t)-1 if quantization is disabled or failed.
+ */
+size_t vector_db_search_quantized(VectorDatabase* db, const double* query, size_t k, size_t* indices, double* distances,
+                                  char* uuids) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    ScalarQuantizer* sq;
+    size_t live;
+    for (;;) {
+        sq = db->quantizer;
+        live = db->size - db->deleted_count;
+        if (!sq) {
+            fprintf(stderr, "Quantized search requested but quantization is disabled\n");
+            pthread_rwlock_unlock(&db->lock);  // Unlock
+            return (size_t)-1;
+        }
+        if (k == 0 || live == 0) {
+            pthread_rwlock_unlock(&db->lock);  // Unlock
+            return 0;
+        }
+        if (sq->trained_count != 0 && live / 2 < sq->trained_count) {
+            break;
+        }
+
+        // Retraining rewrites every code: take the lock for writing, then scan under the shared lock
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+        sq = db->quantizer;
+        live = db->size - db->deleted_count;
+        if (sq && live > 0 && (sq->trained_count == 0 || live / 2 >= sq->trained_count) &&
+            scalar_quantizer_train(sq, db->storage, db->size) != 0) {
+            pthread_rwlock_unlock(&db->lock);  // Unlock
+            return (size_t)-1;
+        }
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    }
+
+    size_t capacity = k > live / db->rescore_factor ? live : k * db->rescore_factor;
+    VectorDBCandidate* candidates = (VectorDBCandidate*)malloc(capacity * sizeof(VectorDBCandidate));
+    ScalarQuantizerQuery prepared;
+    if (!candidates || scalar_quantizer_query_init(sq, query, &prepared) != 0) {
+        fprintf(stderr, "Failed to allocate memory for quantized search\n");
+        free(candidates);
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return (size_t)-1;
+    }
+
+    // Scan every code, keeping the closest candidates by approximate distance
+    size_t count = 0;
+    for (size_t i = 0; i < db->size; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            vector_db_candidate_push(candidates, &count, capacity, scalar_quantizer_distance(sq, &prepared, i), i);
+        }
+    }
+    scalar_quantizer_query_free(&prepared);
+
+    size_t results = vector_db_rescore(db, query, candidates, count, k, indices, distances);
+    vector_db_copy_uuids(db, indices, results, uuids);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    free(candidates);
+    return results;
+}
+
+/**
+ * @brief Set the number of live vectors up to which vector_db_nearest scans every vector.
+ * 
+ * @param db Pointer to the vector database.
+ * @param threshold Largest number of live vectors scanned instead of searching an index, 0 to never scan.
+ */
+void vector_db_set_flat_threshold(VectorDatabase* db, size_t threshold) {
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    db->flat_threshold = threshold;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+}
+
+/**
+ * @brief Read the components of a live slot for the flat scan.
+ * 
+ * Called by several scan threads at once while the caller holds the lock for reading. Cold slots
+ * are read into the buffer of the thread, so a scan leaves the hot set as it found it.
+ *
+ * @param context Pointer to the vector database.
+ * @param index Slot to read.
+ * @param buffer Scratch space of one vector, owned by the calling thread.
+ * @return const void* The components, or NULL for a tombstone or a cold slot that cannot be read.
+ */
+static const void* vector_db_flat_data(void* context, size_t index, void* buffer) {
+    VectorDatabase* db = (VectorDatabase*)context;
+    if (vector_storage_is_deleted(db->storage, index)) {
+        return NULL;
+    }
+    return vector_storage_read(db->storage, index, 0, buffer);
+}
+
+/**
+ * @brief Find the exact nearest vectors over all components by comparing the query with every vector.
+ * 
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param indices Set to the indices of the results, nearest first.
+ * @param distances Set to the Euclidean distances of the results.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL.
+ * @return size_t The number of results, or (size_t)-1 on failure.
+ */
+size_t vector_db_search_flat(VectorDatabase* db, const double* query, size_t k, size_t* indices, double* distances,
+                             char* uuids) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t results = flat_scan_search(query, db->vector_size, db->element_type, db->size, k, cpus > 1 ? (size_t)cpus : 1,
+                                      vector_db_flat_data, db, indices, distances);
+    vector_db_copy_uuids(db, indices, results, uuids);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    if (results == (size_t)-1) {
+        return results;
+    }
+    for (size_t i = 0; i < results; ++i) {
+        distances[i] = sqrt(distances[i]);
+    }
+    return results;
+}
+
+/**
+ * @brief Train a product quantization index on the stored vectors and encode all of them.
+ * 
+ * Evenly spaced live vectors are copied under the lock, and the codebooks are trained on the
+ * copy without it. The index is then installed, so that writers keep the codes of the vectors
+ * they touch up to date, and every slot is encoded in batches of VECTOR_DB_PQ_ENCODE_BATCH.
+ * Searches use the index once every slot is encoded.
+ *
+ * @param db Pointer to the vector database.
+ * @param subspaces Number of subspaces (bytes per code), or 0 for one per 8 components.
+ * @return size_t The number of vectors the codebooks were trained on, or (size_t)-1 on failure.
+ */
+size_t vector_db_train_pq(VectorDatabase* db, size_t subspaces) {
+    if (subspaces == 0) {
+        subspaces = (db->vector_size + VECTOR_DB_PQ_SUBSPACE_COMPONENTS - 1) / VECTOR_DB_PQ_SUBSPACE_COMPONENTS;
+    }
+    PQIndex* pq = pq_index_create(db->vector_size, subspaces);
+    if (!pq) {
+        return (size_t)-1;
+    }
+
+    // Sample the training vectors
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t live = db->size - db->deleted_count;
+    size_t count = live < VECTOR_DB_PQ_TRAIN_SAMPLES ? live : VECTOR_DB_PQ_TRAIN_SAMPLES;
+    float* samples = count > 0 ? (float*)malloc(count * db->vector_size * sizeof(float)) : NULL;
+    if (!samples) {
+        fprintf(stderr, count > 0 ? "Failed to allocate memory for PQ training\n" : "Cannot train a PQ index on an empty database\n");
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        pq_index_free(pq);
+        return (size_t)-1;
+    }
+    size_t step = live / count;
+    size_t taken = 0;
+    void* buffer = db->storage->tier ? malloc(db->storage->vector_bytes) : NULL;
+    for (size_t i = 0, seen = 0; i < db->size && taken < count; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i) && seen++ % step == 0) {
+            const void* data = db->storage->tier && !buffer ? NULL : vector_storage_read(db->storage, i, 0, buffer);
+            if (data) {
+                vector_element_convert(VECTOR_ELEMENT_FLOAT32, samples + taken * db->vector_size, db->element_type,
+                                       data, db->vector_size);
+                taken++;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    free(buffer);
+
+    int status = pq_index_train(pq, samples, taken);
+    free(samples);
+    if (status != 0) {
+        pq_index_free(pq);
+        return (size_t)-1;
+    }
+
+    // Install the index, then encode the slots it has not seen yet a batch at a time
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    pq_index_free(db->pq);
+    db->pq = pq;
+    buffer = db->storage->tier ? malloc(db->storage->vector_bytes) : NULL;
+    size_t next = 0;
+    while (next < db->size) {
+        size_t end = db->size - next < VECTOR_DB_PQ_ENCODE_BATCH ? db->size : next + VECTOR_DB_PQ_ENCODE_BATCH;
+        for (size_t i = next; i < end; ++i) {
+            const void* data = vector_storage_is_deleted(db->storage, i) || (db->storage->tier && !buffer)
+                                   ? NULL : vector_storage_read(db->storage, i, 0, buffer);
+            if (vector_storage_is_deleted(db->storage, i)) {
+                if (pq->encoded == i) {
+                    pq->encoded++; // Tombstones need no code
+                }
+            } else if (!data || pq_index_encode(pq, i, db->element_type, data) != 0) {
+                pthread_rwlock_unlock(&db->lock);  // Unlock
+                free(buffer);
+                return (size_t)-1;
+            }
+        }
+        next = end;
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+        if (db->pq != pq) {
+            // Replaced by a concurrent training
+            pthread_rwlock_unlock(&db->lock);  // Unlock
+            free(buffer);
+            return (size_t)-1;
+        }
+    }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    free(buffer);
+    return taken;
+}
+
+/**
+ * @brief Find the nearest vectors over all components using the product quantization index.
+ * 
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param indices Set to the indices of the results, nearest first.
+ * @param distances Set to the Euclidean distances of the results.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL.
+ * @return size_t The number of results, or (size_t)-1 if the index is not trained or the search failed.
+ */
+size_t vector_db_search_pq(VectorDatabase* db, const double* query, size_t k, size_t* indices, double* distances,
+                           char* uuids) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    PQIndex* pq = db->pq;
+    size_t live = db->size - db->deleted_count;
+    if (!pq || !pq->trained || pq->encoded < db->size) {
+        fprintf(stderr, "PQ search requested but the PQ index is not trained\n");
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return (size_t)-1;
+    }
+    if (k == 0 || live == 0) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return 0;
+    }
+
+    size_t capacity = k > live / db->rescore_factor ? live : k * db->rescore_factor;
+    VectorDBCandidate* candidates = (VectorDBCandidate*)malloc(capacity * sizeof(VectorDBCandidate));
+    float* table = (float*)malloc(pq->subspaces * PQ_INDEX_CENTROIDS * sizeof(float));
+    if (!candidates || !table) {
+        fprintf(stderr, "Failed to allocate memory for PQ search\n");
+        free(candidates);
+        free(table);
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return (size_t)-1;
+    }
+
+    // Scan every code with table lookups, keeping the closest candidates
+    pq_index_table(pq, query, table);
+    size_t count = 0;
+    for (size_t i = 0; i < db->size; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            vector_db_candidate_push(candidates, &count, capacity, pq_index_distance(pq, table, i), i);
+        }
+    }
+    free(table);
+
+    size_t results = vector_db_rescore(db, query, candidates, count, k, indices, distances);
+    vector_db_copy_uuids(db, indices, results, uuids);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    free(candidates);
+    return results;
+}
+
+/**
+ * @brief KD-forest component function reading one component of a storage slot.
+ * 
+ * @param context Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ * @param axis Component to read.
+ * @return double The component, or 0.0 if the vector cannot be read.
+ */
+static double vector_db_forest_component(void* context, size_t index, size_t axis) {
+    VectorDatabase* db = (VectorDatabase*)context;
+    size_t element_size = vector_element_size(db->element_type);
+    unsigned char raw[sizeof(double)];
+    if (vector_storage_copy_out(db->storage, index, axis * element_size, raw, element_size) != 0) {
+        return 0.0;
+    }
+    double value;
+    vector_element_convert(VECTOR_ELEMENT_FLOAT64, &value, db->element_type, raw, 1);
+    return value;
+}
+
+/**
+ * @brief KD-forest distance function comparing a query with a storage slot over all components.
+ * 
+ * @param context Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ * @param query Query vector of vector_size components.
+ * @return double The squared distance, or INFINITY if the vector cannot be read.
+ */
+static double vector_db_forest_distance(void* context, size_t index, const double* query) {
+    VectorDatabase* db = (VectorDatabase*)context;
+    void* scratch;
+    const void* data = vector_db_slot_data(db, index, &scratch);
+    double distance = data ? vector_kernel_l2(query, db->element_type, data, db->vector_size) : INFINITY;
+    free(scratch);
+    return distance;
+}
+
+/**
+ * @brief Build a randomized KD-forest over every live vector.
+ * 
+ * The trees are built by a pool of threads while the write lock is held, so writes never miss
+ * the forest; searches wait for the build.
+ *
+ * @param db Pointer to the vector database.
+ * @param tree_count Number of trees, or 0 for KD_FOREST_DEFAULT_TREES.
+ * @return size_t The number of vectors indexed, or (size_t)-1 on failure.
+ */
+size_t vector_db_build_forest(VectorDatabase* db, size_t tree_count) {
+    KDForest* forest = kd_forest_create(db->vector_size, tree_count > 0 ? tree_count : KD_FOREST_DEFAULT_TREES,
+                                        vector_db_forest_component, vector_db_forest_distance,
+                                        vector_db_kd_prefetch, db);
+    if (!forest) {
+        fprintf(stderr, "Failed to create KD-forest\n");
+        return (size_t)-1;
+    }
+
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    size_t live = db->size - db->deleted_count;
+    size_t* indices = (size_t*)malloc((live > 0 ? live : 1) * sizeof(size_t));
+    size_t count = 0;
+    for (size_t i = 0; indices && i < db->size && count < live; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            indices[count++] = i;
+        }
+    }
+    db->building = 1;
+    int status = indices ? kd_forest_build(forest, indices, count) : -1;
+    db->building = 0;
+    if (status != 0) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        fprintf(stderr, "Failed to build KD-forest\n");
+        free(indices);
+        kd_forest_free(forest);
+        return (size_t)-1;
+    }
+    KDForest* previous = db->forest;
+    db->forest = forest;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+
+    free(indices);
+    kd_forest_free(previous);
+    return count;
+}
+
+/**
+ * @brief Find approximate nearest vectors over all components with the KD-forest.
+ * 
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param max_checks Number of vectors compared, or 0 for KD_FOREST_DEFAULT_CHECKS.
+ * @param indices Set to the indices of the results, nearest first.
+ * @param distances Set to the Euclidean distances of the results.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL.
+ * @return size_t The number of results, or (size_t)-1 if no forest was built or the search failed.
+ */
+size_t vector_db_search_forest(VectorDatabase* db, const double* query, size_t k, size_t max_checks,
+                               size_t* indices, double* distances, char* uuids) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    if (!db->forest) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return (size_t)-1;
+    }
+    size_t results = kd_forest_search(db->forest, query, k, max_checks > 0 ? max_checks : KD_FOREST_DEFAULT_CHECKS,
+                                      indices, distances);
+    vector_db_copy_uuids(db, indices, results, uuids);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    if (results == (size_t)-1) {
+        fprintf(stderr, "Failed to allocate memory for KD-forest search\n");
+    }
+    return results;
+}
+
+/**
+ * @brief Scale a vector to unit length, leaving a zero vector unchanged.
+ * 
+ * @param vector Components to scale.
+ * @param n Number of components.
+ */
+static void vector_db_normalize(double* vector, size_t n) {
+    double norm = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        norm += vector[i] * vector[i];
+    }
+    if (norm > 0.0) {
+        double scale = 1.0 / sqrt(norm);
+        for (size_t i = 0; i < n; ++i) {
+            vector[i] *= scale;
+        }
+    }
+}
+
+/**
+ * @brief HNSW point function reading all components of a storage slot.
+ * 
+ * @param context Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ * @param buffer Scratch space of vector_size doubles.
+ * @return const double* The components as doubles, or NULL if the vector cannot be read.
+ */
+static const double* vector_db_hnsw_point(void* context, size_t index, double* buffer) {
+    VectorDatabase* db = (VectorDatabase*)context;
+    if (db->element_type == VECTOR_ELEMENT_FLOAT64) {
+        return (const double*)vector_storage_read(db->storage, index, !db->building, buffer);
+    }
+    void* scratch;
+    const void* data = vector_db_slot_data(db, index, &scratch);
+    if (data) {
+        vector_element_convert(VECTOR_ELEMENT_FLOAT64, buffer, db->element_type, data, db->vector_size);
+    }
+    free(scratch);
+    return data ? buffer : NULL;
+}
+
+/**
+ * @brief HNSW point function reading a storage slot scaled to unit length, for the cosine metric.
+ * 
+ * @param context Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ * @param buffer Scratch space of vector_size doubles.
+ * @return const double* The unit vector, or NULL if the vector cannot be read.
+ */
+static const double* vector_db_hnsw_unit_point(void* context, size_t index, double* buffer) {
+    VectorDatabase* db = (VectorDatabase*)context;
+    void* scratch;
+    const void* data = vector_db_slot_data(db, index, &scratch);
+    if (data) {
+        vector_element_convert(VECTOR_ELEMENT_FLOAT64, buffer, db->element_type, data, db->vector_size);
+        vector_db_normalize(buffer, db->vector_size);
+    }
+    free(scratch);
+    return data ? buffer : NULL;
+}
+
+/**
+ * @brief HNSW distance function of the l2 metric.
+ * 
+ * @param context Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ * @param query Query vector of vector_size components.
+ * @return double The squared Euclidean distance, or INFINITY if the vector cannot be read.
+ */
+static double vector_db_hnsw_l2(void* context, size_t index, const double* query) {
+    VectorDatabase* db = (VectorDatabase*)context;
+    void* scratch;
+    const void* data = vector_db_slot_data(db, index, &scratch);
+    double distance = data ? vector_kernel_l2(query, db->element_type, data, db->vector_size) : INFINITY;
+    free(scratch);
+    return distance;
+}
+
+/**
+ * @brief HNSW distance function of the cosine metric.
+ * 
+ * @param context Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ * @param query Query vector of unit length.
+ * @return double 1 - cosine similarity (1 for a zero vector), or INFINITY if the vector cannot be read.
+ */
+static double vector_db_hnsw_cosine(void* context, size_t index, const double* query) {
+    VectorDatabase* db = (VectorDatabase*)context;
+    void* scratch;
+    const void* data = vector_db_slot_data(db, index, &scratch);
+    if (!data) {
+        free(scratch);
+        return INFINITY;
+    }
+    double norm;
+    double dot = vector_kernel_dot(query, db->element_type, data, db->vector_size, &norm);
+    free(scratch);
+    return norm > 0.0 ? 1.0 - dot / sqrt(norm) : 1.0;
+}
+
+/**
+ * @brief HNSW distance function of the ip metric.
+ * 
+ * @param context Pointer to the vector database.
+ * @param index Storage slot of the vector.
+ * @param query Query vector of vector_size components.
+ * @return double The negated inner product, or INFINITY if the vector cannot be read.
+ */
+static double vector_db_hnsw_ip(void* context, size_t index, const double* query) {
+    VectorDatabase* db = (VectorDatabase*)context;
+    void* scratch;
+    const void* data = vector_db_slot_data(db, index, &scratch);
+    if (!data) {
+        free(scratch);
+        return INFINITY;
+    }
+    double norm;
+    double dot = vector_kernel_dot(query, db->element_type, data, db->vector_size, &norm);
+    free(scratch);
+    return -dot;
+}
+
+/**
+ * @brief Point the callbacks of an HNSW graph at the functions of its metric.
+ * 
+ * @param graph Graph created or read with any callbacks.
+ */
+static void vector_db_hnsw_bind(HNSW* graph) {
+    graph->point_func = graph->metric == HNSW_METRIC_COSINE ? vector_db_hnsw_unit_point : vector_db_hnsw_point;
+    if (graph->metric == HNSW_METRIC_COSINE) {
+        graph->distance_func = vector_db_hnsw_cosine;
+    } else if (graph->metric == HNSW_METRIC_IP) {
+        graph->distance_func = vector_db_hnsw_ip;
+    } else {
+        graph->distance_func = vector_db_hnsw_l2;
+    }
+}
+
+/**
+ * @brief Load the HNSW graph saved next to a database file, if there is one and it belongs to the file.
+ * 
+ * A graph that fails to load is skipped and can be rebuilt; the database loads either way.
+ *
+ * @param db Pointer to the vector database, just loaded and not shared yet.
+ * @param filename The name of the database file.
+ * @param tag The tag of the database file, see vector_db_file_tag.
+ */
+static void vector_db_load_hnsw(VectorDatabase* db, const char* filename, uint64_t tag) {
+    size_t length = strlen(filename) + sizeof(".hnsw");
+    char* graph_filename = (char*)malloc(length);
+    if (!graph_filename) {
+        return;
+    }
+    snprintf(graph_filename, length, "%s.hnsw", filename);
+    FILE* file = fopen(graph_filename, "rb");
+    if (!file) {
+        free(graph_filename);
+        return;
+    }
+    HNSW* graph = hnsw_read(file, db->vector_size, tag, vector_db_hnsw_point, vector_db_hnsw_l2, db);
+    fclose(file);
+    if (graph && graph->index_capacity > db->size) {
+        for (size_t i = db->size; i < graph->index_capacity; ++i) {
+            if (graph->node_of[i] != HNSW_NONE) {
+                fprintf(stderr, "HNSW graph %s indexes vectors beyond the database\n", graph_filename);
+                hnsw_free(graph);
+                graph = NULL;
+                break;
+            }
+        }
+    }
+    if (!graph) {
+        fprintf(stderr, "Ignoring HNSW graph %s\n", graph_filename);
+        free(graph_filename);
+        return;
+    }
+    vector_db_hnsw_bind(graph);
+
+    // Records skipped as duplicate UUIDs are tombstones, the graph must not return them
+    for (size_t i = 0; db->deleted_count > 0 && i < db->size; ++i) {
+        if (vector_storage_is_deleted(db->storage, i)) {
+            hnsw_remove(graph, i);
+        }
+    }
+    db->hnsw = graph;
+    printf("HNSW graph over %zu vectors loaded from %s\n", graph->count, graph_filename);
+    free(graph_filename);
+}
+
+/**
+ * @brief Build an HNSW graph over every live vector.
+ * 
+ * Vectors are inserted by a pool of threads while the write lock is held, so writes never miss
+ * the graph; searches wait for the build.
+ *
+ * @param db Pointer to the vector database.
+ * @param m Links per node and layer, or 0 for HNSW_DEFAULT_M.
+ * @param ef_construction Candidates kept while linking a vector, or 0 for HNSW_DEFAULT_EF_CONSTRUCTION.
+ * @param metric Metric the graph is built and searched with.
+ * @return size_t The number of vectors indexed, or (size_t)-1 on failure.
+ */
+size_t vector_db_build_hnsw(VectorDatabase* db, size_t m, size_t ef_construction, HNSWMetric metric) {
+    HNSW* graph = hnsw_create(db->vector_size, m > 0 ? m : HNSW_DEFAULT_M,
+                              ef_construction > 0 ? ef_construction : HNSW_DEFAULT_EF_CONSTRUCTION, metric,
+                              vector_db_hnsw_point, vector_db_hnsw_l2, db);
+    if (!graph) {
+        fprintf(stderr, "Failed to create HNSW graph\n");
+        return (size_t)-1;
+    }
+    vector_db_hnsw_bind(graph);
+
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    size_t live = db->size - db->deleted_count;
+    size_t* indices = (size_t*)malloc((live > 0 ? live : 1) * sizeof(size_t));
+    size_t count = 0;
+    for (size_t i = 0; indices && i < db->size && count < live; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            indices[count++] = i;
+        }
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    db->building = 1;
+    int status = indices ? hnsw_build(graph, indices, count, cpus > 1 ? (size_t)cpus : 1) : -1;
+    db->building = 0;
+    if (status != 0) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        fprintf(stderr, "Failed to build HNSW graph\n");
+        free(indices);
+        hnsw_free(graph);
+        return (size_t)-1;
+    }
+    HNSW* previous = db->hnsw;
+    db->hnsw = graph;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+
+    free(indices);
+    hnsw_free(previous);
+    return count;
+}
+
+/**
+ * @brief Keep the HNSW graph loaded with the database if it matches, or build one.
+ * 
+ * @param db Pointer to the vector database.
+ * @param m Links per node and layer, or 0 for HNSW_DEFAULT_M.
+ * @param ef_construction Candidates kept while linking a vector, or 0 for HNSW_DEFAULT_EF_CONSTRUCTION.
+ * @param metric Metric the graph is built and searched with.
+ * @return size_t The number of vectors indexed, or (size_t)-1 on failure.
+ */
+size_t vector_db_enable_hnsw(VectorDatabase* db, size_t m, size_t ef_construction, HNSWMetric metric) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    const HNSW* graph = db->hnsw;
+    int matches = graph && graph->m == (m > 0 ? m : HNSW_DEFAULT_M) && graph->metric == metric;
+    size_t count = graph ? graph->count : 0;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    if (matches) {
+        printf("Using the saved HNSW graph over %zu vectors\n", count);
+        return count;
+    }
+    return vector_db_build_hnsw(db, m, ef_construction, metric);
+}
+
+/**
+ * @brief Find approximate nearest vectors over all components with the HNSW graph.
+ * 
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param ef_search Candidates kept by the beam search, or 0 for HNSW_DEFAULT_EF_SEARCH.
+ * @param indices Set to the indices of the results, nearest first.
+ * @param distances Set to the distances of the results under the graph metric.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL.
+ * @return size_t The number of results, or (size_t)-1 if no graph was built or the search failed.
+ */
+size_t vector_db_search_hnsw(VectorDatabase* db, const double* query, size_t k, size_t ef_search,
+                             size_t* indices, double* distances, char* uuids) {
+    double* unit = (double*)malloc(db->vector_size * sizeof(double));
+    if (!unit) {
+        fprintf(stderr, "Failed to allocate memory for HNSW search\n");
+        return (size_t)-1;
+    }
+
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    if (!db->hnsw) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        free(unit);
+        return (size_t)-1;
+    }
+    HNSWMetric metric = db->hnsw->metric;
+    if (metric == HNSW_METRIC_COSINE) {
+        memcpy(unit, query, db->vector_size * sizeof(double));
+        vector_db_normalize(unit, db->vector_size);
+        query = unit;
+    }
+    size_t results = hnsw_search(db->hnsw, query, k, ef_search > 0 ? ef_search : HNSW_DEFAULT_EF_SEARCH,
+                                 indices, distances);
+    vector_db_copy_uuids(db, indices, results, uuids);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+
+    free(unit);
+    if (results == (size_t)-1) {
+        fprintf(stderr, "Failed to allocate memory for HNSW search\n");
+    } else if (metric == HNSW_METRIC_L2) {
+        for (size_t i = 0; i < results; ++i) {
+            distances[i] = sqrt(distances[i]);
+        }
+    }
+    return results;
+}
+
+/**
+ * @brief Build an inverted file index over every live vector.
+ * 
+ * Evenly spaced live vectors are copied under the lock and the centroids are trained on the copy
+ * without it, by a pool of threads. Every vector is then assigned to its list by the same pool
+ * while the write lock is held, so writes never miss the index; searches wait for the
+ * assignment. The lists are read and compared like the KD-forest and HNSW graph do.
+ *
+ * @param db Pointer to the vector database.
+ * @param list_count Number of lists, or 0 for the square root of the number of live vectors.
+ * @return size_t The number of vectors indexed, or (size_t)-1 on failure.
+ */
+size_t vector_db_build_ivf(VectorDatabase* db, size_t list_count) {
+    IVFIndex* ivf = ivf_index_create(db->vector_size, vector_db_hnsw_point, vector_db_forest_distance,
+                                     vector_db_kd_prefetch, db);
+    if (!ivf) {
+        return (size_t)-1;
+    }
+
+    // Sample the training vectors
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t live = db->size - db->deleted_count;
+    if (list_count == 0) {
+        list_count = (size_t)sqrt((double)live);
+        list_count = list_count > 0 ? list_count : 1;
+    }
+    if (list_count > IVF_MAX_LISTS) {
+        list_count = IVF_MAX_LISTS;
+    }
+    size_t wanted = list_count * VECTOR_DB_IVF_TRAIN_SAMPLES_PER_LIST;
+    size_t count = live < wanted ? live : wanted;
+    float* samples = count > 0 ? (float*)malloc(count * db->vector_size * sizeof(float)) : NULL;
+    if (!samples) {
+        fprintf(stderr, count > 0 ? "Failed to allocate memory for IVF training\n" : "Cannot train an IVF index on an empty database\n");
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        ivf_index_free(ivf);
+        return (size_t)-1;
+    }
+    size_t step = live / count;
+    size_t taken = 0;
+    void* buffer = db->storage->tier ? malloc(db->storage->vector_bytes) : NULL;
+    for (size_t i = 0, seen = 0; i < db->size && taken < count; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i) && seen++ % step == 0) {
+            const void* data = db->storage->tier && !buffer ? NULL : vector_storage_read(db->storage, i, 0, buffer);
+            if (data) {
+                vector_element_convert(VECTOR_ELEMENT_FLOAT32, samples + taken * db->vector_size, db->element_type,
+                                       data, db->vector_size);
+                taken++;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    free(buffer);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = cpus > 1 ? (size_t)cpus : 1;
+    int status = ivf_index_train(ivf, samples, taken, list_count, thread_count);
+    free(samples);
+    if (status != 0) {
+        ivf_index_free(ivf);
+        return (size_t)-1;
+    }
+
+    // Assign every live vector, including those written during the training
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    live = db->size - db->deleted_count;
+    size_t* indices = (size_t*)malloc((live > 0 ? live : 1) * sizeof(size_t));
+    count = 0;
+    for (size_t i = 0; indices && i < db->size && count < live; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            indices[count++] = i;
+        }
+    }
+    db->building = 1;
+    status = indices ? ivf_index_build(ivf, indices, count, thread_count) : -1;
+    db->building = 0;
+    if (status != 0) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        fprintf(stderr, "Failed to build IVF index\n");
+        free(indices);
+        ivf_index_free(ivf);
+        return (size_t)-1;
+    }
+    IVFIndex* previous = db->ivf;
+    db->ivf = ivf;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+
+    free(indices);
+    ivf_index_free(previous);
+    return count;
+}
+
+/**
+ * @brief Split the IVF lists that grew too long since the index was built.
+ * 
+ * @param db Pointer to the vector database.
+ * @param max_splits Maximum number of lists split in this pass.
+ * @return size_t The number of lists split.
+ */
+size_t vector_db_rebalance_ivf(VectorDatabase* db, size_t max_splits) {
+    size_t splits = 0;
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    if (db->ivf) {
+        splits = ivf_index_rebalance(db->ivf, max_splits);
+    }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    return splits == (size_t)-1 ? 0 : splits;
+}
+
+/**
+ * @brief Find approximate nearest vectors over all components with the IVF index.
+ * 
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param nprobe Number of lists scanned, or 0 for IVF_DEFAULT_NPROBE.
+ * @param indices Set to the indices of the results, nearest first.
+ * @param distances Set to the Euclidean distances of the results.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL.
+ * @return size_t The number of results, or (size_t)-1 if no index was built or the search failed.
+ */
+size_t vector_db_search_ivf(VectorDatabase* db, const double* query, size_t k, size_t nprobe,
+                            size_t* indices, double* distances, char* uuids) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    if (!db->ivf) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return (size_t)-1;
+    }
+    size_t results = ivf_index_search(db->ivf, query, k, nprobe > 0 ? nprobe : IVF_DEFAULT_NPROBE, indices, distances);
+    vector_db_copy_uuids(db, indices, results, uuids);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    if (results == (size_t)-1) {
+        fprintf(stderr, "Failed to allocate memory for IVF search\n");
+        return results;
+    }
+    for (size_t i = 0; i < results; ++i) {
+        distances[i] = sqrt(distances[i]);
+    }
+    return results;
+}
+
+/**
+ * @brief Load the Vamana graph next to a database file, if there is one and its map belongs to the file.
+ * 
+ * Live vectors without a node, written after the build, go to the delta list. A graph that fails
+ * to load is skipped and can be rebuilt; the database loads either way.
+ *
+ * @param db Pointer to the vector database, just loaded and not shared yet.
+ * @param filename The name of the database file.
+ * @param tag The tag of the database file, see vector_db_file_tag.
+ */
+static void vector_db_load_diskann(VectorDatabase* db, const char* filename, uint64_t tag) {
+    size_t length = strlen(filename) + sizeof(".diskann.map");
+    char* graph_filename = (char*)malloc(2 * length);
+    if (!graph_filename) {
+        return;
+    }
+    char* map_filename = graph_filename + length;
+    snprintf(graph_filename, length, "%s.diskann", filename);
+    snprintf(map_filename, length, "%s.diskann.map", filename);
+    FILE* file = access(graph_filename, F_OK) == 0 ? fopen(map_filename, "rb") : NULL;
+    if (!file) {
+        free(graph_filename);
+        return;
+    }
+    DiskANN* ann = diskann_open(graph_filename, db->vector_size, vector_db_hnsw_l2, db);
+    int status = ann ? diskann_read_map(ann, file, tag) : -1;
+    fclose(file);
+    for (size_t i = 0; status == 0 && i < db->size; ++i) {
+        if (vector_storage_is_deleted(db->storage, i)) {
+            diskann_remove(ann, i); // Records skipped as duplicate UUIDs are tombstones
+        } else if ((i >= ann->index_capacity || ann->node_of[i] == DISKANN_NONE) && diskann_insert(ann, i) != 0) {
+            status = -1;
+        }
+    }
+    if (status == 0 && ann->count + ann->delta_count != db->size - db->deleted_count) {
+        fprintf(stderr, "Vamana graph %s indexes vectors beyond the database\n", graph_filename);
+        status = -1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "Ignoring Vamana graph %s\n", graph_filename);
+        diskann_free(ann);
+        free(graph_filename);
+        return;
+    }
+    db->diskann = ann;
+    printf("Vamana graph over %zu vectors loaded from %s, %zu vectors written since its build\n",
+           ann->count, graph_filename, ann->delta_count);
+    free(graph_filename);
+}
+
+/**
+ * @brief Build a Vamana graph over every live vector and write it next to the database file.
+ * 
+ * Evenly spaced live vectors are copied under the lock to train the routing codes. The graph is
+ * then linked by a pool of threads and written while the write lock is held, so writes never
+ * miss it; searches wait for the build. The vectors are read like the HNSW graph reads them.
+ *
+ * @param db Pointer to the vector database.
+ * @param filename The name of the database file the graph sits next to.
+ * @param degree Largest number of neighbors per node, or 0 for DISKANN_DEFAULT_DEGREE.
+ * @param build_list Candidates kept while linking a vector, or 0 for DISKANN_DEFAULT_BUILD_LIST.
+ * @return size_t The number of vectors indexed, or (size_t)-1 on failure.
+ */
+size_t vector_db_build_diskann(VectorDatabase* db, const char* filename, size_t degree, size_t build_list) {
+    degree = degree > 0 ? degree : DISKANN_DEFAULT_DEGREE;
+    build_list = build_list > 0 ? build_list : DISKANN_DEFAULT_BUILD_LIST;
+    build_list = build_list > degree ? build_list : degree;
+    size_t length = strlen(filename) + sizeof(".diskann");
+    char* graph_filename = (char*)malloc(length);
+    if (!graph_filename) {
+        fprintf(stderr, "Failed to allocate memory for file name\n");
+        return (size_t)-1;
+    }
+    snprintf(graph_filename, length, "%s.diskann", filename);
+
+    // Sample the training vectors of the routing codes
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t live = db->size - db->deleted_count;
+    size_t count = live < VECTOR_DB_PQ_TRAIN_SAMPLES ? live : VECTOR_DB_PQ_TRAIN_SAMPLES;
+    float* samples = count > 0 ? (float*)malloc(count * db->vector_size * sizeof(float)) : NULL;
+    if (!samples) {
+        fprintf(stderr, count > 0 ? "Failed to allocate memory for Vamana graph training\n" : "Cannot build a Vamana graph over an empty database\n");
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        free(graph_filename);
+        return (size_t)-1;
+    }
+    size_t step = live / count;
+    size_t taken = 0;
+    void* buffer = db->storage->tier ? malloc(db->storage->vector_bytes) : NULL;
+    for (size_t i = 0, seen = 0; i < db->size && taken < count; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i) && seen++ % step == 0) {
+            const void* data = db->storage->tier && !buffer ? NULL : vector_storage_read(db->storage, i, 0, buffer);
+            if (data) {
+                vector_element_convert(VECTOR_ELEMENT_FLOAT32, samples + taken * db->vector_size, db->element_type,
+                                       data, db->vector_size);
+                taken++;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    free(buffer);
+
+    pthread_rwlock_wrlock(&db->lock);  // Lock for writing
+    live = db->size - db->deleted_count;
+    size_t* indices = (size_t*)malloc((live > 0 ? live : 1) * sizeof(size_t));
+    count = 0;
+    for (size_t i = 0; indices && i < db->size && count < live; ++i) {
+        if (!vector_storage_is_deleted(db->storage, i)) {
+            indices[count++] = i;
+        }
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    db->building = 1;
+    DiskANN* ann = indices && count > 0 && taken > 0
+                       ? diskann_build(graph_filename, db->vector_size, db->element_type, degree, build_list, indices, count,
+                                       samples, taken, cpus > 1 ? (size_t)cpus : 1, vector_db_hnsw_point,
+                                       vector_db_hnsw_l2, db)
+                       : NULL;
+    db->building = 0;
+    if (!ann) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        fprintf(stderr, "Failed to build Vamana graph\n");
+        free(indices);
+        free(samples);
+        free(graph_filename);
+        return (size_t)-1;
+    }
+    DiskANN* previous = db->diskann;
+    db->diskann = ann;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+
+    free(indices);
+    free(samples);
+    free(graph_filename);
+    diskann_free(previous);
+    return count;
+}
+
+/**
+ * @brief Keep the Vamana graph loaded with the database if it has the given degree, or build one.
+ * 
+ * @param db Pointer to the vector database.
+ * @param filename The name of the database file the graph sits next to.
+ * @param degree Largest number of neighbors per node, or 0 for DISKANN_DEFAULT_DEGREE.
+ * @param build_list Candidates kept while linking a vector, or 0 for DISKANN_DEFAULT_BUILD_LIST.
+ * @return size_t The number of vectors indexed, or (size_t)-1 on failure.
+ */
+size_t vector_db_enable_diskann(VectorDatabase* db, const char* filename, size_t degree, size_t build_list) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    const DiskANN* ann = db->diskann;
+    int matches = ann && ann->degree == (degree > 0 ? degree : DISKANN_DEFAULT_DEGREE);
+    size_t count = ann ? ann->count + ann->delta_count : 0;
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    if (matches) {
+        printf("Using the saved Vamana graph over %zu vectors\n", count);
+        return count;
+    }
+    return vector_db_build_diskann(db, filename, degree, build_list);
+}
+
+/**
+ * @brief Find approximate nearest vectors over all components with the on-disk Vamana graph.
+ * 
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param search_list Candidates kept by the search, or 0 for DISKANN_DEFAULT_SEARCH_LIST.
+ * @param beam_width Nodes read per round, or 0 for DISKANN_DEFAULT_BEAM_WIDTH.
+ * @param indices Set to the indices of the results, nearest first.
+ * @param distances Set to the Euclidean distances of the results.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL.
+ * @return size_t The number of results, or (size_t)-1 if no graph was built or the search failed.
+ */
+size_t vector_db_search_diskann(VectorDatabase* db, const double* query, size_t k, size_t search_list,
+                                size_t beam_width, size_t* indices, double* distances, char* uuids) {
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    if (!db->diskann) {
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        return (size_t)-1;
+    }
+    size_t results = diskann_search(db->diskann, query, k, search_list > 0 ? search_list : DISKANN_DEFAULT_SEARCH_LIST,
+                                    beam_width > 0 ? beam_width : DISKANN_DEFAULT_BEAM_WIDTH, indices, distances);
+    vector_db_copy_uuids(db, indices, results, uuids);
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    if (results == (size_t)-1) {
+        fprintf(stderr, "Vamana graph search failed\n");
+        return results;
+    }
+    for (size_t i = 0; i < results; ++i) {
+        distances[i] = sqrt(distances[i]);
+    }
+    return results;
+}
+
+/**
+ * @brief Parse the name of a search method.
+ * 
+ * @param name Name to parse.
+ * @param method Set to the parsed method on success.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int vector_db_search_method_parse(const char* name, VectorDBSearchMethod* method) {
+    if (strcmp(name, "kdtree") == 0) {
+        *method = VECTOR_DB_SEARCH_KDTREE;
+    } else if (strcmp(name, "quantized") == 0) {
+        *method = VECTOR_DB_SEARCH_QUANTIZED;
+    } else if (strcmp(name, "pq") == 0) {
+        *method = VECTOR_DB_SEARCH_PQ;
+    } else if (strcmp(name, "forest") == 0) {
+        *method = VECTOR_DB_SEARCH_FOREST;
+    } else if (strcmp(name, "hnsw") == 0) {
+        *method = VECTOR_DB_SEARCH_HNSW;
+    } else if (strcmp(name, "ivf") == 0) {
+        *method = VECTOR_DB_SEARCH_IVF;
+    } else if (strcmp(name, "diskann") == 0) {
+        *method = VECTOR_DB_SEARCH_DISKANN;
+    } else if (strcmp(name, "flat") == 0) {
+        *method = VECTOR_DB_SEARCH_FLAT;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Distance between a query and a vector, as vector_db_nearest reports it for a method.
+ * 
+ * @param db Pointer to the vector database.
+ * @param method Search method the distance is reported for.
+ * @param query Query vector of vector_size components.
+ * @param vec Vector of vector_size components, such as a copy from vector_db_get.
+ * @return double The Euclidean distance over all components, or the distance under the graph
+ *                metric for the HNSW method.
+ */
+double vector_db_distance(VectorDatabase* db, VectorDBSearchMethod method, const double* query, const Vector* vec) {
+    HNSWMetric metric = HNSW_METRIC_L2;
+    if (method == VECTOR_DB_SEARCH_HNSW) {
+        pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+        metric = db->hnsw ? db->hnsw->metric : HNSW_METRIC_L2;
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+    }
+
+    if (metric == HNSW_METRIC_L2) {
+        return sqrt(vector_kernel_l2(query, vec->type, vec->data, vec->dimension));
+    }
+    double norm;
+    double dot = vector_kernel_dot(query, vec->type, vec->data, vec->dimension, &norm);
+    if (metric == HNSW_METRIC_IP) {
+        return -dot;
+    }
+    double query_norm = 0.0;
+    for (size_t i = 0; i < vec->dimension; ++i) {
+        query_norm += query[i] * query[i];
+    }
+    return norm > 0.0 && query_norm > 0.0 ? 1.0 - dot / sqrt(norm * query_norm) : 1.0;
+}
+
+/**
+ * @brief Find the nearest vectors with the given search method.
+ * 
+ * @param db Pointer to the vector database.
+ * @param method Search method.
+ * @param query Query vector of vector_size components.
+ * @param k Maximum number of results.
+ * @param params Per-query knobs, or NULL for the defaults.
+ * @param indices Set to the indices of the results, nearest first.
+ * @param distances Set to the Euclidean distances of the results over all components, or the
+ *                  distances under the graph metric for the HNSW method.
+ * @param uuids Set to the UUIDs of the results, UUID_SIZE bytes each, or NULL.
+ * @return size_t The number of results, or (size_t)-1 if the method is unavailable or failed.
+ */
+size_t vector_db_nearest(VectorDatabase* db, VectorDBSearchMethod method, const double* query, size_t k,
+                         const VectorDBSearchParams* params, size_t* indices, double* distances, char* uuids) {
+    // A small database is scanned exactly for less than an index walk costs, unless the results
+    // would leave the metric of the HNSW graph
+    size_t live = 0;
+    if (method != VECTOR_DB_SEARCH_FLAT) {
+        pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+        live = db->size - db->deleted_count;
+        int scan = live <= db->flat_threshold &&
+                   !(method == VECTOR_DB_SEARCH_HNSW && db->hnsw && db->hnsw->metric != HNSW_METRIC_L2);
+        pthread_rwlock_unlock(&db->lock);  // Unlock
+        method = scan ? VECTOR_DB_SEARCH_FLAT : method;
+    }
+
+    if (method == VECTOR_DB_SEARCH_FLAT) {
+        return vector_db_search_flat(db, query, k, indices, distances, uuids);
+    } else if (method == VECTOR_DB_SEARCH_QUANTIZED) {
+        return vector_db_search_quantized(db, query, k, indices, distances, uuids);
+    } else if (method == VECTOR_DB_SEARCH_PQ) {
+        return vector_db_search_pq(db, query, k, indices, distances, uuids);
+    } else if (method == VECTOR_DB_SEARCH_FOREST) {
+        return vector_db_search_forest(db, query, k, params ? params->max_checks : 0, indices, distances, uuids);
+    } else if (method == VECTOR_DB_SEARCH_HNSW) {
+        return vector_db_search_hnsw(db, query, k, params ? params->ef_search : 0, indices, distances, uuids);
+    } else if (method == VECTOR_DB_SEARCH_IVF) {
+        return vector_db_search_ivf(db, query, k, params ? params->nprobe : 0, indices, distances, uuids);
+    } else if (method == VECTOR_DB_SEARCH_DISKANN) {
+        return vector_db_search_diskann(db, query, k, params ? params->search_list : 0,
+                                        params ? params->beam_width : 0, indices, distances, uuids);
+    }
+
+    if (k == 0) {
+        return 0;
+    }
+
+    // The tree only sees its first dimensions, so extra candidates are ranked over all components.
+    // No more candidates than live vectors are ever found, which also keeps the product in range
+    size_t bound = live > k ? live : k;
+    size_t capacity = k;
+    if (params && params->candidates > 0) {
+        capacity = params->candidates > bound ? bound : (params->candidates > k ? params->candidates : k);
+    } else if (db->kdtree->dimension < db->vector_size) {
+        capacity = k > bound / db->rescore_factor ? bound : k * db->rescore_factor;
+    }
+    size_t* found = (size_t*)malloc(capacity * sizeof(size_t));
+    double* found_distances = (double*)malloc(capacity * sizeof(double));
+    VectorDBCandidate* candidates = (VectorDBCandidate*)malloc(capacity * sizeof(VectorDBCandidate));
+    if (!found || !found_distances || !candidates) {
+        fprintf(stderr, "Failed to allocate memory for KD-Tree search\n");
+        free(found);
+        free(found_distances);
+        free(candidates);
+        return (size_t)-1;
+    }
+
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t count = kdtree_knn(db->kdtree, query, capacity, found, found_distances);
+    size_t results = count;
+    if (count != (size_t)-1) {
+        for (size_t i = 0; i < count; ++i) {
+            candidates[i].index = found[i];
+        }
+        results = vector_db_rescore(db, query, candidates, count, k, indices, distances);
+        vector_db_copy_uuids(db, indices, results, uuids);
+    }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+
+    free(found);
+    free(found_distances);
+    free(candidates);
+    return results;
+}
+
+/**
+ * @struct VectorDBRangeSearch
+ * @brief Vectors collected by a range search.
+ */
+typedef struct VectorDBRangeSearch {
+    VectorDatabase* db;          /**< Database being searched */
+    const double* query;         /**< Query vector */
+    double radius;               /**< Largest distance over all components */
+    size_t max_results;          /**< Number of nearest results kept, 0 for all */
+    VectorDBCandidate* results;  /**< Results, a max-heap when max_results is set */
+    size_t count;                /**< Number of results */
+    size_t capacity;             /**< Entries available in results */
+    int failed;                  /**< Set if results could not grow */
+} VectorDBRangeSearch;
+
+/**
+ * @brief Keep a vector reported by the KD-Tree range search if it is within the radius.
+ * 
+ * @param context Pointer to the VectorDBRangeSearch.
+ * @param index Slot of the vector.
+ * @param distance Distance over the tree's dimensions.
+ * @return int 0 to continue, 1 to stop the search after an allocation failure.
+ */
+static int vector_db_range_visit(void* context, size_t index, double distance) {
+    VectorDBRangeSearch* search = (VectorDBRangeSearch*)context;
+
+    // The tree distance is a lower bound when the tree covers fewer dimensions than the vectors
+    if (search->db->kdtree->dimension < search->db->vector_size) {
+        distance = vector_db_query_distance(search->db, search->query, index);
+        if (!(distance <= search->radius)) {
+            return 0;
+        }
+    }
+    if (search->max_results > 0) {
+        vector_db_candidate_push(search->results, &search->count, search->max_results, distance, index);
+        return 0;
+    }
+    if (search->count == search->capacity) {
+        size_t capacity = search->capacity > 0 ? search->capacity * 2 : 64;
+        VectorDBCandidate* results = (VectorDBCandidate*)realloc(search->results, capacity * sizeof(VectorDBCandidate));
+        if (!results) {
+            search->failed = 1;
+            return 1;
+        }
+        search->results = results;
+        search->capacity = capacity;
+    }
+    search->results[search->count].distance = distance;
+    search->results[search->count].index = index;
+    search->count++;
+    return 0;
+}
+
+/**
+ * @brief Find every vector within a radius of a query with the KD-Tree.
+ * 
+ * @param db Pointer to the vector database.
+ * @param query Query vector of vector_size components.
+ * @param radius Largest Euclidean distance over all components.
+ * @param max_results Keep only the nearest max_results vectors, or 0 to keep all of them.
+ * @param indices Set to a newly allocated array of the indices of the results, nearest first.
+ * @param distances Set to a newly allocated array of the distances of the results.
+ * @return size_t The number of results, or (size_t)-1 on failure.
+ */
+size_t vector_db_range(VectorDatabase* db, const double* query, double radius, size_t max_results,
+                       size_t** indices, double** distances, char** uuids) {
+    *indices = NULL;
+    *distances = NULL;
+    *uuids = NULL;
+    VectorDBRangeSearch search;
+    search.db = db;
+    search.query = query;
+    search.radius = radius;
+    search.max_results = max_results;
+    search.results = NULL;
+    search.count = 0;
+    search.capacity = 0;
+    search.failed = 0;
+
+    pthread_rwlock_rdlock(&db->lock);  // Lock for reading
+    size_t live = db->size - db->deleted_count;
+    if (max_results > 0 && live > 0) {
+        search.capacity = max_results < live ? max_results : live;
+        search.max_results = search.capacity;
+        search.results = (VectorDBCandidate*)malloc(search.capacity * sizeof(VectorDBCandidate));
+        search.failed = search.results == NULL;
+    }
+    if (!search.failed && live > 0 && kdtree_range(db->kdtree, query, radius, vector_db_range_visit, &search) == (size_t)-1) {
+        search.failed = 1;
+    }
+
+    // The UUIDs are copied before unlocking: the compactor may move the vectors once it returns
+    if (!search.failed && search.count > 0) {
+        qsort(search.results, search.count, sizeof(VectorDBCandidate), compare);
+        *indices = (size_t*)malloc(search.count * sizeof(size_t));
+        *distances = (double*)malloc(search.count * sizeof(double));
+        *uuids = (char*)malloc(search.count * UUID_SIZE);
+        if (!*indices || !*distances || !*uuids) {
+            free(*indices);
+            free(*distances);
+            free(*uuids);
+            *indices = NULL;
+            *distances = NULL;
+            *uuids = NULL;
+            search.failed = 1;
+        } else {
+            for (size_t i = 0; i < search.count; ++i) {
+                (*indices)[i] = search.results[i].index;
+                (*distances)[i] = search.results[i].distance;
+                memcpy(*uuids + i * UUID_SIZE, vector_storage_slot(db->storage, search.results[i].index)->uuid, UUID_SIZE);
+            }
+        }
+    }
+    pthread_rwlock_unlock(&db->lock);  // Unlock
+    free(search.results);
+    if (search.failed) {
+        fprintf(stderr, "Failed to allocate memory for range search\n");
+        return (size_t)-1;
+    }
+    return search.count;
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/vector_element.h"
+
+/**
+ * @brief Convert a float to IEEE half precision, rounding to nearest even.
+ *
+ * @param value Value to convert.
+ * @return uint16_t Half precision bits.
+ */
+static uint16_t vector_float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t exponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    if (exponent == 0xFF) {
+        return (uint16_t)(sign | 0x7C00u | (mantissa ? 0x200u : 0u)); // Infinity or NaN
+    }
+    int32_t half_exponent = (int32_t)exponent - 127 + 15;
+    if (half_exponent >= 0x1F) {
+        return (uint16_t)(sign | 0x7C00u); // Overflow to infinity
+    }
+    if (half_exponent <= 0) {
+        if (half_exponent < -10) {
+            return (uint16_t)sign; // Underflow to zero
+        }
+        // Subnormal half: shift the mantissa, implicit bit included
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - half_exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u))) {
+            half++;
+        }
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = sign | ((uint32_t)half_exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+        half++; // A carry into the exponent is the correctly rounded result
+    }
+    return (uint16_t)half;
+}
+
+/**
+ * @brief Convert IEEE half precision bits to a float.
+ *
+ * @param half Half precision bits.
+ * @return float Converted value.
+ */
+static float vector_half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+    uint32_t bits;
+
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        // Subnormal half: normalize into a float exponent
+        exponent = 113;
+        while (!(mantissa & 0x400u)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+    }
+
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Convert a float to bfloat16, rounding to nearest even.
+ *
+ * @param value Value to convert.
+ * @return uint16_t Bfloat16 bits.
+ */
+static uint16_t vector_float_to_bfloat16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7F800000u) == 0x7F800000u && (bits & 0x7FFFFFu)) {
+        return (uint16_t)((bits >> 16) | 0x40u); // Keep NaN quiet after truncation
+    }
+    bits += 0x7FFFu + ((bits >> 16) & 1u);
+    return (uint16_t)(bits >> 16);
+}
+
+/**
+ * @brief Convert bfloat16 bits to a float.
+ *
+ * @param bfloat Bfloat16 bits.
+ * @return float Converted value.
+ */
+static float vector_bfloat16_to_float(uint16_t bfloat) {
+    uint32_t bits = (uint32_t)bfloat << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Size of one component in bytes.
+ *
+ * @param type Element type.
+ * @return size_t Size in bytes, or 0 for an unknown type.
+ */
+size_t vector_element_size(VectorElementType type) {
+    switch (type) {
+        case VECTOR_ELEMENT_FLOAT64: return sizeof(double);
+        case VECTOR_ELEMENT_FLOAT32: return sizeof(float);
+        case VECTOR_ELEMENT_FLOAT16: return sizeof(uint16_t);
+        case VECTOR_ELEMENT_BFLOAT16: return sizeof(uint16_t);
+    }
+    return 0;
+}
+
+/**
+ * @brief Name of an element type.
+ *
+ * @param type Element type.
+ * @return const char* Name of the type.
+ */
+const char* vector_element_name(VectorElementType type) {
+    switch (type) {
+        case VECTOR_ELEMENT_FLOAT64: return "float64";
+        case VECTOR_ELEMENT_FLOAT32: return "float32";
+        case VECTOR_ELEMENT_FLOAT16: return "float16";
+        case VECTOR_ELEMENT_BFLOAT16: return "bfloat16";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Parse the name of an element type.
+ *
+ * @param name Name to parse.
+ * @param type Set to the parsed type on success.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int vector_element_parse(const char* name, VectorElementType* type) {
+    for (int i = 0; i < VECTOR_ELEMENT_TYPE_COUNT; i++) {
+        if (strcmp(name, vector_element_name((VectorElementType)i)) == 0) {
+            *type = (VectorElementType)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Read one component as a double.
+ *
+ * @param type Element type of the array.
+ * @param data Component array.
+ * @param i Component number.
+ * @return double Value of the component.
+ */
+double vector_element_get(VectorElementType type, const void* data, size_t i) {
+    switch (type) {
+        case VECTOR_ELEMENT_FLOAT64: return ((const double*)data)[i];
+        case VECTOR_ELEMENT_FLOAT32: return ((const float*)data)[i];
+        case VECTOR_ELEMENT_FLOAT16: return vector_half_to_float(((const uint16_t*)data)[i]);
+        case VECTOR_ELEMENT_BFLOAT16: return vector_bfloat16_to_float(((const uint16_t*)data)[i]);
+    }
+    return 0.0;
+}
+
+/**
+ * @brief Write one component from a double.
+ *
+ * @param type Element type of the array.
+ * @param data Component array.
+ * @param i Component number.
+ * @param value Value to store.
+ */
+static void vector_element_set(VectorElementType type, void* data, size_t i, double value) {
+    switch (type) {
+        case VECTOR_ELEMENT_FLOAT64: ((double*)data)[i] = value; break;
+        case VECTOR_ELEMENT_FLOAT32: ((float*)data)[i] = (float)value; break;
+        case VECTOR_ELEMENT_FLOAT16: ((uint16_t*)data)[i] = vector_float_to_half((float)value); break;
+        case VECTOR_ELEMENT_BFLOAT16: ((uint16_t*)data)[i] = vector_float_to_bfloat16((float)value); break;
+    }
+}
+
+/**
+ * @brief Convert an array of components from one element type to another.
+ *
+ * @param dst_type Element type of the destination.
+ * @param dst Destination array.
+ * @param src_type Element type of the source.
+ * @param src Source array.
+ * @param count Number of components.
+ */
+void vector_element_convert(VectorElementType dst_type, void* dst, VectorElementType src_type, const void* src, size_t count) {
+    if (dst_type == src_type) {
+        memcpy(dst, src, count * vector_element_size(src_type));
+    } else if (dst_type == VECTOR_ELEMENT_FLOAT32 && src_type == VECTOR_ELEMENT_FLOAT64) {
+        for (size_t i = 0; i < count; i++) {
+            ((float*)dst)[i] = (float)((const double*)src)[i];
+        }
+    } else if (dst_type == VECTOR_ELEMENT_FLOAT64 && src_type == VECTOR_ELEMENT_FLOAT32) {
+        for (size_t i = 0; i < count; i++) {
+            ((double*)dst)[i] = ((const float*)src)[i];
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            vector_element_set(dst_type, dst, i, vector_element_get(src_type, src, i));
+        }
+    }
+}
@@ -0,0 +1,668 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../include/vector_storage.h"
+#include "../include/vector_database.h"
+
+/**
+ * @brief Allocate one chunk and point every slot header at its components.
+ *
+ * @param chunk Chunk to initialize.
+ * @param storage Storage the chunk belongs to.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int vector_chunk_init(VectorChunk* chunk, const VectorStorage* storage) {
+    size_t bytes = VECTOR_STORAGE_CHUNK_VECTORS * storage->vector_bytes;
+    void* data = NULL;
+    if (!storage->tier && posix_memalign(&data, VECTOR_STORAGE_ALIGNMENT, bytes) != 0) {
+        return -1;
+    }
+
+    chunk->headers = (Vector*)calloc(VECTOR_STORAGE_CHUNK_VECTORS, sizeof(Vector));
+    chunk->flags = (unsigned char*)calloc(VECTOR_STORAGE_CHUNK_VECTORS, sizeof(unsigned char));
+    chunk->referenced = storage->tier ? (unsigned char*)calloc(VECTOR_STORAGE_CHUNK_VECTORS, sizeof(unsigned char)) : NULL;
+    if (!chunk->headers || !chunk->flags || (storage->tier && !chunk->referenced)) {
+        free(chunk->headers);
+        free(chunk->flags);
+        free(chunk->referenced);
+        free(data);
+        return -1;
+    }
+
+    // Tiered chunks hold no components; slots get a frame when they are first used
+    chunk->data = (unsigned char*)data;
+    for (size_t i = 0; i < VECTOR_STORAGE_CHUNK_VECTORS; i++) {
+        chunk->headers[i].dimension = storage->stride;
+        chunk->headers[i].type = storage->element_type;
+        chunk->headers[i].data = chunk->data ? chunk->data + i * storage->vector_bytes : NULL;
+    }
+    return 0;
+}
+
+/**
+ * @brief Create a new chunked vector storage.
+ *
+ * @param stride Number of components per vector.
+ * @param element_type Type of every component.
+ * @param initial_capacity Number of slots to reserve up front.
+ * @return VectorStorage* Pointer to the storage, or NULL on failure.
+ */
+VectorStorage* vector_storage_create(size_t stride, VectorElementType element_type, size_t initial_capacity) {
+    if (stride == 0 || vector_element_size(element_type) == 0) {
+        fprintf(stderr, "Vector storage needs a positive stride and a known element type\n");
+        return NULL;
+    }
+
+    VectorStorage* storage = (VectorStorage*)malloc(sizeof(VectorStorage));
+    if (!storage) {
+        return NULL;
+    }
+    storage->chunks = NULL;
+    storage->chunk_count = 0;
+    storage->chunk_capacity = 0;
+    storage->stride = stride;
+    storage->element_type = element_type;
+    storage->vector_bytes = stride * vector_element_size(element_type);
+    storage->mapped_chunks = 0;
+    storage->map_base = NULL;
+    storage->map_length = 0;
+    storage->tier = NULL;
+
+    if (vector_storage_reserve(storage, initial_capacity) != 0) {
+        vector_storage_free(storage);
+        return NULL;
+    }
+    return storage;
+}
+
+/**
+ * @brief Free the storage and every chunk it owns.
+ *
+ * @param storage Storage to free.
+ */
+void vector_storage_free(VectorStorage* storage) {
+    if (storage) {
+        VectorStorageTier* tier = storage->tier;
+        if (tier) {
+            for (size_t i = 0; i < tier->resident_count; i++) {
+                free(vector_storage_slot(storage, tier->resident[i])->data);
+            }
+            free(tier->resident);
+            close(tier->fd);
+            pthread_mutex_destroy(&tier->lock);
+            free(tier);
+        }
+        for (size_t i = 0; i < storage->chunk_count; i++) {
+            free(storage->chunks[i].headers);
+            if (i >= storage->mapped_chunks) {
+                free(storage->chunks[i].data);
+            }
+            free(storage->chunks[i].flags);
+            free(storage->chunks[i].referenced);
+        }
+        free(storage->chunks);
+        if (storage->map_base) {
+            munmap(storage->map_base, storage->map_length);
+        }
+        free(storage);
+    }
+}
+
+/**
+ * @brief Grow the chunk directory so that it can hold `needed` chunks.
+ *
+ * @param storage Storage to grow.
+ * @param needed Required number of directory entries.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int vector_storage_grow_directory(VectorStorage* storage, size_t needed) {
+    if (needed <= storage->chunk_capacity) {
+        return 0;
+    }
+    size_t new_capacity = storage->chunk_capacity > 0 ? storage->chunk_capacity : 16;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    VectorChunk* new_chunks = (VectorChunk*)realloc(storage->chunks, new_capacity * sizeof(VectorChunk));
+    if (!new_chunks) {
+        fprintf(stderr, "Failed to grow vector storage chunk directory\n");
+        return -1;
+    }
+    storage->chunks = new_chunks;
+    storage->chunk_capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Make sure at least `slots` slots are addressable.
+ *
+ * Only the chunk directory is reallocated; existing chunks keep their addresses.
+ *
+ * @param storage Storage to grow.
+ * @param slots Required number of slots.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int vector_storage_reserve(VectorStorage* storage, size_t slots) {
+    size_t needed = (slots + VECTOR_STORAGE_CHUNK_MASK) >> VECTOR_STORAGE_CHUNK_SHIFT;
+    if (needed <= storage->chunk_count) {
+        return 0;
+    }
+
+    if (vector_storage_grow_directory(storage, needed) != 0) {
+        return -1;
+    }
+
+    while (storage->chunk_count < needed) {
+        if (vector_chunk_init(&storage->chunks[storage->chunk_count], storage) != 0) {
+            fprintf(stderr, "Failed to allocate vector storage chunk\n");
+            return -1;
+        }
+        storage->chunk_count++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Serve the first `count` slots of an empty storage from a file mapping.
+ *
+ * @param storage Empty storage to populate.
+ * @param map_base Base address of the mapping.
+ * @param map_length Length of the mapping in bytes.
+ * @param data First component of slot 0 inside the mapping.
+ * @param uuids UUID of slot 0 inside the mapping.
+ * @param uuid_stride Distance in bytes between two consecutive UUIDs.
+ * @param count Number of slots stored in the mapping.
+ * @return int 0 on success, -1 on failure.
+ */
+int vector_storage_map_region(VectorStorage* storage, void* map_base, size_t map_length,
+                              void* data, const char* uuids, size_t uuid_stride, size_t count) {
+    if (storage->chunk_count != 0 || storage->map_base || storage->tier) {
+        fprintf(stderr, "Vector storage must be empty and untiered to map a file\n");
+        return -1;
+    }
+    storage->map_base = map_base;
+    storage->map_length = map_length;
+
+    size_t full_chunks = count >> VECTOR_STORAGE_CHUNK_SHIFT;
+    size_t total_chunks = (count + VECTOR_STORAGE_CHUNK_MASK) >> VECTOR_STORAGE_CHUNK_SHIFT;
+    if (vector_storage_grow_directory(storage, total_chunks) != 0) {
+        return -1;
+    }
+
+    // Full chunks keep their components in the mapping
+    for (size_t c = 0; c < full_chunks; c++) {
+        VectorChunk* chunk = &storage->chunks[c];
+        chunk->headers = (Vector*)calloc(VECTOR_STORAGE_CHUNK_VECTORS, sizeof(Vector));
+        chunk->flags = (unsigned char*)calloc(VECTOR_STORAGE_CHUNK_VECTORS, sizeof(unsigned char));
+        chunk->referenced = NULL;
+        if (!chunk->headers || !chunk->flags) {
+            free(chunk->headers);
+            free(chunk->flags);
+            fprintf(stderr, "Failed to allocate vector storage chunk headers\n");
+            return -1;
+        }
+        chunk->data = (unsigned char*)data + (c << VECTOR_STORAGE_CHUNK_SHIFT) * storage->vector_bytes;
+        for (size_t i = 0; i < VECTOR_STORAGE_CHUNK_VECTORS; i++) {
+            const char* uuid = uuids + ((c << VECTOR_STORAGE_CHUNK_SHIFT) + i) * uuid_stride;
+            memcpy(chunk->headers[i].uuid, uuid, UUID_SIZE);
+            chunk->headers[i].uuid[UUID_SIZE - 1] = '\0';
+            chunk->headers[i].dimension = storage->stride;
+            chunk->headers[i].type = storage->element_type;
+            chunk->headers[i].data = chunk->data + i * storage->vector_bytes;
+        }
+        storage->chunk_count++;
+        storage->mapped_chunks++;
+    }
+    // The partial tail chunk must be able to grow past the end of the file
+    if (total_chunks > full_chunks) {
+        VectorChunk* chunk = &storage->chunks[full_chunks];
+        if (vector_chunk_init(chunk, storage) != 0) {
+            fprintf(stderr, "Failed to allocate vector storage chunk\n");
+            return -1;
+        }
+        storage->chunk_count++;
+        size_t first = full_chunks << VECTOR_STORAGE_CHUNK_SHIFT;
+        memcpy(chunk->data, (unsigned char*)data + first * storage->vector_bytes, (count - first) * storage->vector_bytes);
+        for (size_t i = 0; first + i < count; i++) {
+            memcpy(chunk->headers[i].uuid, uuids + (first + i) * uuid_stride, UUID_SIZE);
+            chunk->headers[i].uuid[UUID_SIZE - 1] = '\0';
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Number of slots currently addressable without allocating.
+ *
+ * @param storage Storage to query.
+ * @return size_t Capacity in slots.
+ */
+size_t vector_storage_capacity(const VectorStorage* storage) {
+    return storage->chunk_count << VECTOR_STORAGE_CHUNK_SHIFT;
+}
+
+/**
+ * @brief Read bytes of the cold file, zero-filling past its end.
+ *
+ * @param tier Cold tier.
+ * @param offset File offset.
+ * @param buffer Destination of length bytes.
+ * @param length Number of bytes to read.
+ * @return int 0 on success, -1 on a read error.
+ */
+static int vector_storage_read_cold(const VectorStorageTier* tier, size_t offset, void* buffer, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(tier->fd, (unsigned char*)buffer + done, length - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            memset((unsigned char*)buffer + done, 0, length - done); // Never written back
+            break;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Write bytes to the cold file.
+ *
+ * @param tier Cold tier.
+ * @param offset File offset.
+ * @param data Bytes to write.
+ * @param length Number of bytes.
+ * @return int 0 on success, -1 on a write error.
+ */
+static int vector_storage_write_cold(const VectorStorageTier* tier, size_t offset, const void* data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(tier->fd, (const unsigned char*)data + done, length - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Set the CLOCK reference bit of a resident slot.
+ *
+ * @param storage Tiered storage.
+ * @param slot Slot number, below the reserved capacity.
+ */
+static void vector_storage_reference(const VectorStorage* storage, size_t slot) {
+    unsigned char* referenced = &storage->chunks[slot >> VECTOR_STORAGE_CHUNK_SHIFT].referenced[slot & VECTOR_STORAGE_CHUNK_MASK];
+    // Skipping the store when the bit is set keeps hot cache lines clean
+    if (!__atomic_load_n(referenced, __ATOMIC_RELAXED)) {
+        __atomic_store_n(referenced, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Get the frame of a slot in tiered storage, promoting the slot if it is cold.
+ *
+ * Concurrent callers may read the same cold slot; the first frame installed wins and the
+ * others are dropped, so no lock is held during the read.
+ *
+ * @param storage Tiered storage.
+ * @param slot Slot number, below the reserved capacity.
+ * @param fetch Non-zero to read the components from the cold file, zero if they will be overwritten.
+ * @param overflow Buffer of vector_bytes the slot is read into instead once hot_limit slots are
+ *                 resident, or NULL to promote the slot regardless.
+ * @return void* The frame or overflow, or NULL on failure.
+ */
+static void* vector_storage_promote(const VectorStorage* storage, size_t slot, int fetch, void* overflow) {
+    VectorStorageTier* tier = storage->tier;
+    Vector* header = vector_storage_slot(storage, slot);
+    void* data = __atomic_load_n(&header->data, __ATOMIC_ACQUIRE);
+    if (data) {
+        vector_storage_reference(storage, slot);
+        return data;
+    }
+
+    // A full hot set serves reads from the buffer until vector_storage_demote makes room
+    if (overflow && __atomic_load_n(&tier->resident_count, __ATOMIC_RELAXED) >= tier->hot_limit) {
+        if (vector_storage_read_cold(tier, slot * storage->vector_bytes, overflow, storage->vector_bytes) != 0) {
+            perror("Failed to read a cold vector");
+            return NULL;
+        }
+        return overflow;
+    }
+
+    void* frame = NULL;
+    if (posix_memalign(&frame, VECTOR_STORAGE_ALIGNMENT, storage->vector_bytes) != 0) {
+        fprintf(stderr, "Failed to allocate a frame for slot %zu\n", slot);
+        return NULL;
+    }
+    if (fetch && vector_storage_read_cold(tier, slot * storage->vector_bytes, frame, storage->vector_bytes) != 0) {
+        perror("Failed to read a cold vector");
+        free(frame);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&tier->lock);
+    if (overflow && tier->resident_count >= tier->hot_limit) {
+        pthread_mutex_unlock(&tier->lock);
+        memcpy(overflow, frame, storage->vector_bytes); // Filled up by concurrent readers
+        free(frame);
+        return overflow;
+    }
+    if (!__atomic_compare_exchange_n(&header->data, &data, frame, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_unlock(&tier->lock);
+        free(frame);
+        vector_storage_reference(storage, slot);
+        return data; // Another reader promoted the slot first
+    }
+    if (tier->resident_count == tier->resident_capacity) {
+        size_t capacity = tier->resident_capacity > 0 ? tier->resident_capacity * 2 : 1024;
+        size_t* resident = (size_t*)realloc(tier->resident, capacity * sizeof(size_t));
+        if (!resident) {
+            __atomic_store_n(&header->data, NULL, __ATOMIC_RELEASE);
+            pthread_mutex_unlock(&tier->lock);
+            free(frame);
+            fprintf(stderr, "Failed to grow the resident set\n");
+            return NULL;
+        }
+        tier->resident = resident;
+        tier->resident_capacity = capacity;
+    }
+    tier->resident[tier->resident_count] = slot;
+    __atomic_store_n(&tier->resident_count, tier->resident_count + 1, __ATOMIC_RELAXED);
+    vector_storage_reference(storage, slot);
+    if (fetch) {
+        tier->promotions++;
+    }
+    pthread_mutex_unlock(&tier->lock);
+    return frame;
+}
+
+/**
+ * @brief Move the components of every slot to a cold file and keep at most hot_limit resident.
+ *
+ * Every chunk is written with one sequential write, then the chunk memory and any file mapping
+ * are released. No slot is resident afterwards.
+ *
+ * @param storage Storage to convert.
+ * @param filename Path of the cold file.
+ * @param count Number of slots in use.
+ * @param hot_limit Number of vectors kept in memory once demotion catches up.
+ * @return int 0 on success, -1 on failure, in which case the storage is unchanged.
+ */
+int vector_storage_enable_tier(VectorStorage* storage, const char* filename, size_t count, size_t hot_limit) {
+    if (storage->tier) {
+        storage->tier->hot_limit = hot_limit;
+        return 0;
+    }
+
+    VectorStorageTier* tier = (VectorStorageTier*)calloc(1, sizeof(VectorStorageTier));
+    if (!tier) {
+        return -1;
+    }
+    tier->hot_limit = hot_limit;
+    tier->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (tier->fd < 0) {
+        perror("Failed to open cold vector file");
+        free(tier);
+        return -1;
+    }
+    unlink(filename);
+    int failed = pthread_mutex_init(&tier->lock, NULL) != 0;
+
+    // Write every chunk in use, and allocate the reference bits
+    for (size_t c = 0; !failed && c < storage->chunk_count; c++) {
+        VectorChunk* chunk = &storage->chunks[c];
+        size_t first = c << VECTOR_STORAGE_CHUNK_SHIFT;
+        size_t used = count > first ? count - first : 0;
+        if (used > VECTOR_STORAGE_CHUNK_VECTORS) {
+            used = VECTOR_STORAGE_CHUNK_VECTORS;
+        }
+        chunk->referenced = (unsigned char*)calloc(VECTOR_STORAGE_CHUNK_VECTORS, sizeof(unsigned char));
+        failed = !chunk->referenced ||
+                 (used > 0 && vector_storage_write_cold(tier, first * storage->vector_bytes, chunk->data, used * storage->vector_bytes) != 0);
+    }
+    if (failed) {
+        fprintf(stderr, "Failed to move vectors to the cold tier\n");
+        for (size_t c = 0; c < storage->chunk_count; c++) {
+            free(storage->chunks[c].referenced);
+            storage->chunks[c].referenced = NULL;
+        }
+        close(tier->fd);
+        free(tier);
+        return -1;
+    }
+
+    // Release the chunk memory: every slot is cold from now on
+    for (size_t c = 0; c < storage->chunk_count; c++) {
+        VectorChunk* chunk = &storage->chunks[c];
+        if (c >= storage->mapped_chunks) {
+            free(chunk->data);
+        }
+        chunk->data = NULL;
+        for (size_t i = 0; i < VECTOR_STORAGE_CHUNK_VECTORS; i++) {
+            chunk->headers[i].data = NULL;
+        }
+    }
+    if (storage->map_base) {
+        munmap(storage->map_base, storage->map_length);
+        storage->map_base = NULL;
+        storage->map_length = 0;
+    }
+    storage->mapped_chunks = 0;
+    storage->tier = tier;
+    printf("Moved %zu vectors to the cold tier, keeping up to %zu in memory\n", count, hot_limit);
+    return 0;
+}
+
+/**
+ * @brief Sweep the CLOCK hand over a full hot set and evict the slots not referenced since.
+ *
+ * The hand clears the reference bit of every slot it passes, so a slot survives one revolution
+ * after its last access. The sweep stops after one revolution once the excess over hot_limit is
+ * gone; only the excess is evicted past that.
+ *
+ * @param storage Tiered storage.
+ * @param max_demotions Maximum number of slots to evict in this pass.
+ * @return size_t Number of slots evicted, or (size_t)-1 on a write error.
+ */
+size_t vector_storage_demote(VectorStorage* storage, size_t max_demotions) {
+    VectorStorageTier* tier = storage->tier;
+    if (!tier || max_demotions == 0 || tier->resident_count == 0 || tier->resident_count < tier->hot_limit) {
+        return 0;
+    }
+
+    size_t count = tier->resident_count;
+    size_t excess = count - tier->hot_limit;
+    size_t reserve = tier->hot_limit / VECTOR_STORAGE_HOT_RESERVE > 0 ? tier->hot_limit / VECTOR_STORAGE_HOT_RESERVE : 1;
+    size_t wanted = excess + reserve < max_demotions ? excess + reserve : max_demotions;
+    size_t demoted = 0;
+    int failed = 0;
+    for (size_t step = 0; step < 2 * count && demoted < wanted && tier->resident_count > 0; step++) {
+        if (step >= count && demoted >= excess) {
+            break;
+        }
+        if (tier->hand >= tier->resident_count) {
+            tier->hand = 0;
+        }
+        size_t slot = tier->resident[tier->hand];
+        VectorChunk* chunk = &storage->chunks[slot >> VECTOR_STORAGE_CHUNK_SHIFT];
+        size_t offset = slot & VECTOR_STORAGE_CHUNK_MASK;
+        Vector* header = &chunk->headers[offset];
+        if (!(chunk->flags[offset] & VECTOR_SLOT_DELETED) && chunk->referenced[offset]) {
+            chunk->referenced[offset] = 0; // Second chance
+            tier->hand++;
+            continue;
+        }
+        if ((chunk->flags[offset] & (VECTOR_SLOT_DIRTY | VECTOR_SLOT_DELETED)) == VECTOR_SLOT_DIRTY) {
+            if (vector_storage_write_cold(tier, slot * storage->vector_bytes, header->data, storage->vector_bytes) != 0) {
+                failed = 1; // Keep the frame, it holds the only copy
+                tier->hand++;
+                continue;
+            }
+            tier->writebacks++;
+        }
+        chunk->flags[offset] &= (unsigned char)~VECTOR_SLOT_DIRTY;
+        chunk->referenced[offset] = 0;
+        free(header->data);
+        header->data = NULL;
+        tier->resident[tier->hand] = tier->resident[--tier->resident_count]; // The hand moves on to the last slot
+        demoted++;
+    }
+    tier->demotions += demoted;
+    if (failed) {
+        perror("Failed to write back a cold vector");
+        return (size_t)-1;
+    }
+    return demoted;
+}
+
+/**
+ * @brief Get the header of a slot.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ * @return Vector* Pointer to the slot header.
+ */
+Vector* vector_storage_slot(const VectorStorage* storage, size_t slot) {
+    return &storage->chunks[slot >> VECTOR_STORAGE_CHUNK_SHIFT].headers[slot & VECTOR_STORAGE_CHUNK_MASK];
+}
+
+/**
+ * @brief Get the components of a slot.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ * @return void* Pointer to `stride` contiguous components.
+ */
+void* vector_storage_data(const VectorStorage* storage, size_t slot) {
+    if (!storage->tier) {
+        return storage->chunks[slot >> VECTOR_STORAGE_CHUNK_SHIFT].data + (slot & VECTOR_STORAGE_CHUNK_MASK) * storage->vector_bytes;
+    }
+    return vector_storage_promote(storage, slot, 1, NULL);
+}
+
+/**
+ * @brief Get the components of a slot, copying a cold slot into a buffer rather than promoting it.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ * @param promote Non-zero to let a point read promote the slot, zero for scans over many slots.
+ * @param buffer Scratch space of vector_bytes bytes; may be NULL in storage without a tier.
+ * @return const void* Pointer to `stride` contiguous components, or NULL on a read error.
+ */
+const void* vector_storage_read(const VectorStorage* storage, size_t slot, int promote, void* buffer) {
+    if (!storage->tier) {
+        return vector_storage_data(storage, slot);
+    }
+    if (promote) {
+        return vector_storage_promote(storage, slot, 1, buffer);
+    }
+    // Scans neither promote nor reference, so they leave the hot set as they found it
+    const void* data = __atomic_load_n(&vector_storage_slot(storage, slot)->data, __ATOMIC_ACQUIRE);
+    if (data) {
+        return data;
+    }
+    if (vector_storage_read_cold(storage->tier, slot * storage->vector_bytes, buffer, storage->vector_bytes) != 0) {
+        perror("Failed to read a cold vector");
+        return NULL;
+    }
+    return buffer;
+}
+
+/**
+ * @brief Get the components of a slot that the caller is about to overwrite entirely.
+ *
+ * @param storage Storage to modify.
+ * @param slot Slot number, below the reserved capacity.
+ * @return void* Pointer to `stride` contiguous components, or NULL on allocation failure.
+ */
+void* vector_storage_data_for_write(VectorStorage* storage, size_t slot) {
+    if (!storage->tier) {
+        return vector_storage_data(storage, slot);
+    }
+    void* data = vector_storage_promote(storage, slot, 0, NULL);
+    if (data) {
+        storage->chunks[slot >> VECTOR_STORAGE_CHUNK_SHIFT].flags[slot & VECTOR_STORAGE_CHUNK_MASK] |= VECTOR_SLOT_DIRTY;
+    }
+    return data;
+}
+
+/**
+ * @brief Copy part of the components of a slot without promoting it.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ * @param offset First byte to copy within the components.
+ * @param buffer Destination of length bytes.
+ * @param length Number of bytes to copy.
+ * @return int 0 on success, -1 on a read error.
+ */
+int vector_storage_copy_out(const VectorStorage* storage, size_t slot, size_t offset, void* buffer, size_t length) {
+    const unsigned char* data = storage->tier
+        ? (const unsigned char*)__atomic_load_n(&vector_storage_slot(storage, slot)->data, __ATOMIC_ACQUIRE)
+        : (const unsigned char*)vector_storage_data(storage, slot);
+    if (data) {
+        memcpy(buffer, data + offset, length);
+        return 0;
+    }
+    return vector_storage_read_cold(storage->tier, slot * storage->vector_bytes + offset, buffer, length);
+}
+
+/**
+ * @brief Start loading the components of a slot into the cache without waiting for them.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ */
+void vector_storage_prefetch(const VectorStorage* storage, size_t slot) {
+#if defined(__GNUC__) || defined(__clang__)
+    if (!storage->tier) {
+        __builtin_prefetch(vector_storage_data(storage, slot));
+    } else {
+        __builtin_prefetch(&vector_storage_slot(storage, slot)->data); // Cold slots are never read ahead
+    }
+#else
+    (void)storage;
+    (void)slot;
+#endif
+}
+
+/**
+ * @brief Check whether a slot holds a tombstone.
+ *
+ * @param storage Storage to read from.
+ * @param slot Slot number, below the reserved capacity.
+ * @return int Non-zero if the slot was deleted.
+ */
+int vector_storage_is_deleted(const VectorStorage* storage, size_t slot) {
+    return storage->chunks[slot >> VECTOR_STORAGE_CHUNK_SHIFT].flags[slot & VECTOR_STORAGE_CHUNK_MASK] & VECTOR_SLOT_DELETED;
+}
+
+/**
+ * @brief Set or clear the tombstone of a slot.
+ *
+ * @param storage Storage to modify.
+ * @param slot Slot number, below the reserved capacity.
+ * @param deleted Non-zero to mark the slot deleted, zero to mark it live.
+ */
+void vector_storage_set_deleted(VectorStorage* storage, size_t slot, int deleted) {
+    unsigned char* flags = &storage->chunks[slot >> VECTOR_STORAGE_CHUNK_SHIFT].flags[slot & VECTOR_STORAGE_CHUNK_MASK];
+    if (deleted) {
+        *flags |= VECTOR_SLOT_DELETED;
+    } else {
+        *flags &= (unsigned char)~VECTOR_SLOT_DELETED;
+    }
+}
@@ -0,0 +1,540 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../include/wal.h"
+#include "../include/crc32c.h"
+#include "../include/vector_database.h"
+
+#define WAL_MAX_RECORD_LENGTH ((uint64_t)1 << 30) // Larger lengths can only come from corruption
+#define WAL_COPY_BUFFER_SIZE 65536
+#define WAL_VECTOR_HEADER (UUID_SIZE + sizeof(uint32_t) + sizeof(uint64_t)) // uuid, element type, dimension
+
+/**
+ * @struct WALRecordHeader
+ * @brief Fixed prefix of every log record. The checksum covers the rest of the header and the payload.
+ */
+typedef struct WALRecordHeader {
+    uint32_t crc;    /**< CRC32C of type, lsn, length and payload */
+    uint32_t type;   /**< WALRecordType */
+    uint64_t lsn;    /**< Sequence number */
+    uint64_t length; /**< Payload length in bytes */
+} WALRecordHeader;
+
+/**
+ * @brief Grow a buffer so that it can hold `needed` bytes.
+ *
+ * @param buffer Buffer to grow.
+ * @param capacity Current capacity, updated on success.
+ * @param needed Required capacity.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int wal_buffer_reserve(char** buffer, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    size_t new_capacity = *capacity > 0 ? *capacity : 4096;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    char* new_buffer = (char*)realloc(*buffer, new_capacity);
+    if (!new_buffer) {
+        return -1;
+    }
+    *buffer = new_buffer;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Write a whole buffer, retrying short writes.
+ *
+ * @param fd File descriptor.
+ * @param data Bytes to write.
+ * @param length Number of bytes.
+ * @return int 0 on success, -1 on failure.
+ */
+static int wal_write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Make a rename into the directory of a log file durable.
+ *
+ * @param path Path of the log file.
+ * @return int 0 on success, -1 on failure.
+ */
+static int wal_sync_directory(const char* path) {
+    const char* slash = strrchr(path, '/');
+    size_t length = slash == path ? 1 : slash ? (size_t)(slash - path) : 1;
+    char* directory = (char*)malloc(length + 1);
+    if (!directory) {
+        return -1;
+    }
+    memcpy(directory, slash ? path : ".", length);
+    directory[length] = '\0';
+    int fd = open(directory, O_RDONLY);
+    free(directory);
+    if (fd < 0) {
+        return -1;
+    }
+    int status = fsync(fd);
+    close(fd);
+    return status == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Walk the record headers of a log file.
+ *
+ * Checksums are not verified; wal_replay already cut off anything invalid before the log is opened.
+ *
+ * @param fd Log file descriptor, opened for reading.
+ * @param lsn Sequence number to look for.
+ * @param offset Set to the offset of the first record whose sequence number is at least `lsn`,
+ *               or to the end of the records if there is none.
+ * @param last_lsn Set to the highest sequence number found, or 0 for an empty log.
+ */
+static void wal_scan(int fd, uint64_t lsn, off_t* offset, uint64_t* last_lsn) {
+    WALRecordHeader header;
+    off_t position = 0;
+    int found = 0;
+    *last_lsn = 0;
+    while (pread(fd, &header, sizeof(header), position) == (ssize_t)sizeof(header) &&
+           header.length <= WAL_MAX_RECORD_LENGTH) {
+        if (!found && header.lsn >= lsn) {
+            *offset = position;
+            found = 1;
+        }
+        if (header.lsn > *last_lsn) {
+            *last_lsn = header.lsn;
+        }
+        position += (off_t)(sizeof(header) + header.length);
+    }
+    if (!found) {
+        *offset = position;
+    }
+}
+
+/**
+ * @brief Flusher thread body.
+ *
+ * Swaps the append buffer with the spare one, then writes and fsyncs it without holding the lock,
+ * so writers keep appending to the next batch while the disk is busy.
+ *
+ * @param arg Pointer to the WAL.
+ * @return Always NULL.
+ */
+static void* wal_flusher_run(void* arg) {
+    WAL* wal = (WAL*)arg;
+
+    pthread_mutex_lock(&wal->lock);
+    for (;;) {
+        if (wal->durability == WAL_DURABILITY_ASYNC && wal->running) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += wal->sync_interval_ms / 1000;
+            deadline.tv_nsec += (long)(wal->sync_interval_ms % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&wal->work, &wal->lock, &deadline);
+        } else {
+            while (wal->running && wal->buffer_length == 0) {
+                pthread_cond_wait(&wal->work, &wal->lock);
+            }
+        }
+        if (wal->buffer_length == 0) {
+            if (!wal->running) {
+                break;
+            }
+            continue;
+        }
+
+        // Take the current batch and let writers fill the other buffer
+        char* batch = wal->buffer;
+        size_t batch_length = wal->buffer_length;
+        size_t batch_capacity = wal->buffer_capacity;
+        uint64_t batch_lsn = wal->next_lsn;
+        wal->buffer = wal->spare;
+        wal->buffer_capacity = wal->spare_capacity;
+        wal->buffer_length = 0;
+        wal->flushing = 1;
+        pthread_mutex_unlock(&wal->lock);
+
+        int ok = wal_write_all(wal->fd, batch, batch_length) == 0 && fdatasync(wal->fd) == 0;
+        if (!ok) {
+            perror("Failed to write write-ahead log");
+        }
+
+        pthread_mutex_lock(&wal->lock);
+        wal->spare = batch;
+        wal->spare_capacity = batch_capacity;
+        wal->flushing = 0;
+        if (ok) {
+            if (batch_lsn > wal->durable_lsn) {
+                wal->durable_lsn = batch_lsn;
+            }
+        } else {
+            wal->failed = 1;
+        }
+        pthread_cond_broadcast(&wal->flushed);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return NULL;
+}
+
+/**
+ * @brief Open (or create) a log file for appending and start its flusher.
+ *
+ * @param filename Path of the log file.
+ * @param durability Durability level, must not be WAL_DURABILITY_OFF.
+ * @param sync_interval_ms fsync period in WAL_DURABILITY_ASYNC mode.
+ * @return WAL* Pointer to the log, or NULL on failure.
+ */
+WAL* wal_open(const char* filename, WALDurability durability, unsigned int sync_interval_ms) {
+    if (durability == WAL_DURABILITY_OFF) {
+        fprintf(stderr, "Write-ahead log durability must not be off\n");
+        return NULL;
+    }
+
+    WAL* wal = (WAL*)calloc(1, sizeof(WAL));
+    if (!wal) {
+        fprintf(stderr, "Failed to allocate memory for write-ahead log\n");
+        return NULL;
+    }
+    wal->path = strdup(filename);
+    wal->fd = wal->path ? open(filename, O_RDWR | O_CREAT | O_APPEND, 0644) : -1;
+    if (wal->fd < 0) {
+        perror("Failed to open write-ahead log");
+        free(wal->path);
+        free(wal);
+        return NULL;
+    }
+
+    // Continue the sequence of the records already in the log
+    off_t end = 0;
+    uint64_t last_lsn = 0;
+    wal_scan(wal->fd, UINT64_MAX, &end, &last_lsn);
+    wal->durability = durability;
+    wal->sync_interval_ms = sync_interval_ms > 0 ? sync_interval_ms : 1;
+    wal->next_lsn = last_lsn + 1;
+    wal->durable_lsn = wal->next_lsn;
+    wal->running = 1;
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->work, NULL);
+    pthread_cond_init(&wal->flushed, NULL);
+
+    if (pthread_create(&wal->flusher, NULL, wal_flusher_run, wal) != 0) {
+        fprintf(stderr, "Failed to start write-ahead log flusher\n");
+        pthread_cond_destroy(&wal->flushed);
+        pthread_cond_destroy(&wal->work);
+        pthread_mutex_destroy(&wal->lock);
+        close(wal->fd);
+        free(wal->path);
+        free(wal);
+        return NULL;
+    }
+    printf("Write-ahead log opened at %s\n", filename);
+    return wal;
+}
+
+/**
+ * @brief Flush every pending record, stop the flusher and close the log.
+ *
+ * @param wal Log to close.
+ */
+void wal_close(WAL* wal) {
+    if (wal) {
+        pthread_mutex_lock(&wal->lock);
+        wal->running = 0;
+        pthread_cond_signal(&wal->work);
+        pthread_mutex_unlock(&wal->lock);
+        pthread_join(wal->flusher, NULL);
+
+        close(wal->fd);
+        pthread_cond_destroy(&wal->flushed);
+        pthread_cond_destroy(&wal->work);
+        pthread_mutex_destroy(&wal->lock);
+        free(wal->buffer);
+        free(wal->spare);
+        free(wal->path);
+        free(wal);
+    }
+}
+
+/**
+ * @brief Append one record to the log buffer.
+ *
+ * @param wal Log to append to.
+ * @param type Kind of mutation.
+ * @param uuid UUID of the vector.
+ * @param data Components (NULL for deletes).
+ * @param element_type Element type of data, stored in the record.
+ * @param dimension Number of components (0 for deletes).
+ * @return uint64_t Sequence number to pass to wal_wait, or 0 on failure.
+ */
+uint64_t wal_append(WAL* wal, WALRecordType type, const char* uuid, const void* data,
+                    VectorElementType element_type, size_t dimension) {
+    WALRecordHeader header;
+    size_t data_length = dimension * vector_element_size(element_type);
+    header.type = (uint32_t)type;
+    header.length = UUID_SIZE;
+    if (type != WAL_RECORD_DELETE) {
+        header.length = WAL_VECTOR_HEADER + data_length;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    if (wal->failed || wal_buffer_reserve(&wal->buffer, &wal->buffer_capacity,
+                                          wal->buffer_length + sizeof(header) + header.length) != 0) {
+        fprintf(stderr, "Failed to append to write-ahead log\n");
+        pthread_mutex_unlock(&wal->lock);
+        return 0;
+    }
+    header.lsn = wal->next_lsn++;
+
+    char* record = wal->buffer + wal->buffer_length;
+    char* payload = record + sizeof(header);
+    memset(payload, 0, UUID_SIZE);
+    strncpy(payload, uuid, UUID_SIZE - 1);
+    if (type != WAL_RECORD_DELETE) {
+        uint32_t record_type = (uint32_t)element_type;
+        uint64_t record_dimension = dimension;
+        memcpy(payload + UUID_SIZE, &record_type, sizeof(record_type));
+        memcpy(payload + UUID_SIZE + sizeof(record_type), &record_dimension, sizeof(record_dimension));
+        memcpy(payload + WAL_VECTOR_HEADER, data, data_length);
+    }
+    header.crc = crc32c_update(0, &header.type, sizeof(header) - sizeof(header.crc));
+    header.crc = crc32c_update(header.crc, payload, header.length);
+    memcpy(record, &header, sizeof(header));
+    wal->buffer_length += sizeof(header) + header.length;
+
+    if (wal->durability == WAL_DURABILITY_GROUP) {
+        pthread_cond_signal(&wal->work);
+    }
+    uint64_t lsn = header.lsn;
+    pthread_mutex_unlock(&wal->lock);
+    return lsn;
+}
+
+/**
+ * @brief Block until a record is durable, according to the durability level.
+ *
+ * In WAL_DURABILITY_ASYNC mode this returns at once; in WAL_DURABILITY_GROUP mode it waits for
+ * the flusher, which makes every record appended before its fsync durable in one go.
+ *
+ * @param wal Log the record was appended to.
+ * @param lsn Sequence number returned by wal_append.
+ * @return int 0 on success, -1 if the log failed.
+ */
+int wal_wait(WAL* wal, uint64_t lsn) {
+    pthread_mutex_lock(&wal->lock);
+    if (wal->durability == WAL_DURABILITY_GROUP) {
+        while (wal->durable_lsn <= lsn && !wal->failed) {
+            pthread_cond_wait(&wal->flushed, &wal->lock);
+        }
+    }
+    int status = wal->durable_lsn > lsn || !wal->failed ? 0 : -1;
+    pthread_mutex_unlock(&wal->lock);
+    return status;
+}
+
+/**
+ * @brief Sequence number the next appended record will get.
+ *
+ * @param wal Log to query.
+ * @return uint64_t Next sequence number.
+ */
+uint64_t wal_next_lsn(WAL* wal) {
+    pthread_mutex_lock(&wal->lock);
+    uint64_t lsn = wal->next_lsn;
+    pthread_mutex_unlock(&wal->lock);
+    return lsn;
+}
+
+/**
+ * @brief Discard the records captured by a snapshot.
+ *
+ * Buffered records are written first so the file holds the whole log. If every record is below
+ * the cutoff the file is simply truncated; otherwise the records to keep are copied to
+ * "<path>.tmp", which is renamed over the log before its directory is synced. Appends wait for the duration of the rewrite,
+ * which only copies the records logged while the snapshot was being written.
+ *
+ * @param wal Log to checkpoint.
+ * @param lsn Cutoff returned by wal_next_lsn when the snapshot was taken.
+ * @return int 0 on success, -1 on failure.
+ */
+int wal_checkpoint(WAL* wal, uint64_t lsn) {
+    pthread_mutex_lock(&wal->lock);
+    while (wal->flushing) {
+        pthread_cond_wait(&wal->flushed, &wal->lock);
+    }
+    int status = 0;
+    if (wal->buffer_length > 0) {
+        status = wal_write_all(wal->fd, wal->buffer, wal->buffer_length);
+        wal->buffer_length = 0;
+    }
+
+    off_t offset = 0;
+    uint64_t last_lsn = 0;
+    wal_scan(wal->fd, lsn, &offset, &last_lsn);
+    off_t end = lseek(wal->fd, 0, SEEK_END);
+
+    if (status != 0 || end < 0) {
+        status = -1;
+    } else if (offset >= end) {
+        status = ftruncate(wal->fd, 0) == 0 && fsync(wal->fd) == 0 ? 0 : -1;
+    } else if (offset == 0) {
+        status = fdatasync(wal->fd);
+    } else {
+        size_t tmp_length = strlen(wal->path) + sizeof(".tmp");
+        char* tmp_path = (char*)malloc(tmp_length);
+        char* copy = (char*)malloc(WAL_COPY_BUFFER_SIZE);
+        int tmp_fd = -1;
+        if (tmp_path && copy) {
+            snprintf(tmp_path, tmp_length, "%s.tmp", wal->path);
+            tmp_fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        }
+        status = tmp_fd >= 0 ? 0 : -1;
+        for (off_t position = offset; status == 0 && position < end;) {
+            size_t length = end - position < WAL_COPY_BUFFER_SIZE ? (size_t)(end - position) : WAL_COPY_BUFFER_SIZE;
+            ssize_t got = pread(wal->fd, copy, length, position);
+            if (got <= 0 || wal_write_all(tmp_fd, copy, (size_t)got) != 0) {
+                status = -1;
+                break;
+            }
+            position += got;
+        }
+        if (status == 0 && fsync(tmp_fd) == 0 && rename(tmp_path, wal->path) == 0) {
+            close(wal->fd);
+            wal->fd = tmp_fd;
+            // Until the directory entry is on disk a crash brings back the old file, which
+            // misses every record appended from here on
+            status = wal_sync_directory(wal->path);
+        } else {
+            status = -1;
+            if (tmp_fd >= 0) {
+                close(tmp_fd);
+                unlink(tmp_path);
+            }
+        }
+        free(copy);
+        free(tmp_path);
+    }
+
+    if (status != 0) {
+        perror("Failed to checkpoint write-ahead log");
+        wal->failed = 1;
+    } else {
+        wal->failed = 0;
+        wal->durable_lsn = wal->next_lsn;
+    }
+    pthread_cond_broadcast(&wal->flushed);
+    pthread_mutex_unlock(&wal->lock);
+    return status;
+}
+
+/**
+ * @brief Replay every valid record of a log file.
+ *
+ * Records are read in order until the end of the file or the first record that is truncated or
+ * fails its checksum, which is what a crash in the middle of a write leaves behind. The file is
+ * then cut at the end of the last valid record.
+ *
+ * @param filename Path of the log file. A missing file replays nothing.
+ * @param callback Function called for each record, in log order.
+ * @param ctx User context passed to the callback.
+ * @return size_t Number of records replayed, or (size_t)-1 on failure.
+ */
+size_t wal_replay(const char* filename, WALReplayCallback callback, void* ctx) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        perror("Failed to open write-ahead log for reading");
+        return (size_t)-1;
+    }
+
+    size_t replayed = 0;
+    long valid_end = 0;
+    char* payload = NULL;
+    size_t payload_capacity = 0;
+    WALRecordHeader header;
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (header.length < UUID_SIZE || header.length > WAL_MAX_RECORD_LENGTH ||
+            wal_buffer_reserve(&payload, &payload_capacity, (size_t)header.length) != 0 ||
+            fread(payload, 1, (size_t)header.length, file) != (size_t)header.length) {
+            break;
+        }
+        uint32_t crc = crc32c_update(0, &header.type, sizeof(header) - sizeof(header.crc));
+        crc = crc32c_update(crc, payload, (size_t)header.length);
+        if (crc != header.crc) {
+            break;
+        }
+
+        char uuid[UUID_SIZE];
+        memcpy(uuid, payload, UUID_SIZE);
+        uuid[UUID_SIZE - 1] = '\0';
+        if (header.type == WAL_RECORD_DELETE) {
+            callback(ctx, WAL_RECORD_DELETE, uuid, NULL, VECTOR_ELEMENT_FLOAT64, 0);
+        } else if (header.type == WAL_RECORD_INSERT || header.type == WAL_RECORD_UPDATE) {
+            uint32_t element_type = 0;
+            uint64_t dimension = 0;
+            if (header.length < WAL_VECTOR_HEADER) {
+                break;
+            }
+            memcpy(&element_type, payload + UUID_SIZE, sizeof(element_type));
+            memcpy(&dimension, payload + UUID_SIZE + sizeof(element_type), sizeof(dimension));
+            size_t element_size = element_type < VECTOR_ELEMENT_TYPE_COUNT ? vector_element_size((VectorElementType)element_type) : 0;
+            if (element_size == 0 || header.length != WAL_VECTOR_HEADER + dimension * element_size) {
+                break;
+            }
+            // Copy the components out of the packed payload so that they are aligned
+            void* data = malloc(dimension * element_size + 1);
+            if (!data) {
+                fprintf(stderr, "Failed to allocate memory for write-ahead log record\n");
+                break;
+            }
+            memcpy(data, payload + WAL_VECTOR_HEADER, dimension * element_size);
+            callback(ctx, (WALRecordType)header.type, uuid, data, (VectorElementType)element_type, (size_t)dimension);
+            free(data);
+        } else {
+            break;
+        }
+        replayed++;
+        valid_end = ftell(file);
+    }
+    free(payload);
+
+    struct stat st;
+    int torn = fstat(fileno(file), &st) == 0 && st.st_size > valid_end;
+    fclose(file);
+    if (torn) {
+        fprintf(stderr, "Discarding %lld bytes of torn write-ahead log after record %zu\n",
+                (long long)(st.st_size - valid_end), replayed);
+        if (truncate(filename, valid_end) != 0) {
+            perror("Failed to truncate write-ahead log");
+            return (size_t)-1;
+        }
+    }
+    printf("Replayed %zu write-ahead log records from %s\n", replayed, filename);
+    return replayed;
+}